@@ -6,6 +6,12 @@ pushd build
 :: Script parameters:
 :: No argument -> build game dll and platform exe.
 :: game -> build the game dll
+:: replay [golden hash file] -> build everything and run the headless replay
+:: of the last live loop recording (optionally validated against golden hashes).
+:: rollback -> build everything and run a headless rollback session between two
+:: peers over a simulated link.
+:: batch [instance count] -> build everything and run instances of the game
+:: headless on all cores (default : 64 instances).
 
 :: Documentation for compiler options : https://learn.microsoft.com/en-us/cpp/build/reference/compiler-options-listed-by-category?view=msvc-170
 
@@ -56,6 +62,8 @@ set win32_compiler_flags=%win32_compiler_flags% /std:c17
 set win32_linker_flags=user32.lib
 set win32_linker_flags=%win32_linker_flags% gdi32.lib
 set win32_linker_flags=%win32_linker_flags% Winmm.lib
+set win32_linker_flags=%win32_linker_flags% Shell32.lib
+set win32_linker_flags=%win32_linker_flags% Advapi32.lib
 
 :: LD : Create a DLL.
 :: PDB : Creates a PDB using user specified name.
@@ -69,13 +77,45 @@ del *.raddbg
 set game_linker_flags=/DEBUG:FULL
 set game_linker_flags=%game_linker_flags% /PDB:game_pdb_%RANDOM%.pdb
 
+:: lock.tmp exists while the game dll (and its pdb) is being built. The platform
+:: does not hot reload the game dll until the lock file is deleted.
+echo WAITING FOR PDB > lock.tmp
+
 IF "%1"=="game" (
 	cl.exe %win32_compiler_flags% ../src/game.c /LD /link %game_linker_flags%
+	del lock.tmp
 ) else IF "%1"=="" (
 	cl.exe %win32_compiler_flags% ../src/game.c /LD /link %game_linker_flags%
+	del lock.tmp
 	cl.exe %win32_compiler_flags% ../src/win32_main.c /Fe:win32_main.exe /link %win32_linker_flags%
 
 	win32_main.exe
+) else IF "%1"=="replay" (
+	cl.exe %win32_compiler_flags% ../src/game.c /LD /link %game_linker_flags%
+	del lock.tmp
+	cl.exe %win32_compiler_flags% ../src/win32_main.c /Fe:win32_main.exe /link %win32_linker_flags%
+
+	IF "%2"=="" (
+		win32_main.exe --replay
+	) else (
+		win32_main.exe --replay --golden %2
+	)
+) else IF "%1"=="rollback" (
+	cl.exe %win32_compiler_flags% ../src/game.c /LD /link %game_linker_flags%
+	del lock.tmp
+	cl.exe %win32_compiler_flags% ../src/win32_main.c /Fe:win32_main.exe /link %win32_linker_flags%
+
+	win32_main.exe --rollback
+) else IF "%1"=="batch" (
+	cl.exe %win32_compiler_flags% ../src/game.c /LD /link %game_linker_flags%
+	del lock.tmp
+	cl.exe %win32_compiler_flags% ../src/win32_main.c /Fe:win32_main.exe /link %win32_linker_flags%
+
+	IF "%2"=="" (
+		win32_main.exe --batch 64
+	) else (
+		win32_main.exe --batch %2
+	)
 )
 
 popd
@@ -0,0 +1,25 @@
+#!/bin/sh
+
+# Builds (and runs) the game layer benchmarks on linux.
+# Script parameters are passed on to the benchmark executable, for example :
+# ./build_bench.sh --baseline prism_bench_results_old.txt
+
+# O2 : Benchmarks measure optimized code (and PRISM_DEBUG is not defined, so
+# ASSERTs compile to nothing).
+# fgnu89-inline : Headers use (non static) inline functions, which need the
+# MSVC / gnu89 semantics.
+# ffp-contract=off : Precise floating point model (as with fp:precise).
+
+set -e
+
+mkdir -p build
+cd build
+
+compiler_flags="-O2 -g -std=gnu17 -fgnu89-inline -ffp-contract=off"
+compiler_flags="$compiler_flags -Wall -Wextra -Werror"
+compiler_flags="$compiler_flags -Wno-unused-parameter -Wno-unused-variable"
+compiler_flags="$compiler_flags -Wno-unused-but-set-variable"
+
+cc $compiler_flags ../src/bench_main.c -o bench -lm -lpthread
+
+./bench "$@"
@@ -0,0 +1,71 @@
+#ifndef __ATOMICS_H__
+#define __ATOMICS_H__
+
+#include "common.h"
+
+// Atomic operations and the cpu timestamp counter, used to publish data
+// between threads without locks.
+// NOTE: All atomic operations are full barriers (on both the compiler and the
+// cpu).
+#if defined(_MSC_VER)
+
+#include <intrin.h>
+
+inline u32 atomic_exchange_u32(volatile u32 *const value, const u32 new_value)
+{
+    return (u32)_InterlockedExchange((volatile long *)value, (long)new_value);
+}
+
+// Returns the original value (the exchange happened if it equals expected).
+inline u32 atomic_compare_exchange_u32(volatile u32 *const value,
+                                       const u32 new_value, const u32 expected)
+{
+    return (u32)_InterlockedCompareExchange((volatile long *)value,
+                                           (long)new_value, (long)expected);
+}
+
+// Returns the value before the addition.
+inline u64 atomic_add_u64(volatile u64 *const value, const u64 addend)
+{
+    return (u64)_InterlockedExchangeAdd64((volatile __int64 *)value,
+                                          (__int64)addend);
+}
+
+#else
+
+#include <x86intrin.h>
+
+inline u32 atomic_exchange_u32(volatile u32 *const value, const u32 new_value)
+{
+    return __atomic_exchange_n(value, new_value, __ATOMIC_SEQ_CST);
+}
+
+inline u32 atomic_compare_exchange_u32(volatile u32 *const value,
+                                       const u32 new_value, const u32 expected)
+{
+    u32 original_value = expected;
+    __atomic_compare_exchange_n(value, &original_value, new_value, false,
+                                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+
+    return original_value;
+}
+
+inline u64 atomic_add_u64(volatile u64 *const value, const u64 addend)
+{
+    return __atomic_fetch_add(value, addend, __ATOMIC_SEQ_CST);
+}
+
+#endif
+
+inline u64 read_cpu_timestamp()
+{
+    return __rdtsc();
+}
+
+// Hint to the cpu that the thread is spinning on a value.
+inline void cpu_pause()
+{
+    _mm_pause();
+}
+
+#endif
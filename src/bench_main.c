@@ -0,0 +1,1258 @@
+// Benchmarks for the game layer (built with build_bench.sh, on linux).
+// The game is included directly (unity build), so that internal functions can
+// be benchmarked on their own. Every benchmark runs its hot path with fixed
+// inputs : each of BENCH_SAMPLE_COUNT samples times a fixed number of
+// iterations, and the reported values are the mean over samples with a 95%
+// confidence interval (plus the median, which is less sensitive to noise).
+//
+// Usage : bench [--output <path>] [--baseline <path>] [--filter <name>]
+// [--huge-pages]
+// --output <path> : Where the results are written (default :
+// prism_bench_results.txt).
+// --baseline <path> : Results of an earlier run (e.g another commit) to compare
+// against. Changes larger than the combined confidence intervals are flagged.
+// --filter <name> : Only run benchmarks whose name contains name.
+// --huge-pages : Back game memory with huge pages (hugetlbfs pages if some are
+// reserved, transparent huge pages otherwise).
+//
+// Format of the results file : One line per benchmark with its name, ns / op
+// (mean, 95% confidence interval and median), cycles / op, pixels / s (0 if
+// the benchmark does not write pixels) and chunks / s / core (0 if the
+// benchmark does not generate chunks).
+// NOTE: Cycles are cpu timestamp counter ticks, which run at a constant rate
+// (not necessarily the core's current clock).
+
+#include <stddef.h>
+#include <string.h>
+
+// NOTE: The game is a dll on windows, here it is linked in.
+#if !defined(_MSC_VER)
+#define __declspec(x)
+#endif
+
+#include "game.c"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_SAMPLE_COUNT 32u
+
+// Two sided 95% t value for BENCH_SAMPLE_COUNT - 1 degrees of freedom.
+#define BENCH_T_VALUE_95 2.040
+
+#define BENCH_MAX_RESULTS 32u
+#define BENCH_MAX_NAME_LENGTH 64u
+
+// Same as the platform's default.
+#define BENCH_GAME_MEMORY_BASE_ADDRESS TERABYTE(2)
+
+// Same as the platform's maximum worker thread count.
+#define BENCH_MAX_THREADS 16u
+
+#define BENCH_FRAMEBUFFER_WIDTH 1920u
+#define BENCH_FRAMEBUFFER_HEIGHT 1080u
+
+// Largest difference (in 8 bit steps) allowed between blending and the float
+// reference.
+#define BENCH_MAX_BLEND_ERROR 1u
+
+typedef struct
+{
+    char name[BENCH_MAX_NAME_LENGTH];
+
+    f64 ns_per_op;
+    f64 ns_per_op_ci;
+    f64 median_ns_per_op;
+    f64 cycles_per_op;
+    f64 pixels_per_second;
+    f64 chunks_per_second_per_core;
+} bench_result_t;
+
+typedef struct
+{
+    const char *filter;
+
+    bench_result_t results[BENCH_MAX_RESULTS];
+    u32 result_count;
+
+    // Written by benchmarks, so the compiler can not remove the work.
+    volatile u64 sink;
+} bench_t;
+
+// State of a single benchmark run.
+typedef struct
+{
+    u64 iteration_count;
+
+    // Pixels written per iteration.
+    u64 pixel_count;
+
+    // Threads that generate chunks (one chunk per iteration), 0 if the
+    // benchmark does not generate chunks.
+    u32 chunk_thread_count;
+
+    f64 sample_ns[BENCH_SAMPLE_COUNT];
+    f64 sample_cycles[BENCH_SAMPLE_COUNT];
+} bench_run_t;
+
+internal u64 bench_get_time_ns()
+{
+    struct timespec time = {0};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (u64)time.tv_sec * 1000000000ull + (u64)time.tv_nsec;
+}
+
+internal int bench_compare_f64(const void *a, const void *b)
+{
+    const f64 value_a = *(const f64 *)a;
+    const f64 value_b = *(const f64 *)b;
+
+    return (value_a > value_b) - (value_a < value_b);
+}
+
+internal b32 bench_should_run(const bench_t *const restrict bench,
+                              const char *const restrict name)
+{
+    return !bench->filter || strstr(name, bench->filter);
+}
+
+// Computes the per op stats from the run's samples, and adds them to the
+// results.
+internal void bench_add_result(bench_t *const restrict bench,
+                               const char *const restrict name,
+                               const bench_run_t *const restrict run)
+{
+    ASSERT(bench);
+    ASSERT(name);
+    ASSERT(run);
+    ASSERT(bench->result_count < BENCH_MAX_RESULTS);
+
+    bench_result_t *result = &bench->results[bench->result_count++];
+    memset(result, 0, sizeof(bench_result_t));
+    snprintf(result->name, sizeof(result->name), "%s", name);
+
+    f64 ns_per_op[BENCH_SAMPLE_COUNT];
+    f64 ns_sum = 0.0;
+    f64 cycles_sum = 0.0;
+
+    for (u32 i = 0; i < BENCH_SAMPLE_COUNT; i++)
+    {
+        ns_per_op[i] = run->sample_ns[i] / (f64)run->iteration_count;
+        ns_sum += ns_per_op[i];
+        cycles_sum += run->sample_cycles[i] / (f64)run->iteration_count;
+    }
+
+    const f64 mean = ns_sum / BENCH_SAMPLE_COUNT;
+
+    f64 variance = 0.0;
+    for (u32 i = 0; i < BENCH_SAMPLE_COUNT; i++)
+    {
+        variance += (ns_per_op[i] - mean) * (ns_per_op[i] - mean);
+    }
+    variance /= BENCH_SAMPLE_COUNT - 1;
+
+    qsort(ns_per_op, BENCH_SAMPLE_COUNT, sizeof(f64), bench_compare_f64);
+
+    result->ns_per_op = mean;
+    result->ns_per_op_ci =
+        BENCH_T_VALUE_95 * sqrt(variance / (f64)BENCH_SAMPLE_COUNT);
+    result->median_ns_per_op =
+        0.5 * (ns_per_op[(BENCH_SAMPLE_COUNT - 1) / 2] +
+               ns_per_op[BENCH_SAMPLE_COUNT / 2]);
+    result->cycles_per_op = cycles_sum / BENCH_SAMPLE_COUNT;
+    result->pixels_per_second =
+        run->pixel_count ? (f64)run->pixel_count * 1e9 / mean : 0.0;
+    result->chunks_per_second_per_core =
+        run->chunk_thread_count
+            ? 1e9 / mean / (f64)run->chunk_thread_count
+            : 0.0;
+
+    printf("%-40s %12.2f ns/op (+- %5.2f%%) %14.1f cycles/op", result->name,
+           result->ns_per_op, 100.0 * result->ns_per_op_ci / result->ns_per_op,
+           result->cycles_per_op);
+    if (result->pixels_per_second > 0.0)
+    {
+        printf(" %10.1f Mpixels/s", result->pixels_per_second / 1e6);
+    }
+    if (result->chunks_per_second_per_core > 0.0)
+    {
+        printf(" %10.1f chunks/s/core", result->chunks_per_second_per_core);
+    }
+    printf("\n");
+}
+
+// Benchmarks are written as :
+// BENCH_BEGIN_SAMPLES(&run) { ...run->iteration_count iterations... }
+// BENCH_END_SAMPLES(&run)
+// One warm up sample is run (and discarded) before the timed ones.
+#define BENCH_BEGIN_SAMPLES(run)                                               \
+    for (i32 sample_index = -1; sample_index < (i32)BENCH_SAMPLE_COUNT;        \
+         sample_index++)                                                       \
+    {                                                                          \
+        const u64 sample_start_ns = bench_get_time_ns();                       \
+        const u64 sample_start_cycles = read_cpu_timestamp();
+
+#define BENCH_END_SAMPLES(run)                                                 \
+    const u64 sample_end_cycles = read_cpu_timestamp();                        \
+    const u64 sample_end_ns = bench_get_time_ns();                             \
+    if (sample_index >= 0)                                                     \
+    {                                                                          \
+        (run)->sample_ns[sample_index] =                                       \
+            (f64)(sample_end_ns - sample_start_ns);                            \
+        (run)->sample_cycles[sample_index] =                                   \
+            (f64)(sample_end_cycles - sample_start_cycles);                    \
+    }                                                                          \
+    }
+
+// Game state after the first frames, shared by the world and frame
+// benchmarks.
+typedef struct
+{
+    game_memory_t game_memory;
+    game_platform_services_t platform_services;
+
+    u32 *framebuffer_memory;
+    game_offscreen_buffer_t buffer;
+
+    i16 sound_samples[2 * GAME_MAX_SOUND_SAMPLES_PER_FRAME];
+} bench_game_t;
+
+typedef enum
+{
+    bench_page_type_small = 0,
+    bench_page_type_transparent_huge = 1,
+    bench_page_type_huge = 2,
+} bench_page_type_t;
+
+// Zeroed memory at the fixed base address (if it is free, otherwise anywhere),
+// like the platform allocates game memory.
+internal u8 *bench_allocate_game_memory(const u64 size,
+                                        const b32 use_huge_pages,
+                                        bench_page_type_t *const page_type,
+                                        b32 *const is_at_base_address)
+{
+    ASSERT(page_type);
+    ASSERT(is_at_base_address);
+
+    void *memory = MAP_FAILED;
+
+    *page_type = bench_page_type_small;
+
+    // The base address may be taken, in which case any address is used.
+    for (u32 attempt = 0; attempt < 2 && memory == MAP_FAILED; attempt++)
+    {
+        void *base = attempt == 0 ? (void *)BENCH_GAME_MEMORY_BASE_ADDRESS
+                                  : NULL;
+        const i32 fixed_flag = attempt == 0 ? MAP_FIXED_NOREPLACE : 0;
+
+        if (use_huge_pages)
+        {
+            // NOTE: Fails unless huge pages were reserved (vm.nr_hugepages).
+            memory = mmap(base, size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                              fixed_flag,
+                          -1, 0);
+            *page_type = bench_page_type_huge;
+        }
+
+        if (memory == MAP_FAILED)
+        {
+            memory = mmap(base, size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | fixed_flag, -1, 0);
+            *page_type = bench_page_type_small;
+
+            if (memory != MAP_FAILED && use_huge_pages &&
+                madvise(memory, size, MADV_HUGEPAGE) == 0)
+            {
+                *page_type = bench_page_type_transparent_huge;
+            }
+        }
+    }
+
+    ASSERT(memory != MAP_FAILED);
+
+    // NOTE: Kernels older than 4.17 treat MAP_FIXED_NOREPLACE as a hint, so
+    // the first attempt may succeed somewhere else.
+    *is_at_base_address = memory == (void *)BENCH_GAME_MEMORY_BASE_ADDRESS;
+
+    return (u8 *)memory;
+}
+
+// Runs one frame, where the player does not move.
+internal void bench_run_game_frame(bench_game_t *const restrict game)
+{
+    ASSERT(game);
+
+    game_input_t game_input = {0};
+    game_input.delta_time = 1000.0f / 60.0f;
+
+    // 800 samples : a frame's worth at 60 Hz.
+    game_sound_output_buffer_t sound_buffer = {0};
+    sound_buffer.samples = game->sound_samples;
+    sound_buffer.sample_count = GAME_SOUND_SAMPLES_PER_SECOND / 60u;
+    sound_buffer.samples_per_second = GAME_SOUND_SAMPLES_PER_SECOND;
+
+    game_update_and_render(&game->buffer, &game_input, &sound_buffer,
+                           &game->game_memory, &game->platform_services);
+}
+
+internal void bench_init_game(bench_game_t *const restrict game,
+                              const b32 use_huge_pages)
+{
+    ASSERT(game);
+
+    memset(game, 0, sizeof(bench_game_t));
+
+    const u64 start_ns = bench_get_time_ns();
+
+    bench_page_type_t page_type = bench_page_type_small;
+    b32 is_at_base_address = false;
+
+    game->game_memory.permanent_memory_block_size = MEGABYTE(16);
+    game->game_memory.permanent_memory_block = bench_allocate_game_memory(
+        game->game_memory.permanent_memory_block_size, use_huge_pages,
+        &page_type, &is_at_base_address);
+
+    // Pages are allocated on first touch, which is part of the startup time.
+    for (u64 offset = 0; offset < game->game_memory.permanent_memory_block_size;
+         offset += KILOBYTE(4))
+    {
+        ((volatile u8 *)game->game_memory.permanent_memory_block)[offset] = 0;
+    }
+
+    const char *page_type_names[] = {
+        [bench_page_type_small] = "small",
+        [bench_page_type_transparent_huge] = "transparent huge",
+        [bench_page_type_huge] = "huge",
+    };
+
+    printf("Game memory : at %p (fixed base : %d), %s pages, allocated in "
+           "%.3f ms.\n",
+           (void *)game->game_memory.permanent_memory_block,
+           is_at_base_address, page_type_names[page_type],
+           (f64)(bench_get_time_ns() - start_ns) / 1e6);
+
+    game->framebuffer_memory = (u32 *)calloc(
+        (u64)BENCH_FRAMEBUFFER_WIDTH * BENCH_FRAMEBUFFER_HEIGHT, sizeof(u32));
+    ASSERT(game->framebuffer_memory);
+
+    game->buffer.framebuffer_memory = game->framebuffer_memory;
+    game->buffer.width = BENCH_FRAMEBUFFER_WIDTH;
+    game->buffer.height = BENCH_FRAMEBUFFER_HEIGHT;
+    game->buffer.render_scale = 1.0f;
+
+    // NOTE: Without a work queue, the game generates chunks on the game
+    // thread, so every run does the same work.
+    // The first frame generates the chunks around the player.
+    bench_run_game_frame(game);
+}
+
+internal void bench_render_rectangle(bench_t *const restrict bench,
+                                     bench_game_t *const restrict game,
+                                     const char *const restrict name,
+                                     const f32 width, const f32 height,
+                                     const f32 alpha)
+{
+    if (!bench_should_run(bench, name))
+    {
+        return;
+    }
+
+    bench_run_t run = {0};
+    run.pixel_count = (u64)width * (u64)height;
+    run.iteration_count = 1 + (64ull * 1024 * 1024) / run.pixel_count;
+
+    // Rectangles that fit are moved around a little, so rows start at
+    // different alignments.
+    const u64 offset_mask =
+        width + 8.0f <= (f32)game->buffer.width &&
+                height + 8.0f <= (f32)game->buffer.height
+            ? 7
+            : 0;
+
+    BENCH_BEGIN_SAMPLES(&run)
+    {
+        for (u64 i = 0; i < run.iteration_count; i++)
+        {
+            const f32 offset = (f32)(i & offset_mask);
+            game_render_rectangle(&game->buffer, offset, offset,
+                                  offset + width, offset + height, 0.25f, 0.5f,
+                                  0.75f, alpha);
+        }
+    }
+    BENCH_END_SAMPLES(&run)
+
+    bench->sink += game->framebuffer_memory[0];
+
+    bench_add_result(bench, name, &run);
+}
+
+// Blends a range of colors and alphas over a range of destination pixels, and
+// returns the largest difference (of any channel) from blending in double
+// precision with the exact sRGB conversions.
+internal u32 bench_check_blend_accuracy()
+{
+    const f32 source_colors[][3] = {
+        {0.0f, 0.0f, 0.0f}, {1.0f, 1.0f, 1.0f},   {0.25f, 0.5f, 0.75f},
+        {1.0f, 0.0f, 0.5f}, {0.02f, 0.04f, 0.9f},
+    };
+    const f32 source_alphas[] = {1.0f / 255.0f, 0.0625f, 0.25f, 0.5f,
+                                 0.75f,         0.98f,   1.0f};
+
+    // NOTE: Not a multiple of 4, so the last pixels go through the tail of
+    // the span.
+    u32 pixels[255];
+
+    u32 max_error = 0;
+
+    for (u32 color_index = 0; color_index < ARRAY_COUNT(source_colors);
+         color_index++)
+    {
+        for (u32 alpha_index = 0; alpha_index < ARRAY_COUNT(source_alphas);
+             alpha_index++)
+        {
+            const f32 *source = source_colors[color_index];
+            const f32 alpha = source_alphas[alpha_index];
+
+            for (u32 i = 0; i < ARRAY_COUNT(pixels); i++)
+            {
+                pixels[i] = 0xff000000 | (i << 16) | ((255 - i) << 8) |
+                            ((i * 37) & 0xff);
+            }
+
+            game_blend_span(
+                &g_blend_tables, pixels, ARRAY_COUNT(pixels),
+                game_get_linear_color(source[0], source[1], source[2], alpha));
+
+            for (u32 i = 0; i < ARRAY_COUNT(pixels); i++)
+            {
+                const u32 destination[3] = {i, 255 - i, (i * 37) & 0xff};
+
+                for (u32 channel = 0; channel < 3; channel++)
+                {
+                    const f64 source_value = (f64)source[channel];
+                    const f64 destination_value =
+                        (f64)destination[channel] / 255.0;
+
+                    const f64 source_linear =
+                        source_value <= 0.04045
+                            ? source_value / 12.92
+                            : pow((source_value + 0.055) / 1.055, 2.4);
+                    const f64 destination_linear =
+                        destination_value <= 0.04045
+                            ? destination_value / 12.92
+                            : pow((destination_value + 0.055) / 1.055, 2.4);
+
+                    const f64 linear = source_linear * alpha +
+                                       destination_linear * (1.0 - alpha);
+                    const f64 encoded =
+                        linear <= 0.0031308
+                            ? linear * 12.92
+                            : 1.055 * pow(linear, 1.0 / 2.4) - 0.055;
+
+                    const i32 expected = (i32)(encoded * 255.0 + 0.5);
+                    const i32 actual =
+                        (i32)((pixels[i] >> (16 - 8 * channel)) & 0xff);
+
+                    const u32 error = (u32)abs(actual - expected);
+                    if (error > max_error)
+                    {
+                        max_error = error;
+                    }
+                }
+            }
+        }
+    }
+
+    return max_error;
+}
+
+// Sprite of size x size pixels, rotated by angle (in radians).
+internal void bench_render_sprite(bench_t *const restrict bench,
+                                  bench_game_t *const restrict game,
+                                  const char *const restrict name,
+                                  const f32 size, const f32 angle)
+{
+    if (!bench_should_run(bench, name))
+    {
+        return;
+    }
+
+    bench_run_t run = {0};
+    run.pixel_count = (u64)(size * size);
+    run.iteration_count = 1 + (16ull * 1024 * 1024) / run.pixel_count;
+
+    const f32 x_axis_x = size * cosf(angle);
+    const f32 x_axis_y = size * sinf(angle);
+
+    // Centered on the buffer.
+    const f32 center_x = (f32)game->buffer.width / 2.0f;
+    const f32 center_y = (f32)game->buffer.height / 2.0f;
+
+    BENCH_BEGIN_SAMPLES(&run)
+    {
+        for (u64 i = 0; i < run.iteration_count; i++)
+        {
+            // Sub pixel offsets, so pixel centers land on different texel
+            // fractions.
+            const f32 offset = (f32)(i & 7) * 0.125f;
+
+            game_render_sprite(&game->buffer, &g_sprites.player,
+                               center_x - 0.5f * (x_axis_x - x_axis_y) + offset,
+                               center_y - 0.5f * (x_axis_y + x_axis_x) + offset,
+                               x_axis_x, x_axis_y, -x_axis_y, x_axis_x);
+        }
+    }
+    BENCH_END_SAMPLES(&run)
+
+    bench->sink += game->framebuffer_memory[0];
+
+    bench_add_result(bench, name, &run);
+}
+
+internal void bench_readjust_position(bench_t *const restrict bench,
+                                      bench_game_t *const restrict game)
+{
+    const char *name = "readjust_position";
+    if (!bench_should_run(bench, name))
+    {
+        return;
+    }
+
+    game_state_t *game_state =
+        (game_state_t *)game->game_memory.permanent_memory_block;
+
+    // Fixed positions, with offsets that cross into neighbouring tiles (in
+    // both directions) as well as ones that stay within the tile.
+    game_world_position_t positions[256];
+    u32 random = 0x9e3779b9u;
+    for (u32 i = 0; i < ARRAY_COUNT(positions); i++)
+    {
+        random = random * 1664525u + 1013904223u;
+
+        positions[i].abs_tile_index_x = random >> 8;
+        positions[i].abs_tile_index_y = random >> 12;
+        positions[i].tile_rel_x = (f32)((random >> 4) % 400) / 100.0f - 2.0f;
+        positions[i].tile_rel_y = (f32)((random >> 16) % 400) / 100.0f - 2.0f;
+    }
+
+    bench_run_t run = {0};
+    run.iteration_count = 1u << 20;
+
+    u64 sum = 0;
+
+    BENCH_BEGIN_SAMPLES(&run)
+    {
+        for (u64 i = 0; i < run.iteration_count; i++)
+        {
+            const game_world_position_t position = readjust_position(
+                &game_state->game_world,
+                positions[i & (ARRAY_COUNT(positions) - 1)]);
+            sum += position.abs_tile_index_x + position.abs_tile_index_y;
+        }
+    }
+    BENCH_END_SAMPLES(&run)
+
+    bench->sink += sum;
+
+    bench_add_result(bench, name, &run);
+}
+
+internal void bench_get_tile_value_in_world(bench_t *const restrict bench,
+                                            bench_game_t *const restrict game)
+{
+    const char *name = "get_tile_value_in_world";
+    if (!bench_should_run(bench, name))
+    {
+        return;
+    }
+
+    game_state_t *game_state =
+        (game_state_t *)game->game_memory.permanent_memory_block;
+
+    // Tiles around the player, within the chunks that are loaded (and some
+    // that are not, which is the slowest case).
+    const u32 player_x = game_state->player_position.abs_tile_index_x;
+    const u32 player_y = game_state->player_position.abs_tile_index_y;
+
+    game_world_position_t positions[1024];
+    u32 random = 0x2545f491u;
+    for (u32 i = 0; i < ARRAY_COUNT(positions); i++)
+    {
+        random = random * 1664525u + 1013904223u;
+
+        game_world_position_t position = {0};
+        position.abs_tile_index_x =
+            player_x + ((random >> 8) % (8 * TILE_CHUNK_DIM)) -
+            4 * TILE_CHUNK_DIM;
+        position.abs_tile_index_y =
+            player_y + ((random >> 20) % (8 * TILE_CHUNK_DIM)) -
+            4 * TILE_CHUNK_DIM;
+
+        positions[i] = position;
+    }
+
+    bench_run_t run = {0};
+    run.iteration_count = 1u << 20;
+
+    u64 sum = 0;
+
+    BENCH_BEGIN_SAMPLES(&run)
+    {
+        for (u64 i = 0; i < run.iteration_count; i++)
+        {
+            sum += get_tile_value_in_world(
+                &game_state->game_world,
+                positions[i & (ARRAY_COUNT(positions) - 1)]);
+        }
+    }
+    BENCH_END_SAMPLES(&run)
+
+    bench->sink += sum;
+
+    bench_add_result(bench, name, &run);
+}
+
+// Reads a rectangle of tiles, with get_tile_values_in_rect or one tile at a
+// time. The rectangle moves around within spread tiles of the corner of the
+// player's chunk, so that it straddles chunk edges (and, with a large spread,
+// covers chunks that are not loaded) now and then.
+internal void bench_get_tile_values_in_rect(bench_t *const restrict bench,
+                                            bench_game_t *const restrict game,
+                                            const char *const restrict name,
+                                            const u32 width, const u32 height,
+                                            const u32 spread,
+                                            const b32 is_per_tile)
+{
+    if (!bench_should_run(bench, name))
+    {
+        return;
+    }
+
+    game_state_t *game_state =
+        (game_state_t *)game->game_memory.permanent_memory_block;
+    game_world_t *world = &game_state->game_world;
+
+    const u32 corner_x =
+        game_state->player_position.abs_tile_index_x & ~(TILE_CHUNK_DIM - 1);
+    const u32 corner_y =
+        game_state->player_position.abs_tile_index_y & ~(TILE_CHUNK_DIM - 1);
+
+    static u32 values[256 * 256];
+    ASSERT(width <= 256 && height <= 256);
+
+    bench_run_t run = {0};
+    run.iteration_count = 1 + (16ull * 1024 * 1024) / (width * height);
+
+    u32 random = 0x2545f491u;
+    u64 sum = 0;
+
+    BENCH_BEGIN_SAMPLES(&run)
+    {
+        for (u64 i = 0; i < run.iteration_count; i++)
+        {
+            random = random * 1664525u + 1013904223u;
+
+            const u32 min_x =
+                corner_x + ((random >> 8) % (2 * spread)) - spread;
+            const u32 min_y =
+                corner_y + ((random >> 20) % (2 * spread)) - spread;
+
+            if (is_per_tile)
+            {
+                for (u32 y = 0; y < height; y++)
+                {
+                    for (u32 x = 0; x < width; x++)
+                    {
+                        game_world_position_t position = {0};
+                        position.abs_tile_index_x = min_x + x;
+                        position.abs_tile_index_y = min_y + y;
+
+                        values[y * width + x] =
+                            get_tile_value_in_world(world, position);
+                    }
+                }
+            }
+            else
+            {
+                get_tile_values_in_rect(world, min_x, min_y, width, height,
+                                        values, width);
+            }
+
+            sum += values[(random & 0xff) % (width * height)];
+        }
+    }
+    BENCH_END_SAMPLES(&run)
+
+    bench->sink += sum;
+
+    bench_add_result(bench, name, &run);
+}
+
+// Tests whether runs of 64 tiles along a row (near the corner of the player's
+// chunk, so that some span chunks) are empty, with the chunks' solid bits or
+// one tile value at a time.
+internal void bench_solid_tile_bits_in_row(bench_t *const restrict bench,
+                                           bench_game_t *const restrict game,
+                                           const char *const restrict name,
+                                           const b32 is_per_tile)
+{
+    if (!bench_should_run(bench, name))
+    {
+        return;
+    }
+
+    game_state_t *game_state =
+        (game_state_t *)game->game_memory.permanent_memory_block;
+    game_world_t *world = &game_state->game_world;
+
+    const u32 corner_x =
+        game_state->player_position.abs_tile_index_x & ~(TILE_CHUNK_DIM - 1);
+    const u32 corner_y =
+        game_state->player_position.abs_tile_index_y & ~(TILE_CHUNK_DIM - 1);
+
+    bench_run_t run = {0};
+    run.iteration_count = 1u << 18;
+
+    u32 random = 0x2545f491u;
+    u64 empty_count = 0;
+
+    BENCH_BEGIN_SAMPLES(&run)
+    {
+        for (u64 i = 0; i < run.iteration_count; i++)
+        {
+            random = random * 1664525u + 1013904223u;
+
+            const u32 min_x = corner_x + ((random >> 8) % 128) - 64;
+            const u32 y = corner_y + ((random >> 20) % 128) - 64;
+
+            b32 is_empty = true;
+            if (is_per_tile)
+            {
+                for (u32 x = 0; x < 64 && is_empty; x++)
+                {
+                    game_world_position_t position = {0};
+                    position.abs_tile_index_x = min_x + x;
+                    position.abs_tile_index_y = y;
+
+                    is_empty = get_tile_value_in_world(world, position) == 0;
+                }
+            }
+            else
+            {
+                is_empty =
+                    get_solid_tile_bits_in_world(world, min_x, y, 64, false) ==
+                    0;
+            }
+
+            empty_count += is_empty;
+        }
+    }
+    BENCH_END_SAMPLES(&run)
+
+    bench->sink += empty_count;
+
+    bench_add_result(bench, name, &run);
+}
+
+// Copies of the player's chunk, stored in either layout (regardless of the one
+// the game is built with), scanned row by row, or read as the 3x3
+// neighbourhoods of scattered tiles. There are as many copies as the world
+// has loaded chunks at most, so that tiles do not all fit in the cache.
+internal void bench_tile_chunk_layout(bench_t *const restrict bench,
+                                      bench_game_t *const restrict game,
+                                      const char *const restrict name,
+                                      const b32 is_morton,
+                                      const b32 is_neighborhood)
+{
+    if (!bench_should_run(bench, name))
+    {
+        return;
+    }
+
+    game_state_t *game_state =
+        (game_state_t *)game->game_memory.permanent_memory_block;
+
+    game_tile_chunk_t *chunk = get_tile_chunk_from_world(
+        &game_state->game_world,
+        GET_CHUNK_INDEX_IN_WORLD(game_state->player_position.abs_tile_index_x),
+        GET_CHUNK_INDEX_IN_WORLD(
+            game_state->player_position.abs_tile_index_y));
+    ASSERT(chunk);
+
+    static u32 chunk_tiles[GAME_MAX_LOADED_TILE_CHUNKS]
+                          [TILE_CHUNK_DIM * TILE_CHUNK_DIM];
+    for (u32 i = 0; i < GAME_MAX_LOADED_TILE_CHUNKS; i++)
+    {
+        for (u32 y = 0; y < TILE_CHUNK_DIM; y++)
+        {
+            for (u32 x = 0; x < TILE_CHUNK_DIM; x++)
+            {
+                const u32 index =
+                    is_morton ? get_tile_index_in_chunk_morton(x, y)
+                              : get_tile_index_in_chunk_row_major(x, y);
+                chunk_tiles[i][index] =
+                    chunk->tiles[get_tile_index_in_chunk(x, y)];
+            }
+        }
+    }
+
+    bench_run_t run = {0};
+    run.iteration_count = is_neighborhood ? 1u << 20 : 64;
+
+    u32 random = 0x2545f491u;
+    u64 sum = 0;
+
+    BENCH_BEGIN_SAMPLES(&run)
+    {
+        for (u64 i = 0; i < run.iteration_count; i++)
+        {
+            if (is_neighborhood)
+            {
+                random = random * 1664525u + 1013904223u;
+
+                const u32 *tiles =
+                    chunk_tiles[random % GAME_MAX_LOADED_TILE_CHUNKS];
+
+                const u32 center_x = 1 + (random >> 8) % (TILE_CHUNK_DIM - 2);
+                const u32 center_y = 1 + (random >> 20) % (TILE_CHUNK_DIM - 2);
+
+                for (u32 y = center_y - 1; y <= center_y + 1; y++)
+                {
+                    for (u32 x = center_x - 1; x <= center_x + 1; x++)
+                    {
+                        if (is_morton)
+                        {
+                            sum += tiles[get_tile_index_in_chunk_morton(x, y)];
+                        }
+                        else
+                        {
+                            sum +=
+                                tiles[get_tile_index_in_chunk_row_major(x, y)];
+                        }
+                    }
+                }
+            }
+            else if (is_morton)
+            {
+                const u32 *tiles =
+                    chunk_tiles[i % GAME_MAX_LOADED_TILE_CHUNKS];
+
+                for (u32 y = 0; y < TILE_CHUNK_DIM; y++)
+                {
+                    for (u32 x = 0; x < TILE_CHUNK_DIM; x++)
+                    {
+                        sum += tiles[get_tile_index_in_chunk_morton(x, y)];
+                    }
+                }
+            }
+            else
+            {
+                const u32 *tiles =
+                    chunk_tiles[i % GAME_MAX_LOADED_TILE_CHUNKS];
+
+                for (u32 y = 0; y < TILE_CHUNK_DIM; y++)
+                {
+                    for (u32 x = 0; x < TILE_CHUNK_DIM; x++)
+                    {
+                        sum += tiles[get_tile_index_in_chunk_row_major(x, y)];
+                    }
+                }
+            }
+        }
+    }
+    BENCH_END_SAMPLES(&run)
+
+    bench->sink += sum;
+
+    bench_add_result(bench, name, &run);
+}
+
+typedef struct
+{
+    game_tile_chunk_slot_t *slot;
+
+    u32 first_chunk_x;
+    u32 chunk_count;
+} bench_chunk_thread_t;
+
+internal void *bench_chunk_thread_proc(void *param)
+{
+    bench_chunk_thread_t *thread = (bench_chunk_thread_t *)param;
+    game_tile_chunk_slot_t *slot = thread->slot;
+
+    for (u32 i = 0; i < thread->chunk_count; i++)
+    {
+        slot->state = game_tile_chunk_state_queued;
+        slot->chunk_x = thread->first_chunk_x + i;
+        slot->chunk_y = 1000;
+        slot->seed = 0x5eed;
+
+        game_generate_tile_chunk_work(NULL, slot);
+    }
+
+    return NULL;
+}
+
+// Generates chunks with the generation job, on thread_count threads at once
+// (one chunk per iteration, split evenly between threads). Every thread gets
+// its own chunks, so threads only share the generation cycles counter.
+internal void bench_tile_chunk_generation(bench_t *const restrict bench,
+                                          const char *const restrict name,
+                                          const u32 thread_count)
+{
+    ASSERT(thread_count >= 1 && thread_count <= BENCH_MAX_THREADS);
+
+    if (!bench_should_run(bench, name))
+    {
+        return;
+    }
+
+    const u32 chunks_per_thread = 16;
+
+    bench_run_t run = {0};
+    run.iteration_count = (u64)chunks_per_thread * thread_count;
+    run.chunk_thread_count = thread_count;
+
+    bench_chunk_thread_t threads[BENCH_MAX_THREADS] = {0};
+    for (u32 i = 0; i < thread_count; i++)
+    {
+        threads[i].slot = (game_tile_chunk_slot_t *)calloc(
+            1, sizeof(game_tile_chunk_slot_t));
+        ASSERT(threads[i].slot);
+
+        threads[i].first_chunk_x = 1000 + i * chunks_per_thread;
+        threads[i].chunk_count = chunks_per_thread;
+    }
+
+    const u64 start_generation_cycles = g_tile_chunk_generation_cycles;
+
+    BENCH_BEGIN_SAMPLES(&run)
+    {
+        pthread_t thread_handles[BENCH_MAX_THREADS];
+
+        // NOTE: The calling thread generates chunks as well.
+        for (u32 i = 1; i < thread_count; i++)
+        {
+            const i32 error = pthread_create(&thread_handles[i], NULL,
+                                             bench_chunk_thread_proc,
+                                             &threads[i]);
+            ASSERT(error == 0);
+        }
+
+        bench_chunk_thread_proc(&threads[0]);
+
+        for (u32 i = 1; i < thread_count; i++)
+        {
+            pthread_join(thread_handles[i], NULL);
+        }
+    }
+    BENCH_END_SAMPLES(&run)
+
+    // Cycles within the jobs, which leaves out the cost of threads (and shows
+    // how much generation itself slows down as threads are added).
+    const u64 generated_chunk_count =
+        (BENCH_SAMPLE_COUNT + 1) * run.iteration_count;
+    const f64 job_cycles_per_chunk =
+        (f64)(g_tile_chunk_generation_cycles - start_generation_cycles) /
+        (f64)generated_chunk_count;
+
+    for (u32 i = 0; i < thread_count; i++)
+    {
+        bench->sink += threads[i].slot->tile_chunk.tiles[0];
+        free(threads[i].slot);
+    }
+
+    bench_add_result(bench, name, &run);
+
+    printf("%-40s %12u threads %14.1f cycles/chunk in jobs\n", "",
+           thread_count, job_cycles_per_chunk);
+}
+
+// Dependent loads from every page of game memory, in an order that hardware
+// prefetchers do not follow. With small pages, most loads miss the TLB, so
+// this shows the difference huge pages make.
+internal void bench_game_memory_page_walk(bench_t *const restrict bench,
+                                          bench_game_t *const restrict game)
+{
+    const char *name = "game_memory_page_walk";
+    if (!bench_should_run(bench, name))
+    {
+        return;
+    }
+
+    const u8 *memory = game->game_memory.permanent_memory_block;
+
+    const u64 page_count =
+        game->game_memory.permanent_memory_block_size / KILOBYTE(4);
+    ASSERT((page_count & (page_count - 1)) == 0);
+
+    // An odd stride visits every page before repeating.
+    const u64 page_stride = (page_count / 3) | 1;
+
+    bench_run_t run = {0};
+    run.iteration_count = 1u << 16;
+
+    u64 page_index = 0;
+
+    BENCH_BEGIN_SAMPLES(&run)
+    {
+        for (u64 i = 0; i < run.iteration_count; i++)
+        {
+            const u64 value =
+                *(volatile const u64 *)(memory + page_index * KILOBYTE(4));
+
+            // The loaded value (whatever it is) decides the next page, so
+            // loads can not overlap.
+            page_index = ((page_index + page_stride) ^ (value >> 63)) &
+                         (page_count - 1);
+        }
+    }
+    BENCH_END_SAMPLES(&run)
+
+    bench->sink += page_index;
+
+    bench_add_result(bench, name, &run);
+}
+
+internal void bench_game_frame(bench_t *const restrict bench,
+                               bench_game_t *const restrict game)
+{
+    const char *name = "game_update_and_render";
+    if (!bench_should_run(bench, name))
+    {
+        return;
+    }
+
+    bench_run_t run = {0};
+    run.iteration_count = 16;
+    run.pixel_count = (u64)BENCH_FRAMEBUFFER_WIDTH * BENCH_FRAMEBUFFER_HEIGHT;
+
+    BENCH_BEGIN_SAMPLES(&run)
+    {
+        for (u64 i = 0; i < run.iteration_count; i++)
+        {
+            bench_run_game_frame(game);
+        }
+    }
+    BENCH_END_SAMPLES(&run)
+
+    bench->sink += game->framebuffer_memory[0];
+
+    bench_add_result(bench, name, &run);
+}
+
+internal b32 bench_write_results(const bench_t *const restrict bench,
+                                 const char *const restrict file_path)
+{
+    ASSERT(bench);
+    ASSERT(file_path);
+
+    FILE *file = fopen(file_path, "w");
+    if (!file)
+    {
+        return false;
+    }
+
+    for (u32 i = 0; i < bench->result_count; i++)
+    {
+        const bench_result_t *result = &bench->results[i];
+
+        fprintf(file, "%s %.3f %.3f %.3f %.1f %.0f %.1f\n", result->name,
+                result->ns_per_op, result->ns_per_op_ci,
+                result->median_ns_per_op, result->cycles_per_op,
+                result->pixels_per_second, result->chunks_per_second_per_core);
+    }
+
+    fclose(file);
+
+    return true;
+}
+
+// Prints the change of every benchmark that is in both this run and the
+// baseline. Returns the number of benchmarks that got slower by more than
+// their confidence intervals.
+internal u32 bench_compare_with_baseline(const bench_t *const restrict bench,
+                                         const char *const restrict file_path)
+{
+    ASSERT(bench);
+    ASSERT(file_path);
+
+    FILE *file = fopen(file_path, "r");
+    if (!file)
+    {
+        printf("Bench : Failed to read baseline %s.\n", file_path);
+        return 0;
+    }
+
+    printf("\nCompared with %s :\n", file_path);
+
+    u32 regression_count = 0;
+
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        bench_result_t baseline = {0};
+
+        // NOTE: Results written before chunks / s / core was added have one
+        // column less.
+        if (sscanf(line, "%63s %lf %lf %lf %lf %lf %lf", baseline.name,
+                   &baseline.ns_per_op, &baseline.ns_per_op_ci,
+                   &baseline.median_ns_per_op, &baseline.cycles_per_op,
+                   &baseline.pixels_per_second,
+                   &baseline.chunks_per_second_per_core) < 6)
+        {
+            continue;
+        }
+
+        for (u32 i = 0; i < bench->result_count; i++)
+        {
+            const bench_result_t *result = &bench->results[i];
+
+            if (strcmp(result->name, baseline.name) != 0)
+            {
+                continue;
+            }
+
+            const f64 delta = result->ns_per_op - baseline.ns_per_op;
+            const b32 is_significant =
+                fabs(delta) > result->ns_per_op_ci + baseline.ns_per_op_ci;
+
+            const char *verdict = "unchanged";
+            if (is_significant)
+            {
+                verdict = delta > 0.0 ? "SLOWER" : "faster";
+                regression_count += delta > 0.0;
+            }
+
+            printf("%-40s %12.2f -> %12.2f ns/op (%+6.2f%%) %s\n",
+                   result->name, baseline.ns_per_op, result->ns_per_op,
+                   100.0 * delta / baseline.ns_per_op, verdict);
+        }
+    }
+
+    fclose(file);
+
+    return regression_count;
+}
+
+int main(int argument_count, char **arguments)
+{
+    const char *output_file_path = "prism_bench_results.txt";
+    const char *baseline_file_path = NULL;
+    b32 use_huge_pages = false;
+
+    local_persist bench_t bench = {0};
+
+    for (i32 i = 1; i < argument_count; i++)
+    {
+        if (strcmp(arguments[i], "--output") == 0 && i + 1 < argument_count)
+        {
+            output_file_path = arguments[++i];
+        }
+        else if (strcmp(arguments[i], "--baseline") == 0 &&
+                 i + 1 < argument_count)
+        {
+            baseline_file_path = arguments[++i];
+        }
+        else if (strcmp(arguments[i], "--filter") == 0 &&
+                 i + 1 < argument_count)
+        {
+            bench.filter = arguments[++i];
+        }
+        else if (strcmp(arguments[i], "--huge-pages") == 0)
+        {
+            use_huge_pages = true;
+        }
+    }
+
+    local_persist bench_game_t game = {0};
+    bench_init_game(&game, use_huge_pages);
+
+    // NOTE: Blending is checked for accuracy before it is benchmarked.
+    const u32 max_blend_error = bench_check_blend_accuracy();
+    printf("Blend accuracy : max error of %u (8 bit steps) against the float "
+           "reference.\n",
+           max_blend_error);
+    if (max_blend_error > BENCH_MAX_BLEND_ERROR)
+    {
+        printf("Bench : Blend accuracy check failed.\n");
+        return 1;
+    }
+
+    bench_render_rectangle(&bench, &game, "game_render_rectangle_tile", 100.0f,
+                           100.0f, 1.0f);
+    bench_render_rectangle(&bench, &game, "game_render_rectangle_fullscreen",
+                           (f32)BENCH_FRAMEBUFFER_WIDTH,
+                           (f32)BENCH_FRAMEBUFFER_HEIGHT, 1.0f);
+    bench_render_rectangle(&bench, &game, "game_render_rectangle_blend_tile",
+                           100.0f, 100.0f, 0.5f);
+    bench_render_rectangle(&bench, &game,
+                           "game_render_rectangle_blend_fullscreen",
+                           (f32)BENCH_FRAMEBUFFER_WIDTH,
+                           (f32)BENCH_FRAMEBUFFER_HEIGHT, 0.5f);
+    bench_render_sprite(&bench, &game, "game_render_sprite", 100.0f, 0.0f);
+    bench_render_sprite(&bench, &game, "game_render_sprite_rotated", 100.0f,
+                        0.5f);
+    bench_readjust_position(&bench, &game);
+    bench_get_tile_value_in_world(&bench, &game);
+    bench_get_tile_values_in_rect(&bench, &game, "get_tile_values_in_rect_3x1",
+                                  3, 1, 8, false);
+    bench_get_tile_values_in_rect(&bench, &game,
+                                  "get_tile_values_in_rect_3x1_per_tile", 3, 1,
+                                  8, true);
+    bench_get_tile_values_in_rect(&bench, &game,
+                                  "get_tile_values_in_rect_64x64", 64, 64,
+                                  2 * TILE_CHUNK_DIM, false);
+    bench_get_tile_values_in_rect(&bench, &game,
+                                  "get_tile_values_in_rect_64x64_per_tile", 64,
+                                  64, 2 * TILE_CHUNK_DIM, true);
+    bench_solid_tile_bits_in_row(&bench, &game, "solid_tile_bits_in_row_64",
+                                 false);
+    bench_solid_tile_bits_in_row(&bench, &game,
+                                 "solid_tile_bits_in_row_64_per_tile", true);
+    bench_tile_chunk_layout(&bench, &game, "tile_chunk_row_scan_row_major",
+                            false, false);
+    bench_tile_chunk_layout(&bench, &game, "tile_chunk_row_scan_morton", true,
+                            false);
+    bench_tile_chunk_layout(&bench, &game,
+                            "tile_chunk_neighborhood_row_major", false, true);
+    bench_tile_chunk_layout(&bench, &game, "tile_chunk_neighborhood_morton",
+                            true, true);
+    bench_game_memory_page_walk(&bench, &game);
+    bench_game_frame(&bench, &game);
+
+    // One thread per logical processor (as many as the platform's workers
+    // and game thread).
+    const i64 processor_count = sysconf(_SC_NPROCESSORS_ONLN);
+    const u32 thread_count =
+        processor_count < 1
+            ? 1
+            : (processor_count > BENCH_MAX_THREADS ? BENCH_MAX_THREADS
+                                                   : (u32)processor_count);
+
+    bench_tile_chunk_generation(&bench, "tile_chunk_generation_1_thread", 1);
+    bench_tile_chunk_generation(&bench, "tile_chunk_generation_all_threads",
+                                thread_count);
+
+    if (!bench_write_results(&bench, output_file_path))
+    {
+        printf("Bench : Failed to write results to %s.\n", output_file_path);
+        return 1;
+    }
+
+    u32 regression_count = 0;
+    if (baseline_file_path)
+    {
+        regression_count =
+            bench_compare_with_baseline(&bench, baseline_file_path);
+    }
+
+    return regression_count ? 2 : 0;
+}
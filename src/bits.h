@@ -0,0 +1,33 @@
+#ifndef __BITS_H__
+#define __BITS_H__
+
+#include "common.h"
+
+// Bit scans, used to walk bitmaps a word at a time.
+#if defined(_MSC_VER)
+
+#include <intrin.h>
+
+// Index of the lowest set bit. value must not be 0.
+inline u32 find_first_set_bit_u64(const u64 value)
+{
+    ASSERT(value);
+
+    unsigned long index = 0;
+    _BitScanForward64(&index, value);
+
+    return (u32)index;
+}
+
+#else
+
+inline u32 find_first_set_bit_u64(const u64 value)
+{
+    ASSERT(value);
+
+    return (u32)__builtin_ctzll(value);
+}
+
+#endif
+
+#endif
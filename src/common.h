@@ -48,6 +48,7 @@ typedef double f64;
 #define KILOBYTE(x) (x * 1024LL)
 #define MEGABYTE(x) (KILOBYTE(x) * 1024LL)
 #define GIGABYTE(x) (MEGABYTE(x) * 1024LL)
+#define TERABYTE(x) (GIGABYTE(x) * 1024LL)
 
 #define ARRAY_COUNT(x) (sizeof(x) / sizeof(x[0]))
 
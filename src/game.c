@@ -1,9 +1,21 @@
 #include "game.h"
 
+#include "atomics.h"
+#include "bits.h"
 #include "common.h"
+#include "hash.h"
+
+#include <emmintrin.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "game_blend.c"
+#include "game_sprite.c"
 
 // NOTE: The top left x and y are relative to 'framebuffer' coordinates, where
 // the top left corner is origin.
+// Colors are sRGB encoded. Translucent rectangles are blended (see
+// game_blend.c), opaque ones are filled.
 internal void game_render_rectangle(
     game_offscreen_buffer_t *restrict const buffer, f32 top_left_x,
     f32 top_left_y, f32 bottom_right_x, f32 bottom_right_y, f32 normalized_red,
@@ -45,6 +57,27 @@ internal void game_render_rectangle(
     const u8 blue = round_f32_to_u8(normalized_blue * 255.0f);
     const u8 alpha = round_f32_to_u8(normalized_alpha * 255.0f);
 
+    if (alpha < 0xff)
+    {
+        if (alpha == 0 || min_x >= max_x)
+        {
+            return;
+        }
+
+        const game_linear_color_t linear_color =
+            game_get_linear_color(normalized_red, normalized_green,
+                                  normalized_blue, normalized_alpha);
+
+        for (i32 y = min_y; y < max_y; y++)
+        {
+            game_blend_span(&g_blend_tables, row, (u32)(max_x - min_x),
+                            linear_color);
+            row += pitch;
+        }
+
+        return;
+    }
+
     // Layout in memory is : XX RR GG BB.
     const u32 color = blue | (green << 8) | (red << 16) | (alpha << 24);
 
@@ -74,6 +107,14 @@ internal void readjust_coordinate(u32 *tile_index, f32 *tile_rel, u32 tile_dim)
 
     *tile_rel = *tile_rel - delta * (i32)tile_dim;
 
+    // NOTE: A tiny negative tile rel rounds up to tile_dim when tile_dim is
+    // added to it.
+    if (*tile_rel >= tile_dim)
+    {
+        *tile_index += 1;
+        *tile_rel = 0.0f;
+    }
+
     ASSERT(*tile_rel < tile_dim);
     ASSERT(*tile_rel >= 0.0f);
 }
@@ -92,18 +133,42 @@ internal game_world_position_t readjust_position(
     return result;
 }
 
+// Returns the slot holding (or generating) the chunk, NULL if the chunk is not
+// loaded.
+// NOTE: The chunk pool is small, so a linear search is used.
+internal game_tile_chunk_slot_t *
+game_find_tile_chunk_slot(game_world_t *const restrict world,
+                          const u32 tile_chunk_x, const u32 tile_chunk_y)
+{
+    ASSERT(world);
+
+    for (u32 i = 0; i < GAME_MAX_LOADED_TILE_CHUNKS; i++)
+    {
+        game_tile_chunk_slot_t *slot = &world->tile_chunk_slots[i];
+
+        if (slot->state != game_tile_chunk_state_unloaded &&
+            slot->chunk_x == tile_chunk_x && slot->chunk_y == tile_chunk_y)
+        {
+            return slot;
+        }
+    }
+
+    return NULL;
+}
+
+// Chunks that are not loaded (yet) are treated as missing, i.e every tile in
+// them is invalid.
 internal game_tile_chunk_t *get_tile_chunk_from_world(
     game_world_t *const restrict world, u32 tile_chunk_x, u32 tile_chunk_y)
 {
     ASSERT(world);
 
-    if (tile_chunk_x < world->tile_chunk_count_x &&
-        tile_chunk_y < world->tile_chunk_count_y)
+    game_tile_chunk_slot_t *slot =
+        game_find_tile_chunk_slot(world, tile_chunk_x, tile_chunk_y);
+
+    if (slot && slot->state == game_tile_chunk_state_loaded)
     {
-        game_tile_chunk_t *tile_chunk =
-            &world->tile_chunks[tile_chunk_x +
-                                tile_chunk_y * world->tile_chunk_count_x];
-        return tile_chunk;
+        return &slot->tile_chunk;
     }
 
     return NULL;
@@ -118,7 +183,8 @@ get_tile_value_in_chunk(game_tile_chunk_t *const restrict tile_chunk,
         if (tile_index_x < (i32)TILE_CHUNK_DIM &&
             tile_index_y < (i32)TILE_CHUNK_DIM)
         {
-            return tile_chunk->tiles[tile_index_y][tile_index_x];
+            return tile_chunk->tiles[get_tile_index_in_chunk(tile_index_x,
+                                                             tile_index_y)];
         }
     }
 
@@ -144,24 +210,362 @@ internal u32 get_tile_value_in_world(game_world_t *const restrict world,
     return INVALID_TILE_VALUE;
 }
 
-internal b32
-is_tile_point_empty_in_world(game_world_t *const restrict world,
-                             const game_world_position_t world_position)
+// Copies the values of the width * height tiles starting at (min_tile_x,
+// min_tile_y) into values, one row (of width values) every pitch values,
+// bottom row first. The rectangle wraps around the world like tile indices do.
+// NOTE: Each chunk the rectangle covers is looked up once, and its part of
+// every row is copied at once, instead of resolving the chunk of each tile.
+internal void get_tile_values_in_rect(game_world_t *const restrict world,
+                                      const u32 min_tile_x,
+                                      const u32 min_tile_y, const u32 width,
+                                      const u32 height,
+                                      u32 *const restrict values,
+                                      const u32 pitch)
+{
+    ASSERT(world);
+    ASSERT(values);
+    ASSERT(width <= pitch);
+
+    for (u32 row = 0; row < height;)
+    {
+        const u32 tile_y = min_tile_y + row;
+        const u32 tile_index_y = GET_TILE_INDEX_IN_CHUNK(tile_y);
+
+        u32 row_count = TILE_CHUNK_DIM - tile_index_y;
+        if (row_count > height - row)
+        {
+            row_count = height - row;
+        }
+
+        for (u32 column = 0; column < width;)
+        {
+            const u32 tile_x = min_tile_x + column;
+            const u32 tile_index_x = GET_TILE_INDEX_IN_CHUNK(tile_x);
+
+            u32 column_count = TILE_CHUNK_DIM - tile_index_x;
+            if (column_count > width - column)
+            {
+                column_count = width - column;
+            }
+
+            const game_tile_chunk_t *tile_chunk = get_tile_chunk_from_world(
+                world, GET_CHUNK_INDEX_IN_WORLD(tile_x),
+                GET_CHUNK_INDEX_IN_WORLD(tile_y));
+
+            for (u32 i = 0; i < row_count; i++)
+            {
+                u32 *destination = values + (u64)(row + i) * pitch + column;
+
+                if (tile_chunk)
+                {
+#if GAME_TILE_CHUNK_LAYOUT == GAME_TILE_CHUNK_LAYOUT_ROW_MAJOR
+                    memcpy(destination,
+                           &tile_chunk->tiles[get_tile_index_in_chunk(
+                               tile_index_x, tile_index_y + i)],
+                           column_count * sizeof(u32));
+#else
+                    for (u32 j = 0; j < column_count; j++)
+                    {
+                        destination[j] =
+                            tile_chunk->tiles[get_tile_index_in_chunk(
+                                tile_index_x + j, tile_index_y + i)];
+                    }
+#endif
+                }
+                else
+                {
+                    for (u32 j = 0; j < column_count; j++)
+                    {
+                        destination[j] = INVALID_TILE_VALUE;
+                    }
+                }
+            }
 
+            column += column_count;
+        }
+
+        row += row_count;
+    }
+}
+
+#include "game_collision.c"
+#include "game_world_gen.c"
+#include "game_nav.c"
+#include "game_light.c"
+
+// NOTE: Tiles in chunks that are not loaded can not be changed.
+internal void
+set_tile_value_in_world(game_world_t *const restrict world,
+                        game_nav_t *const restrict nav,
+                        game_light_t *const restrict light,
+                        const game_world_position_t world_position,
+                        const u32 tile_value)
+{
+    ASSERT(world);
+    ASSERT(nav);
+    ASSERT(light);
+
+    game_tile_chunk_t *tile_chunk = get_tile_chunk_from_world(
+        world, GET_CHUNK_INDEX_IN_WORLD(world_position.abs_tile_index_x),
+        GET_CHUNK_INDEX_IN_WORLD(world_position.abs_tile_index_y));
+
+    if (tile_chunk)
+    {
+        const u32 tile_index_x =
+            GET_TILE_INDEX_IN_CHUNK(world_position.abs_tile_index_x);
+        const u32 tile_index_y =
+            GET_TILE_INDEX_IN_CHUNK(world_position.abs_tile_index_y);
+
+        tile_chunk->tiles[get_tile_index_in_chunk(tile_index_x,
+                                                  tile_index_y)] = tile_value;
+        game_set_tile_solid_bit(tile_chunk, tile_index_x, tile_index_y,
+                                tile_value);
+
+        game_record_tile_edit(&world->tile_edits,
+                              world_position.abs_tile_index_x,
+                              world_position.abs_tile_index_y, tile_value);
+
+        game_nav_invalidate_tile(nav, world, world_position.abs_tile_index_x,
+                                 world_position.abs_tile_index_y);
+        game_light_invalidate_tile(light, world,
+                                   world_position.abs_tile_index_x,
+                                   world_position.abs_tile_index_y);
+    }
+}
+
+#include "game_audio.c"
+#include "game_agents.c"
+#include "game_save.c"
+#include "game_memory_stats.c"
+
+// Upgrades game state written with an older layout in place. Returns false if
+// no migration exists, in which case the game state is re-initialized.
+internal b32 game_migrate_state_layout(
+    game_state_t *const restrict game_state,
+    const game_state_layout_stamp_t old_layout_stamp)
 {
-    return get_tile_value_in_world(world, world_position) == 0;
+    ASSERT(game_state);
+
+    // NOTE: No migrations exist yet. When game_state_t changes, add the
+    // upgrade from the previous version here.
+    return false;
+}
+
+internal void
+game_validate_state_layout(game_state_t *const restrict game_state,
+                           game_memory_t *const restrict game_memory)
+{
+    ASSERT(game_state);
+    ASSERT(game_memory);
+
+    const game_state_layout_stamp_t layout_stamp = game_state->layout_stamp;
+
+    if (layout_stamp.version == GAME_STATE_LAYOUT_VERSION &&
+        layout_stamp.size == sizeof(game_state_t))
+    {
+        return;
+    }
+
+    // Zeroed game memory (first frame) has no stamp, so there is nothing to
+    // migrate.
+    const b32 has_layout_stamp = layout_stamp.version != 0;
+
+    if (!has_layout_stamp ||
+        !game_migrate_state_layout(game_state, layout_stamp))
+    {
+        memset(game_memory->permanent_memory_block, 0,
+               game_memory->permanent_memory_block_size);
+    }
+
+    game_state->layout_stamp.version = GAME_STATE_LAYOUT_VERSION;
+    game_state->layout_stamp.size = sizeof(game_state_t);
+}
+
+// Renders a horizontal run of tiles with the same value and light level as a
+// single rectangle.
+// NOTE: tile_x / tile_y are relative to the player's tile.
+internal void game_render_tile_span(
+    game_offscreen_buffer_t *const restrict buffer, const u32 tile_value,
+    const u32 light_level, const i32 span_start_tile_x,
+    const i32 span_end_tile_x, const i32 tile_y, const f32 center_x,
+    const f32 center_y, const f32 tile_width_in_pixels,
+    const f32 tile_height_in_pixels)
+{
+    // Walls are not lit (light does not go into them), and lamps are always
+    // fully lit. Floor is modulated by the light level, and unlit floor has
+    // the same color as the cleared screen, so nothing has to be drawn for it.
+    f32 red = 1.0f;
+    f32 green = 1.0f;
+    f32 blue = 1.0f;
+
+    if (tile_value == GAME_TILE_LAMP)
+    {
+        green = 0.85f;
+        blue = 0.4f;
+    }
+    else if (tile_value != GAME_TILE_WALL)
+    {
+        if (light_level == 0)
+        {
+            return;
+        }
+
+        const f32 light = (f32)light_level / (f32)GAME_MAX_LIGHT_LEVEL;
+        red = 0.45f * light;
+        green = 0.4f * light;
+        blue = 0.33f * light;
+    }
+
+    // NOTE: These are in framebuffer coords (top left corner is origin).
+    const f32 fb_span_left_x =
+        center_x + span_start_tile_x * tile_width_in_pixels;
+    const f32 fb_span_right_x =
+        center_x + span_end_tile_x * tile_width_in_pixels;
+
+    const f32 fb_span_bottom_y = center_y - tile_y * tile_height_in_pixels;
+    const f32 fb_span_top_y = fb_span_bottom_y - tile_height_in_pixels;
+
+    game_render_rectangle(buffer, fb_span_left_x, fb_span_top_y,
+                          fb_span_right_x, fb_span_bottom_y, red, green, blue,
+                          1.0f);
+}
+
+// Renders all the tiles that are visible in the offscreen buffer.
+// The visible tile bounds are computed from the buffer dimensions and the
+// camera (which is centered on the player). Tiles are walked chunk by chunk,
+// so each chunk is resolved only once, and horizontal runs of tiles with the
+// same value and light level within a chunk row are rendered as a single span.
+internal void
+game_render_tiles(game_offscreen_buffer_t *const restrict buffer,
+                  game_world_t *const restrict world,
+                  const game_world_position_t camera_position,
+                  const f32 center_x, const f32 center_y,
+                  const f32 pixels_per_meter)
+{
+    ASSERT(buffer);
+    ASSERT(world);
+
+    const f32 tile_width_in_pixels = pixels_per_meter * world->tile_width;
+    const f32 tile_height_in_pixels = pixels_per_meter * world->tile_height;
+
+    // Tile x (relative to the camera tile) covers
+    // [center_x + x * tile_width, center_x + (x + 1) * tile_width), and tile y
+    // covers [center_y - (y + 1) * tile_height, center_y - y * tile_height)
+    // (y increases upwards).
+    const i32 min_tile_x = floor_f32_to_i32(-center_x / tile_width_in_pixels);
+    const i32 max_tile_x =
+        floor_f32_to_i32((buffer->width - center_x) / tile_width_in_pixels) + 1;
+
+    const i32 min_tile_y =
+        floor_f32_to_i32((center_y - buffer->height) / tile_height_in_pixels);
+    const i32 max_tile_y =
+        floor_f32_to_i32(center_y / tile_height_in_pixels) + 1;
+
+    i32 tile_y = min_tile_y;
+    while (tile_y < max_tile_y)
+    {
+        // NOTE: Absolute tile indices wrap around (the world is toroidal).
+        const u32 abs_tile_y = camera_position.abs_tile_index_y + (u32)tile_y;
+        const u32 first_tile_y_in_chunk = GET_TILE_INDEX_IN_CHUNK(abs_tile_y);
+
+        i32 row_count = (i32)(TILE_CHUNK_DIM - first_tile_y_in_chunk);
+        if (row_count > max_tile_y - tile_y)
+        {
+            row_count = max_tile_y - tile_y;
+        }
+
+        i32 tile_x = min_tile_x;
+        while (tile_x < max_tile_x)
+        {
+            const u32 abs_tile_x =
+                camera_position.abs_tile_index_x + (u32)tile_x;
+            const u32 first_tile_x_in_chunk =
+                GET_TILE_INDEX_IN_CHUNK(abs_tile_x);
+
+            i32 column_count = (i32)(TILE_CHUNK_DIM - first_tile_x_in_chunk);
+            if (column_count > max_tile_x - tile_x)
+            {
+                column_count = max_tile_x - tile_x;
+            }
+
+            game_tile_chunk_slot_t *slot = game_find_tile_chunk_slot(
+                world, GET_CHUNK_INDEX_IN_WORLD(abs_tile_x),
+                GET_CHUNK_INDEX_IN_WORLD(abs_tile_y));
+
+            if (slot && slot->state == game_tile_chunk_state_loaded)
+            {
+                for (i32 row = 0; row < row_count; row++)
+                {
+                    const u32 tile_y_in_chunk =
+                        first_tile_y_in_chunk + (u32)row;
+                    const u8 *light_levels =
+                        &slot->light
+                             .levels[tile_y_in_chunk][first_tile_x_in_chunk];
+
+                    i32 span_start = 0;
+                    u32 span_tile_value =
+                        slot->tile_chunk.tiles[get_tile_index_in_chunk(
+                            first_tile_x_in_chunk, tile_y_in_chunk)];
+
+                    for (i32 column = 1; column <= column_count; column++)
+                    {
+                        const u32 tile_value =
+                            column < column_count
+                                ? slot->tile_chunk
+                                      .tiles[get_tile_index_in_chunk(
+                                          first_tile_x_in_chunk + (u32)column,
+                                          tile_y_in_chunk)]
+                                : INVALID_TILE_VALUE;
+
+                        if (column == column_count ||
+                            tile_value != span_tile_value ||
+                            light_levels[column] != light_levels[span_start])
+                        {
+                            game_render_tile_span(
+                                buffer, span_tile_value,
+                                light_levels[span_start], tile_x + span_start,
+                                tile_x + column, tile_y + row, center_x,
+                                center_y, tile_width_in_pixels,
+                                tile_height_in_pixels);
+
+                            span_start = column;
+                            span_tile_value = tile_value;
+                        }
+                    }
+                }
+            }
+
+            tile_x += column_count;
+        }
+
+        tile_y += row_count;
+    }
+}
+
+__declspec(dllexport) DEF_GAME_INIT_GLOBALS_FUNC(game_init_globals)
+{
+    game_init_blend_tables(&g_blend_tables);
+    game_init_sprites(&g_sprites);
 }
 
 __declspec(dllexport) DEF_GAME_UPDATE_AND_RENDER_FUNC(game_update_and_render)
 {
     ASSERT(game_offscreen_buffer);
     ASSERT(game_input);
+    ASSERT(game_sound_buffer);
     ASSERT(game_memory);
     ASSERT(platform_services);
 
+    // NOTE: The world's chunk pool lives in game state.
+    ASSERT(sizeof(game_state_t) <= game_memory->permanent_memory_block_size);
+
     game_state_t *game_state =
         (game_state_t *)game_memory->permanent_memory_block;
 
+    game_validate_state_layout(game_state, game_memory);
+
+    game_init_globals();
+
     if (!game_state->is_initialized)
     {
         game_state->pixels_per_meter = 100;
@@ -179,42 +583,44 @@ __declspec(dllexport) DEF_GAME_UPDATE_AND_RENDER_FUNC(game_update_and_render)
         game_state->game_world.tile_width = 1u;
         game_state->game_world.tile_height = 1u;
 
-        game_state->game_world.tile_chunk_count_x = 1;
-        game_state->game_world.tile_chunk_count_y = 1;
+        game_state->game_world.seed = GAME_WORLD_SEED;
+
+        game_init_audio(&game_state->audio);
+
+        game_load_save(game_state, platform_services);
 
         game_state->is_initialized = true;
     }
 
-    // clang-format off
-    // NOTE: The bottom left tile is considered as 0, 0.
-    // This means that the tiles in the tile chunk prefab are flipped.
-    game_tile_chunk_t tile_chunk_00 = {
-    .tiles = {
-            {1, 1, 1, 1,  1, 1, 1, 1,  1, 1, 1, 1,  1, 1, 1, 1, 1,    1, 1, 1, 1,  1, 1, 1, 1,  1, 1, 1, 1,  1, 1, 1, 1, 1},
-            {1, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0, 0,    0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0, 1},
-            {1, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0, 0,    0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0, 1},
-            {1, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0, 0,    0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0, 1},
-            {0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0, 0,    0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0, 1},
-            {1, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0, 0,    0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0, 1},
-            {1, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0, 0,    0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0, 1},
-            {1, 1, 1, 1,  1, 1, 1, 1,  0, 0, 0, 0,  1, 1, 1, 1, 0,    0, 1, 1, 1,  1, 1, 1, 1,  0, 1, 1, 1,  1, 1, 1, 1, 1},
-
-            {1, 1, 1, 1,  1, 1, 1, 1,  0, 0, 0, 0,  1, 1, 1, 1, 1,    1, 1, 1, 1,  1, 1, 1, 1,  0, 1, 1, 1,  1, 1, 1, 1, 1},
-            {1, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0, 1,    1, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0, 1},
-            {1, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0, 1,    1, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0, 1},
-            {1, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0, 1,    1, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0, 1},
-            {1, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0, 1,    0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0, 1},
-            {1, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0, 1,    1, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0, 1},
-            {1, 1, 1, 1,  1, 1, 1, 1,  1, 1, 1, 1,  1, 1, 1, 1, 1,    1, 1, 1, 1,  1, 1, 1, 1,  1, 1, 1, 1,  1, 1, 1, 1, 1}
-    },};
-    // clang-format on
+    const u32 player_chunk_x =
+        GET_CHUNK_INDEX_IN_WORLD(game_state->player_position.abs_tile_index_x);
+    const u32 player_chunk_y =
+        GET_CHUNK_INDEX_IN_WORLD(game_state->player_position.abs_tile_index_y);
 
-    // Clear screen.
-    game_render_rectangle(
-        game_offscreen_buffer, 0.0f, 0.0f, (f32)game_offscreen_buffer->width,
-        (f32)game_offscreen_buffer->height, 0.0f, 0.0f, 0.0f, 1.0f);
+    game_stream_tile_chunks(&game_state->game_world, player_chunk_x,
+                            player_chunk_y, platform_services);
+
+    game_update_nav(&game_state->nav, &game_state->game_world, player_chunk_x,
+                    player_chunk_y);
 
-    game_state->game_world.tile_chunks = &tile_chunk_00;
+    if (game_state->agent_count == 0)
+    {
+        game_spawn_agents(game_state);
+    }
+
+    // NOTE: The platform passes no framebuffer memory for frames that are not
+    // displayed (batch simulation, rollback re-simulation), in which case the
+    // game only simulates.
+    const b32 is_rendering = game_offscreen_buffer->framebuffer_memory != NULL;
+
+    // Clear screen.
+    if (is_rendering)
+    {
+        game_render_rectangle(game_offscreen_buffer, 0.0f, 0.0f,
+                              (f32)game_offscreen_buffer->width,
+                              (f32)game_offscreen_buffer->height, 0.0f, 0.0f,
+                              0.0f, 1.0f);
+    }
 
     // delta time in ms per frame.
     // Player movement speed is in meters per second.
@@ -228,21 +634,25 @@ __declspec(dllexport) DEF_GAME_UPDATE_AND_RENDER_FUNC(game_update_and_render)
     if (game_input->keyboard_state.key_w.is_key_down)
     {
         new_player_y += player_movement_speed;
+        game_state->player_facing_direction = game_nav_direction_north;
     }
 
     if (game_input->keyboard_state.key_s.is_key_down)
     {
         new_player_y -= player_movement_speed;
+        game_state->player_facing_direction = game_nav_direction_south;
     }
 
     if (game_input->keyboard_state.key_a.is_key_down)
     {
         new_player_x -= player_movement_speed;
+        game_state->player_facing_direction = game_nav_direction_west;
     }
 
     if (game_input->keyboard_state.key_d.is_key_down)
     {
         new_player_x += player_movement_speed;
+        game_state->player_facing_direction = game_nav_direction_east;
     }
 
     // Use the player sprite's bottom left / center / right point for collision
@@ -279,110 +689,154 @@ __declspec(dllexport) DEF_GAME_UPDATE_AND_RENDER_FUNC(game_update_and_render)
     game_world_position_t player_world_position_right =
         readjust_position(&game_state->game_world, player_right_rp);
 
-    b32 can_player_move = true;
-    if (!(is_tile_point_empty_in_world(&game_state->game_world,
-                                       player_world_position_center) &&
-          is_tile_point_empty_in_world(&game_state->game_world,
-                                       player_world_position_left) &&
-          is_tile_point_empty_in_world(&game_state->game_world,
-                                       player_world_position_right)))
-    {
-        can_player_move = false;
-    }
+    // NOTE: The check points are on one row, so the tiles from the left one
+    // to the right one (which include the center one) are tested at once.
+    ASSERT(player_world_position_left.abs_tile_index_y ==
+           player_world_position_right.abs_tile_index_y);
+
+    const u32 collision_tile_count =
+        player_world_position_right.abs_tile_index_x -
+        player_world_position_left.abs_tile_index_x + 1;
+    ASSERT(collision_tile_count <= 64);
+
+    const b32 can_player_move =
+        get_solid_tile_bits_in_world(
+            &game_state->game_world,
+            player_world_position_left.abs_tile_index_x,
+            player_world_position_left.abs_tile_index_y, collision_tile_count,
+            false) == 0;
 
     // Convert player coords to tile map coords.
     if (can_player_move)
     {
+        if (player_world_position_center.abs_tile_index_x !=
+                game_state->player_position.abs_tile_index_x ||
+            player_world_position_center.abs_tile_index_y !=
+                game_state->player_position.abs_tile_index_y)
+        {
+            game_play_sound(&game_state->audio, game_sound_id_footstep, 0.5f,
+                            0.0f, false);
+        }
+
         game_state->player_position = player_world_position_center;
     }
 
-    // NOTE: Player is always rendered right at the center of screen.
-    const f32 center_x = game_offscreen_buffer->width / 2.0f -
-                         game_state->pixels_per_meter *
-                             game_state->player_position.tile_rel_x *
-                             game_state->game_world.tile_width;
+    // Space toggles the wall on the tile the player is facing.
+    if (game_input->keyboard_state.key_space.is_key_down &&
+        game_input->keyboard_state.key_space.state_transition_count > 0 &&
+        game_state->player_facing_direction != game_nav_direction_none)
+    {
+        game_world_position_t facing_tile = game_state->player_position;
+        facing_tile.abs_tile_index_x +=
+            game_nav_get_direction_x(game_state->player_facing_direction);
+        facing_tile.abs_tile_index_y +=
+            game_nav_get_direction_y(game_state->player_facing_direction);
 
-    const f32 center_y = game_offscreen_buffer->height / 2.0f +
-                         game_state->pixels_per_meter *
-                             game_state->player_position.tile_rel_y *
-                             game_state->game_world.tile_height;
+        const u32 tile_value =
+            get_tile_value_in_world(&game_state->game_world, facing_tile);
 
-    for (i32 y = -7; y < 7; y++)
-    {
-        for (i32 x = -19; x < 19; x++)
+        if (tile_value != INVALID_TILE_VALUE)
         {
-            i32 tile_x = x + (i32)game_state->player_position.abs_tile_index_x;
-            i32 tile_y = y + (i32)game_state->player_position.abs_tile_index_y;
+            set_tile_value_in_world(&game_state->game_world, &game_state->nav,
+                                    &game_state->light, facing_tile,
+                                    tile_value == 0 ? 1 : 0);
 
-            f32 color = 0.0f;
+            game_play_sound(&game_state->audio, game_sound_id_toggle_tile,
+                            0.6f, 0.0f, false);
+        }
+    }
 
-            game_world_position_t tile_position = {
-                .abs_tile_index_x = tile_x,
-                .abs_tile_index_y = tile_y,
-            };
+    const u32 heard_agent_count =
+        game_update_agents(game_state, game_input->delta_time);
 
-            u32 current_tile_value =
-                get_tile_value_in_world(&game_state->game_world, tile_position);
+    game_update_save(game_state, game_input->delta_time, platform_services);
 
-            if (current_tile_value == INVALID_TILE_VALUE)
-            {
-                continue;
-            }
+    // The ambience swells while agents are close to the player.
+    if (game_state->audio.ambience_playing_sound_index !=
+        GAME_INVALID_PLAYING_SOUND)
+    {
+        const f32 ambience_volume =
+            heard_agent_count > 4 ? 0.5f : 0.3f + 0.05f * heard_agent_count;
 
-            if (current_tile_value == 1)
-            {
-                color = 1.0f;
-            }
+        game_set_playing_sound_volume(
+            &game_state->audio, game_state->audio.ambience_playing_sound_index,
+            ambience_volume, 0.0f);
+    }
 
-            // Highlight player current tile position.
-            if (x == 0 && y == 0)
-            {
-                color = 0.5f;
-            }
+    game_mix_sounds(&game_state->audio, game_sound_buffer);
 
-            // NOTE: These are in framebuffer coords (top left corner is
-            // origin).
-            f32 fb_tile_left_x =
-                (f32)(center_x + (x * (i32)game_state->game_world.tile_width *
-                                  (i32)game_state->pixels_per_meter));
+    // NOTE: Done after the player moved and tiles changed, so the light
+    // matches what is rendered this frame.
+    game_update_lighting(&game_state->light, &game_state->game_world,
+                         game_state->player_position.abs_tile_index_x,
+                         game_state->player_position.abs_tile_index_y,
+                         player_chunk_x, player_chunk_y);
 
-            f32 fb_tile_right_x =
-                fb_tile_left_x + ((i32)game_state->pixels_per_meter *
-                                  (i32)game_state->game_world.tile_width);
+    game_update_memory_stats(game_state, game_memory, game_input->delta_time,
+                             platform_services);
 
-            f32 fb_tile_bottom_y =
-                (f32)(center_y -
-                      ((y) * (i32)game_state->game_world.tile_height *
-                       (i32)game_state->pixels_per_meter));
+    if (!is_rendering)
+    {
+        return;
+    }
 
-            f32 fb_tile_top_y =
-                fb_tile_bottom_y - ((i32)game_state->pixels_per_meter *
-                                    game_state->game_world.tile_height);
+    // NOTE: The platform may render at a reduced internal resolution, in which
+    // case everything is scaled down so that the visible part of the world
+    // stays the same.
+    const f32 pixels_per_meter =
+        game_state->pixels_per_meter * game_offscreen_buffer->render_scale;
 
-            game_render_rectangle(game_offscreen_buffer, fb_tile_left_x,
-                                  fb_tile_top_y, fb_tile_right_x,
-                                  fb_tile_bottom_y, color, color, color, 1.0f);
-        }
+    // NOTE: Player is always rendered right at the center of screen.
+    const f32 center_x = game_offscreen_buffer->width / 2.0f -
+                         pixels_per_meter *
+                             game_state->player_position.tile_rel_x *
+                             game_state->game_world.tile_width;
+
+    const f32 center_y = game_offscreen_buffer->height / 2.0f +
+                         pixels_per_meter *
+                             game_state->player_position.tile_rel_y *
+                             game_state->game_world.tile_height;
+
+    game_render_tiles(game_offscreen_buffer, &game_state->game_world,
+                      game_state->player_position, center_x, center_y,
+                      pixels_per_meter);
+
+    // Highlight player current tile position.
+    if (get_tile_value_in_world(&game_state->game_world,
+                                game_state->player_position) !=
+        INVALID_TILE_VALUE)
+    {
+        game_render_rectangle(
+            game_offscreen_buffer, center_x,
+            center_y - pixels_per_meter * game_state->game_world.tile_height,
+            center_x + pixels_per_meter * game_state->game_world.tile_width,
+            center_y, 1.0f, 1.0f, 1.0f, 0.35f);
     }
 
+    game_render_agents(game_offscreen_buffer, game_state, center_x, center_y,
+                       pixels_per_meter);
+
     // Render the player.
     f32 fb_player_left_x =
         center_x +
-        game_state->pixels_per_meter *
+        pixels_per_meter *
             (-game_state->player_width / 2.0f +
              game_state->player_position.tile_rel_x * game_state->player_width);
 
-    f32 fb_player_right_x = fb_player_left_x + (game_state->pixels_per_meter *
+    f32 fb_player_right_x = fb_player_left_x + (pixels_per_meter *
                                                 game_state->player_width);
 
     f32 fb_player_bottom_y = center_y - game_state->player_position.tile_rel_y *
                                             game_state->player_height *
-                                            game_state->pixels_per_meter;
+                                            pixels_per_meter;
 
-    f32 fb_player_top_y = fb_player_bottom_y - (game_state->pixels_per_meter *
+    f32 fb_player_top_y = fb_player_bottom_y - (pixels_per_meter *
                                                 game_state->player_height);
 
-    game_render_rectangle(game_offscreen_buffer, fb_player_left_x,
-                          fb_player_top_y, fb_player_right_x,
-                          fb_player_bottom_y, 0.1f, 0.2f, 1.0f, 1.0f);
+    // NOTE: The player is drawn at its exact (sub pixel) position, so it moves
+    // smoothly.
+    game_render_sprite(game_offscreen_buffer, &g_sprites.player,
+                       fb_player_left_x, fb_player_top_y,
+                       fb_player_right_x - fb_player_left_x, 0.0f, 0.0f,
+                       fb_player_bottom_y - fb_player_top_y);
 }
@@ -5,12 +5,34 @@
 
 typedef struct
 {
+    // NOTE: NULL when the frame is not displayed, the game then skips
+    // rendering.
     u32 *framebuffer_memory;
 
     u32 width;
     u32 height;
+
+    // Ratio of the (internal) render resolution to the full resolution. Less
+    // than 1 when the platform lowers resolution to stay within frame budget.
+    f32 render_scale;
 } game_offscreen_buffer_t;
 
+// Sound output.
+// Every frame, the game mixes sample_count stereo samples (interleaved left /
+// right, 16 bit) into samples. The platform chooses sample_count so that the
+// amount of audio queued for the device stays at its target latency.
+#define GAME_SOUND_SAMPLES_PER_SECOND 48000u
+#define GAME_MAX_SOUND_SAMPLES_PER_FRAME 4096u
+
+typedef struct
+{
+    i16 *samples;
+
+    // NOTE: Always a multiple of 4 (the mixer works on 4 samples at a time).
+    u32 sample_count;
+    u32 samples_per_second;
+} game_sound_output_buffer_t;
+
 typedef struct
 {
     b32 is_key_down;
@@ -23,12 +45,50 @@ typedef struct
     game_key_state_t key_a;
     game_key_state_t key_s;
     game_key_state_t key_d;
+    game_key_state_t key_space;
 } game_keyboard_state_t;
 
+// Key transitions, in the order they happened during the frame.
+// Timestamps are in platform counts (timestamp_frequency per second), the
+// latency of a transition when the game gets it is
+// (sample_timestamp - timestamp) / timestamp_frequency.
+// NOTE: Inputs that do not come from the keyboard (scripted players, rollback
+// predictions) have no events, and all timestamps are 0.
+#define GAME_MAX_INPUT_EVENTS 16u
+
+typedef enum
+{
+    game_key_w = 0,
+    game_key_a = 1,
+    game_key_s = 2,
+    game_key_d = 3,
+    game_key_space = 4,
+    game_key_count = 5,
+} game_key_t;
+
+typedef struct
+{
+    u64 timestamp;
+    u32 key;
+    b32 is_key_down;
+} game_input_event_t;
+
+// NOTE: Inputs are recorded and compared as raw bytes, so the layout must not
+// have padding.
 typedef struct
 {
     game_keyboard_state_t keyboard_state;
     f32 delta_time;
+
+    // Transitions past GAME_MAX_INPUT_EVENTS are not in the list (but are in
+    // keyboard_state).
+    u32 event_count;
+
+    // When the platform handed the input to the game.
+    u64 sample_timestamp;
+    u64 timestamp_frequency;
+
+    game_input_event_t events[GAME_MAX_INPUT_EVENTS];
 } game_input_t;
 
 // Tile chunk related information.
@@ -37,7 +97,7 @@ typedef struct
 // NOTE: The absolute tile index consist of 2 parts : The lower 8 bits
 // constitute the index of tile within the chunk, while the higher 24 bits are
 // the index of chunk in the world.
-#define GET_CHUNK_INDEX_IN_WORLD(x) (((x) & 0xffffff00) > 0xff)
+#define GET_CHUNK_INDEX_IN_WORLD(x) (((x) & 0xffffff00) >> 8)
 #define GET_TILE_INDEX_IN_CHUNK(x) ((x) & 0x000000ff)
 
 #define SET_CHUNK_INDEX(tile_pos, chunk_index)                                 \
@@ -48,23 +108,453 @@ typedef struct
 
 #define INVALID_TILE_VALUE 0xffffffff
 
+// Layout of a chunk's tiles in memory, selected at build time (e.g with
+// /DGAME_TILE_CHUNK_LAYOUT=GAME_TILE_CHUNK_LAYOUT_MORTON) :
+// Row major : tile (x, y) is at y * TILE_CHUNK_DIM + x, so rows are
+// contiguous, and vertical neighbours are a row (1KB) apart.
+// Morton (Z-order) : the bits of x and y are interleaved, so every aligned
+// 2^n x 2^n block of tiles is contiguous, and most neighbours (in either
+// direction) are on the same cache line, at the cost of rows being scattered.
+#define GAME_TILE_CHUNK_LAYOUT_ROW_MAJOR 0
+#define GAME_TILE_CHUNK_LAYOUT_MORTON 1
+
+#if !defined(GAME_TILE_CHUNK_LAYOUT)
+#define GAME_TILE_CHUNK_LAYOUT GAME_TILE_CHUNK_LAYOUT_ROW_MAJOR
+#endif
+
+#define TILE_CHUNK_SOLID_WORDS_PER_ROW (TILE_CHUNK_DIM / 64)
+
 typedef struct
 {
-    u32 tiles[TILE_CHUNK_DIM][TILE_CHUNK_DIM];
+    // NOTE: Indexed with get_tile_index_in_chunk.
+    u32 tiles[TILE_CHUNK_DIM * TILE_CHUNK_DIM];
+
+    // Derived from the tiles, and kept in sync with them : bit (x % 64) of
+    // solid_bits[y][x / 64] is set if tile (x, y) is not empty. See
+    // game_collision.c.
+    u64 solid_bits[TILE_CHUNK_DIM][TILE_CHUNK_SOLID_WORDS_PER_ROW];
 } game_tile_chunk_t;
 
+inline u32 get_tile_index_in_chunk_row_major(const u32 tile_index_x,
+                                             const u32 tile_index_y)
+{
+    return tile_index_y * TILE_CHUNK_DIM + tile_index_x;
+}
+
+// Spreads the (8) bits of value to the even bits of the result.
+// NOTE: A few shifts and masks, rather than PDEP (which not every x64 cpu
+// has), or a table (which would have to be built before chunks are generated
+// on worker threads).
+inline u32 spread_tile_index_bits(u32 value)
+{
+    value = (value | (value << 4)) & 0x0f0fu;
+    value = (value | (value << 2)) & 0x3333u;
+    value = (value | (value << 1)) & 0x5555u;
+
+    return value;
+}
+
+inline u32 get_tile_index_in_chunk_morton(const u32 tile_index_x,
+                                          const u32 tile_index_y)
+{
+    return spread_tile_index_bits(tile_index_x) |
+           (spread_tile_index_bits(tile_index_y) << 1);
+}
+
+// NOTE: Tile indices must be within the chunk (i.e less than TILE_CHUNK_DIM).
+inline u32 get_tile_index_in_chunk(const u32 tile_index_x,
+                                   const u32 tile_index_y)
+{
+#if GAME_TILE_CHUNK_LAYOUT == GAME_TILE_CHUNK_LAYOUT_MORTON
+    return get_tile_index_in_chunk_morton(tile_index_x, tile_index_y);
+#else
+    return get_tile_index_in_chunk_row_major(tile_index_x, tile_index_y);
+#endif
+}
+
+// Chunk indices are 24 bits, and wrap around (the world is toroidal).
+#define TILE_CHUNK_INDEX_MASK 0x00ffffffu
+
+// World generation.
+// Tile chunks are generated on demand (from the world seed) as the player
+// approaches them, and live in a fixed pool of chunk slots. Chunks far away
+// from the player are evicted to make room for new ones.
+// NOTE: The chunk pool must hold all chunks within the load radius (and a few
+// more, so that chunks can be requested before the old ones are evicted).
+#define GAME_MAX_LOADED_TILE_CHUNKS 32u
+
+#define GAME_WORLD_SEED 0x2545f491u
+
+// Chunks within the load radius (in chunks) of the player's chunk are
+// generated in the background, the ones within the required radius must be
+// generated before the frame can be simulated and rendered.
+#define GAME_TILE_CHUNK_LOAD_RADIUS 2
+#define GAME_TILE_CHUNK_REQUIRED_RADIUS 1
+
+typedef enum
+{
+    game_tile_chunk_state_unloaded = 0,
+    // Queued for (or being) generated on a worker thread.
+    game_tile_chunk_state_queued = 1,
+    // Generated, but not yet published to the game thread.
+    game_tile_chunk_state_generated = 2,
+    game_tile_chunk_state_loaded = 3,
+} game_tile_chunk_state_t;
+
+// Navigation.
+// Each tile chunk is divided into clusters of GAME_NAV_CLUSTER_DIM x
+// GAME_NAV_CLUSTER_DIM tiles. The walkable tiles on a cluster's border that
+// connect to the neighbouring cluster are grouped into portals, with one node
+// per portal on either side. Each cluster stores the path length between all
+// of its nodes, so that long range searches run over the (much smaller) node
+// graph, and only have to look at individual tiles within a single cluster.
+// NOTE: Cluster sides are tested as bitmaps (in a u64), so the cluster
+// dimension must be less than 64.
+#define GAME_NAV_CLUSTER_DIM 32u
+#define GAME_NAV_CLUSTERS_PER_CHUNK_DIM (TILE_CHUNK_DIM / GAME_NAV_CLUSTER_DIM)
+#define GAME_NAV_CLUSTERS_PER_CHUNK                                            \
+    (GAME_NAV_CLUSTERS_PER_CHUNK_DIM * GAME_NAV_CLUSTERS_PER_CHUNK_DIM)
+
+#define GAME_NAV_MAX_CLUSTER_NODES 16u
+#define GAME_NAV_UNREACHABLE 0xffffu
+
+// Movement is 4 connected.
+typedef enum
+{
+    game_nav_direction_none = 0,
+    game_nav_direction_west = 1,
+    game_nav_direction_east = 2,
+    game_nav_direction_south = 3,
+    game_nav_direction_north = 4,
+} game_nav_direction_t;
+
+typedef struct
+{
+    u8 node_count;
+
+    // Node positions are relative to the cluster's bottom left tile. The
+    // direction is the one that crosses into the neighbouring cluster.
+    u8 node_x[GAME_NAV_MAX_CLUSTER_NODES];
+    u8 node_y[GAME_NAV_MAX_CLUSTER_NODES];
+    u8 node_directions[GAME_NAV_MAX_CLUSTER_NODES];
+
+    // Path length (in tiles) between each pair of nodes, without leaving the
+    // cluster.
+    u16 node_distances[GAME_NAV_MAX_CLUSTER_NODES][GAME_NAV_MAX_CLUSTER_NODES];
+} game_nav_cluster_t;
+
+typedef struct
+{
+    // Bit i is set if cluster i has to be rebuilt before it can be used (its
+    // tiles, or the tiles bordering it changed).
+    u64 dirty_cluster_mask;
+
+    // Bit per direction (1 << game_nav_direction_t), set if the neighbouring
+    // chunk in that direction was loaded when the border clusters were built.
+    u32 loaded_neighbor_mask;
+
+    game_nav_cluster_t clusters[GAME_NAV_CLUSTERS_PER_CHUNK];
+} game_nav_chunk_t;
+
+// Lighting.
+// Every tile has a light level. Light spreads from light sources (lamp tiles,
+// and a light carried by the player) through non solid tiles, losing one level
+// per tile (4 connected), and a tile's level is the brightest light reaching
+// it. Levels are kept up to date incrementally : only tiles around a changed
+// tile or a moved light are relit, and a chunk's levels are built once when it
+// is loaded.
+#define GAME_MAX_LIGHT_LEVEL 15u
+#define GAME_LAMP_LIGHT_LEVEL 15u
+#define GAME_PLAYER_LIGHT_LEVEL 10u
+
+// Tile values.
+#define GAME_TILE_EMPTY 0u
+#define GAME_TILE_WALL 1u
+#define GAME_TILE_LAMP 2u
+
 typedef struct
 {
-    game_tile_chunk_t *tile_chunks;
+    // Set when the chunk is (re)loaded, until its levels are built.
+    b32 needs_build;
 
-    u32 tile_chunk_count_x;
-    u32 tile_chunk_count_y;
+    u8 levels[TILE_CHUNK_DIM][TILE_CHUNK_DIM];
+} game_light_chunk_t;
+
+typedef struct
+{
+    // NOTE: Only the worker thread generating the chunk writes to a queued
+    // slot. It hands the slot back by atomically setting the state to
+    // generated, after which only the game thread touches it.
+    volatile u32 state;
+
+    u32 chunk_x;
+    u32 chunk_y;
+
+    u32 seed;
+
+    // NOTE: Only used by the game thread, once the chunk is loaded.
+    game_nav_chunk_t nav;
+    game_light_chunk_t light;
+
+    game_tile_chunk_t tile_chunk;
+} game_tile_chunk_slot_t;
+
+// Tile edits.
+// Chunks are generated from the seed again whenever they are loaded, so tiles
+// changed by the game are kept as edits (per chunk), which are applied on top
+// of the generated tiles. A chunk's edits form a list in the edit pool.
+// Edits are never removed (changing a tile back updates its edit).
+#define GAME_MAX_EDITED_TILE_CHUNKS 256u
+#define GAME_MAX_TILE_EDITS 65536u
+#define GAME_INVALID_TILE_EDIT 0xffffffffu
+
+typedef struct
+{
+    // GAME_INVALID_TILE_EDIT for the chunk's last edit.
+    u32 next_edit_index;
+
+    // Index of the tile in the chunk (y * TILE_CHUNK_DIM + x).
+    u32 tile_index;
+    u32 tile_value;
+} game_tile_edit_t;
+
+typedef struct
+{
+    u32 chunk_x;
+    u32 chunk_y;
+
+    u32 first_edit_index;
+    u32 edit_count;
+
+    // Set when the chunk's edits changed since they were last saved.
+    b32 is_dirty;
+} game_edited_tile_chunk_t;
+
+typedef struct
+{
+    u32 edited_chunk_count;
+    game_edited_tile_chunk_t edited_chunks[GAME_MAX_EDITED_TILE_CHUNKS];
+
+    u32 edit_count;
+    game_tile_edit_t edits[GAME_MAX_TILE_EDITS];
+
+    // Edits that did not fit in the pool (the tiles are generated again when
+    // their chunk is reloaded).
+    u32 dropped_edit_count;
+} game_tile_edits_t;
+
+typedef struct
+{
+    u32 seed;
+
+    game_tile_chunk_slot_t tile_chunk_slots[GAME_MAX_LOADED_TILE_CHUNKS];
+
+    game_tile_edits_t tile_edits;
 
     // Tile width and height are in meters.
     u32 tile_width;
     u32 tile_height;
+
+    // World generation stats.
+    u64 generated_tile_chunk_count;
+
+    // Number of frames the game thread had to wait for required chunks.
+    u32 tile_chunk_wait_count;
+
+    // Chunk requests that found no free slot (they are retried next frame).
+    u32 tile_chunk_slot_miss_count;
 } game_world_t;
 
+// Flow fields.
+// A flow field stores, for every tile in a window centered on a goal, the
+// direction to move in to get to the goal along a shortest path. Any number of
+// agents heading for the same goal share one field. Fields are cached, and
+// rebuilt when tiles within their window change.
+#define GAME_FLOW_FIELD_DIM 128u
+#define GAME_MAX_FLOW_FIELDS 4u
+
+typedef struct
+{
+    b32 is_valid;
+
+    // Absolute tile indices of the goal.
+    u32 goal_x;
+    u32 goal_y;
+
+    // Fields built while some of their tiles were not loaded are rebuilt
+    // once more chunks are loaded.
+    b32 has_unloaded_tiles;
+    u64 built_tile_chunk_count;
+
+    u64 last_used_frame_index;
+
+    // game_nav_direction_t per tile, relative to the goal tile minus half the
+    // field dimension.
+    u8 directions[GAME_FLOW_FIELD_DIM][GAME_FLOW_FIELD_DIM];
+} game_flow_field_t;
+
+#define GAME_NAV_MAX_NODES                                                     \
+    (GAME_MAX_LOADED_TILE_CHUNKS * GAME_NAV_CLUSTERS_PER_CHUNK *               \
+     GAME_NAV_MAX_CLUSTER_NODES)
+
+// The start and goal of a search are temporary nodes, after the real ones.
+#define GAME_NAV_SEARCH_NODE_COUNT (GAME_NAV_MAX_NODES + 2)
+
+// Per node state of the (A*) search over the node graph. Node state is only
+// valid if its search id matches the current search, so nothing has to be
+// cleared between searches.
+typedef struct
+{
+    u32 search_id;
+
+    u32 node_search_ids[GAME_NAV_SEARCH_NODE_COUNT];
+    u32 node_costs[GAME_NAV_SEARCH_NODE_COUNT];
+    u32 node_estimates[GAME_NAV_SEARCH_NODE_COUNT];
+    u32 node_parents[GAME_NAV_SEARCH_NODE_COUNT];
+    u32 node_heap_indices[GAME_NAV_SEARCH_NODE_COUNT];
+
+    // Binary min heap (by estimate) of open nodes.
+    u32 open_heap[GAME_NAV_SEARCH_NODE_COUNT];
+    u32 open_count;
+} game_nav_search_t;
+
+typedef struct
+{
+    u64 frame_index;
+
+    game_nav_search_t search;
+
+    game_flow_field_t flow_fields[GAME_MAX_FLOW_FIELDS];
+    u16 flow_field_queue[GAME_FLOW_FIELD_DIM * GAME_FLOW_FIELD_DIM];
+
+    // Tile values of the field being built, read at once before the search.
+    u32 flow_field_tiles[GAME_FLOW_FIELD_DIM * GAME_FLOW_FIELD_DIM];
+
+    // Stats.
+    u32 rebuilt_cluster_count;
+    u32 path_search_count;
+    u32 flow_field_build_count;
+} game_nav_t;
+
+// Relighting is done with two breadth first passes over queued tiles : tiles
+// whose light may have gone away are darkened first (and the light sources
+// bordering the darkened area are queued), then light spreads again from the
+// queued tiles.
+#define GAME_LIGHT_QUEUE_SIZE 16384u
+
+typedef struct
+{
+    u32 tile_x;
+    u32 tile_y;
+
+    // Level the tile had before it was darkened (darkening pass only).
+    u32 level;
+} game_light_queue_entry_t;
+
+typedef struct
+{
+    b32 has_player_light;
+    u32 player_light_x;
+    u32 player_light_y;
+
+    // Ring buffers (counts are not wrapped).
+    game_light_queue_entry_t darken_queue[GAME_LIGHT_QUEUE_SIZE];
+    u32 darken_queue_read_count;
+    u32 darken_queue_write_count;
+
+    game_light_queue_entry_t spread_queue[GAME_LIGHT_QUEUE_SIZE];
+    u32 spread_queue_read_count;
+    u32 spread_queue_write_count;
+
+    // Stats.
+    u32 built_chunk_count;
+    u32 relit_tile_count;
+    u32 queued_entry_count;
+    u32 dropped_queue_entry_count;
+
+    // Most entries in the queues at once during the last update.
+    u32 peak_queued_entry_count;
+} game_light_t;
+
+// AI agents, which chase the player.
+#define GAME_MAX_AGENTS 128u
+#define GAME_AGENT_MAX_PATH_STEPS 32u
+
+typedef struct
+{
+    // Absolute tile indices of the tile the agent is on (or is leaving).
+    u32 tile_x;
+    u32 tile_y;
+
+    // Step to the neighbouring tile in progress (progress is in 0..1).
+    u8 step_direction;
+    f32 step_progress;
+
+    // Path to follow when outside of the goal's flow field.
+    u8 path_steps[GAME_AGENT_MAX_PATH_STEPS];
+    u32 path_step_count;
+    u32 path_step_index;
+} game_agent_t;
+
+// Audio.
+// Sounds are mono 16 bit samples, synthesized when the game is initialized.
+// Playing sounds are panned into stereo with per channel volumes.
+typedef enum
+{
+    game_sound_id_footstep = 0,
+    game_sound_id_toggle_tile = 1,
+    game_sound_id_agent_step = 2,
+    game_sound_id_ambience = 3,
+    game_sound_id_count = 4,
+} game_sound_id_t;
+
+#define GAME_MAX_SOUND_SAMPLES 65536u
+#define GAME_MAX_PLAYING_SOUNDS 64u
+#define GAME_INVALID_PLAYING_SOUND 0xffffffffu
+
+typedef struct
+{
+    // Range in game_audio_t's sound_samples.
+    // NOTE: sample_count is a multiple of 4 (sounds are padded with silence).
+    u32 first_sample_index;
+    u32 sample_count;
+} game_sound_t;
+
+typedef struct
+{
+    b32 is_active;
+    b32 is_looping;
+
+    u32 sound_id;
+    u32 sample_index;
+
+    // Volume changes are ramped over a few ms to avoid clicks. The volume
+    // moves from volume to target_volume over the next ramp_sample_count
+    // samples.
+    f32 volume[2];
+    f32 target_volume[2];
+    u32 ramp_sample_count;
+} game_playing_sound_t;
+
+typedef struct
+{
+    game_sound_t sounds[game_sound_id_count];
+
+    u32 sound_sample_count;
+    i16 sound_samples[GAME_MAX_SOUND_SAMPLES];
+
+    game_playing_sound_t playing_sounds[GAME_MAX_PLAYING_SOUNDS];
+
+    u32 ambience_playing_sound_index;
+
+    // Per channel accumulation buffers.
+    f32 mix_buffer[2][GAME_MAX_SOUND_SAMPLES_PER_FRAME];
+
+    // Stats.
+    u32 played_sound_count;
+    u32 dropped_sound_count;
+} game_audio_t;
+
 typedef struct
 {
     // The absolute tile index into the (toroidal) world, which is unbounded
@@ -76,8 +566,177 @@ typedef struct
     f32 tile_rel_y;
 } game_world_position_t;
 
+// Save games.
+// A save file is a header followed by a journal of records, each with a
+// checksum of its payload. A chunk record holds all of the edits of a tile
+// chunk, and an entity record holds the player and the agents. Saves append
+// the chunks edited since the last save and the entities, and later records
+// replace earlier ones when the journal is loaded. Once the journal grows too
+// large, it is compacted : the file is rewritten with one record per edited
+// chunk.
+// Writes are done on a worker thread, so saving never stalls a frame.
+#define GAME_SAVE_FILE_NAME "prism_save.bin"
+#define GAME_SAVE_MAGIC 0x56415350u
+#define GAME_SAVE_VERSION 1u
+
+// Game time between saves.
+#define GAME_SAVE_INTERVAL_MS 5000.0f
+
+// The journal is compacted once it is larger than twice its size after the
+// last compaction, plus this much.
+#define GAME_SAVE_COMPACTION_SLACK KILOBYTE(64)
+
+typedef struct
+{
+    u32 magic;
+    u32 version;
+    u32 seed;
+    u32 reserved;
+} game_save_file_header_t;
+
+typedef enum
+{
+    game_save_record_type_chunk = 1,
+    game_save_record_type_entities = 2,
+} game_save_record_type_t;
+
 typedef struct
 {
+    u32 type;
+
+    // Size of the payload (which follows the header).
+    u32 size;
+    u64 checksum;
+} game_save_record_header_t;
+
+// Followed by edit_count game_save_tile_edit_t.
+typedef struct
+{
+    u32 chunk_x;
+    u32 chunk_y;
+    u32 edit_count;
+    u32 reserved;
+} game_save_chunk_record_t;
+
+typedef struct
+{
+    u32 tile_index;
+    u32 tile_value;
+} game_save_tile_edit_t;
+
+typedef struct
+{
+    game_world_position_t player_position;
+    u32 player_facing_direction;
+
+    u32 agent_count;
+    game_agent_t agents[GAME_MAX_AGENTS];
+} game_save_entity_record_t;
+
+// Large enough for a compacted journal (with every edit in the pool).
+#define GAME_SAVE_BUFFER_SIZE                                                  \
+    (sizeof(game_save_file_header_t) +                                         \
+     GAME_MAX_EDITED_TILE_CHUNKS * (sizeof(game_save_record_header_t) +        \
+                                    sizeof(game_save_chunk_record_t)) +        \
+     GAME_MAX_TILE_EDITS * sizeof(game_save_tile_edit_t) +                     \
+     sizeof(game_save_record_header_t) + sizeof(game_save_entity_record_t))
+
+typedef struct
+{
+    // Size of the save file once the writes queued so far are done.
+    u64 journal_size;
+
+    // Size of the save file right after it was last compacted.
+    u64 compacted_size;
+
+    f32 ms_since_save;
+
+    // Stats.
+    u32 save_count;
+    u32 compaction_count;
+    u32 skipped_save_count;
+    u32 failed_write_count;
+    u32 loaded_record_count;
+    u32 corrupt_record_count;
+} game_save_t;
+
+// Memory accounting.
+// Game memory is made up of fixed size pools (chunk slots, tile edits, light
+// queues, ...). Each pool is accounted for as a region : its capacity, how much
+// of it is used (at the end of the last frame, the most during the last frame,
+// and the most ever), how many allocations were made from it, and how many did
+// not fit. Regions are sampled once per frame from the counts their subsystem
+// keeps anyway, so accounting is cheap enough to leave on in release builds.
+// A region that gets close to full (or overflows) is reported right away, and
+// all regions are dumped to GAME_MEMORY_STATS_FILE_NAME periodically.
+#define GAME_MEMORY_STATS_FILE_NAME "prism_memory_stats.txt"
+#define GAME_MEMORY_STATS_DUMP_INTERVAL_MS 10000.0f
+
+// Regions are reported as nearly full above this much of their capacity.
+#define GAME_MEMORY_WARNING_PERCENT 90u
+
+typedef enum
+{
+    game_memory_region_id_permanent_block = 0,
+    game_memory_region_id_tile_chunks = 1,
+    game_memory_region_id_tile_edits = 2,
+    game_memory_region_id_light_queues = 3,
+    game_memory_region_id_flow_fields = 4,
+    game_memory_region_id_agents = 5,
+    game_memory_region_id_playing_sounds = 6,
+    game_memory_region_id_save_buffer = 7,
+    game_memory_region_id_count = 8,
+} game_memory_region_id_t;
+
+typedef struct
+{
+    // In bytes.
+    u64 capacity;
+    u64 used;
+    u64 frame_high_water;
+    u64 high_water;
+
+    u32 frame_allocation_count;
+    u64 allocation_count;
+    u64 overflow_count;
+
+    b32 is_near_full;
+} game_memory_region_t;
+
+typedef struct
+{
+    game_memory_region_t regions[game_memory_region_id_count];
+
+    // The subsystem counters at the last sample, allocation and overflow
+    // counts are the differences.
+    u64 last_allocation_counters[game_memory_region_id_count];
+    u64 last_overflow_counters[game_memory_region_id_count];
+
+    f32 ms_since_dump;
+
+    // Stats.
+    u32 warning_count;
+    u32 dump_count;
+} game_memory_stats_t;
+
+// The layout stamp lets the game detect that game memory was written by a
+// build with a different game_state_t layout (after a hot reload, or when
+// loading a snapshot / recording). Bump GAME_STATE_LAYOUT_VERSION whenever the
+// meaning of game state changes without its size changing.
+#define GAME_STATE_LAYOUT_VERSION 3u
+
+// NOTE: This must remain the first member of game_state_t, and must never
+// change layout.
+typedef struct
+{
+    u32 version;
+    u32 size;
+} game_state_layout_stamp_t;
+
+typedef struct
+{
+    game_state_layout_stamp_t layout_stamp;
+
     b32 is_initialized;
 
     game_world_position_t player_position;
@@ -89,8 +748,25 @@ typedef struct
     // The number of pixels that makes up a meter.
     u32 pixels_per_meter;
 
+    // Direction of the player's last move (game_nav_direction_t).
+    u32 player_facing_direction;
+
     game_world_t game_world;
 
+    game_nav_t nav;
+
+    game_light_t light;
+
+    game_save_t save;
+
+    game_memory_stats_t memory_stats;
+
+    u32 agent_count;
+    u32 next_agent_to_plan;
+    game_agent_t agents[GAME_MAX_AGENTS];
+
+    game_audio_t audio;
+
 } game_state_t;
 
 typedef struct
@@ -100,7 +776,8 @@ typedef struct
 } game_memory_t;
 
 // Interfaces provided by the platform to the game.
-#define DEF_PLATFORM_READ_FILE_FUNC(name) u8 *name(const char *file_name)
+#define DEF_PLATFORM_READ_FILE_FUNC(name)                                      \
+    u8 *name(const char *file_name, u64 *const restrict out_file_size)
 typedef DEF_PLATFORM_READ_FILE_FUNC(platform_read_file_t);
 
 #define DEF_PLATFORM_CLOSE_FILE_FUNC(name) void name(u8 *file_buffer)
@@ -110,19 +787,86 @@ typedef DEF_PLATFORM_CLOSE_FILE_FUNC(platform_close_file_t);
     b32 name(const char *string, const char *file_name)
 typedef DEF_PLATFORM_WRITE_TO_FILE_FUNC(platform_write_to_file_t);
 
+// Writes data at offset into the file, and truncates the file right after it.
+// With an offset of 0, the file is replaced atomically (a crash leaves either
+// the old or the new file). Can be called from worker threads.
+#define DEF_PLATFORM_WRITE_FILE_AT_OFFSET_FUNC(name)                           \
+    b32 name(const char *file_name, const void *data, u64 data_size,           \
+             u64 offset)
+typedef DEF_PLATFORM_WRITE_FILE_AT_OFFSET_FUNC(
+    platform_write_file_at_offset_t);
+
+// Debug output (e.g. the debugger's output window).
+#define DEF_PLATFORM_DEBUG_PRINT_FUNC(name) void name(const char *string)
+typedef DEF_PLATFORM_DEBUG_PRINT_FUNC(platform_debug_print_t);
+
+// Work queue, used by the game to run jobs on the platform's worker threads.
+// Jobs are added by the game thread only. The platform must not call into the
+// game (or restore game memory) while jobs are pending, so it completes all
+// work before doing so.
+// Jobs that only do file I/O (and do not touch game memory) go to a separate
+// queue, which the platform only completes before unloading the game, so that
+// a slow disk does not stall checkpoints.
+typedef struct platform_work_queue_t platform_work_queue_t;
+
+#define DEF_PLATFORM_WORK_QUEUE_CALLBACK(name)                                 \
+    void name(platform_work_queue_t *const restrict work_queue, void *data)
+typedef DEF_PLATFORM_WORK_QUEUE_CALLBACK(platform_work_queue_callback_t);
+
+#define DEF_PLATFORM_ADD_WORK_QUEUE_ENTRY_FUNC(name)                           \
+    void name(platform_work_queue_t *const restrict work_queue,                \
+              platform_work_queue_callback_t *callback, void *data)
+typedef DEF_PLATFORM_ADD_WORK_QUEUE_ENTRY_FUNC(platform_add_work_queue_entry_t);
+
+// Blocks until all jobs are done (the calling thread runs jobs as well).
+#define DEF_PLATFORM_COMPLETE_ALL_WORK_FUNC(name)                              \
+    void name(platform_work_queue_t *const restrict work_queue)
+typedef DEF_PLATFORM_COMPLETE_ALL_WORK_FUNC(platform_complete_all_work_t);
+
+// Runs the next pending job (if any) on the calling thread, so it can help
+// while it waits for specific jobs. Returns false if no job was pending.
+#define DEF_PLATFORM_DO_NEXT_WORK_QUEUE_ENTRY_FUNC(name)                       \
+    b32 name(platform_work_queue_t *const restrict work_queue)
+typedef DEF_PLATFORM_DO_NEXT_WORK_QUEUE_ENTRY_FUNC(
+    platform_do_next_work_queue_entry_t);
+
 typedef struct
 {
     platform_read_file_t *read_file;
     platform_close_file_t *close_file;
     platform_write_to_file_t *write_to_file;
+
+    // NOTE: NULL when the game must not write save files (for example during
+    // replays).
+    platform_write_file_at_offset_t *write_file_at_offset;
+
+    platform_debug_print_t *debug_print;
+
+    // NOTE: work_queue is NULL when the platform wants everything to run on
+    // the game thread (for example deterministic headless replays).
+    platform_work_queue_t *work_queue;
+    // NOTE: Jobs on io_work_queue must not touch game memory. NULL when the
+    // platform wants file I/O to run on the game thread.
+    platform_work_queue_t *io_work_queue;
+    platform_add_work_queue_entry_t *add_work_queue_entry;
+    platform_complete_all_work_t *complete_all_work;
+    platform_do_next_work_queue_entry_t *do_next_work_queue_entry;
 } game_platform_services_t;
 
 #define DEF_GAME_UPDATE_AND_RENDER_FUNC(name)                                  \
     void name(game_offscreen_buffer_t *const restrict game_offscreen_buffer,   \
               game_input_t *const restrict game_input,                         \
+              game_sound_output_buffer_t *const restrict game_sound_buffer,    \
               game_memory_t *const restrict game_memory,                       \
               game_platform_services_t *const restrict platform_services)
 
 typedef DEF_GAME_UPDATE_AND_RENDER_FUNC(game_update_and_render_t);
 
+// Builds the game dll's globals (blend tables, sprites). game_update_and_render
+// does it on its first call, so only platforms that call into the game from
+// several threads at once need to call it first (once per load of the dll).
+#define DEF_GAME_INIT_GLOBALS_FUNC(name) void name(void)
+
+typedef DEF_GAME_INIT_GLOBALS_FUNC(game_init_globals_t);
+
 #endif
@@ -0,0 +1,283 @@
+// AI agents.
+// All agents chase the player. Agents within the flow field around the player
+// follow it (one field shared by all agents), the ones further away follow a
+// path from the hierarchical pathfinder. Path searches are spread over frames
+// (a few agents plan per frame), and an agent only keeps the first steps of
+// its path, searching again once it has walked them.
+
+// Agent speed in tiles per second.
+#define GAME_AGENT_SPEED 4.0f
+
+#define GAME_MAX_AGENT_PATH_SEARCHES_PER_FRAME 4u
+
+// Agents are spawned on empty tiles within this distance (in tiles) of the
+// player.
+#define GAME_AGENT_SPAWN_RADIUS 200u
+
+internal void game_spawn_agents(game_state_t *const restrict game_state)
+{
+    ASSERT(game_state);
+
+    game_world_t *world = &game_state->game_world;
+
+    const game_world_position_t player_position = game_state->player_position;
+
+    for (u32 i = 0; i < GAME_MAX_AGENTS; i++)
+    {
+        // A few attempts to find an empty tile.
+        for (u32 attempt = 0; attempt < 16; attempt++)
+        {
+            u64 hash = hash_mix_u64(HASH_SEED, world->seed);
+            hash = hash_mix_u64(hash, i);
+            hash = hash_mix_u64(hash, attempt);
+
+            game_world_position_t position = {0};
+            position.abs_tile_index_x =
+                player_position.abs_tile_index_x +
+                (u32)(hash % (2 * GAME_AGENT_SPAWN_RADIUS + 1)) -
+                GAME_AGENT_SPAWN_RADIUS;
+            position.abs_tile_index_y =
+                player_position.abs_tile_index_y +
+                (u32)((hash >> 32) % (2 * GAME_AGENT_SPAWN_RADIUS + 1)) -
+                GAME_AGENT_SPAWN_RADIUS;
+
+            if (is_tile_point_empty_in_world(world, position))
+            {
+                game_agent_t *agent =
+                    &game_state->agents[game_state->agent_count++];
+
+                *agent = (game_agent_t){0};
+                agent->tile_x = position.abs_tile_index_x;
+                agent->tile_y = position.abs_tile_index_y;
+
+                break;
+            }
+        }
+    }
+}
+
+// Picks the direction of the agent's next step.
+internal u32 game_choose_agent_step(game_state_t *const restrict game_state,
+                                    game_agent_t *const restrict agent,
+                                    const game_flow_field_t *const flow_field,
+                                    u32 *const restrict path_search_budget)
+{
+    const u32 goal_x = game_state->player_position.abs_tile_index_x;
+    const u32 goal_y = game_state->player_position.abs_tile_index_y;
+
+    if (agent->tile_x == goal_x && agent->tile_y == goal_y)
+    {
+        return game_nav_direction_none;
+    }
+
+    const u32 flow_direction =
+        game_get_flow_field_direction(flow_field, agent->tile_x, agent->tile_y);
+
+    if (flow_direction != game_nav_direction_none)
+    {
+        // The path is no longer needed.
+        agent->path_step_count = 0;
+        agent->path_step_index = 0;
+
+        return flow_direction;
+    }
+
+    if (agent->path_step_index == agent->path_step_count &&
+        *path_search_budget > 0)
+    {
+        (*path_search_budget)--;
+
+        agent->path_step_count = game_nav_find_path(
+            &game_state->nav, &game_state->game_world, agent->tile_x,
+            agent->tile_y, goal_x, goal_y, agent->path_steps,
+            GAME_AGENT_MAX_PATH_STEPS);
+        agent->path_step_index = 0;
+    }
+
+    if (agent->path_step_index < agent->path_step_count)
+    {
+        return agent->path_steps[agent->path_step_index++];
+    }
+
+    return game_nav_direction_none;
+}
+
+// Distance (in tiles, manhattan) between an agent and the player's tile.
+internal u32
+game_get_agent_distance_to_player(const game_state_t *const restrict game_state,
+                                  const game_agent_t *const restrict agent)
+{
+    return game_nav_get_tile_distance(
+               agent->tile_x, game_state->player_position.abs_tile_index_x) +
+           game_nav_get_tile_distance(
+               agent->tile_y, game_state->player_position.abs_tile_index_y);
+}
+
+// Plays the step sound of an agent, panned towards the agent and quieter with
+// distance. Agents out of hearing distance are not heard.
+internal void
+game_play_agent_step_sound(game_state_t *const restrict game_state,
+                           const game_agent_t *const restrict agent)
+{
+    const u32 distance = game_get_agent_distance_to_player(game_state, agent);
+
+    if (distance >= GAME_SOUND_AGENT_HEARING_DISTANCE)
+    {
+        return;
+    }
+
+    const i32 offset_x =
+        (i32)(agent->tile_x - game_state->player_position.abs_tile_index_x);
+
+    const f32 hearing_distance = (f32)GAME_SOUND_AGENT_HEARING_DISTANCE;
+    const f32 volume = 0.1f * (1.0f - (f32)distance / hearing_distance);
+
+    f32 pan = (f32)offset_x / hearing_distance;
+    pan = pan < -1.0f ? -1.0f : (pan > 1.0f ? 1.0f : pan);
+
+    game_play_sound(&game_state->audio, game_sound_id_agent_step, volume, pan,
+                    false);
+}
+
+// Returns the number of agents within hearing distance of the player.
+// NOTE: delta_time is in ms.
+internal u32 game_update_agents(game_state_t *const restrict game_state,
+                                const f32 delta_time)
+{
+    ASSERT(game_state);
+
+    game_world_t *world = &game_state->game_world;
+
+    const game_flow_field_t *flow_field = game_get_flow_field(
+        &game_state->nav, world, game_state->player_position.abs_tile_index_x,
+        game_state->player_position.abs_tile_index_y);
+
+    u32 path_search_budget = GAME_MAX_AGENT_PATH_SEARCHES_PER_FRAME;
+
+    u32 heard_agent_count = 0;
+
+    // Agents take turns being the first to plan.
+    const u32 first_agent_index = game_state->agent_count
+                                      ? game_state->next_agent_to_plan %
+                                            game_state->agent_count
+                                      : 0;
+    game_state->next_agent_to_plan = first_agent_index + 1;
+
+    for (u32 i = 0; i < game_state->agent_count; i++)
+    {
+        game_agent_t *agent =
+            &game_state->agents[(first_agent_index + i) %
+                                game_state->agent_count];
+
+        f32 distance = GAME_AGENT_SPEED * delta_time / 1000.0f;
+
+        while (distance > 0.0f)
+        {
+            if (agent->step_direction == game_nav_direction_none)
+            {
+                const u32 direction = game_choose_agent_step(
+                    game_state, agent, flow_field, &path_search_budget);
+
+                if (direction == game_nav_direction_none)
+                {
+                    break;
+                }
+
+                // Tiles might have changed since the path was found.
+                game_world_position_t next_position = {0};
+                next_position.abs_tile_index_x =
+                    agent->tile_x + game_nav_get_direction_x(direction);
+                next_position.abs_tile_index_y =
+                    agent->tile_y + game_nav_get_direction_y(direction);
+
+                if (!is_tile_point_empty_in_world(world, next_position))
+                {
+                    agent->path_step_count = 0;
+                    agent->path_step_index = 0;
+                    break;
+                }
+
+                agent->step_direction = (u8)direction;
+            }
+
+            const f32 remaining_distance = 1.0f - agent->step_progress;
+
+            if (distance < remaining_distance)
+            {
+                agent->step_progress += distance;
+                break;
+            }
+
+            distance -= remaining_distance;
+
+            agent->tile_x += game_nav_get_direction_x(agent->step_direction);
+            agent->tile_y += game_nav_get_direction_y(agent->step_direction);
+            agent->step_direction = game_nav_direction_none;
+            agent->step_progress = 0.0f;
+
+            game_play_agent_step_sound(game_state, agent);
+        }
+
+        if (game_get_agent_distance_to_player(game_state, agent) <
+            GAME_SOUND_AGENT_HEARING_DISTANCE)
+        {
+            heard_agent_count++;
+        }
+    }
+
+    return heard_agent_count;
+}
+
+// NOTE: center_x / center_y are the framebuffer coordinates of the bottom left
+// corner of the player's tile.
+internal void
+game_render_agents(game_offscreen_buffer_t *const restrict buffer,
+                   game_state_t *const restrict game_state, const f32 center_x,
+                   const f32 center_y, const f32 pixels_per_meter)
+{
+    ASSERT(buffer);
+    ASSERT(game_state);
+
+    const f32 tile_width_in_pixels =
+        pixels_per_meter * game_state->game_world.tile_width;
+    const f32 tile_height_in_pixels =
+        pixels_per_meter * game_state->game_world.tile_height;
+
+    const f32 agent_size = 0.6f;
+
+    for (u32 i = 0; i < game_state->agent_count; i++)
+    {
+        const game_agent_t *agent = &game_state->agents[i];
+
+        // NOTE: Tile indices wrap around (the world is toroidal).
+        const f32 tile_x =
+            (f32)(i32)(agent->tile_x -
+                       game_state->player_position.abs_tile_index_x) +
+            agent->step_progress *
+                game_nav_get_direction_x(agent->step_direction);
+        const f32 tile_y =
+            (f32)(i32)(agent->tile_y -
+                       game_state->player_position.abs_tile_index_y) +
+            agent->step_progress *
+                game_nav_get_direction_y(agent->step_direction);
+
+        const f32 left_x =
+            center_x + (tile_x + (1.0f - agent_size) / 2.0f) *
+                           tile_width_in_pixels;
+        const f32 bottom_y =
+            center_y - (tile_y + (1.0f - agent_size) / 2.0f) *
+                           tile_height_in_pixels;
+
+        const f32 right_x = left_x + agent_size * tile_width_in_pixels;
+        const f32 top_y = bottom_y - agent_size * tile_height_in_pixels;
+
+        if (right_x < 0.0f || left_x > buffer->width || bottom_y < 0.0f ||
+            top_y > buffer->height)
+        {
+            continue;
+        }
+
+        game_render_rectangle(buffer, left_x, top_y, right_x, bottom_y, 1.0f,
+                              0.3f, 0.2f, 1.0f);
+    }
+}
@@ -0,0 +1,367 @@
+// Software audio mixer.
+// All playing sounds are mixed into per channel f32 buffers, which are then
+// converted (with saturation) into the platform's 16 bit stereo sound buffer.
+// Mixing and conversion use SSE2, 4 samples at a time. That is why sounds
+// and the number of samples mixed per frame are multiples of 4.
+
+// Volume changes are spread over 10 ms.
+#define GAME_SOUND_VOLUME_RAMP_SAMPLE_COUNT                                    \
+    (GAME_SOUND_SAMPLES_PER_SECOND / 100)
+
+// Agents are heard within this distance (in tiles) of the player.
+#define GAME_SOUND_AGENT_HEARING_DISTANCE 12u
+
+// Reserves sample_count (rounded up to a multiple of 4) samples for a sound,
+// and returns them so that the sound can be synthesized into them.
+internal i16 *game_add_sound(game_audio_t *const restrict audio,
+                             const game_sound_id_t sound_id,
+                             const u32 sample_count)
+{
+    ASSERT(audio);
+    ASSERT(sound_id < game_sound_id_count);
+
+    const u32 padded_sample_count = (sample_count + 3) & ~3u;
+
+    // NOTE: If this fires, GAME_MAX_SOUND_SAMPLES is too small.
+    ASSERT(audio->sound_sample_count + padded_sample_count <=
+           GAME_MAX_SOUND_SAMPLES);
+
+    game_sound_t *sound = &audio->sounds[sound_id];
+    sound->first_sample_index = audio->sound_sample_count;
+    sound->sample_count = padded_sample_count;
+
+    audio->sound_sample_count += padded_sample_count;
+
+    i16 *samples = &audio->sound_samples[sound->first_sample_index];
+    memset(samples, 0, sizeof(i16) * padded_sample_count);
+
+    return samples;
+}
+
+internal i16 game_get_sound_sample_from_f32(const f32 value)
+{
+    ASSERT(value >= -1.0f && value <= 1.0f);
+
+    return (i16)(value * 32767.0f);
+}
+
+// NOTE: There are no sound assets yet, so sounds are synthesized.
+internal void game_synthesize_sounds(game_audio_t *const restrict audio)
+{
+    ASSERT(audio);
+
+    const f32 samples_per_second = (f32)GAME_SOUND_SAMPLES_PER_SECOND;
+
+    // Footstep : Low passed noise burst.
+    {
+        const u32 sample_count = GAME_SOUND_SAMPLES_PER_SECOND * 6 / 100;
+        i16 *samples =
+            game_add_sound(audio, game_sound_id_footstep, sample_count);
+
+        f32 filtered_noise = 0.0f;
+        for (u32 i = 0; i < sample_count; i++)
+        {
+            const u64 hash = hash_mix_u64(HASH_SEED, i);
+            const f32 noise = (f32)(hash & 0xffff) / 32768.0f - 1.0f;
+
+            filtered_noise += 0.2f * (noise - filtered_noise);
+
+            const f32 envelope = expf(-(f32)i / (samples_per_second * 0.012f));
+            samples[i] = game_get_sound_sample_from_f32(0.6f * envelope *
+                                                        filtered_noise);
+        }
+    }
+
+    // Toggle tile : Sine sweeping down from 880 to 440 Hz.
+    {
+        const u32 sample_count = GAME_SOUND_SAMPLES_PER_SECOND * 15 / 100;
+        i16 *samples =
+            game_add_sound(audio, game_sound_id_toggle_tile, sample_count);
+
+        f32 phase = 0.0f;
+        for (u32 i = 0; i < sample_count; i++)
+        {
+            const f32 t = (f32)i / (f32)sample_count;
+            const f32 frequency = 880.0f - 440.0f * t;
+
+            phase += 2.0f * pi32 * frequency / samples_per_second;
+            if (phase > 2.0f * pi32)
+            {
+                phase -= 2.0f * pi32;
+            }
+
+            // Short attack, so the sound does not start with a click.
+            const f32 attack = t < 0.02f ? t / 0.02f : 1.0f;
+            samples[i] = game_get_sound_sample_from_f32(
+                0.4f * attack * (1.0f - t) * sinf(phase));
+        }
+    }
+
+    // Agent step : Short, low click.
+    {
+        const u32 sample_count = GAME_SOUND_SAMPLES_PER_SECOND * 4 / 100;
+        i16 *samples =
+            game_add_sound(audio, game_sound_id_agent_step, sample_count);
+
+        for (u32 i = 0; i < sample_count; i++)
+        {
+            const f32 time = (f32)i / samples_per_second;
+            const f32 envelope = expf(-time / 0.008f);
+
+            samples[i] = game_get_sound_sample_from_f32(
+                0.5f * envelope * sinf(2.0f * pi32 * 180.0f * time));
+        }
+    }
+
+    // Ambience : Low drone. Both frequencies complete a whole number of cycles
+    // within the sound, so it loops seamlessly.
+    {
+        const u32 sample_count = GAME_SOUND_SAMPLES_PER_SECOND;
+        i16 *samples =
+            game_add_sound(audio, game_sound_id_ambience, sample_count);
+
+        for (u32 i = 0; i < sample_count; i++)
+        {
+            const f32 time = (f32)i / samples_per_second;
+
+            samples[i] = game_get_sound_sample_from_f32(
+                0.25f * sinf(2.0f * pi32 * 55.0f * time) +
+                0.15f * sinf(2.0f * pi32 * 83.0f * time));
+        }
+    }
+}
+
+// pan is in -1 (left) .. 1 (right).
+internal void game_get_channel_volumes(const f32 volume, const f32 pan,
+                                       f32 *const restrict channel_volumes)
+{
+    ASSERT(channel_volumes);
+    ASSERT(pan >= -1.0f && pan <= 1.0f);
+
+    channel_volumes[0] = volume * (pan > 0.0f ? 1.0f - pan : 1.0f);
+    channel_volumes[1] = volume * (pan < 0.0f ? 1.0f + pan : 1.0f);
+}
+
+// Returns the index of the playing sound, or GAME_INVALID_PLAYING_SOUND if
+// too many sounds are playing.
+internal u32 game_play_sound(game_audio_t *const restrict audio,
+                             const game_sound_id_t sound_id, const f32 volume,
+                             const f32 pan, const b32 is_looping)
+{
+    ASSERT(audio);
+    ASSERT(sound_id < game_sound_id_count);
+
+    for (u32 i = 0; i < GAME_MAX_PLAYING_SOUNDS; i++)
+    {
+        game_playing_sound_t *playing_sound = &audio->playing_sounds[i];
+
+        if (!playing_sound->is_active)
+        {
+            *playing_sound = (game_playing_sound_t){0};
+            playing_sound->is_active = true;
+            playing_sound->is_looping = is_looping;
+            playing_sound->sound_id = sound_id;
+
+            game_get_channel_volumes(volume, pan, playing_sound->volume);
+            game_get_channel_volumes(volume, pan,
+                                     playing_sound->target_volume);
+
+            audio->played_sound_count++;
+
+            return i;
+        }
+    }
+
+    audio->dropped_sound_count++;
+
+    return GAME_INVALID_PLAYING_SOUND;
+}
+
+internal void game_set_playing_sound_volume(game_audio_t *const restrict audio,
+                                            const u32 playing_sound_index,
+                                            const f32 volume, const f32 pan)
+{
+    ASSERT(audio);
+    ASSERT(playing_sound_index < GAME_MAX_PLAYING_SOUNDS);
+
+    game_playing_sound_t *playing_sound =
+        &audio->playing_sounds[playing_sound_index];
+
+    game_get_channel_volumes(volume, pan, playing_sound->target_volume);
+    playing_sound->ramp_sample_count = GAME_SOUND_VOLUME_RAMP_SAMPLE_COUNT;
+}
+
+internal void game_init_audio(game_audio_t *const restrict audio)
+{
+    ASSERT(audio);
+
+    game_synthesize_sounds(audio);
+
+    // The ambience fades in.
+    audio->ambience_playing_sound_index =
+        game_play_sound(audio, game_sound_id_ambience, 0.0f, 0.0f, true);
+    game_set_playing_sound_volume(audio, audio->ambience_playing_sound_index,
+                                  0.3f, 0.0f);
+}
+
+// Adds sample_count source samples, scaled by a linearly changing volume
+// (volume + i * volume_step for the i'th sample), to the mix buffers.
+internal void game_mix_sound_samples(
+    f32 *const restrict left, f32 *const restrict right,
+    const i16 *const restrict source, const u32 sample_count,
+    const f32 *const restrict volume, const f32 *const restrict volume_step)
+{
+    ASSERT(left);
+    ASSERT(right);
+    ASSERT(source);
+    ASSERT(sample_count % 4 == 0);
+
+    __m128 left_volume =
+        _mm_setr_ps(volume[0], volume[0] + volume_step[0],
+                    volume[0] + 2.0f * volume_step[0],
+                    volume[0] + 3.0f * volume_step[0]);
+    __m128 right_volume =
+        _mm_setr_ps(volume[1], volume[1] + volume_step[1],
+                    volume[1] + 2.0f * volume_step[1],
+                    volume[1] + 3.0f * volume_step[1]);
+
+    const __m128 left_volume_step = _mm_set1_ps(4.0f * volume_step[0]);
+    const __m128 right_volume_step = _mm_set1_ps(4.0f * volume_step[1]);
+
+    for (u32 i = 0; i < sample_count; i += 4)
+    {
+        // Sign extend 4 16 bit samples to 32 bit, and convert them to f32.
+        const __m128i samples_16 =
+            _mm_loadl_epi64((const __m128i *)&source[i]);
+        const __m128 samples = _mm_cvtepi32_ps(
+            _mm_srai_epi32(_mm_unpacklo_epi16(samples_16, samples_16), 16));
+
+        _mm_storeu_ps(&left[i], _mm_add_ps(_mm_loadu_ps(&left[i]),
+                                           _mm_mul_ps(samples, left_volume)));
+        _mm_storeu_ps(&right[i], _mm_add_ps(_mm_loadu_ps(&right[i]),
+                                            _mm_mul_ps(samples, right_volume)));
+
+        left_volume = _mm_add_ps(left_volume, left_volume_step);
+        right_volume = _mm_add_ps(right_volume, right_volume_step);
+    }
+}
+
+internal void
+game_mix_playing_sound(game_audio_t *const restrict audio,
+                       game_playing_sound_t *const restrict playing_sound,
+                       const u32 sample_count)
+{
+    ASSERT(audio);
+    ASSERT(playing_sound);
+
+    const game_sound_t *sound = &audio->sounds[playing_sound->sound_id];
+
+    u32 mixed_sample_count = 0;
+
+    while (playing_sound->is_active && mixed_sample_count < sample_count)
+    {
+        // Mix up to the end of the sound, or of the volume ramp, whichever
+        // comes first.
+        u32 segment_sample_count = sample_count - mixed_sample_count;
+
+        const u32 remaining_sample_count =
+            sound->sample_count - playing_sound->sample_index;
+        if (segment_sample_count > remaining_sample_count)
+        {
+            segment_sample_count = remaining_sample_count;
+        }
+
+        f32 volume_step[2] = {0.0f, 0.0f};
+
+        if (playing_sound->ramp_sample_count)
+        {
+            if (segment_sample_count > playing_sound->ramp_sample_count)
+            {
+                segment_sample_count = playing_sound->ramp_sample_count;
+            }
+
+            for (u32 channel = 0; channel < 2; channel++)
+            {
+                volume_step[channel] = (playing_sound->target_volume[channel] -
+                                        playing_sound->volume[channel]) /
+                                       (f32)playing_sound->ramp_sample_count;
+            }
+        }
+
+        game_mix_sound_samples(
+            &audio->mix_buffer[0][mixed_sample_count],
+            &audio->mix_buffer[1][mixed_sample_count],
+            &audio->sound_samples[sound->first_sample_index +
+                                  playing_sound->sample_index],
+            segment_sample_count, playing_sound->volume, volume_step);
+
+        if (playing_sound->ramp_sample_count)
+        {
+            playing_sound->ramp_sample_count -= segment_sample_count;
+
+            for (u32 channel = 0; channel < 2; channel++)
+            {
+                playing_sound->volume[channel] =
+                    playing_sound->ramp_sample_count
+                        ? playing_sound->volume[channel] +
+                              volume_step[channel] * segment_sample_count
+                        : playing_sound->target_volume[channel];
+            }
+        }
+
+        mixed_sample_count += segment_sample_count;
+        playing_sound->sample_index += segment_sample_count;
+
+        if (playing_sound->sample_index == sound->sample_count)
+        {
+            if (playing_sound->is_looping)
+            {
+                playing_sound->sample_index = 0;
+            }
+            else
+            {
+                playing_sound->is_active = false;
+            }
+        }
+    }
+}
+
+internal void
+game_mix_sounds(game_audio_t *const restrict audio,
+                game_sound_output_buffer_t *const restrict sound_buffer)
+{
+    ASSERT(audio);
+    ASSERT(sound_buffer);
+    ASSERT(sound_buffer->sample_count <= GAME_MAX_SOUND_SAMPLES_PER_FRAME);
+    ASSERT(sound_buffer->sample_count % 4 == 0);
+    ASSERT(sound_buffer->samples_per_second == GAME_SOUND_SAMPLES_PER_SECOND);
+
+    const u32 sample_count = sound_buffer->sample_count;
+
+    memset(audio->mix_buffer[0], 0, sizeof(f32) * sample_count);
+    memset(audio->mix_buffer[1], 0, sizeof(f32) * sample_count);
+
+    for (u32 i = 0; i < GAME_MAX_PLAYING_SOUNDS; i++)
+    {
+        if (audio->playing_sounds[i].is_active)
+        {
+            game_mix_playing_sound(audio, &audio->playing_sounds[i],
+                                   sample_count);
+        }
+    }
+
+    // Convert to 16 bit (saturating) and interleave the channels.
+    for (u32 i = 0; i < sample_count; i += 4)
+    {
+        const __m128i left =
+            _mm_cvtps_epi32(_mm_loadu_ps(&audio->mix_buffer[0][i]));
+        const __m128i right =
+            _mm_cvtps_epi32(_mm_loadu_ps(&audio->mix_buffer[1][i]));
+
+        const __m128i left_16 = _mm_packs_epi32(left, left);
+        const __m128i right_16 = _mm_packs_epi32(right, right);
+
+        _mm_storeu_si128((__m128i *)&sound_buffer->samples[2 * i],
+                         _mm_unpacklo_epi16(left_16, right_16));
+    }
+}
@@ -0,0 +1,217 @@
+// Blending.
+// The framebuffer holds sRGB encoded 8 bit colors. Blending is done in linear
+// space with premultiplied alpha ("over" : result = source + destination * (1 -
+// source alpha)), 4 pixels at a time.
+// sRGB <-> linear conversions use lookup tables : decoding indexes a table with
+// the 8 bit value, encoding indexes a table with the linear value quantized to
+// GAME_LINEAR_TO_SRGB_TABLE_BITS bits, which is within one 8 bit step of the
+// exact conversion.
+// NOTE: The lookups are scalar (SSE2 has no gather). 4 wide polynomial
+// approximations of both conversions, at the same accuracy, blend at less than
+// half the rate : encoding then takes two square roots and a degree 4
+// polynomial per channel, where the table takes a single load from L1.
+
+#define GAME_LINEAR_TO_SRGB_TABLE_BITS 12u
+#define GAME_LINEAR_TO_SRGB_TABLE_SIZE (1u << GAME_LINEAR_TO_SRGB_TABLE_BITS)
+
+typedef struct
+{
+    b32 is_initialized;
+
+    f32 srgb_to_linear[256];
+    u8 linear_to_srgb[GAME_LINEAR_TO_SRGB_TABLE_SIZE];
+} game_blend_tables_t;
+
+// NOTE: Globals of the game dll are reset when it is reloaded, so the tables
+// are built (again) on the first frame after a reload.
+global_variable game_blend_tables_t g_blend_tables = {0};
+
+// Color in linear space, with premultiplied alpha.
+typedef struct
+{
+    f32 red;
+    f32 green;
+    f32 blue;
+    f32 alpha;
+} game_linear_color_t;
+
+internal f32 game_srgb_to_linear(const f32 value)
+{
+    if (value <= 0.04045f)
+    {
+        return value / 12.92f;
+    }
+
+    return powf((value + 0.055f) / 1.055f, 2.4f);
+}
+
+internal f32 game_linear_to_srgb(const f32 value)
+{
+    if (value <= 0.0031308f)
+    {
+        return value * 12.92f;
+    }
+
+    return 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+}
+
+internal void game_init_blend_tables(game_blend_tables_t *const restrict tables)
+{
+    ASSERT(tables);
+
+    if (tables->is_initialized)
+    {
+        return;
+    }
+
+    for (u32 i = 0; i < 256; i++)
+    {
+        tables->srgb_to_linear[i] = game_srgb_to_linear((f32)i / 255.0f);
+    }
+
+    for (u32 i = 0; i < GAME_LINEAR_TO_SRGB_TABLE_SIZE; i++)
+    {
+        tables->linear_to_srgb[i] = round_f32_to_u8(
+            255.0f * game_linear_to_srgb(
+                         (f32)i / (f32)(GAME_LINEAR_TO_SRGB_TABLE_SIZE - 1)));
+    }
+
+    tables->is_initialized = true;
+}
+
+// Normalized (sRGB encoded, straight alpha) components to a linear
+// premultiplied color.
+internal game_linear_color_t
+game_get_linear_color(const f32 normalized_red, const f32 normalized_green,
+                      const f32 normalized_blue, const f32 normalized_alpha)
+{
+    game_linear_color_t result = {0};
+
+    result.alpha = normalized_alpha;
+    result.red = game_srgb_to_linear(normalized_red) * normalized_alpha;
+    result.green = game_srgb_to_linear(normalized_green) * normalized_alpha;
+    result.blue = game_srgb_to_linear(normalized_blue) * normalized_alpha;
+
+    return result;
+}
+
+// Blend terms of a color, as used by the blend kernel.
+typedef struct
+{
+    // Premultiplied source components, scaled to linear_to_srgb indices.
+    __m128 source_red;
+    __m128 source_green;
+    __m128 source_blue;
+    __m128 source_alpha;
+
+    __m128 inverse_alpha;
+    __m128 inverse_alpha_scaled;
+    __m128 max_index;
+} game_blend_terms_t;
+
+// Blends 4 pixels (layout in memory is : AA RR GG BB, where alpha is linear).
+internal void
+game_blend_4_pixels(const game_blend_tables_t *const restrict tables,
+                    u32 *const restrict pixels,
+                    const game_blend_terms_t *const restrict terms)
+{
+    const __m128i destination = _mm_loadu_si128((const __m128i *)pixels);
+
+    // Decode (there is no gather in SSE2, so table lookups are scalar).
+    f32 red[4];
+    f32 green[4];
+    f32 blue[4];
+
+    for (u32 i = 0; i < 4; i++)
+    {
+        red[i] = tables->srgb_to_linear[(pixels[i] >> 16) & 0xff];
+        green[i] = tables->srgb_to_linear[(pixels[i] >> 8) & 0xff];
+        blue[i] = tables->srgb_to_linear[pixels[i] & 0xff];
+    }
+
+    // Blend, the results are table indices (rounded to nearest).
+    i32 red_indices[4];
+    i32 green_indices[4];
+    i32 blue_indices[4];
+
+    _mm_storeu_si128(
+        (__m128i *)red_indices,
+        _mm_cvtps_epi32(_mm_min_ps(
+            _mm_add_ps(terms->source_red,
+                       _mm_mul_ps(_mm_loadu_ps(red),
+                                  terms->inverse_alpha_scaled)),
+            terms->max_index)));
+    _mm_storeu_si128(
+        (__m128i *)green_indices,
+        _mm_cvtps_epi32(_mm_min_ps(
+            _mm_add_ps(terms->source_green,
+                       _mm_mul_ps(_mm_loadu_ps(green),
+                                  terms->inverse_alpha_scaled)),
+            terms->max_index)));
+    _mm_storeu_si128(
+        (__m128i *)blue_indices,
+        _mm_cvtps_epi32(_mm_min_ps(
+            _mm_add_ps(terms->source_blue,
+                       _mm_mul_ps(_mm_loadu_ps(blue),
+                                  terms->inverse_alpha_scaled)),
+            terms->max_index)));
+
+    // Alpha is linear, so it is blended directly.
+    const __m128 destination_alpha =
+        _mm_cvtepi32_ps(_mm_srli_epi32(destination, 24));
+    const __m128i alpha = _mm_cvtps_epi32(
+        _mm_add_ps(terms->source_alpha,
+                   _mm_mul_ps(destination_alpha, terms->inverse_alpha)));
+
+    // Encode.
+    u32 encoded[4];
+    for (u32 i = 0; i < 4; i++)
+    {
+        encoded[i] = ((u32)tables->linear_to_srgb[red_indices[i]] << 16) |
+                     ((u32)tables->linear_to_srgb[green_indices[i]] << 8) |
+                     (u32)tables->linear_to_srgb[blue_indices[i]];
+    }
+
+    _mm_storeu_si128((__m128i *)pixels,
+                     _mm_or_si128(_mm_loadu_si128((const __m128i *)encoded),
+                                  _mm_slli_epi32(alpha, 24)));
+}
+
+// Blends color over pixel_count pixels.
+internal void game_blend_span(const game_blend_tables_t *const restrict tables,
+                              u32 *const restrict pixels, const u32 pixel_count,
+                              const game_linear_color_t color)
+{
+    ASSERT(tables);
+    ASSERT(tables->is_initialized);
+    ASSERT(pixels);
+
+    const f32 max_index = (f32)(GAME_LINEAR_TO_SRGB_TABLE_SIZE - 1);
+
+    game_blend_terms_t terms = {0};
+    terms.source_red = _mm_set1_ps(color.red * max_index);
+    terms.source_green = _mm_set1_ps(color.green * max_index);
+    terms.source_blue = _mm_set1_ps(color.blue * max_index);
+    terms.source_alpha = _mm_set1_ps(color.alpha * 255.0f);
+    terms.inverse_alpha = _mm_set1_ps(1.0f - color.alpha);
+    terms.inverse_alpha_scaled = _mm_set1_ps((1.0f - color.alpha) * max_index);
+    terms.max_index = _mm_set1_ps(max_index);
+
+    u32 i = 0;
+    for (; i + 4 <= pixel_count; i += 4)
+    {
+        game_blend_4_pixels(tables, pixels + i, &terms);
+    }
+
+    // Remaining (< 4) pixels go through the same kernel, so that all pixels
+    // are blended (and rounded) the same way.
+    if (i < pixel_count)
+    {
+        u32 remaining_pixels[4] = {0};
+        memcpy(remaining_pixels, pixels + i, (pixel_count - i) * sizeof(u32));
+
+        game_blend_4_pixels(tables, remaining_pixels, &terms);
+
+        memcpy(pixels + i, remaining_pixels, (pixel_count - i) * sizeof(u32));
+    }
+}
@@ -0,0 +1,159 @@
+// Collision.
+// Every chunk keeps a bitmap of its solid tiles next to the tiles themselves
+// (see game_tile_chunk_t), so that runs of up to 64 tiles along a row are
+// tested with a word (or two) instead of one tile value each. A tile is solid
+// if it is not empty (i.e its value is not 0).
+// NOTE: Tiles of chunks that are not loaded are solid, like invalid tiles.
+
+internal void game_set_tile_solid_bit(game_tile_chunk_t *const restrict chunk,
+                                      const u32 tile_index_x,
+                                      const u32 tile_index_y,
+                                      const u32 tile_value)
+{
+    ASSERT(chunk);
+    ASSERT(tile_index_x < TILE_CHUNK_DIM && tile_index_y < TILE_CHUNK_DIM);
+
+    u64 *word = &chunk->solid_bits[tile_index_y][tile_index_x / 64];
+    const u64 bit = 1ull << (tile_index_x % 64);
+
+    *word = tile_value ? (*word | bit) : (*word & ~bit);
+}
+
+// Derives the bitmap from the chunk's tiles.
+internal void
+game_build_tile_solid_bits(game_tile_chunk_t *const restrict chunk)
+{
+    ASSERT(chunk);
+
+    for (u32 y = 0; y < TILE_CHUNK_DIM; y++)
+    {
+        for (u32 word_index = 0; word_index < TILE_CHUNK_SOLID_WORDS_PER_ROW;
+             word_index++)
+        {
+            u64 word = 0;
+            for (u32 bit_index = 0; bit_index < 64; bit_index++)
+            {
+                const u32 x = word_index * 64 + bit_index;
+                if (chunk->tiles[get_tile_index_in_chunk(x, y)] != 0)
+                {
+                    word |= 1ull << bit_index;
+                }
+            }
+
+            chunk->solid_bits[y][word_index] = word;
+        }
+    }
+}
+
+// Returns the solid bits of tile_count (at most 64) tiles of the chunk's row
+// tile_index_y, starting at tile_index_x : bit i is set if tile
+// (tile_index_x + i) is solid. The tiles must be within the chunk.
+internal u64
+game_get_solid_tile_bits_in_chunk_row(const game_tile_chunk_t *const chunk,
+                                      const u32 tile_index_x,
+                                      const u32 tile_index_y,
+                                      const u32 tile_count)
+{
+    ASSERT(chunk);
+    ASSERT(tile_count > 0 && tile_count <= 64);
+    ASSERT(tile_index_x + tile_count <= TILE_CHUNK_DIM);
+    ASSERT(tile_index_y < TILE_CHUNK_DIM);
+
+    const u64 *row = chunk->solid_bits[tile_index_y];
+    const u32 word_index = tile_index_x / 64;
+    const u32 shift = tile_index_x % 64;
+
+    u64 bits = row[word_index] >> shift;
+    if (shift && word_index + 1 < TILE_CHUNK_SOLID_WORDS_PER_ROW)
+    {
+        bits |= row[word_index + 1] << (64 - shift);
+    }
+
+    return tile_count == 64 ? bits : bits & ((1ull << tile_count) - 1);
+}
+
+// Same as above, for the tiles going up from (tile_index_x, tile_index_y) in
+// the chunk.
+// NOTE: Columns are not contiguous in the bitmap, so this tests a bit per
+// tile.
+internal u64
+game_get_solid_tile_bits_in_chunk_column(const game_tile_chunk_t *const chunk,
+                                         const u32 tile_index_x,
+                                         const u32 tile_index_y,
+                                         const u32 tile_count)
+{
+    ASSERT(chunk);
+    ASSERT(tile_count > 0 && tile_count <= 64);
+    ASSERT(tile_index_x < TILE_CHUNK_DIM);
+    ASSERT(tile_index_y + tile_count <= TILE_CHUNK_DIM);
+
+    const u32 word_index = tile_index_x / 64;
+    const u32 shift = tile_index_x % 64;
+
+    u64 bits = 0;
+    for (u32 i = 0; i < tile_count; i++)
+    {
+        bits |= ((chunk->solid_bits[tile_index_y + i][word_index] >> shift) &
+                 1ull)
+                << i;
+    }
+
+    return bits;
+}
+
+// Returns the solid bits of tile_count (at most 64) tiles, going right (or up
+// if is_column is set) from (tile_x, tile_y) : bit i is set if the i-th tile is
+// solid. The tiles may span chunks, and wrap around the world.
+internal u64 get_solid_tile_bits_in_world(game_world_t *const restrict world,
+                                          const u32 tile_x, const u32 tile_y,
+                                          const u32 tile_count,
+                                          const b32 is_column)
+{
+    ASSERT(world);
+    ASSERT(tile_count <= 64);
+
+    u64 bits = 0;
+
+    for (u32 i = 0; i < tile_count;)
+    {
+        const u32 x = is_column ? tile_x : tile_x + i;
+        const u32 y = is_column ? tile_y + i : tile_y;
+        const u32 tile_index_x = GET_TILE_INDEX_IN_CHUNK(x);
+        const u32 tile_index_y = GET_TILE_INDEX_IN_CHUNK(y);
+
+        u32 count = TILE_CHUNK_DIM - (is_column ? tile_index_y : tile_index_x);
+        if (count > tile_count - i)
+        {
+            count = tile_count - i;
+        }
+
+        const game_tile_chunk_t *chunk = get_tile_chunk_from_world(
+            world, GET_CHUNK_INDEX_IN_WORLD(x), GET_CHUNK_INDEX_IN_WORLD(y));
+
+        u64 chunk_bits = count == 64 ? ~0ull : (1ull << count) - 1;
+        if (chunk)
+        {
+            chunk_bits = is_column ? game_get_solid_tile_bits_in_chunk_column(
+                                         chunk, tile_index_x, tile_index_y,
+                                         count)
+                                   : game_get_solid_tile_bits_in_chunk_row(
+                                         chunk, tile_index_x, tile_index_y,
+                                         count);
+        }
+
+        bits |= chunk_bits << i;
+        i += count;
+    }
+
+    return bits;
+}
+
+internal b32
+is_tile_point_empty_in_world(game_world_t *const restrict world,
+                             const game_world_position_t world_position)
+
+{
+    return get_solid_tile_bits_in_world(world, world_position.abs_tile_index_x,
+                                        world_position.abs_tile_index_y, 1,
+                                        false) == 0;
+}
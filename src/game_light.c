@@ -0,0 +1,421 @@
+// Incremental tile lighting.
+// See the lighting section of game.h.
+// When a tile changes (or a light moves), the tile is darkened : the darkening
+// pass clears every tile whose light could have come through it (its
+// neighbours that are dimmer than it), and queues the brighter tiles around
+// the cleared area, as well as light sources within it. The spreading pass
+// then spreads light from the queued tiles into the cleared area again. Both
+// passes only visit tiles within GAME_MAX_LIGHT_LEVEL tiles of the change.
+// NOTE: Light does not spread into chunks that are not loaded. When a chunk
+// is evicted, light that spread from it into its neighbours stays (evicted
+// chunks are far away from the player).
+
+// Upper bound on the chunk builds per frame, so that loading chunks does not
+// cause a spike in frame time.
+#define GAME_LIGHT_MAX_CHUNK_BUILDS_PER_FRAME 2u
+
+// Tile and light level lookups, caching the last chunk looked up.
+typedef struct
+{
+    game_world_t *world;
+
+    u32 chunk_x;
+    u32 chunk_y;
+    game_tile_chunk_slot_t *slot;
+} game_light_tile_reader_t;
+
+// Returns the slot of the tile's chunk, NULL if it is not loaded.
+internal game_tile_chunk_slot_t *
+game_light_get_slot(game_light_tile_reader_t *const restrict reader,
+                    const u32 tile_x, const u32 tile_y)
+{
+    const u32 chunk_x = GET_CHUNK_INDEX_IN_WORLD(tile_x);
+    const u32 chunk_y = GET_CHUNK_INDEX_IN_WORLD(tile_y);
+
+    if (!reader->slot || reader->chunk_x != chunk_x ||
+        reader->chunk_y != chunk_y)
+    {
+        reader->slot = game_find_tile_chunk_slot(reader->world, chunk_x,
+                                                 chunk_y);
+        if (reader->slot &&
+            reader->slot->state != game_tile_chunk_state_loaded)
+        {
+            reader->slot = NULL;
+        }
+
+        reader->chunk_x = chunk_x;
+        reader->chunk_y = chunk_y;
+    }
+
+    return reader->slot;
+}
+
+// Level of light the tile emits itself.
+internal u32
+game_light_get_emitted_level(const game_light_t *const restrict light,
+                             const u32 tile_value, const u32 tile_x,
+                             const u32 tile_y)
+{
+    u32 level = tile_value == GAME_TILE_LAMP ? GAME_LAMP_LIGHT_LEVEL : 0;
+
+    if (light->has_player_light && tile_x == light->player_light_x &&
+        tile_y == light->player_light_y && tile_value != GAME_TILE_WALL &&
+        level < GAME_PLAYER_LIGHT_LEVEL)
+    {
+        level = GAME_PLAYER_LIGHT_LEVEL;
+    }
+
+    return level;
+}
+
+internal void game_light_push(game_light_t *const restrict light,
+                              game_light_queue_entry_t *const restrict queue,
+                              const u32 read_count, u32 *const write_count,
+                              const u32 tile_x, const u32 tile_y,
+                              const u32 level)
+{
+    // NOTE: If this happens, GAME_LIGHT_QUEUE_SIZE is too small. Dropped
+    // tiles are lit incorrectly until they are relit.
+    if (*write_count - read_count == GAME_LIGHT_QUEUE_SIZE)
+    {
+        light->dropped_queue_entry_count++;
+        return;
+    }
+
+    game_light_queue_entry_t *entry =
+        &queue[*write_count % GAME_LIGHT_QUEUE_SIZE];
+    entry->tile_x = tile_x;
+    entry->tile_y = tile_y;
+    entry->level = level;
+
+    (*write_count)++;
+
+    light->queued_entry_count++;
+
+    const u32 queued_entry_count =
+        (light->darken_queue_write_count - light->darken_queue_read_count) +
+        (light->spread_queue_write_count - light->spread_queue_read_count);
+    if (queued_entry_count > light->peak_queued_entry_count)
+    {
+        light->peak_queued_entry_count = queued_entry_count;
+    }
+}
+
+internal void game_light_push_spread(game_light_t *const restrict light,
+                                     const u32 tile_x, const u32 tile_y)
+{
+    game_light_push(light, light->spread_queue, light->spread_queue_read_count,
+                    &light->spread_queue_write_count, tile_x, tile_y, 0);
+}
+
+internal void game_light_push_darken(game_light_t *const restrict light,
+                                     const u32 tile_x, const u32 tile_y,
+                                     const u32 level)
+{
+    game_light_push(light, light->darken_queue, light->darken_queue_read_count,
+                    &light->darken_queue_write_count, tile_x, tile_y, level);
+}
+
+// Runs the darkening pass, then the spreading pass, over the queued tiles.
+internal void game_light_process_queues(game_light_t *const restrict light,
+                                        game_world_t *const restrict world)
+{
+    ASSERT(light);
+    ASSERT(world);
+
+    game_light_tile_reader_t reader = {0};
+    reader.world = world;
+
+    while (light->darken_queue_read_count != light->darken_queue_write_count)
+    {
+        const game_light_queue_entry_t entry =
+            light->darken_queue[light->darken_queue_read_count++ %
+                                GAME_LIGHT_QUEUE_SIZE];
+
+        for (u32 direction = game_nav_direction_west;
+             direction <= game_nav_direction_north; direction++)
+        {
+            const u32 tile_x =
+                entry.tile_x + game_nav_get_direction_x(direction);
+            const u32 tile_y =
+                entry.tile_y + game_nav_get_direction_y(direction);
+
+            game_tile_chunk_slot_t *slot =
+                game_light_get_slot(&reader, tile_x, tile_y);
+            if (!slot)
+            {
+                continue;
+            }
+
+            u8 *level = &slot->light.levels[GET_TILE_INDEX_IN_CHUNK(tile_y)]
+                                           [GET_TILE_INDEX_IN_CHUNK(tile_x)];
+            if (*level == 0)
+            {
+                continue;
+            }
+
+            if (*level < entry.level)
+            {
+                // The neighbour may have been lit through the darkened tile.
+                const u32 neighbor_level = *level;
+                *level = 0;
+                light->relit_tile_count++;
+
+                game_light_push_darken(light, tile_x, tile_y, neighbor_level);
+
+                // Light sources are lit again right away.
+                const u32 emitted_level = game_light_get_emitted_level(
+                    light,
+                    slot->tile_chunk.tiles[get_tile_index_in_chunk(
+                        GET_TILE_INDEX_IN_CHUNK(tile_x),
+                        GET_TILE_INDEX_IN_CHUNK(tile_y))],
+                    tile_x, tile_y);
+                if (emitted_level)
+                {
+                    *level = (u8)emitted_level;
+                    game_light_push_spread(light, tile_x, tile_y);
+                }
+            }
+            else
+            {
+                // Lit by something else, spread it back into the darkened
+                // area.
+                game_light_push_spread(light, tile_x, tile_y);
+            }
+        }
+    }
+
+    while (light->spread_queue_read_count != light->spread_queue_write_count)
+    {
+        const game_light_queue_entry_t entry =
+            light->spread_queue[light->spread_queue_read_count++ %
+                                GAME_LIGHT_QUEUE_SIZE];
+
+        game_tile_chunk_slot_t *slot =
+            game_light_get_slot(&reader, entry.tile_x, entry.tile_y);
+        if (!slot)
+        {
+            continue;
+        }
+
+        const u32 level =
+            slot->light.levels[GET_TILE_INDEX_IN_CHUNK(entry.tile_y)]
+                              [GET_TILE_INDEX_IN_CHUNK(entry.tile_x)];
+        if (level <= 1)
+        {
+            continue;
+        }
+
+        for (u32 direction = game_nav_direction_west;
+             direction <= game_nav_direction_north; direction++)
+        {
+            const u32 tile_x =
+                entry.tile_x + game_nav_get_direction_x(direction);
+            const u32 tile_y =
+                entry.tile_y + game_nav_get_direction_y(direction);
+
+            game_tile_chunk_slot_t *neighbor_slot =
+                game_light_get_slot(&reader, tile_x, tile_y);
+            if (!neighbor_slot)
+            {
+                continue;
+            }
+
+            const u32 tile_x_in_chunk = GET_TILE_INDEX_IN_CHUNK(tile_x);
+            const u32 tile_y_in_chunk = GET_TILE_INDEX_IN_CHUNK(tile_y);
+
+            // Walls block light (they stay at level 0).
+            if (neighbor_slot->tile_chunk.tiles[get_tile_index_in_chunk(
+                    tile_x_in_chunk, tile_y_in_chunk)] == GAME_TILE_WALL)
+            {
+                continue;
+            }
+
+            u8 *neighbor_level =
+                &neighbor_slot->light.levels[tile_y_in_chunk][tile_x_in_chunk];
+            if (*neighbor_level + 1u < level)
+            {
+                *neighbor_level = (u8)(level - 1);
+                light->relit_tile_count++;
+
+                game_light_push_spread(light, tile_x, tile_y);
+            }
+        }
+    }
+}
+
+// Relights the area around the tile, after its value (or the lights on it)
+// changed.
+internal void game_light_invalidate_tile(game_light_t *const restrict light,
+                                         game_world_t *const restrict world,
+                                         const u32 tile_x, const u32 tile_y)
+{
+    ASSERT(light);
+    ASSERT(world);
+
+    game_light_tile_reader_t reader = {0};
+    reader.world = world;
+
+    game_tile_chunk_slot_t *slot = game_light_get_slot(&reader, tile_x, tile_y);
+    if (!slot || slot->light.needs_build)
+    {
+        return;
+    }
+
+    const u32 tile_x_in_chunk = GET_TILE_INDEX_IN_CHUNK(tile_x);
+    const u32 tile_y_in_chunk = GET_TILE_INDEX_IN_CHUNK(tile_y);
+
+    u8 *level = &slot->light.levels[tile_y_in_chunk][tile_x_in_chunk];
+
+    // Darken the tile (and everything it lit), then light it again from its
+    // neighbours and its own light.
+    if (*level)
+    {
+        game_light_push_darken(light, tile_x, tile_y, *level);
+        *level = 0;
+    }
+
+    for (u32 direction = game_nav_direction_west;
+         direction <= game_nav_direction_north; direction++)
+    {
+        game_light_push_spread(light,
+                               tile_x + game_nav_get_direction_x(direction),
+                               tile_y + game_nav_get_direction_y(direction));
+    }
+
+    const u32 emitted_level = game_light_get_emitted_level(
+        light,
+        slot->tile_chunk
+            .tiles[get_tile_index_in_chunk(tile_x_in_chunk, tile_y_in_chunk)],
+        tile_x, tile_y);
+    if (emitted_level)
+    {
+        *level = (u8)emitted_level;
+        game_light_push_spread(light, tile_x, tile_y);
+    }
+
+    light->relit_tile_count++;
+}
+
+// Lights a chunk that was just loaded : from its own light sources, and from
+// the light of its loaded neighbours.
+internal void
+game_light_build_chunk(game_light_t *const restrict light,
+                       game_world_t *const restrict world,
+                       game_tile_chunk_slot_t *const restrict slot)
+{
+    ASSERT(light);
+    ASSERT(world);
+    ASSERT(slot);
+
+    memset(slot->light.levels, 0, sizeof(slot->light.levels));
+    slot->light.needs_build = false;
+
+    const u32 first_tile_x = slot->chunk_x * TILE_CHUNK_DIM;
+    const u32 first_tile_y = slot->chunk_y * TILE_CHUNK_DIM;
+
+    for (u32 y = 0; y < TILE_CHUNK_DIM; y++)
+    {
+        for (u32 x = 0; x < TILE_CHUNK_DIM; x++)
+        {
+            const u32 emitted_level = game_light_get_emitted_level(
+                light, slot->tile_chunk.tiles[get_tile_index_in_chunk(x, y)],
+                first_tile_x + x, first_tile_y + y);
+
+            if (emitted_level)
+            {
+                slot->light.levels[y][x] = (u8)emitted_level;
+                game_light_push_spread(light, first_tile_x + x,
+                                       first_tile_y + y);
+
+                // Keeps the queue short.
+                game_light_process_queues(light, world);
+            }
+        }
+    }
+
+    // The tiles just outside of each border (ignored if not loaded).
+    for (u32 i = 0; i < TILE_CHUNK_DIM; i++)
+    {
+        game_light_push_spread(light, first_tile_x - 1, first_tile_y + i);
+        game_light_push_spread(light, first_tile_x + TILE_CHUNK_DIM,
+                               first_tile_y + i);
+        game_light_push_spread(light, first_tile_x + i, first_tile_y - 1);
+        game_light_push_spread(light, first_tile_x + i,
+                               first_tile_y + TILE_CHUNK_DIM);
+
+        game_light_process_queues(light, world);
+    }
+
+    light->built_chunk_count++;
+}
+
+// Called once per frame, after chunks are streamed in. Builds the light of
+// newly loaded chunks (closest to the center chunk first), and moves the
+// player's light to the player's tile.
+internal void game_update_lighting(game_light_t *const restrict light,
+                                   game_world_t *const restrict world,
+                                   const u32 player_tile_x,
+                                   const u32 player_tile_y,
+                                   const u32 center_chunk_x,
+                                   const u32 center_chunk_y)
+{
+    ASSERT(light);
+    ASSERT(world);
+
+    light->relit_tile_count = 0;
+
+    // Entries queued since the last update are still in the queues.
+    light->peak_queued_entry_count =
+        (light->darken_queue_write_count - light->darken_queue_read_count) +
+        (light->spread_queue_write_count - light->spread_queue_read_count);
+
+    u32 build_budget = GAME_LIGHT_MAX_CHUNK_BUILDS_PER_FRAME;
+
+    for (u32 radius = 0; radius <= GAME_TILE_CHUNK_LOAD_RADIUS; radius++)
+    {
+        for (u32 i = 0; i < GAME_MAX_LOADED_TILE_CHUNKS && build_budget; i++)
+        {
+            game_tile_chunk_slot_t *slot = &world->tile_chunk_slots[i];
+            if (slot->state != game_tile_chunk_state_loaded ||
+                !slot->light.needs_build)
+            {
+                continue;
+            }
+
+            const u32 distance_x =
+                game_get_tile_chunk_distance(slot->chunk_x, center_chunk_x);
+            const u32 distance_y =
+                game_get_tile_chunk_distance(slot->chunk_y, center_chunk_y);
+
+            if ((distance_x > distance_y ? distance_x : distance_y) != radius)
+            {
+                continue;
+            }
+
+            game_light_build_chunk(light, world, slot);
+            build_budget--;
+        }
+    }
+
+    if (!light->has_player_light || light->player_light_x != player_tile_x ||
+        light->player_light_y != player_tile_y)
+    {
+        const b32 had_player_light = light->has_player_light;
+        const u32 previous_x = light->player_light_x;
+        const u32 previous_y = light->player_light_y;
+
+        light->has_player_light = true;
+        light->player_light_x = player_tile_x;
+        light->player_light_y = player_tile_y;
+
+        if (had_player_light)
+        {
+            game_light_invalidate_tile(light, world, previous_x, previous_y);
+        }
+
+        game_light_invalidate_tile(light, world, player_tile_x, player_tile_y);
+    }
+
+    game_light_process_queues(light, world);
+}
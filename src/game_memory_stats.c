@@ -0,0 +1,323 @@
+// Memory accounting.
+// See the memory accounting section of game.h.
+
+global_variable const char
+    *g_memory_region_names[game_memory_region_id_count] = {
+        [game_memory_region_id_permanent_block] = "permanent_block",
+        [game_memory_region_id_tile_chunks] = "tile_chunks",
+        [game_memory_region_id_tile_edits] = "tile_edits",
+        [game_memory_region_id_light_queues] = "light_queues",
+        [game_memory_region_id_flow_fields] = "flow_fields",
+        [game_memory_region_id_agents] = "agents",
+        [game_memory_region_id_playing_sounds] = "playing_sounds",
+        [game_memory_region_id_save_buffer] = "save_buffer",
+};
+
+// The dump in flight. There is at most one, and the game thread only formats
+// into the text while no write is pending.
+// NOTE: Like g_save_write, this is a global of the game dll rather than game
+// state, so the write can be in flight while game memory is restored.
+typedef struct
+{
+    // Set by the game thread when the write is queued, cleared by the worker
+    // thread once the write is done.
+    volatile u32 is_pending;
+
+    platform_write_to_file_t *write_to_file;
+
+    char text[2048];
+} game_memory_stats_write_t;
+
+global_variable game_memory_stats_write_t g_memory_stats_write = {0};
+
+internal DEF_PLATFORM_WORK_QUEUE_CALLBACK(game_memory_stats_write_work)
+{
+    game_memory_stats_write_t *write = (game_memory_stats_write_t *)data;
+    ASSERT(write);
+    ASSERT(write->is_pending);
+
+    write->write_to_file(write->text, GAME_MEMORY_STATS_FILE_NAME);
+
+    atomic_exchange_u32(&write->is_pending, false);
+}
+
+// A region's use at the end of the frame, and the (ever increasing) subsystem
+// counters of its allocations and overflows.
+typedef struct
+{
+    u64 capacity;
+    u64 used;
+
+    // Only set for regions whose use changes within a frame.
+    u64 frame_high_water;
+
+    u64 allocation_counter;
+    u64 overflow_counter;
+} game_memory_region_sample_t;
+
+internal void
+game_sample_memory_regions(const game_state_t *const restrict game_state,
+                           const game_memory_t *const restrict game_memory,
+                           game_memory_region_sample_t *const restrict samples)
+{
+    ASSERT(game_state);
+    ASSERT(game_memory);
+    ASSERT(samples);
+
+    memset(samples, 0,
+           game_memory_region_id_count * sizeof(game_memory_region_sample_t));
+
+    game_memory_region_sample_t *sample =
+        &samples[game_memory_region_id_permanent_block];
+    sample->capacity = game_memory->permanent_memory_block_size;
+    sample->used = sizeof(game_state_t);
+
+    const game_world_t *world = &game_state->game_world;
+
+    sample = &samples[game_memory_region_id_tile_chunks];
+    sample->capacity =
+        GAME_MAX_LOADED_TILE_CHUNKS * sizeof(game_tile_chunk_slot_t);
+    for (u32 i = 0; i < GAME_MAX_LOADED_TILE_CHUNKS; i++)
+    {
+        if (world->tile_chunk_slots[i].state != game_tile_chunk_state_unloaded)
+        {
+            sample->used += sizeof(game_tile_chunk_slot_t);
+        }
+    }
+    sample->allocation_counter = world->generated_tile_chunk_count;
+    sample->overflow_counter = world->tile_chunk_slot_miss_count;
+
+    const game_tile_edits_t *tile_edits = &world->tile_edits;
+
+    sample = &samples[game_memory_region_id_tile_edits];
+    sample->capacity =
+        GAME_MAX_TILE_EDITS * sizeof(game_tile_edit_t) +
+        GAME_MAX_EDITED_TILE_CHUNKS * sizeof(game_edited_tile_chunk_t);
+    sample->used =
+        tile_edits->edit_count * sizeof(game_tile_edit_t) +
+        tile_edits->edited_chunk_count * sizeof(game_edited_tile_chunk_t);
+    sample->allocation_counter = tile_edits->edit_count;
+    sample->overflow_counter = tile_edits->dropped_edit_count;
+
+    const game_light_t *light = &game_state->light;
+
+    sample = &samples[game_memory_region_id_light_queues];
+    sample->capacity =
+        2 * GAME_LIGHT_QUEUE_SIZE * sizeof(game_light_queue_entry_t);
+    sample->used =
+        ((light->darken_queue_write_count - light->darken_queue_read_count) +
+         (light->spread_queue_write_count - light->spread_queue_read_count)) *
+        sizeof(game_light_queue_entry_t);
+    sample->frame_high_water =
+        light->peak_queued_entry_count * sizeof(game_light_queue_entry_t);
+    sample->allocation_counter = light->queued_entry_count;
+    sample->overflow_counter = light->dropped_queue_entry_count;
+
+    sample = &samples[game_memory_region_id_flow_fields];
+    sample->capacity = GAME_MAX_FLOW_FIELDS * sizeof(game_flow_field_t);
+    for (u32 i = 0; i < GAME_MAX_FLOW_FIELDS; i++)
+    {
+        if (game_state->nav.flow_fields[i].is_valid)
+        {
+            sample->used += sizeof(game_flow_field_t);
+        }
+    }
+    sample->allocation_counter = game_state->nav.flow_field_build_count;
+
+    sample = &samples[game_memory_region_id_agents];
+    sample->capacity = GAME_MAX_AGENTS * sizeof(game_agent_t);
+    sample->used = game_state->agent_count * sizeof(game_agent_t);
+    sample->allocation_counter = game_state->agent_count;
+
+    const game_audio_t *audio = &game_state->audio;
+
+    sample = &samples[game_memory_region_id_playing_sounds];
+    sample->capacity = GAME_MAX_PLAYING_SOUNDS * sizeof(game_playing_sound_t);
+    for (u32 i = 0; i < GAME_MAX_PLAYING_SOUNDS; i++)
+    {
+        if (audio->playing_sounds[i].is_active)
+        {
+            sample->used += sizeof(game_playing_sound_t);
+        }
+    }
+    sample->allocation_counter = audio->played_sound_count;
+    sample->overflow_counter = audio->dropped_sound_count;
+
+    // NOTE: The save buffer is not in game memory (see game_save.c), but it is
+    // a fixed size pool all the same.
+    sample = &samples[game_memory_region_id_save_buffer];
+    sample->capacity = GAME_SAVE_BUFFER_SIZE;
+    sample->used = g_save_write.data_size;
+    sample->allocation_counter = game_state->save.save_count;
+}
+
+internal void game_memory_stats_print(
+    game_platform_services_t *const restrict platform_services,
+    const char *const restrict text)
+{
+    if (platform_services->debug_print)
+    {
+        platform_services->debug_print(text);
+    }
+}
+
+// Writes one line per region : name, capacity, used, frame high water, high
+// water (all in bytes), allocations in the last frame, allocations and
+// overflows.
+// The file is written on the I/O work queue (if any), so the game thread does
+// not wait for the disk.
+internal void game_dump_memory_stats(
+    game_memory_stats_t *const restrict memory_stats,
+    game_platform_services_t *const restrict platform_services)
+{
+    ASSERT(memory_stats);
+    ASSERT(platform_services);
+
+    // NOTE: Counted whether or not this dump is written, as game state must not
+    // depend on how fast the disk is.
+    memory_stats->dump_count++;
+
+    // Nothing to format for (e.g headless replays).
+    if (!platform_services->debug_print && !platform_services->write_to_file)
+    {
+        return;
+    }
+
+    game_memory_stats_write_t *write = &g_memory_stats_write;
+
+    // NOTE: The previous dump is still being written (the disk is slow). The
+    // counts are cumulative, so the next dump covers this one.
+    if (write->is_pending)
+    {
+        return;
+    }
+
+    char *text = write->text;
+    const u32 text_size = sizeof(write->text);
+
+    u32 text_length = (u32)snprintf(
+        text, text_size,
+        "# region capacity used frame_high_water high_water "
+        "frame_allocation_count allocation_count overflow_count\n");
+
+    for (u32 i = 0; i < game_memory_region_id_count; i++)
+    {
+        const game_memory_region_t *region = &memory_stats->regions[i];
+
+        ASSERT(text_length < text_size);
+        text_length += (u32)snprintf(
+            text + text_length, text_size - text_length,
+            "%s %llu %llu %llu %llu %u %llu %llu\n", g_memory_region_names[i],
+            (unsigned long long)region->capacity,
+            (unsigned long long)region->used,
+            (unsigned long long)region->frame_high_water,
+            (unsigned long long)region->high_water,
+            region->frame_allocation_count,
+            (unsigned long long)region->allocation_count,
+            (unsigned long long)region->overflow_count);
+    }
+
+    game_memory_stats_print(platform_services, text);
+
+    if (platform_services->write_to_file)
+    {
+        write->write_to_file = platform_services->write_to_file;
+        write->is_pending = true;
+
+        if (platform_services->io_work_queue)
+        {
+            platform_services->add_work_queue_entry(
+                platform_services->io_work_queue, game_memory_stats_write_work,
+                write);
+        }
+        else
+        {
+            game_memory_stats_write_work(NULL, write);
+        }
+    }
+}
+
+// Change of a subsystem counter since the last sample. Not every counter only
+// ever increases (e.g the agent count, or counters restored by loading a
+// save), one that went down counts as no allocations rather than wrapping
+// around.
+internal u64 game_get_memory_counter_delta(const u64 counter,
+                                           const u64 last_counter)
+{
+    return counter > last_counter ? counter - last_counter : 0;
+}
+
+// Called once per frame, once the frame's simulation is done.
+internal void game_update_memory_stats(
+    game_state_t *const restrict game_state,
+    const game_memory_t *const restrict game_memory, const f32 delta_time,
+    game_platform_services_t *const restrict platform_services)
+{
+    ASSERT(game_state);
+    ASSERT(platform_services);
+
+    game_memory_stats_t *memory_stats = &game_state->memory_stats;
+
+    game_memory_region_sample_t samples[game_memory_region_id_count];
+    game_sample_memory_regions(game_state, game_memory, samples);
+
+    for (u32 i = 0; i < game_memory_region_id_count; i++)
+    {
+        const game_memory_region_sample_t *sample = &samples[i];
+        game_memory_region_t *region = &memory_stats->regions[i];
+
+        region->capacity = sample->capacity;
+        region->used = sample->used;
+        region->frame_high_water = sample->frame_high_water > sample->used
+                                       ? sample->frame_high_water
+                                       : sample->used;
+        if (region->frame_high_water > region->high_water)
+        {
+            region->high_water = region->frame_high_water;
+        }
+
+        region->frame_allocation_count = (u32)game_get_memory_counter_delta(
+            sample->allocation_counter,
+            memory_stats->last_allocation_counters[i]);
+        region->allocation_count += region->frame_allocation_count;
+
+        const u64 overflow_count = game_get_memory_counter_delta(
+            sample->overflow_counter, memory_stats->last_overflow_counters[i]);
+        region->overflow_count += overflow_count;
+
+        memory_stats->last_allocation_counters[i] = sample->allocation_counter;
+        memory_stats->last_overflow_counters[i] = sample->overflow_counter;
+
+        // Early warning, reported once when the region gets nearly full (and
+        // again after it went back below the threshold).
+        const b32 is_near_full =
+            region->frame_high_water * 100 >=
+            region->capacity * GAME_MEMORY_WARNING_PERCENT;
+
+        if ((is_near_full && !region->is_near_full) || overflow_count)
+        {
+            char text[256];
+            snprintf(text, sizeof(text),
+                     "Memory : %s is %llu%% full (%llu of %llu bytes), %llu "
+                     "allocations did not fit this frame.\n",
+                     g_memory_region_names[i],
+                     (unsigned long long)(region->frame_high_water * 100 /
+                                          region->capacity),
+                     (unsigned long long)region->frame_high_water,
+                     (unsigned long long)region->capacity,
+                     (unsigned long long)overflow_count);
+            game_memory_stats_print(platform_services, text);
+
+            memory_stats->warning_count++;
+        }
+
+        region->is_near_full = is_near_full;
+    }
+
+    memory_stats->ms_since_dump += delta_time;
+    if (memory_stats->ms_since_dump >= GAME_MEMORY_STATS_DUMP_INTERVAL_MS)
+    {
+        memory_stats->ms_since_dump = 0.0f;
+        game_dump_memory_stats(memory_stats, platform_services);
+    }
+}
@@ -0,0 +1,1113 @@
+// Hierarchical pathfinding and flow fields.
+// See the navigation section of game.h for the cluster / node layout.
+// Node graph searches (A*) find the sequence of portals to go through, and
+// the path is then refined one cluster at a time (a breadth first search over
+// at most GAME_NAV_CLUSTER_DIM^2 tiles), only as far as the caller needs it.
+// Clusters are (re)built incrementally on the game thread : when their chunk
+// is loaded, when a neighbouring chunk is loaded or evicted, and when a tile
+// in or next to them changes.
+
+#define GAME_NAV_CLUSTER_TILE_COUNT                                            \
+    (GAME_NAV_CLUSTER_DIM * GAME_NAV_CLUSTER_DIM)
+
+// Upper bound on the cluster builds per frame, so that loading a chunk does
+// not cause a spike in frame time.
+#define GAME_NAV_MAX_CLUSTER_BUILDS_PER_FRAME 32u
+
+#define GAME_NAV_NODES_PER_CHUNK                                               \
+    (GAME_NAV_CLUSTERS_PER_CHUNK * GAME_NAV_MAX_CLUSTER_NODES)
+
+#define GAME_NAV_START_NODE_ID (GAME_NAV_MAX_NODES)
+#define GAME_NAV_GOAL_NODE_ID (GAME_NAV_MAX_NODES + 1)
+#define GAME_NAV_INVALID_NODE_ID 0xffffffffu
+
+// Values of node_heap_indices for nodes that are not in the open heap.
+#define GAME_NAV_NODE_NOT_OPENED 0xffffffffu
+#define GAME_NAV_NODE_CLOSED 0xfffffffeu
+
+// Max number of nodes on a path through the node graph.
+#define GAME_NAV_MAX_PATH_NODES 1024u
+
+// Clusters along each side of a chunk (bit i -> cluster i).
+#define GAME_NAV_WEST_BORDER_CLUSTER_MASK 0x0101010101010101ull
+#define GAME_NAV_EAST_BORDER_CLUSTER_MASK 0x8080808080808080ull
+#define GAME_NAV_SOUTH_BORDER_CLUSTER_MASK 0x00000000000000ffull
+#define GAME_NAV_NORTH_BORDER_CLUSTER_MASK 0xff00000000000000ull
+
+// Position of a tile in the node graph.
+typedef struct
+{
+    u32 slot_index;
+    u32 cluster_index;
+
+    // Relative to the cluster's bottom left tile.
+    u32 x;
+    u32 y;
+} game_nav_location_t;
+
+internal i32 game_nav_get_direction_x(const u32 direction)
+{
+    return direction == game_nav_direction_west   ? -1
+           : direction == game_nav_direction_east ? 1
+                                                  : 0;
+}
+
+internal i32 game_nav_get_direction_y(const u32 direction)
+{
+    return direction == game_nav_direction_south   ? -1
+           : direction == game_nav_direction_north ? 1
+                                                   : 0;
+}
+
+internal u32 game_nav_get_opposite_direction(const u32 direction)
+{
+    switch (direction)
+    {
+    case game_nav_direction_west:
+        return game_nav_direction_east;
+    case game_nav_direction_east:
+        return game_nav_direction_west;
+    case game_nav_direction_south:
+        return game_nav_direction_north;
+    case game_nav_direction_north:
+        return game_nav_direction_south;
+    }
+
+    return game_nav_direction_none;
+}
+
+// Distance along one axis of the toroidal world (in tiles).
+internal u32 game_nav_get_tile_distance(const u32 a, const u32 b)
+{
+    const i32 delta = (i32)(a - b);
+    return delta < 0 ? (u32)-delta : (u32)delta;
+}
+
+internal u32 game_nav_get_lowest_set_bit(const u64 mask)
+{
+    ASSERT(mask);
+
+    u32 bit = 0;
+    while (!(mask & (1ull << bit)))
+    {
+        bit++;
+    }
+
+    return bit;
+}
+
+internal b32 game_nav_locate_tile(game_world_t *const restrict world,
+                                  const u32 tile_x, const u32 tile_y,
+                                  game_nav_location_t *const restrict location)
+{
+    ASSERT(world);
+    ASSERT(location);
+
+    game_tile_chunk_slot_t *slot = game_find_tile_chunk_slot(
+        world, GET_CHUNK_INDEX_IN_WORLD(tile_x),
+        GET_CHUNK_INDEX_IN_WORLD(tile_y));
+
+    if (!slot || slot->state != game_tile_chunk_state_loaded)
+    {
+        return false;
+    }
+
+    const u32 tile_x_in_chunk = GET_TILE_INDEX_IN_CHUNK(tile_x);
+    const u32 tile_y_in_chunk = GET_TILE_INDEX_IN_CHUNK(tile_y);
+
+    location->slot_index = (u32)(slot - world->tile_chunk_slots);
+    location->cluster_index =
+        (tile_y_in_chunk / GAME_NAV_CLUSTER_DIM) *
+            GAME_NAV_CLUSTERS_PER_CHUNK_DIM +
+        tile_x_in_chunk / GAME_NAV_CLUSTER_DIM;
+    location->x = tile_x_in_chunk % GAME_NAV_CLUSTER_DIM;
+    location->y = tile_y_in_chunk % GAME_NAV_CLUSTER_DIM;
+
+    return true;
+}
+
+// Clusters that are waiting to be rebuilt can not be used.
+internal b32 game_nav_locate_tile_in_built_cluster(
+    game_world_t *const restrict world, const u32 tile_x, const u32 tile_y,
+    game_nav_location_t *const restrict location)
+{
+    if (!game_nav_locate_tile(world, tile_x, tile_y, location))
+    {
+        return false;
+    }
+
+    const game_nav_chunk_t *nav_chunk =
+        &world->tile_chunk_slots[location->slot_index].nav;
+
+    return !(nav_chunk->dirty_cluster_mask &
+             (1ull << location->cluster_index));
+}
+
+// Absolute tile indices of the cluster's bottom left tile.
+internal void game_nav_get_cluster_origin(game_world_t *const restrict world,
+                                          const u32 slot_index,
+                                          const u32 cluster_index,
+                                          u32 *const restrict tile_x,
+                                          u32 *const restrict tile_y)
+{
+    ASSERT(world);
+    ASSERT(tile_x);
+    ASSERT(tile_y);
+
+    const game_tile_chunk_slot_t *slot = &world->tile_chunk_slots[slot_index];
+
+    *tile_x = slot->chunk_x * TILE_CHUNK_DIM +
+              (cluster_index % GAME_NAV_CLUSTERS_PER_CHUNK_DIM) *
+                  GAME_NAV_CLUSTER_DIM;
+    *tile_y = slot->chunk_y * TILE_CHUNK_DIM +
+              (cluster_index / GAME_NAV_CLUSTERS_PER_CHUNK_DIM) *
+                  GAME_NAV_CLUSTER_DIM;
+}
+
+// Breadth first search within a cluster, starting at the target tile.
+// Fills the distance (in tiles) to the target, and the direction to move in
+// to get closer to it, for every tile of the cluster (GAME_NAV_UNREACHABLE /
+// none if the target can not be reached without leaving the cluster).
+internal void game_nav_search_cluster(
+    const game_tile_chunk_t *const restrict chunk, const u32 cluster_index,
+    const u32 target_x, const u32 target_y, u16 *const restrict distances,
+    u8 *const restrict directions)
+{
+    ASSERT(chunk);
+    ASSERT(distances);
+    ASSERT(target_x < GAME_NAV_CLUSTER_DIM && target_y < GAME_NAV_CLUSTER_DIM);
+
+    const u32 cluster_x = (cluster_index % GAME_NAV_CLUSTERS_PER_CHUNK_DIM) *
+                          GAME_NAV_CLUSTER_DIM;
+    const u32 cluster_y = (cluster_index / GAME_NAV_CLUSTERS_PER_CHUNK_DIM) *
+                          GAME_NAV_CLUSTER_DIM;
+
+    u16 queue[GAME_NAV_CLUSTER_TILE_COUNT];
+    u32 queue_read_index = 0;
+    u32 queue_write_index = 0;
+
+    for (u32 i = 0; i < GAME_NAV_CLUSTER_TILE_COUNT; i++)
+    {
+        distances[i] = GAME_NAV_UNREACHABLE;
+    }
+
+    if (directions)
+    {
+        memset(directions, game_nav_direction_none,
+               GAME_NAV_CLUSTER_TILE_COUNT);
+    }
+
+    if (chunk->tiles[get_tile_index_in_chunk(cluster_x + target_x,
+                                             cluster_y + target_y)] != 0)
+    {
+        return;
+    }
+
+    const u16 target_index = (u16)(target_y * GAME_NAV_CLUSTER_DIM + target_x);
+    distances[target_index] = 0;
+    queue[queue_write_index++] = target_index;
+
+    while (queue_read_index < queue_write_index)
+    {
+        const u16 index = queue[queue_read_index++];
+        const i32 x = index % GAME_NAV_CLUSTER_DIM;
+        const i32 y = index / GAME_NAV_CLUSTER_DIM;
+
+        for (u32 direction = game_nav_direction_west;
+             direction <= game_nav_direction_north; direction++)
+        {
+            const i32 neighbor_x = x + game_nav_get_direction_x(direction);
+            const i32 neighbor_y = y + game_nav_get_direction_y(direction);
+
+            if (neighbor_x < 0 || neighbor_x >= (i32)GAME_NAV_CLUSTER_DIM ||
+                neighbor_y < 0 || neighbor_y >= (i32)GAME_NAV_CLUSTER_DIM)
+            {
+                continue;
+            }
+
+            const u16 neighbor_index =
+                (u16)(neighbor_y * GAME_NAV_CLUSTER_DIM + neighbor_x);
+
+            if (distances[neighbor_index] != GAME_NAV_UNREACHABLE ||
+                chunk->tiles[get_tile_index_in_chunk(
+                    cluster_x + (u32)neighbor_x,
+                    cluster_y + (u32)neighbor_y)] != 0)
+            {
+                continue;
+            }
+
+            distances[neighbor_index] = distances[index] + 1;
+            if (directions)
+            {
+                directions[neighbor_index] =
+                    (u8)game_nav_get_opposite_direction(direction);
+            }
+
+            queue[queue_write_index++] = neighbor_index;
+        }
+    }
+}
+
+internal void game_nav_build_cluster(game_world_t *const restrict world,
+                                     const u32 slot_index,
+                                     const u32 cluster_index)
+{
+    ASSERT(world);
+    ASSERT(slot_index < GAME_MAX_LOADED_TILE_CHUNKS);
+    ASSERT(cluster_index < GAME_NAV_CLUSTERS_PER_CHUNK);
+
+    game_tile_chunk_slot_t *slot = &world->tile_chunk_slots[slot_index];
+    game_nav_cluster_t *cluster = &slot->nav.clusters[cluster_index];
+
+    const u32 cluster_x = (cluster_index % GAME_NAV_CLUSTERS_PER_CHUNK_DIM) *
+                          GAME_NAV_CLUSTER_DIM;
+    const u32 cluster_y = (cluster_index / GAME_NAV_CLUSTERS_PER_CHUNK_DIM) *
+                          GAME_NAV_CLUSTER_DIM;
+
+    u32 origin_x = 0;
+    u32 origin_y = 0;
+    game_nav_get_cluster_origin(world, slot_index, cluster_index, &origin_x,
+                                &origin_y);
+
+    cluster->node_count = 0;
+
+    // Find the portals along each side : runs of border tiles that are
+    // walkable, and whose neighbour across the border is walkable too. Each
+    // portal gets a node in the middle of the run.
+    // NOTE: A side's tiles (and their neighbours) are tested at once with the
+    // chunks' solid bits, and runs are found with bit scans.
+    const u32 last = GAME_NAV_CLUSTER_DIM - 1;
+    const u64 side_mask = (1ull << GAME_NAV_CLUSTER_DIM) - 1;
+
+    for (u32 direction = game_nav_direction_west;
+         direction <= game_nav_direction_north; direction++)
+    {
+        const b32 is_vertical_side = direction == game_nav_direction_west ||
+                                     direction == game_nav_direction_east;
+
+        // First tile of the side, relative to the cluster.
+        const u32 x = direction == game_nav_direction_east ? last : 0;
+        const u32 y = direction == game_nav_direction_north ? last : 0;
+
+        const u64 solid_bits =
+            (is_vertical_side
+                 ? game_get_solid_tile_bits_in_chunk_column(
+                       &slot->tile_chunk, cluster_x + x, cluster_y + y,
+                       GAME_NAV_CLUSTER_DIM)
+                 : game_get_solid_tile_bits_in_chunk_row(
+                       &slot->tile_chunk, cluster_x + x, cluster_y + y,
+                       GAME_NAV_CLUSTER_DIM)) |
+            get_solid_tile_bits_in_world(
+                world, origin_x + x + game_nav_get_direction_x(direction),
+                origin_y + y + game_nav_get_direction_y(direction),
+                GAME_NAV_CLUSTER_DIM, is_vertical_side);
+
+        u64 walkable_bits = ~solid_bits & side_mask;
+
+        while (walkable_bits)
+        {
+            // The run ends at the first tile after its start that is not
+            // walkable (at the latest, one past the side's last tile).
+            const u32 run_start = find_first_set_bit_u64(walkable_bits);
+            const u32 run_end = find_first_set_bit_u64(
+                ~walkable_bits & ~((1ull << run_start) - 1));
+
+            walkable_bits &= ~((1ull << run_end) - 1);
+
+            // NOTE: Portals past the node limit are dropped (the cluster is
+            // then not connected through them).
+            if (cluster->node_count < GAME_NAV_MAX_CLUSTER_NODES)
+            {
+                const u32 middle = (run_start + run_end - 1) / 2;
+                const u32 node_index = cluster->node_count++;
+
+                cluster->node_x[node_index] =
+                    (u8)(is_vertical_side ? x : middle);
+                cluster->node_y[node_index] =
+                    (u8)(is_vertical_side ? middle : y);
+                cluster->node_directions[node_index] = (u8)direction;
+            }
+        }
+    }
+
+    // Path lengths between all nodes.
+    u16 distances[GAME_NAV_CLUSTER_TILE_COUNT];
+
+    for (u32 i = 0; i < cluster->node_count; i++)
+    {
+        game_nav_search_cluster(&slot->tile_chunk, cluster_index,
+                                cluster->node_x[i], cluster->node_y[i],
+                                distances, NULL);
+
+        for (u32 j = 0; j < cluster->node_count; j++)
+        {
+            cluster->node_distances[i][j] =
+                distances[cluster->node_y[j] * GAME_NAV_CLUSTER_DIM +
+                          cluster->node_x[j]];
+        }
+    }
+}
+
+// Marks the clusters whose nodes depend on the tile as dirty : the tile's own
+// cluster, and the neighbouring cluster when the tile is on a border.
+internal void game_nav_invalidate_tile(game_nav_t *const restrict nav,
+                                       game_world_t *const restrict world,
+                                       const u32 tile_x, const u32 tile_y)
+{
+    ASSERT(nav);
+    ASSERT(world);
+
+    game_nav_location_t location = {0};
+    if (game_nav_locate_tile(world, tile_x, tile_y, &location))
+    {
+        world->tile_chunk_slots[location.slot_index].nav.dirty_cluster_mask |=
+            1ull << location.cluster_index;
+    }
+
+    for (u32 direction = game_nav_direction_west;
+         direction <= game_nav_direction_north; direction++)
+    {
+        game_nav_location_t neighbor = {0};
+        if (game_nav_locate_tile(
+                world, tile_x + game_nav_get_direction_x(direction),
+                tile_y + game_nav_get_direction_y(direction), &neighbor))
+        {
+            world->tile_chunk_slots[neighbor.slot_index]
+                .nav.dirty_cluster_mask |= 1ull << neighbor.cluster_index;
+        }
+    }
+
+    for (u32 i = 0; i < GAME_MAX_FLOW_FIELDS; i++)
+    {
+        game_flow_field_t *flow_field = &nav->flow_fields[i];
+
+        const u32 field_x =
+            tile_x - (flow_field->goal_x - GAME_FLOW_FIELD_DIM / 2);
+        const u32 field_y =
+            tile_y - (flow_field->goal_y - GAME_FLOW_FIELD_DIM / 2);
+
+        if (field_x < GAME_FLOW_FIELD_DIM && field_y < GAME_FLOW_FIELD_DIM)
+        {
+            flow_field->is_valid = false;
+        }
+    }
+}
+
+// Called once per frame, before any searches. Rebuilds dirty clusters, closest
+// to the center chunk first.
+internal void game_update_nav(game_nav_t *const restrict nav,
+                              game_world_t *const restrict world,
+                              const u32 center_chunk_x,
+                              const u32 center_chunk_y)
+{
+    ASSERT(nav);
+    ASSERT(world);
+
+    nav->frame_index++;
+
+    const u64 border_cluster_masks[] = {
+        0,
+        GAME_NAV_WEST_BORDER_CLUSTER_MASK,
+        GAME_NAV_EAST_BORDER_CLUSTER_MASK,
+        GAME_NAV_SOUTH_BORDER_CLUSTER_MASK,
+        GAME_NAV_NORTH_BORDER_CLUSTER_MASK,
+    };
+
+    // Portals on a chunk's border depend on the neighbouring chunk, so border
+    // clusters are rebuilt whenever a neighbour is loaded or evicted.
+    for (u32 i = 0; i < GAME_MAX_LOADED_TILE_CHUNKS; i++)
+    {
+        game_tile_chunk_slot_t *slot = &world->tile_chunk_slots[i];
+        if (slot->state != game_tile_chunk_state_loaded)
+        {
+            continue;
+        }
+
+        u32 loaded_neighbor_mask = 0;
+        for (u32 direction = game_nav_direction_west;
+             direction <= game_nav_direction_north; direction++)
+        {
+            if (get_tile_chunk_from_world(
+                    world,
+                    (slot->chunk_x + game_nav_get_direction_x(direction)) &
+                        TILE_CHUNK_INDEX_MASK,
+                    (slot->chunk_y + game_nav_get_direction_y(direction)) &
+                        TILE_CHUNK_INDEX_MASK))
+            {
+                loaded_neighbor_mask |= 1u << direction;
+            }
+        }
+
+        const u32 changed_mask =
+            loaded_neighbor_mask ^ slot->nav.loaded_neighbor_mask;
+
+        for (u32 direction = game_nav_direction_west;
+             direction <= game_nav_direction_north; direction++)
+        {
+            if (changed_mask & (1u << direction))
+            {
+                slot->nav.dirty_cluster_mask |= border_cluster_masks[direction];
+            }
+        }
+
+        slot->nav.loaded_neighbor_mask = loaded_neighbor_mask;
+    }
+
+    u32 build_budget = GAME_NAV_MAX_CLUSTER_BUILDS_PER_FRAME;
+
+    for (u32 radius = 0; radius <= GAME_TILE_CHUNK_LOAD_RADIUS; radius++)
+    {
+        for (u32 i = 0; i < GAME_MAX_LOADED_TILE_CHUNKS && build_budget; i++)
+        {
+            game_tile_chunk_slot_t *slot = &world->tile_chunk_slots[i];
+            if (slot->state != game_tile_chunk_state_loaded)
+            {
+                continue;
+            }
+
+            const u32 distance_x =
+                game_get_tile_chunk_distance(slot->chunk_x, center_chunk_x);
+            const u32 distance_y =
+                game_get_tile_chunk_distance(slot->chunk_y, center_chunk_y);
+
+            if ((distance_x > distance_y ? distance_x : distance_y) != radius)
+            {
+                continue;
+            }
+
+            while (slot->nav.dirty_cluster_mask && build_budget)
+            {
+                const u32 cluster_index =
+                    game_nav_get_lowest_set_bit(slot->nav.dirty_cluster_mask);
+
+                game_nav_build_cluster(world, i, cluster_index);
+
+                slot->nav.dirty_cluster_mask &= ~(1ull << cluster_index);
+                build_budget--;
+                nav->rebuilt_cluster_count++;
+            }
+        }
+    }
+}
+
+internal u32 game_nav_get_node_id(const u32 slot_index, const u32 cluster_index,
+                                  const u32 node_index)
+{
+    return slot_index * GAME_NAV_NODES_PER_CHUNK +
+           cluster_index * GAME_NAV_MAX_CLUSTER_NODES + node_index;
+}
+
+internal void game_nav_get_node_tile(game_world_t *const restrict world,
+                                     const u32 node_id, u32 *const restrict x,
+                                     u32 *const restrict y)
+{
+    ASSERT(node_id < GAME_NAV_MAX_NODES);
+
+    const u32 slot_index = node_id / GAME_NAV_NODES_PER_CHUNK;
+    const u32 cluster_index =
+        (node_id / GAME_NAV_MAX_CLUSTER_NODES) % GAME_NAV_CLUSTERS_PER_CHUNK;
+    const u32 node_index = node_id % GAME_NAV_MAX_CLUSTER_NODES;
+
+    const game_nav_cluster_t *cluster =
+        &world->tile_chunk_slots[slot_index].nav.clusters[cluster_index];
+
+    game_nav_get_cluster_origin(world, slot_index, cluster_index, x, y);
+
+    *x += cluster->node_x[node_index];
+    *y += cluster->node_y[node_index];
+}
+
+// Returns the node on the other side of the node's portal.
+internal u32 game_nav_find_partner_node(game_world_t *const restrict world,
+                                        const u32 node_id)
+{
+    const u32 slot_index = node_id / GAME_NAV_NODES_PER_CHUNK;
+    const u32 cluster_index =
+        (node_id / GAME_NAV_MAX_CLUSTER_NODES) % GAME_NAV_CLUSTERS_PER_CHUNK;
+    const u32 node_index = node_id % GAME_NAV_MAX_CLUSTER_NODES;
+
+    const u32 direction = world->tile_chunk_slots[slot_index]
+                              .nav.clusters[cluster_index]
+                              .node_directions[node_index];
+
+    u32 x = 0;
+    u32 y = 0;
+    game_nav_get_node_tile(world, node_id, &x, &y);
+
+    game_nav_location_t partner = {0};
+    if (!game_nav_locate_tile_in_built_cluster(
+            world, x + game_nav_get_direction_x(direction),
+            y + game_nav_get_direction_y(direction), &partner))
+    {
+        return GAME_NAV_INVALID_NODE_ID;
+    }
+
+    const game_nav_cluster_t *partner_cluster =
+        &world->tile_chunk_slots[partner.slot_index]
+             .nav.clusters[partner.cluster_index];
+
+    const u32 partner_direction = game_nav_get_opposite_direction(direction);
+
+    for (u32 i = 0; i < partner_cluster->node_count; i++)
+    {
+        if (partner_cluster->node_x[i] == partner.x &&
+            partner_cluster->node_y[i] == partner.y &&
+            partner_cluster->node_directions[i] == partner_direction)
+        {
+            return game_nav_get_node_id(partner.slot_index,
+                                        partner.cluster_index, i);
+        }
+    }
+
+    return GAME_NAV_INVALID_NODE_ID;
+}
+
+internal void
+game_nav_swap_heap_entries(game_nav_search_t *const restrict search,
+                           const u32 a, const u32 b)
+{
+    const u32 node_a = search->open_heap[a];
+    const u32 node_b = search->open_heap[b];
+
+    search->open_heap[a] = node_b;
+    search->open_heap[b] = node_a;
+
+    search->node_heap_indices[node_b] = a;
+    search->node_heap_indices[node_a] = b;
+}
+
+internal void game_nav_sift_up(game_nav_search_t *const restrict search,
+                               u32 heap_index)
+{
+    while (heap_index > 0)
+    {
+        const u32 parent_index = (heap_index - 1) / 2;
+
+        if (search->node_estimates[search->open_heap[parent_index]] <=
+            search->node_estimates[search->open_heap[heap_index]])
+        {
+            break;
+        }
+
+        game_nav_swap_heap_entries(search, heap_index, parent_index);
+        heap_index = parent_index;
+    }
+}
+
+internal u32 game_nav_pop_open_node(game_nav_search_t *const restrict search)
+{
+    ASSERT(search->open_count > 0);
+
+    const u32 node_id = search->open_heap[0];
+
+    search->open_count--;
+    if (search->open_count > 0)
+    {
+        game_nav_swap_heap_entries(search, 0, search->open_count);
+    }
+
+    u32 heap_index = 0;
+    for (;;)
+    {
+        const u32 left = 2 * heap_index + 1;
+        const u32 right = left + 1;
+        u32 smallest = heap_index;
+
+        if (left < search->open_count &&
+            search->node_estimates[search->open_heap[left]] <
+                search->node_estimates[search->open_heap[smallest]])
+        {
+            smallest = left;
+        }
+
+        if (right < search->open_count &&
+            search->node_estimates[search->open_heap[right]] <
+                search->node_estimates[search->open_heap[smallest]])
+        {
+            smallest = right;
+        }
+
+        if (smallest == heap_index)
+        {
+            break;
+        }
+
+        game_nav_swap_heap_entries(search, heap_index, smallest);
+        heap_index = smallest;
+    }
+
+    search->node_heap_indices[node_id] = GAME_NAV_NODE_CLOSED;
+
+    return node_id;
+}
+
+// Opens the node, or lowers its cost if a cheaper path to it was found.
+internal void game_nav_relax_node(game_nav_search_t *const restrict search,
+                                  const u32 node_id, const u32 parent_node_id,
+                                  const u32 cost, const u32 heuristic)
+{
+    if (search->node_search_ids[node_id] != search->search_id)
+    {
+        search->node_search_ids[node_id] = search->search_id;
+        search->node_costs[node_id] = 0xffffffff;
+        search->node_heap_indices[node_id] = GAME_NAV_NODE_NOT_OPENED;
+    }
+
+    if (search->node_heap_indices[node_id] == GAME_NAV_NODE_CLOSED ||
+        cost >= search->node_costs[node_id])
+    {
+        return;
+    }
+
+    search->node_costs[node_id] = cost;
+    search->node_estimates[node_id] = cost + heuristic;
+    search->node_parents[node_id] = parent_node_id;
+
+    if (search->node_heap_indices[node_id] == GAME_NAV_NODE_NOT_OPENED)
+    {
+        search->node_heap_indices[node_id] = search->open_count;
+        search->open_heap[search->open_count++] = node_id;
+    }
+
+    game_nav_sift_up(search, search->node_heap_indices[node_id]);
+}
+
+// Appends the steps from (from_x, from_y) to (to_x, to_y) within the cluster
+// to steps, up to max_steps. Returns false if there is no such path.
+internal b32 game_nav_append_cluster_path(
+    game_world_t *const restrict world, const u32 slot_index,
+    const u32 cluster_index, u32 x, u32 y, const u32 to_x, const u32 to_y,
+    u8 *const restrict steps, u32 *const restrict step_count,
+    const u32 max_steps)
+{
+    u16 distances[GAME_NAV_CLUSTER_TILE_COUNT];
+    u8 directions[GAME_NAV_CLUSTER_TILE_COUNT];
+
+    game_nav_search_cluster(&world->tile_chunk_slots[slot_index].tile_chunk,
+                            cluster_index, to_x, to_y, distances, directions);
+
+    if (distances[y * GAME_NAV_CLUSTER_DIM + x] == GAME_NAV_UNREACHABLE)
+    {
+        return false;
+    }
+
+    while ((x != to_x || y != to_y) && *step_count < max_steps)
+    {
+        const u8 direction = directions[y * GAME_NAV_CLUSTER_DIM + x];
+
+        steps[(*step_count)++] = direction;
+
+        x += game_nav_get_direction_x(direction);
+        y += game_nav_get_direction_y(direction);
+    }
+
+    return true;
+}
+
+// Finds a shortest path (through the node graph) from the start tile to the
+// goal tile, and writes its first max_steps steps (game_nav_direction_t) to
+// steps. Returns the number of steps written, 0 if there is no path (or start
+// and goal are the same tile).
+// NOTE: Only loaded chunks with built clusters are searched.
+internal u32 game_nav_find_path(game_nav_t *const restrict nav,
+                                game_world_t *const restrict world,
+                                const u32 start_x, const u32 start_y,
+                                const u32 goal_x, const u32 goal_y,
+                                u8 *const restrict steps, const u32 max_steps)
+{
+    ASSERT(nav);
+    ASSERT(world);
+    ASSERT(steps);
+
+    nav->path_search_count++;
+
+    game_nav_location_t start = {0};
+    game_nav_location_t goal = {0};
+
+    if (!game_nav_locate_tile_in_built_cluster(world, start_x, start_y,
+                                               &start) ||
+        !game_nav_locate_tile_in_built_cluster(world, goal_x, goal_y, &goal))
+    {
+        return 0;
+    }
+
+    u32 step_count = 0;
+
+    // Within a single cluster, a direct path is used if there is one.
+    const b32 is_same_cluster = start.slot_index == goal.slot_index &&
+                                start.cluster_index == goal.cluster_index;
+
+    if (is_same_cluster &&
+        game_nav_append_cluster_path(world, start.slot_index,
+                                     start.cluster_index, start.x, start.y,
+                                     goal.x, goal.y, steps, &step_count,
+                                     max_steps))
+    {
+        return step_count;
+    }
+
+    // Path lengths from the start to the nodes of its cluster, and from the
+    // nodes of the goal's cluster to the goal.
+    const game_nav_cluster_t *start_cluster =
+        &world->tile_chunk_slots[start.slot_index]
+             .nav.clusters[start.cluster_index];
+    const game_nav_cluster_t *goal_cluster =
+        &world->tile_chunk_slots[goal.slot_index]
+             .nav.clusters[goal.cluster_index];
+
+    u16 distances[GAME_NAV_CLUSTER_TILE_COUNT];
+    u16 start_node_distances[GAME_NAV_MAX_CLUSTER_NODES];
+    u16 goal_node_distances[GAME_NAV_MAX_CLUSTER_NODES];
+
+    game_nav_search_cluster(
+        &world->tile_chunk_slots[start.slot_index].tile_chunk,
+        start.cluster_index, start.x, start.y, distances, NULL);
+    for (u32 i = 0; i < start_cluster->node_count; i++)
+    {
+        start_node_distances[i] =
+            distances[start_cluster->node_y[i] * GAME_NAV_CLUSTER_DIM +
+                      start_cluster->node_x[i]];
+    }
+
+    game_nav_search_cluster(
+        &world->tile_chunk_slots[goal.slot_index].tile_chunk,
+        goal.cluster_index, goal.x, goal.y, distances, NULL);
+    for (u32 i = 0; i < goal_cluster->node_count; i++)
+    {
+        goal_node_distances[i] =
+            distances[goal_cluster->node_y[i] * GAME_NAV_CLUSTER_DIM +
+                      goal_cluster->node_x[i]];
+    }
+
+    // A* over the node graph. The heuristic is the manhattan distance, which
+    // never overestimates with 4 connected movement.
+    game_nav_search_t *search = &nav->search;
+
+    search->search_id++;
+    if (search->search_id == 0)
+    {
+        memset(search->node_search_ids, 0, sizeof(search->node_search_ids));
+        search->search_id = 1;
+    }
+    search->open_count = 0;
+
+    game_nav_relax_node(search, GAME_NAV_START_NODE_ID,
+                        GAME_NAV_INVALID_NODE_ID, 0, 0);
+
+    b32 found_goal = false;
+
+    while (search->open_count > 0)
+    {
+        const u32 node_id = game_nav_pop_open_node(search);
+        const u32 cost = search->node_costs[node_id];
+
+        if (node_id == GAME_NAV_GOAL_NODE_ID)
+        {
+            found_goal = true;
+            break;
+        }
+
+        u32 slot_index = start.slot_index;
+        u32 cluster_index = start.cluster_index;
+
+        const game_nav_cluster_t *cluster = start_cluster;
+        const u16 *node_distances = start_node_distances;
+
+        if (node_id != GAME_NAV_START_NODE_ID)
+        {
+            slot_index = node_id / GAME_NAV_NODES_PER_CHUNK;
+            cluster_index = (node_id / GAME_NAV_MAX_CLUSTER_NODES) %
+                            GAME_NAV_CLUSTERS_PER_CHUNK;
+
+            cluster = &world->tile_chunk_slots[slot_index]
+                           .nav.clusters[cluster_index];
+            node_distances =
+                cluster->node_distances[node_id % GAME_NAV_MAX_CLUSTER_NODES];
+
+            if (slot_index == goal.slot_index &&
+                cluster_index == goal.cluster_index)
+            {
+                const u16 goal_distance =
+                    goal_node_distances[node_id % GAME_NAV_MAX_CLUSTER_NODES];
+
+                if (goal_distance != GAME_NAV_UNREACHABLE)
+                {
+                    game_nav_relax_node(search, GAME_NAV_GOAL_NODE_ID, node_id,
+                                        cost + goal_distance, 0);
+                }
+            }
+
+            const u32 partner_node_id =
+                game_nav_find_partner_node(world, node_id);
+
+            if (partner_node_id != GAME_NAV_INVALID_NODE_ID)
+            {
+                u32 x = 0;
+                u32 y = 0;
+                game_nav_get_node_tile(world, partner_node_id, &x, &y);
+
+                game_nav_relax_node(search, partner_node_id, node_id, cost + 1,
+                                    game_nav_get_tile_distance(x, goal_x) +
+                                        game_nav_get_tile_distance(y, goal_y));
+            }
+        }
+
+        // Other nodes of the same cluster.
+        for (u32 i = 0; i < cluster->node_count; i++)
+        {
+            const u32 neighbor_node_id =
+                game_nav_get_node_id(slot_index, cluster_index, i);
+
+            if (neighbor_node_id == node_id ||
+                node_distances[i] == GAME_NAV_UNREACHABLE)
+            {
+                continue;
+            }
+
+            u32 x = 0;
+            u32 y = 0;
+            game_nav_get_node_tile(world, neighbor_node_id, &x, &y);
+
+            game_nav_relax_node(search, neighbor_node_id, node_id,
+                                cost + node_distances[i],
+                                game_nav_get_tile_distance(x, goal_x) +
+                                    game_nav_get_tile_distance(y, goal_y));
+        }
+    }
+
+    if (!found_goal)
+    {
+        return 0;
+    }
+
+    // Walk back from the goal to get the nodes in path order.
+    u32 path_nodes[GAME_NAV_MAX_PATH_NODES];
+    u32 path_node_count = 0;
+
+    for (u32 node_id = search->node_parents[GAME_NAV_GOAL_NODE_ID];
+         node_id != GAME_NAV_START_NODE_ID;
+         node_id = search->node_parents[node_id])
+    {
+        if (path_node_count == GAME_NAV_MAX_PATH_NODES)
+        {
+            return 0;
+        }
+
+        path_nodes[path_node_count++] = node_id;
+    }
+
+    // Refine the path one segment at a time (from the start), until enough
+    // steps are written.
+    game_nav_location_t location = start;
+
+    for (i32 i = (i32)path_node_count - 1; i >= -1; i--)
+    {
+        if (step_count == max_steps)
+        {
+            break;
+        }
+
+        game_nav_location_t target = goal;
+
+        if (i >= 0)
+        {
+            const u32 node_id = path_nodes[i];
+
+            target.slot_index = node_id / GAME_NAV_NODES_PER_CHUNK;
+            target.cluster_index = (node_id / GAME_NAV_MAX_CLUSTER_NODES) %
+                                   GAME_NAV_CLUSTERS_PER_CHUNK;
+
+            const game_nav_cluster_t *cluster =
+                &world->tile_chunk_slots[target.slot_index]
+                     .nav.clusters[target.cluster_index];
+
+            target.x = cluster->node_x[node_id % GAME_NAV_MAX_CLUSTER_NODES];
+            target.y = cluster->node_y[node_id % GAME_NAV_MAX_CLUSTER_NODES];
+        }
+
+        if (target.slot_index == location.slot_index &&
+            target.cluster_index == location.cluster_index)
+        {
+            game_nav_append_cluster_path(
+                world, location.slot_index, location.cluster_index,
+                location.x, location.y, target.x, target.y, steps,
+                &step_count, max_steps);
+        }
+        else
+        {
+            // Crossing a portal (a single step into the neighbouring cluster).
+            ASSERT(i + 1 < (i32)path_node_count);
+            const u32 previous_node_id = path_nodes[i + 1];
+
+            steps[step_count++] =
+                world->tile_chunk_slots[location.slot_index]
+                    .nav.clusters[location.cluster_index]
+                    .node_directions[previous_node_id %
+                                     GAME_NAV_MAX_CLUSTER_NODES];
+        }
+
+        location = target;
+    }
+
+    return step_count;
+}
+
+// Walkability of tiles for flow fields, caching the last chunk looked up.
+internal void game_build_flow_field(game_nav_t *const restrict nav,
+                                    game_world_t *const restrict world,
+                                    game_flow_field_t *const restrict field,
+                                    const u32 goal_x, const u32 goal_y)
+{
+    ASSERT(nav);
+    ASSERT(world);
+    ASSERT(field);
+
+    nav->flow_field_build_count++;
+
+    field->is_valid = true;
+    field->goal_x = goal_x;
+    field->goal_y = goal_y;
+    field->built_tile_chunk_count = world->generated_tile_chunk_count;
+
+    memset(field->directions, game_nav_direction_none,
+           sizeof(field->directions));
+
+    const u32 origin_x = goal_x - GAME_FLOW_FIELD_DIM / 2;
+    const u32 origin_y = goal_y - GAME_FLOW_FIELD_DIM / 2;
+    const u32 goal_index = (GAME_FLOW_FIELD_DIM / 2) * GAME_FLOW_FIELD_DIM +
+                           GAME_FLOW_FIELD_DIM / 2;
+
+    // NOTE: Tiles of chunks that are not loaded are invalid, and so not
+    // walkable.
+    u32 *tiles = nav->flow_field_tiles;
+    get_tile_values_in_rect(world, origin_x, origin_y, GAME_FLOW_FIELD_DIM,
+                            GAME_FLOW_FIELD_DIM, tiles, GAME_FLOW_FIELD_DIM);
+
+    b32 found_unloaded_tile = tiles[goal_index] == INVALID_TILE_VALUE;
+
+    u16 *queue = nav->flow_field_queue;
+    u32 queue_read_index = 0;
+    u32 queue_write_index = 0;
+
+    if (tiles[goal_index] == 0)
+    {
+        queue[queue_write_index++] = (u16)goal_index;
+    }
+
+    // Breadth first search from the goal. A tile was visited if it has a
+    // direction (the goal is the only visited tile without one).
+    while (queue_read_index < queue_write_index)
+    {
+        const u32 index = queue[queue_read_index++];
+        const i32 x = (i32)(index % GAME_FLOW_FIELD_DIM);
+        const i32 y = (i32)(index / GAME_FLOW_FIELD_DIM);
+
+        for (u32 direction = game_nav_direction_west;
+             direction <= game_nav_direction_north; direction++)
+        {
+            const i32 neighbor_x = x + game_nav_get_direction_x(direction);
+            const i32 neighbor_y = y + game_nav_get_direction_y(direction);
+
+            if (neighbor_x < 0 || neighbor_x >= (i32)GAME_FLOW_FIELD_DIM ||
+                neighbor_y < 0 || neighbor_y >= (i32)GAME_FLOW_FIELD_DIM)
+            {
+                continue;
+            }
+
+            const u32 neighbor_index =
+                (u32)neighbor_y * GAME_FLOW_FIELD_DIM + (u32)neighbor_x;
+
+            if (neighbor_index == goal_index ||
+                field->directions[neighbor_y][neighbor_x] !=
+                    game_nav_direction_none)
+            {
+                continue;
+            }
+
+            if (tiles[neighbor_index] != 0)
+            {
+                if (tiles[neighbor_index] == INVALID_TILE_VALUE)
+                {
+                    found_unloaded_tile = true;
+                }
+                continue;
+            }
+
+            field->directions[neighbor_y][neighbor_x] =
+                (u8)game_nav_get_opposite_direction(direction);
+
+            queue[queue_write_index++] = (u16)neighbor_index;
+        }
+    }
+
+    field->has_unloaded_tiles = found_unloaded_tile;
+}
+
+// Returns the (cached) flow field towards the goal tile.
+internal game_flow_field_t *
+game_get_flow_field(game_nav_t *const restrict nav,
+                    game_world_t *const restrict world, const u32 goal_x,
+                    const u32 goal_y)
+{
+    ASSERT(nav);
+    ASSERT(world);
+
+    game_flow_field_t *field = NULL;
+
+    for (u32 i = 0; i < GAME_MAX_FLOW_FIELDS; i++)
+    {
+        game_flow_field_t *cached_field = &nav->flow_fields[i];
+
+        if (cached_field->goal_x == goal_x && cached_field->goal_y == goal_y)
+        {
+            field = cached_field;
+            break;
+        }
+    }
+
+    if (field && field->is_valid &&
+        (!field->has_unloaded_tiles ||
+         field->built_tile_chunk_count == world->generated_tile_chunk_count))
+    {
+        field->last_used_frame_index = nav->frame_index;
+        return field;
+    }
+
+    // Replace the least recently used field.
+    if (!field)
+    {
+        field = &nav->flow_fields[0];
+        for (u32 i = 1; i < GAME_MAX_FLOW_FIELDS; i++)
+        {
+            if (nav->flow_fields[i].last_used_frame_index <
+                field->last_used_frame_index)
+            {
+                field = &nav->flow_fields[i];
+            }
+        }
+    }
+
+    game_build_flow_field(nav, world, field, goal_x, goal_y);
+    field->last_used_frame_index = nav->frame_index;
+
+    return field;
+}
+
+// Returns the direction to move in from the tile, none if the tile is outside
+// of the field, is the goal, or the goal can not be reached from it.
+internal u32
+game_get_flow_field_direction(const game_flow_field_t *const restrict field,
+                              const u32 tile_x, const u32 tile_y)
+{
+    ASSERT(field);
+
+    const u32 field_x = tile_x - (field->goal_x - GAME_FLOW_FIELD_DIM / 2);
+    const u32 field_y = tile_y - (field->goal_y - GAME_FLOW_FIELD_DIM / 2);
+
+    if (field_x >= GAME_FLOW_FIELD_DIM || field_y >= GAME_FLOW_FIELD_DIM)
+    {
+        return game_nav_direction_none;
+    }
+
+    return field->directions[field_y][field_x];
+}
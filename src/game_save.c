@@ -0,0 +1,374 @@
+// Save games.
+// See the save games section of game.h.
+
+// The write in flight. There is at most one, and the game thread only fills the
+// buffer while no write is pending.
+// NOTE: Globals of the game dll are reset when it is reloaded. The platform
+// completes all work before reloading the game, so no write is pending then.
+typedef struct
+{
+    // Set by the game thread when the write is queued, cleared by the worker
+    // thread once the write is done.
+    volatile u32 is_pending;
+    b32 did_fail;
+
+    platform_write_file_at_offset_t *write_file_at_offset;
+    u64 offset;
+    u64 data_size;
+
+    u8 buffer[GAME_SAVE_BUFFER_SIZE];
+} game_save_write_t;
+
+global_variable game_save_write_t g_save_write = {0};
+
+internal DEF_PLATFORM_WORK_QUEUE_CALLBACK(game_save_write_work)
+{
+    game_save_write_t *write = (game_save_write_t *)data;
+    ASSERT(write);
+    ASSERT(write->is_pending);
+
+    write->did_fail =
+        !write->write_file_at_offset(GAME_SAVE_FILE_NAME, write->buffer,
+                                     write->data_size, write->offset);
+
+    // Since this is a full barrier, the game thread sees did_fail once it sees
+    // that the write is done.
+    atomic_exchange_u32(&write->is_pending, false);
+}
+
+internal void *game_save_push_size(game_save_write_t *const restrict write,
+                                   const u64 size)
+{
+    ASSERT(write);
+    ASSERT(write->data_size + size <= GAME_SAVE_BUFFER_SIZE);
+
+    void *result = write->buffer + write->data_size;
+    write->data_size += size;
+
+    return result;
+}
+
+// The record's payload is pushed after its header, and the header is filled
+// in once the payload is complete.
+internal game_save_record_header_t *
+game_save_begin_record(game_save_write_t *const restrict write,
+                       const game_save_record_type_t type)
+{
+    game_save_record_header_t *header = (game_save_record_header_t *)
+        game_save_push_size(write, sizeof(game_save_record_header_t));
+    header->type = type;
+
+    return header;
+}
+
+internal void
+game_save_end_record(game_save_write_t *const restrict write,
+                     game_save_record_header_t *const restrict header)
+{
+    ASSERT(write);
+    ASSERT(header);
+
+    const u8 *payload = (const u8 *)(header + 1);
+
+    header->size =
+        truncate_u64_to_u32((u64)(write->buffer + write->data_size - payload));
+    header->checksum = hash_bytes(HASH_SEED, payload, header->size);
+}
+
+internal void game_save_push_chunk_record(
+    game_save_write_t *const restrict write,
+    const game_tile_edits_t *const restrict tile_edits,
+    const game_edited_tile_chunk_t *const restrict edited_chunk)
+{
+    ASSERT(tile_edits);
+    ASSERT(edited_chunk);
+
+    game_save_record_header_t *header =
+        game_save_begin_record(write, game_save_record_type_chunk);
+
+    game_save_chunk_record_t *chunk_record = (game_save_chunk_record_t *)
+        game_save_push_size(write, sizeof(game_save_chunk_record_t));
+    chunk_record->chunk_x = edited_chunk->chunk_x;
+    chunk_record->chunk_y = edited_chunk->chunk_y;
+    chunk_record->edit_count = edited_chunk->edit_count;
+    chunk_record->reserved = 0;
+
+    game_save_tile_edit_t *saved_edits = (game_save_tile_edit_t *)
+        game_save_push_size(write, edited_chunk->edit_count *
+                                       sizeof(game_save_tile_edit_t));
+
+    u32 saved_edit_count = 0;
+    for (u32 edit_index = edited_chunk->first_edit_index;
+         edit_index != GAME_INVALID_TILE_EDIT;
+         edit_index = tile_edits->edits[edit_index].next_edit_index)
+    {
+        const game_tile_edit_t *edit = &tile_edits->edits[edit_index];
+
+        saved_edits[saved_edit_count].tile_index = edit->tile_index;
+        saved_edits[saved_edit_count].tile_value = edit->tile_value;
+        saved_edit_count++;
+    }
+
+    ASSERT(saved_edit_count == edited_chunk->edit_count);
+
+    game_save_end_record(write, header);
+}
+
+internal void
+game_save_push_entity_record(game_save_write_t *const restrict write,
+                             const game_state_t *const restrict game_state)
+{
+    ASSERT(game_state);
+
+    game_save_record_header_t *header =
+        game_save_begin_record(write, game_save_record_type_entities);
+
+    game_save_entity_record_t *entity_record = (game_save_entity_record_t *)
+        game_save_push_size(write, sizeof(game_save_entity_record_t));
+    memset(entity_record, 0, sizeof(game_save_entity_record_t));
+
+    entity_record->player_position = game_state->player_position;
+    entity_record->player_facing_direction =
+        game_state->player_facing_direction;
+
+    entity_record->agent_count = game_state->agent_count;
+    memcpy(entity_record->agents, game_state->agents,
+           game_state->agent_count * sizeof(game_agent_t));
+
+    game_save_end_record(write, header);
+}
+
+// Called once per frame. Every GAME_SAVE_INTERVAL_MS, queues a write of the
+// chunks edited since the last save and of the entities (or of everything, when
+// the journal is compacted).
+internal void
+game_update_save(game_state_t *const restrict game_state, const f32 delta_time,
+                 game_platform_services_t *const restrict platform_services)
+{
+    ASSERT(game_state);
+    ASSERT(platform_services);
+
+    game_save_t *save = &game_state->save;
+    game_save_write_t *write = &g_save_write;
+
+    save->ms_since_save += delta_time;
+
+    if (!platform_services->write_file_at_offset ||
+        save->ms_since_save < GAME_SAVE_INTERVAL_MS)
+    {
+        return;
+    }
+
+    // NOTE: The previous write is still in flight (the disk is slow). Saving
+    // is tried again next frame.
+    if (write->is_pending)
+    {
+        save->skipped_save_count++;
+        return;
+    }
+
+    // The file may be missing records (or be torn), so all of it is written
+    // again.
+    if (write->did_fail)
+    {
+        write->did_fail = false;
+        save->journal_size = 0;
+        save->failed_write_count++;
+    }
+
+    save->ms_since_save = 0.0f;
+
+    const b32 is_compacting =
+        save->journal_size == 0 ||
+        save->journal_size >
+            2 * save->compacted_size + GAME_SAVE_COMPACTION_SLACK;
+
+    write->offset = is_compacting ? 0 : save->journal_size;
+    write->data_size = 0;
+
+    if (is_compacting)
+    {
+        game_save_file_header_t *file_header = (game_save_file_header_t *)
+            game_save_push_size(write, sizeof(game_save_file_header_t));
+        file_header->magic = GAME_SAVE_MAGIC;
+        file_header->version = GAME_SAVE_VERSION;
+        file_header->seed = game_state->game_world.seed;
+        file_header->reserved = 0;
+    }
+
+    game_tile_edits_t *tile_edits = &game_state->game_world.tile_edits;
+    for (u32 i = 0; i < tile_edits->edited_chunk_count; i++)
+    {
+        game_edited_tile_chunk_t *edited_chunk = &tile_edits->edited_chunks[i];
+
+        if (is_compacting || edited_chunk->is_dirty)
+        {
+            game_save_push_chunk_record(write, tile_edits, edited_chunk);
+            edited_chunk->is_dirty = false;
+        }
+    }
+
+    game_save_push_entity_record(write, game_state);
+
+    save->journal_size = write->offset + write->data_size;
+    save->save_count++;
+
+    if (is_compacting)
+    {
+        save->compacted_size = save->journal_size;
+        save->compaction_count++;
+    }
+
+    // NOTE: The platform's functions are not stored in game state, since they
+    // move when the platform is restarted.
+    write->write_file_at_offset = platform_services->write_file_at_offset;
+    write->is_pending = true;
+
+    // NOTE: The write only reads from g_save_write, so it can be in flight
+    // while the platform saves or restores game memory.
+    if (platform_services->io_work_queue)
+    {
+        platform_services->add_work_queue_entry(
+            platform_services->io_work_queue, game_save_write_work, write);
+    }
+    else
+    {
+        game_save_write_work(NULL, write);
+    }
+}
+
+internal void
+game_load_save_record(game_state_t *const restrict game_state,
+                      const game_save_record_header_t *const restrict header)
+{
+    ASSERT(game_state);
+    ASSERT(header);
+
+    const u8 *payload = (const u8 *)(header + 1);
+
+    if (header->type == game_save_record_type_chunk &&
+        header->size >= sizeof(game_save_chunk_record_t))
+    {
+        const game_save_chunk_record_t *chunk_record =
+            (const game_save_chunk_record_t *)payload;
+        const game_save_tile_edit_t *saved_edits =
+            (const game_save_tile_edit_t *)(chunk_record + 1);
+
+        if (header->size != sizeof(game_save_chunk_record_t) +
+                                (u64)chunk_record->edit_count *
+                                    sizeof(game_save_tile_edit_t))
+        {
+            return;
+        }
+
+        for (u32 i = 0; i < chunk_record->edit_count; i++)
+        {
+            const u32 tile_index = saved_edits[i].tile_index;
+
+            if (tile_index < TILE_CHUNK_DIM * TILE_CHUNK_DIM)
+            {
+                game_record_tile_edit(
+                    &game_state->game_world.tile_edits,
+                    chunk_record->chunk_x * TILE_CHUNK_DIM +
+                        tile_index % TILE_CHUNK_DIM,
+                    chunk_record->chunk_y * TILE_CHUNK_DIM +
+                        tile_index / TILE_CHUNK_DIM,
+                    saved_edits[i].tile_value);
+            }
+        }
+    }
+    else if (header->type == game_save_record_type_entities &&
+             header->size == sizeof(game_save_entity_record_t))
+    {
+        const game_save_entity_record_t *entity_record =
+            (const game_save_entity_record_t *)payload;
+
+        if (entity_record->agent_count > GAME_MAX_AGENTS)
+        {
+            return;
+        }
+
+        game_state->player_position = entity_record->player_position;
+        game_state->player_facing_direction =
+            entity_record->player_facing_direction;
+
+        game_state->agent_count = entity_record->agent_count;
+        memcpy(game_state->agents, entity_record->agents,
+               entity_record->agent_count * sizeof(game_agent_t));
+    }
+}
+
+// Loads the save file (if there is one) into newly initialized game state, by
+// replaying its journal.
+internal void
+game_load_save(game_state_t *const restrict game_state,
+               game_platform_services_t *const restrict platform_services)
+{
+    ASSERT(game_state);
+    ASSERT(platform_services);
+
+    if (!platform_services->read_file)
+    {
+        return;
+    }
+
+    u64 file_size = 0;
+    u8 *file = platform_services->read_file(GAME_SAVE_FILE_NAME, &file_size);
+
+    if (!file)
+    {
+        return;
+    }
+
+    game_save_t *save = &game_state->save;
+
+    const game_save_file_header_t *file_header =
+        (const game_save_file_header_t *)file;
+
+    // NOTE: Saves of other versions (or worlds) are ignored, and replaced by
+    // the first save.
+    if (file_size >= sizeof(game_save_file_header_t) &&
+        file_header->magic == GAME_SAVE_MAGIC &&
+        file_header->version == GAME_SAVE_VERSION &&
+        file_header->seed == game_state->game_world.seed)
+    {
+        u64 offset = sizeof(game_save_file_header_t);
+
+        while (offset + sizeof(game_save_record_header_t) <= file_size)
+        {
+            const game_save_record_header_t *header =
+                (const game_save_record_header_t *)(file + offset);
+
+            const u64 payload_offset =
+                offset + sizeof(game_save_record_header_t);
+
+            // NOTE: A write cut short (by a crash, or power loss) leaves a
+            // partial record at the end of the journal. It is ignored, along
+            // with anything after it, and overwritten by the next save.
+            if (header->size > file_size - payload_offset ||
+                hash_bytes(HASH_SEED, file + payload_offset, header->size) !=
+                    header->checksum)
+            {
+                save->corrupt_record_count++;
+                break;
+            }
+
+            game_load_save_record(game_state, header);
+            save->loaded_record_count++;
+
+            offset = payload_offset + header->size;
+        }
+
+        save->journal_size = offset;
+        save->compacted_size = offset;
+
+        // Everything loaded is in the file already.
+        game_tile_edits_t *tile_edits = &game_state->game_world.tile_edits;
+        for (u32 i = 0; i < tile_edits->edited_chunk_count; i++)
+        {
+            tile_edits->edited_chunks[i].is_dirty = false;
+        }
+    }
+
+    platform_services->close_file(file);
+}
@@ -0,0 +1,408 @@
+// Sprites.
+// Sprites are bitmaps drawn at an arbitrary (sub pixel) position, rotation and
+// scale : the sprite covers the parallelogram spanned by x_axis and y_axis
+// from origin (in framebuffer pixels). Every pixel within the parallelogram's
+// bounding box is tested against its edges, and covered pixels get the
+// bitmap's bilinear filtered texel, blended over the framebuffer (see
+// game_blend.c). Pixels are processed 4 at a time.
+// Texels are linear, premultiplied 16 bit per channel colors, so that filtering
+// and blending both happen in linear space.
+// NOTE: Bitmaps should have a transparent 1 texel border, so that the edges of
+// a sprite are filtered (rather than cut off).
+
+// Texel layout in memory (16 bits each) : AA RR GG BB.
+typedef struct
+{
+    u32 width;
+    u32 height;
+
+    u64 *texels;
+} game_bitmap_t;
+
+#define GAME_PLAYER_BITMAP_WIDTH 34u
+#define GAME_PLAYER_BITMAP_HEIGHT 50u
+
+typedef struct
+{
+    b32 is_initialized;
+
+    u64 player_texels[GAME_PLAYER_BITMAP_HEIGHT][GAME_PLAYER_BITMAP_WIDTH];
+    game_bitmap_t player;
+} game_sprites_t;
+
+// NOTE: Like the blend tables, sprites are built (again) on the first frame
+// after the game dll is (re)loaded.
+global_variable game_sprites_t g_sprites = {0};
+
+internal u64 game_get_texel(const f32 red, const f32 green, const f32 blue,
+                            const f32 alpha)
+{
+    const game_linear_color_t color =
+        game_get_linear_color(red, green, blue, alpha);
+
+    return ((u64)round_f32_to_u32(color.alpha * 65535.0f) << 48) |
+           ((u64)round_f32_to_u32(color.red * 65535.0f) << 32) |
+           ((u64)round_f32_to_u32(color.green * 65535.0f) << 16) |
+           (u64)round_f32_to_u32(color.blue * 65535.0f);
+}
+
+// The player is a blue rounded rectangle with a light visor near its top.
+internal void game_init_sprites(game_sprites_t *const restrict sprites)
+{
+    ASSERT(sprites);
+
+    if (sprites->is_initialized)
+    {
+        return;
+    }
+
+    const f32 corner_radius = 8.0f;
+
+    // Without the transparent border.
+    const f32 body_width = (f32)(GAME_PLAYER_BITMAP_WIDTH - 2);
+    const f32 body_height = (f32)(GAME_PLAYER_BITMAP_HEIGHT - 2);
+
+    for (u32 y = 0; y < GAME_PLAYER_BITMAP_HEIGHT; y++)
+    {
+        for (u32 x = 0; x < GAME_PLAYER_BITMAP_WIDTH; x++)
+        {
+            // Texel center, relative to the body's top left corner.
+            const f32 body_x = (f32)x - 1.0f + 0.5f;
+            const f32 body_y = (f32)y - 1.0f + 0.5f;
+
+            // Distance outside of the rectangle shrunk by the corner radius
+            // (<= corner_radius inside the body), the texel's coverage falls
+            // off over one texel.
+            const f32 outside_x =
+                fmaxf(fmaxf(corner_radius - body_x,
+                            body_x - (body_width - corner_radius)),
+                      0.0f);
+            const f32 outside_y =
+                fmaxf(fmaxf(corner_radius - body_y,
+                            body_y - (body_height - corner_radius)),
+                      0.0f);
+            const f32 distance =
+                sqrtf(outside_x * outside_x + outside_y * outside_y);
+
+            const f32 coverage =
+                fminf(fmaxf(corner_radius + 0.5f - distance, 0.0f), 1.0f);
+
+            const b32 is_visor = body_y >= 8.0f && body_y < 14.0f &&
+                                 body_x >= 6.0f && body_x < body_width - 6.0f;
+
+            sprites->player_texels[y][x] =
+                is_visor ? game_get_texel(0.8f, 0.9f, 1.0f, coverage)
+                         : game_get_texel(0.1f, 0.2f, 1.0f, coverage);
+        }
+    }
+
+    sprites->player.width = GAME_PLAYER_BITMAP_WIDTH;
+    sprites->player.height = GAME_PLAYER_BITMAP_HEIGHT;
+    sprites->player.texels = &sprites->player_texels[0][0];
+
+    sprites->is_initialized = true;
+}
+
+// Fetches the texel at each of the 4 indices, and returns them as vectors of
+// the blue, green, red and alpha components (in 0..1).
+internal void game_fetch_texels(const game_bitmap_t *const restrict bitmap,
+                                const i32 *const restrict indices,
+                                __m128 *const restrict components)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 scale = _mm_set1_ps(1.0f / 65535.0f);
+
+    // One texel (b, g, r, a) per vector, then transposed to one component per
+    // vector.
+    __m128 texels[4];
+    for (u32 i = 0; i < 4; i++)
+    {
+        const __m128i texel =
+            _mm_loadl_epi64((const __m128i *)&bitmap->texels[indices[i]]);
+        texels[i] = _mm_mul_ps(
+            _mm_cvtepi32_ps(_mm_unpacklo_epi16(texel, zero)), scale);
+    }
+
+    _MM_TRANSPOSE4_PS(texels[0], texels[1], texels[2], texels[3]);
+
+    for (u32 i = 0; i < 4; i++)
+    {
+        components[i] = texels[i];
+    }
+}
+
+// Draws the bitmap over the parallelogram spanned by x_axis and y_axis from
+// origin (all in framebuffer pixels). The bitmap's first row is along x_axis
+// (at origin).
+internal void game_render_sprite(game_offscreen_buffer_t *const restrict buffer,
+                                 const game_bitmap_t *const restrict bitmap,
+                                 const f32 origin_x, const f32 origin_y,
+                                 const f32 x_axis_x, const f32 x_axis_y,
+                                 const f32 y_axis_x, const f32 y_axis_y)
+{
+    ASSERT(buffer);
+    ASSERT(bitmap);
+    ASSERT(bitmap->width >= 3 && bitmap->height >= 3);
+
+    // NOTE: Texel indices are computed with a 16 bit multiply.
+    ASSERT(bitmap->width * bitmap->height <= 0x10000);
+    ASSERT(g_blend_tables.is_initialized);
+
+    const f32 x_axis_length_squared = x_axis_x * x_axis_x + x_axis_y * x_axis_y;
+    const f32 y_axis_length_squared = y_axis_x * y_axis_x + y_axis_y * y_axis_y;
+
+    if (x_axis_length_squared <= 0.0f || y_axis_length_squared <= 0.0f)
+    {
+        return;
+    }
+
+    // Bounding box of the 4 corners.
+    f32 min_corner_x = origin_x;
+    f32 min_corner_y = origin_y;
+    f32 max_corner_x = origin_x;
+    f32 max_corner_y = origin_y;
+
+    const f32 corners_x[3] = {origin_x + x_axis_x, origin_x + y_axis_x,
+                              origin_x + x_axis_x + y_axis_x};
+    const f32 corners_y[3] = {origin_y + x_axis_y, origin_y + y_axis_y,
+                              origin_y + x_axis_y + y_axis_y};
+
+    for (u32 i = 0; i < 3; i++)
+    {
+        min_corner_x = fminf(min_corner_x, corners_x[i]);
+        min_corner_y = fminf(min_corner_y, corners_y[i]);
+        max_corner_x = fmaxf(max_corner_x, corners_x[i]);
+        max_corner_y = fmaxf(max_corner_y, corners_y[i]);
+    }
+
+    i32 min_x = floor_f32_to_i32(min_corner_x);
+    i32 min_y = floor_f32_to_i32(min_corner_y);
+    i32 max_x = (i32)ceilf(max_corner_x);
+    i32 max_y = (i32)ceilf(max_corner_y);
+
+    if (min_x < 0)
+    {
+        min_x = 0;
+    }
+
+    if (min_y < 0)
+    {
+        min_y = 0;
+    }
+
+    if (max_x > (i32)buffer->width)
+    {
+        max_x = buffer->width;
+    }
+
+    if (max_y > (i32)buffer->height)
+    {
+        max_y = buffer->height;
+    }
+
+    if (min_x >= max_x || min_y >= max_y)
+    {
+        return;
+    }
+
+    // A pixel center p is at u = dot(p - origin, x_axis) / |x_axis|^2 along
+    // the x axis (and likewise for v along the y axis). The pixel is covered
+    // if both are within [0, 1), which is the same as being inside of all 4
+    // edges.
+    // NOTE: u / v are only the texture coordinates for orthogonal axes, which
+    // is the case for rotations and scales.
+    const __m128 u_per_x = _mm_set1_ps(x_axis_x / x_axis_length_squared);
+    const __m128 u_per_y = _mm_set1_ps(x_axis_y / x_axis_length_squared);
+    const __m128 v_per_x = _mm_set1_ps(y_axis_x / y_axis_length_squared);
+    const __m128 v_per_y = _mm_set1_ps(y_axis_y / y_axis_length_squared);
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    // Texel coordinates : u / v of 0 and 1 are the edges between the bitmap's
+    // border and its inside (which is what the axes span), so that both
+    // bilinear samples are always within the bitmap.
+    const __m128 texel_scale_x = _mm_set1_ps((f32)(bitmap->width - 2));
+    const __m128 texel_scale_y = _mm_set1_ps((f32)(bitmap->height - 2));
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128i texel_pitch = _mm_set1_epi32((i32)bitmap->width);
+
+    const f32 max_index = (f32)(GAME_LINEAR_TO_SRGB_TABLE_SIZE - 1);
+    const __m128 index_scale = _mm_set1_ps(max_index);
+    const __m128 max_index_vector = _mm_set1_ps(max_index);
+
+    const __m128 max_alpha = _mm_set1_ps(255.0f);
+
+    const __m128 lane_offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+
+    for (i32 y = min_y; y < max_y; y++)
+    {
+        u32 *row = buffer->framebuffer_memory + (u64)y * buffer->width;
+
+        const __m128 pixel_y = _mm_set1_ps((f32)y + 0.5f - origin_y);
+
+        for (i32 x = min_x; x < max_x; x += 4)
+        {
+            // Groups of 4 that would run off the end of the row are copied
+            // out (and back), so every group goes through the same code.
+            u32 tail_pixels[4] = {0};
+            const b32 is_tail = x + 4 > (i32)buffer->width;
+
+            u32 *pixels = row + x;
+            if (is_tail)
+            {
+                memcpy(tail_pixels, pixels, (buffer->width - x) * sizeof(u32));
+                pixels = tail_pixels;
+            }
+
+            const __m128 pixel_x = _mm_add_ps(
+                _mm_set1_ps((f32)x - origin_x), lane_offsets);
+
+            __m128 u = _mm_add_ps(_mm_mul_ps(pixel_x, u_per_x),
+                                  _mm_mul_ps(pixel_y, u_per_y));
+            __m128 v = _mm_add_ps(_mm_mul_ps(pixel_x, v_per_x),
+                                  _mm_mul_ps(pixel_y, v_per_y));
+
+            // Edge tests (lanes past max_x are not written).
+            __m128 mask = _mm_and_ps(
+                _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmplt_ps(u, one)),
+                _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmplt_ps(v, one)));
+            mask = _mm_and_ps(
+                mask, _mm_cmplt_ps(_mm_add_ps(_mm_set1_ps((f32)x),
+                                              lane_offsets),
+                                   _mm_set1_ps((f32)max_x)));
+
+            const i32 mask_bits = _mm_movemask_ps(mask);
+            if (mask_bits == 0)
+            {
+                continue;
+            }
+
+            // Uncovered lanes still fetch (valid) texels, and are discarded
+            // when writing.
+            u = _mm_min_ps(_mm_max_ps(u, zero), one);
+            v = _mm_min_ps(_mm_max_ps(v, zero), one);
+
+            const __m128 texel_x =
+                _mm_add_ps(_mm_mul_ps(u, texel_scale_x), half);
+            const __m128 texel_y =
+                _mm_add_ps(_mm_mul_ps(v, texel_scale_y), half);
+
+            // Texel coordinates are positive, so truncating is flooring.
+            const __m128i texel_x_integer = _mm_cvttps_epi32(texel_x);
+            const __m128i texel_y_integer = _mm_cvttps_epi32(texel_y);
+
+            const __m128 fraction_x =
+                _mm_sub_ps(texel_x, _mm_cvtepi32_ps(texel_x_integer));
+            const __m128 fraction_y =
+                _mm_sub_ps(texel_y, _mm_cvtepi32_ps(texel_y_integer));
+
+            // Index of the top left texel of every 2x2 footprint.
+            // NOTE: SSE2 has no 32 bit multiply, bitmaps are small enough for
+            // a 16 bit one.
+            i32 indices[4];
+            _mm_storeu_si128(
+                (__m128i *)indices,
+                _mm_add_epi32(_mm_mullo_epi16(texel_y_integer, texel_pitch),
+                              texel_x_integer));
+
+            i32 corner_indices[4][4];
+            for (u32 i = 0; i < 4; i++)
+            {
+                corner_indices[0][i] = indices[i];
+                corner_indices[1][i] = indices[i] + 1;
+                corner_indices[2][i] = indices[i] + (i32)bitmap->width;
+                corner_indices[3][i] = indices[i] + (i32)bitmap->width + 1;
+            }
+
+            __m128 corners[4][4];
+            for (u32 i = 0; i < 4; i++)
+            {
+                game_fetch_texels(bitmap, corner_indices[i], corners[i]);
+            }
+
+            // Bilinear filter (per component : blue, green, red, alpha).
+            const __m128 inverse_fraction_x = _mm_sub_ps(one, fraction_x);
+            const __m128 inverse_fraction_y = _mm_sub_ps(one, fraction_y);
+
+            __m128 texel[4];
+            for (u32 i = 0; i < 4; i++)
+            {
+                const __m128 top =
+                    _mm_add_ps(_mm_mul_ps(corners[0][i], inverse_fraction_x),
+                               _mm_mul_ps(corners[1][i], fraction_x));
+                const __m128 bottom =
+                    _mm_add_ps(_mm_mul_ps(corners[2][i], inverse_fraction_x),
+                               _mm_mul_ps(corners[3][i], fraction_x));
+
+                texel[i] = _mm_add_ps(_mm_mul_ps(top, inverse_fraction_y),
+                                      _mm_mul_ps(bottom, fraction_y));
+            }
+
+            // Decode the destination.
+            f32 destination[3][4];
+            for (u32 i = 0; i < 4; i++)
+            {
+                destination[0][i] =
+                    g_blend_tables.srgb_to_linear[pixels[i] & 0xff];
+                destination[1][i] =
+                    g_blend_tables.srgb_to_linear[(pixels[i] >> 8) & 0xff];
+                destination[2][i] =
+                    g_blend_tables.srgb_to_linear[(pixels[i] >> 16) & 0xff];
+            }
+
+            // Blend (premultiplied "over"), the results are table indices.
+            const __m128 inverse_alpha = _mm_sub_ps(one, texel[3]);
+
+            i32 encode_indices[3][4];
+            for (u32 i = 0; i < 3; i++)
+            {
+                const __m128 blended = _mm_add_ps(
+                    texel[i],
+                    _mm_mul_ps(_mm_loadu_ps(destination[i]), inverse_alpha));
+
+                _mm_storeu_si128(
+                    (__m128i *)encode_indices[i],
+                    _mm_cvtps_epi32(_mm_min_ps(
+                        _mm_mul_ps(blended, index_scale), max_index_vector)));
+            }
+
+            const __m128i destination_pixels =
+                _mm_loadu_si128((const __m128i *)pixels);
+
+            const __m128 destination_alpha =
+                _mm_cvtepi32_ps(_mm_srli_epi32(destination_pixels, 24));
+            const __m128i alpha = _mm_cvtps_epi32(
+                _mm_add_ps(_mm_mul_ps(texel[3], max_alpha),
+                           _mm_mul_ps(destination_alpha, inverse_alpha)));
+
+            // Encode.
+            u32 encoded[4];
+            for (u32 i = 0; i < 4; i++)
+            {
+                encoded[i] =
+                    ((u32)g_blend_tables.linear_to_srgb[encode_indices[2][i]]
+                     << 16) |
+                    ((u32)g_blend_tables.linear_to_srgb[encode_indices[1][i]]
+                     << 8) |
+                    (u32)g_blend_tables.linear_to_srgb[encode_indices[0][i]];
+            }
+
+            const __m128i result =
+                _mm_or_si128(_mm_loadu_si128((const __m128i *)encoded),
+                             _mm_slli_epi32(alpha, 24));
+
+            // Only covered pixels are written.
+            const __m128i write_mask = _mm_castps_si128(mask);
+            _mm_storeu_si128(
+                (__m128i *)pixels,
+                _mm_or_si128(_mm_and_si128(write_mask, result),
+                             _mm_andnot_si128(write_mask, destination_pixels)));
+
+            if (is_tail)
+            {
+                memcpy(row + x, tail_pixels, (buffer->width - x) * sizeof(u32));
+            }
+        }
+    }
+}
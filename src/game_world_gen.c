@@ -0,0 +1,480 @@
+// Procedural world generation.
+// The world is a grid of rooms (GAME_WORLD_ROOM_DIM tiles wide and high).
+// Each room owns the wall along its left (west) column and its bottom (south)
+// row, and every wall has a door in it, or is left out completely (so that
+// rooms merge into larger ones), which keeps all rooms reachable.
+// Everything about a wall is derived from a hash of the world seed and the
+// wall's room coordinates, so a tile can be generated independently of its
+// neighbours, chunks generate the same regardless of the order / thread they
+// are generated on, and walls match up across chunk borders. Some rooms also
+// have a lamp in them, placed the same way.
+
+#define GAME_WORLD_ROOM_DIM 16u
+#define GAME_WORLD_ROOMS_PER_CHUNK (TILE_CHUNK_DIM / GAME_WORLD_ROOM_DIM)
+
+typedef enum
+{
+    game_world_wall_west = 0,
+    game_world_wall_south = 1,
+    // NOTE: Not a wall, used to hash the room's lamp.
+    game_world_room_lamp = 2,
+} game_world_wall_t;
+
+internal u32 game_world_hash(const u32 seed, const u32 room_x, const u32 room_y,
+                             const game_world_wall_t wall)
+{
+    u64 hash = hash_mix_u64(HASH_SEED, seed);
+    hash = hash_mix_u64(hash, room_x);
+    hash = hash_mix_u64(hash, room_y);
+    hash = hash_mix_u64(hash, wall);
+
+    return (u32)(hash ^ (hash >> 32));
+}
+
+// Writes the wall of a room (GAME_WORLD_ROOM_DIM tiles, the first one being the
+// corner post) into the chunk. The room's corner post is at (first_tile_x,
+// first_tile_y) in the chunk.
+internal void game_generate_room_wall(game_tile_chunk_t *const restrict chunk,
+                                      const u32 first_tile_x,
+                                      const u32 first_tile_y, const u32 seed,
+                                      const u32 room_x, const u32 room_y,
+                                      const game_world_wall_t wall)
+{
+    ASSERT(chunk);
+
+    const u32 hash = game_world_hash(seed, room_x, room_y, wall);
+
+    // One in four walls is left out.
+    const b32 is_open = (hash & 0x3) == 0;
+
+    // Doors are 2 or 3 tiles wide, and never next to a corner post.
+    const u32 door_width = 2 + ((hash >> 2) & 0x1);
+    const u32 door_start =
+        2 + (hash >> 8) % (GAME_WORLD_ROOM_DIM - 3 - door_width);
+
+    // West walls go up from the corner post, south walls go right.
+    const u32 step_x = wall == game_world_wall_south ? 1 : 0;
+    const u32 step_y = wall == game_world_wall_west ? 1 : 0;
+
+    // The corner post is always solid.
+    chunk->tiles[get_tile_index_in_chunk(first_tile_x, first_tile_y)] = 1;
+
+    for (u32 i = 1; i < GAME_WORLD_ROOM_DIM; i++)
+    {
+        const b32 is_door = i >= door_start && i < door_start + door_width;
+        chunk->tiles[get_tile_index_in_chunk(first_tile_x + i * step_x,
+                                             first_tile_y + i * step_y)] =
+            (is_open || is_door) ? 0 : 1;
+    }
+}
+
+// Places the room's lamp (if it has one) in the chunk. The room's corner post
+// is at (first_tile_x, first_tile_y) in the chunk.
+internal void game_generate_room_lamp(game_tile_chunk_t *const restrict chunk,
+                                      const u32 first_tile_x,
+                                      const u32 first_tile_y, const u32 seed,
+                                      const u32 room_x, const u32 room_y)
+{
+    ASSERT(chunk);
+
+    const u32 hash =
+        game_world_hash(seed, room_x, room_y, game_world_room_lamp);
+
+    // One in three rooms has a lamp.
+    if (hash % 3 != 0)
+    {
+        return;
+    }
+
+    // Lamps are kept away from the walls, so they never block a door.
+    const u32 lamp_x = 3 + (hash >> 8) % (GAME_WORLD_ROOM_DIM - 6);
+    const u32 lamp_y = 3 + (hash >> 16) % (GAME_WORLD_ROOM_DIM - 6);
+
+    chunk->tiles[get_tile_index_in_chunk(first_tile_x + lamp_x,
+                                         first_tile_y + lamp_y)] =
+        GAME_TILE_LAMP;
+}
+
+// NOTE: Chunk indices are absolute (24 bit) chunk indices in the world.
+internal void game_generate_tile_chunk(game_tile_chunk_t *const restrict chunk,
+                                       const u32 chunk_x, const u32 chunk_y,
+                                       const u32 seed)
+{
+    ASSERT(chunk);
+
+    // Rooms are aligned to chunks, so a chunk never holds part of a room.
+    const u32 first_room_x = chunk_x * GAME_WORLD_ROOMS_PER_CHUNK;
+    const u32 first_room_y = chunk_y * GAME_WORLD_ROOMS_PER_CHUNK;
+
+    memset(chunk->tiles, 0, sizeof(chunk->tiles));
+
+    for (u32 room_y = 0; room_y < GAME_WORLD_ROOMS_PER_CHUNK; room_y++)
+    {
+        for (u32 room_x = 0; room_x < GAME_WORLD_ROOMS_PER_CHUNK; room_x++)
+        {
+            const u32 first_tile_x = room_x * GAME_WORLD_ROOM_DIM;
+            const u32 first_tile_y = room_y * GAME_WORLD_ROOM_DIM;
+
+            game_generate_room_wall(chunk, first_tile_x, first_tile_y, seed,
+                                    first_room_x + room_x,
+                                    first_room_y + room_y,
+                                    game_world_wall_west);
+
+            game_generate_room_wall(chunk, first_tile_x, first_tile_y, seed,
+                                    first_room_x + room_x,
+                                    first_room_y + room_y,
+                                    game_world_wall_south);
+
+            game_generate_room_lamp(chunk, first_tile_x, first_tile_y, seed,
+                                    first_room_x + room_x,
+                                    first_room_y + room_y);
+        }
+    }
+
+    game_build_tile_solid_bits(chunk);
+}
+
+// CPU timestamp counter cycles spent generating chunks.
+// NOTE: Timings are kept out of game memory, which must only depend on the
+// inputs (replays and rollback sessions compare its hash).
+global_variable volatile u64 g_tile_chunk_generation_cycles = 0;
+
+internal DEF_PLATFORM_WORK_QUEUE_CALLBACK(game_generate_tile_chunk_work)
+{
+    game_tile_chunk_slot_t *slot = (game_tile_chunk_slot_t *)data;
+    ASSERT(slot);
+    ASSERT(slot->state == game_tile_chunk_state_queued);
+
+    const u64 start_cycles = read_cpu_timestamp();
+
+    game_generate_tile_chunk(&slot->tile_chunk, slot->chunk_x, slot->chunk_y,
+                             slot->seed);
+
+    atomic_add_u64(&g_tile_chunk_generation_cycles,
+                   read_cpu_timestamp() - start_cycles);
+
+    // Publish the chunk. Since this is a full barrier, the game thread sees
+    // all of the tiles once it sees the new state.
+    atomic_exchange_u32(&slot->state, game_tile_chunk_state_generated);
+}
+
+// Distance (in chunks) between two chunk indices, along one axis of the
+// toroidal world.
+internal u32 game_get_tile_chunk_distance(const u32 a, const u32 b)
+{
+    const u32 delta = (a - b) & TILE_CHUNK_INDEX_MASK;
+    const u32 wrapped_delta = (TILE_CHUNK_INDEX_MASK + 1 - delta);
+
+    return delta < wrapped_delta ? delta : wrapped_delta;
+}
+
+// Returns the chunk's edits, NULL if it has none.
+// NOTE: Chunks are edited rarely, so a linear search is used.
+internal game_edited_tile_chunk_t *
+game_find_edited_tile_chunk(game_tile_edits_t *const restrict tile_edits,
+                            const u32 chunk_x, const u32 chunk_y)
+{
+    ASSERT(tile_edits);
+
+    for (u32 i = 0; i < tile_edits->edited_chunk_count; i++)
+    {
+        game_edited_tile_chunk_t *edited_chunk = &tile_edits->edited_chunks[i];
+
+        if (edited_chunk->chunk_x == chunk_x &&
+            edited_chunk->chunk_y == chunk_y)
+        {
+            return edited_chunk;
+        }
+    }
+
+    return NULL;
+}
+
+// Records the new value of a tile, so that it survives the chunk being
+// reloaded (and is saved).
+internal void
+game_record_tile_edit(game_tile_edits_t *const restrict tile_edits,
+                      const u32 tile_x, const u32 tile_y, const u32 tile_value)
+{
+    ASSERT(tile_edits);
+
+    const u32 chunk_x = GET_CHUNK_INDEX_IN_WORLD(tile_x);
+    const u32 chunk_y = GET_CHUNK_INDEX_IN_WORLD(tile_y);
+    const u32 tile_index = GET_TILE_INDEX_IN_CHUNK(tile_y) * TILE_CHUNK_DIM +
+                           GET_TILE_INDEX_IN_CHUNK(tile_x);
+
+    game_edited_tile_chunk_t *edited_chunk =
+        game_find_edited_tile_chunk(tile_edits, chunk_x, chunk_y);
+
+    if (edited_chunk)
+    {
+        for (u32 edit_index = edited_chunk->first_edit_index;
+             edit_index != GAME_INVALID_TILE_EDIT;
+             edit_index = tile_edits->edits[edit_index].next_edit_index)
+        {
+            game_tile_edit_t *edit = &tile_edits->edits[edit_index];
+
+            if (edit->tile_index == tile_index)
+            {
+                edit->tile_value = tile_value;
+                edited_chunk->is_dirty = true;
+                return;
+            }
+        }
+    }
+
+    // NOTE: If this happens, the edit pool is too small. The tile keeps its
+    // value until its chunk is evicted.
+    if (tile_edits->edit_count == GAME_MAX_TILE_EDITS ||
+        (!edited_chunk &&
+         tile_edits->edited_chunk_count == GAME_MAX_EDITED_TILE_CHUNKS))
+    {
+        tile_edits->dropped_edit_count++;
+        return;
+    }
+
+    if (!edited_chunk)
+    {
+        edited_chunk =
+            &tile_edits->edited_chunks[tile_edits->edited_chunk_count++];
+        edited_chunk->chunk_x = chunk_x;
+        edited_chunk->chunk_y = chunk_y;
+        edited_chunk->first_edit_index = GAME_INVALID_TILE_EDIT;
+        edited_chunk->edit_count = 0;
+    }
+
+    game_tile_edit_t *edit = &tile_edits->edits[tile_edits->edit_count];
+    edit->next_edit_index = edited_chunk->first_edit_index;
+    edit->tile_index = tile_index;
+    edit->tile_value = tile_value;
+
+    edited_chunk->first_edit_index = tile_edits->edit_count++;
+    edited_chunk->edit_count++;
+    edited_chunk->is_dirty = true;
+}
+
+internal void
+game_apply_tile_edits(game_tile_edits_t *const restrict tile_edits,
+                      game_tile_chunk_slot_t *const restrict slot)
+{
+    ASSERT(tile_edits);
+    ASSERT(slot);
+
+    game_edited_tile_chunk_t *edited_chunk =
+        game_find_edited_tile_chunk(tile_edits, slot->chunk_x, slot->chunk_y);
+
+    if (edited_chunk)
+    {
+        game_tile_chunk_t *chunk = &slot->tile_chunk;
+
+        for (u32 edit_index = edited_chunk->first_edit_index;
+             edit_index != GAME_INVALID_TILE_EDIT;
+             edit_index = tile_edits->edits[edit_index].next_edit_index)
+        {
+            const game_tile_edit_t *edit = &tile_edits->edits[edit_index];
+            const u32 tile_index_x = edit->tile_index % TILE_CHUNK_DIM;
+            const u32 tile_index_y = edit->tile_index / TILE_CHUNK_DIM;
+
+            chunk->tiles[get_tile_index_in_chunk(tile_index_x, tile_index_y)] =
+                edit->tile_value;
+            game_set_tile_solid_bit(chunk, tile_index_x, tile_index_y,
+                                    edit->tile_value);
+        }
+    }
+}
+
+// Makes chunks generated on worker threads visible to the game (with their
+// edits applied).
+internal void
+game_publish_generated_tile_chunks(game_world_t *const restrict world)
+{
+    ASSERT(world);
+
+    for (u32 i = 0; i < GAME_MAX_LOADED_TILE_CHUNKS; i++)
+    {
+        game_tile_chunk_slot_t *slot = &world->tile_chunk_slots[i];
+
+        if (slot->state == game_tile_chunk_state_generated)
+        {
+            world->generated_tile_chunk_count++;
+
+            game_apply_tile_edits(&world->tile_edits, slot);
+
+            slot->state = game_tile_chunk_state_loaded;
+        }
+    }
+}
+
+// Returns a slot that is not in use, evicting the loaded chunk that is
+// farthest away from the center chunk if required. Returns NULL if every slot
+// is either being generated or holds a chunk within the load radius.
+internal game_tile_chunk_slot_t *
+game_acquire_tile_chunk_slot(game_world_t *const restrict world,
+                             const u32 center_chunk_x, const u32 center_chunk_y)
+{
+    ASSERT(world);
+
+    game_tile_chunk_slot_t *farthest_slot = NULL;
+    u32 farthest_distance = 0;
+
+    for (u32 i = 0; i < GAME_MAX_LOADED_TILE_CHUNKS; i++)
+    {
+        game_tile_chunk_slot_t *slot = &world->tile_chunk_slots[i];
+
+        if (slot->state == game_tile_chunk_state_unloaded)
+        {
+            return slot;
+        }
+
+        // Chunks that are still being generated can not be evicted.
+        if (slot->state != game_tile_chunk_state_loaded)
+        {
+            continue;
+        }
+
+        const u32 distance_x =
+            game_get_tile_chunk_distance(slot->chunk_x, center_chunk_x);
+        const u32 distance_y =
+            game_get_tile_chunk_distance(slot->chunk_y, center_chunk_y);
+        const u32 distance = distance_x > distance_y ? distance_x : distance_y;
+
+        // NOTE: Chunks within the load radius are not evicted, as they would
+        // only be requested again.
+        if (distance > GAME_TILE_CHUNK_LOAD_RADIUS &&
+            distance > farthest_distance)
+        {
+            farthest_slot = slot;
+            farthest_distance = distance;
+        }
+    }
+
+    return farthest_slot;
+}
+
+internal void game_request_tile_chunk(
+    game_world_t *const restrict world, const u32 chunk_x, const u32 chunk_y,
+    const u32 center_chunk_x, const u32 center_chunk_y,
+    game_platform_services_t *const restrict platform_services)
+{
+    ASSERT(world);
+    ASSERT(platform_services);
+
+    if (game_find_tile_chunk_slot(world, chunk_x, chunk_y))
+    {
+        return;
+    }
+
+    game_tile_chunk_slot_t *slot =
+        game_acquire_tile_chunk_slot(world, center_chunk_x, center_chunk_y);
+
+    // The chunk is requested again next frame, once a slot is free.
+    if (!slot)
+    {
+        world->tile_chunk_slot_miss_count++;
+        return;
+    }
+
+    slot->chunk_x = chunk_x;
+    slot->chunk_y = chunk_y;
+    slot->seed = world->seed;
+
+    // Navigation data is built once the chunk is loaded.
+    slot->nav.dirty_cluster_mask = ~0ull;
+    slot->nav.loaded_neighbor_mask = 0;
+
+    // As is lighting.
+    slot->light.needs_build = true;
+
+    slot->state = game_tile_chunk_state_queued;
+
+    if (platform_services->work_queue)
+    {
+        platform_services->add_work_queue_entry(
+            platform_services->work_queue, game_generate_tile_chunk_work, slot);
+    }
+    else
+    {
+        game_generate_tile_chunk_work(NULL, slot);
+    }
+}
+
+// Requests all chunks within the load radius of the center chunk (closest
+// first), and waits for the ones within the required radius.
+// NOTE: Chunks only become visible to the game here, at the start of a frame,
+// so a chunk never appears halfway through simulating or rendering a frame.
+internal void game_stream_tile_chunks(
+    game_world_t *const restrict world, const u32 center_chunk_x,
+    const u32 center_chunk_y,
+    game_platform_services_t *const restrict platform_services)
+{
+    ASSERT(world);
+    ASSERT(platform_services);
+
+    game_publish_generated_tile_chunks(world);
+
+    for (i32 radius = 0; radius <= GAME_TILE_CHUNK_LOAD_RADIUS; radius++)
+    {
+        for (i32 offset_y = -radius; offset_y <= radius; offset_y++)
+        {
+            for (i32 offset_x = -radius; offset_x <= radius; offset_x++)
+            {
+                // Only the ring at this radius.
+                if (offset_x != -radius && offset_x != radius &&
+                    offset_y != -radius && offset_y != radius)
+                {
+                    continue;
+                }
+
+                game_request_tile_chunk(
+                    world, (center_chunk_x + offset_x) & TILE_CHUNK_INDEX_MASK,
+                    (center_chunk_y + offset_y) & TILE_CHUNK_INDEX_MASK,
+                    center_chunk_x, center_chunk_y, platform_services);
+            }
+        }
+    }
+
+    game_publish_generated_tile_chunks(world);
+
+    b32 did_wait = false;
+
+    const i32 radius = GAME_TILE_CHUNK_REQUIRED_RADIUS;
+    for (i32 offset_y = -radius; offset_y <= radius; offset_y++)
+    {
+        for (i32 offset_x = -radius; offset_x <= radius; offset_x++)
+        {
+            // NOTE: Chunks that did not get a slot are not waited for (they
+            // are requested again next frame).
+            const game_tile_chunk_slot_t *slot = game_find_tile_chunk_slot(
+                world, (center_chunk_x + offset_x) & TILE_CHUNK_INDEX_MASK,
+                (center_chunk_y + offset_y) & TILE_CHUNK_INDEX_MASK);
+
+            if (!slot || slot->state != game_tile_chunk_state_queued)
+            {
+                continue;
+            }
+
+            // NOTE: Only happens when the player moves faster than chunks are
+            // generated (or on the first frame). Only this chunk is waited
+            // for, the game thread runs pending jobs in the meantime.
+            ASSERT(platform_services->work_queue);
+
+            while (slot->state == game_tile_chunk_state_queued)
+            {
+                if (!platform_services->do_next_work_queue_entry(
+                        platform_services->work_queue))
+                {
+                    cpu_pause();
+                }
+            }
+
+            did_wait = true;
+        }
+    }
+
+    if (did_wait)
+    {
+        game_publish_generated_tile_chunks(world);
+
+        world->tile_chunk_wait_count++;
+    }
+}
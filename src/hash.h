@@ -0,0 +1,49 @@
+#ifndef __HASH_H__
+#define __HASH_H__
+
+#include "common.h"
+
+#include <string.h>
+
+// Non cryptographic 64 bit hash, used to detect divergence between runs (not
+// for hash tables). Processes 8 bytes at a time so that hashing a full 1080p
+// framebuffer every frame stays cheap.
+#define HASH_SEED 0xcbf29ce484222325ULL
+#define HASH_PRIME 0x100000001b3ULL
+
+inline u64 hash_mix_u64(u64 hash, const u64 value)
+{
+    hash ^= value;
+    hash *= HASH_PRIME;
+    hash ^= hash >> 29;
+
+    return hash;
+}
+
+inline u64 hash_bytes(u64 hash, const void *const data, const u64 size)
+{
+    ASSERT(data || size == 0);
+
+    const u8 *bytes = (const u8 *)data;
+    const u64 word_count = size / sizeof(u64);
+
+    for (u64 i = 0; i < word_count; i++)
+    {
+        u64 word = 0;
+        memcpy(&word, bytes + i * sizeof(u64), sizeof(u64));
+
+        hash = hash_mix_u64(hash, word);
+    }
+
+    // Hash the remaining (< 8) bytes one at a time.
+    for (u64 i = word_count * sizeof(u64); i < size; i++)
+    {
+        hash = hash_mix_u64(hash, bytes[i]);
+    }
+
+    hash = hash_mix_u64(hash, size);
+
+    return hash;
+}
+
+#endif
@@ -0,0 +1,359 @@
+#ifndef __LOG_H__
+#define __LOG_H__
+
+#include "atomics.h"
+#include "common.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// Binary logging.
+// Logging a message does not format it : the thread that logs only writes a
+// compact record (the id of its format string, and the raw arguments) into its
+// own ring buffer. Records are formatted later, by whoever consumes the rings
+// (e.g a background thread that writes them to a file).
+// Every ring has a single producer (the thread that owns it) and a single
+// consumer, so no locks are needed. When a ring is full, records are dropped
+// (and counted) rather than waiting for the consumer.
+// NOTE: Format strings use printf conversions. %s arguments are stored as
+// pointers, so they must point to strings that outlive the record (string
+// literals).
+
+#define LOG_MAX_ARGS 10
+
+// NOTE: Must be a power of 2.
+#define LOG_RING_RECORD_COUNT 1024u
+
+typedef enum
+{
+    log_severity_debug = 0,
+    log_severity_info = 1,
+    log_severity_warning = 2,
+    log_severity_error = 3,
+    log_severity_count = 4,
+} log_severity_t;
+
+typedef enum
+{
+    log_arg_type_i32 = 0,
+    log_arg_type_u32 = 1,
+    log_arg_type_i64 = 2,
+    log_arg_type_u64 = 3,
+    log_arg_type_f64 = 4,
+    log_arg_type_string = 5,
+} log_arg_type_t;
+
+typedef struct
+{
+    const char *text;
+
+    // Filled in by log_parse_format.
+    u32 arg_count;
+    u8 arg_types[LOG_MAX_ARGS];
+} log_format_t;
+
+typedef struct
+{
+    u64 timestamp;
+
+    u16 format_id;
+    u8 severity;
+    u8 category;
+
+    // NOTE: f64 arguments are stored as their bits.
+    u64 args[LOG_MAX_ARGS];
+} log_record_t;
+
+typedef struct
+{
+    // Total number of records written / read (not wrapped). Written only by
+    // the producer / consumer respectively, and kept on separate cache lines
+    // so that the two do not contend.
+    volatile u32 write_count;
+    u8 write_padding[60];
+
+    volatile u32 read_count;
+    u8 read_padding[60];
+
+    // Written by the producer only.
+    volatile u32 dropped_count;
+
+    log_record_t records[LOG_RING_RECORD_COUNT];
+} log_ring_t;
+
+// Finds the type of every conversion in the format's text. Returns false if
+// the text has a conversion that is not supported, or too many of them.
+inline b32 log_parse_format(log_format_t *const restrict format)
+{
+    ASSERT(format);
+    ASSERT(format->text);
+
+    format->arg_count = 0;
+
+    for (const char *c = format->text; *c; c++)
+    {
+        if (*c != '%')
+        {
+            continue;
+        }
+
+        c++;
+        if (*c == '%')
+        {
+            continue;
+        }
+
+        // Skip flags, width and precision.
+        while (*c && strchr("-+ #0123456789.", *c))
+        {
+            c++;
+        }
+
+        // NOTE: Only ll makes a conversion 64 bit (long is 32 bit on
+        // windows).
+        u32 long_modifier_count = 0;
+        while (*c == 'l')
+        {
+            long_modifier_count++;
+            c++;
+        }
+        const b32 is_64_bit = long_modifier_count >= 2;
+
+        log_arg_type_t arg_type = log_arg_type_i32;
+
+        switch (*c)
+        {
+        case 'd':
+        case 'i': {
+            arg_type = is_64_bit ? log_arg_type_i64 : log_arg_type_i32;
+        }
+        break;
+
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'c': {
+            arg_type = is_64_bit ? log_arg_type_u64 : log_arg_type_u32;
+        }
+        break;
+
+        case 'f':
+        case 'e':
+        case 'g': {
+            arg_type = log_arg_type_f64;
+        }
+        break;
+
+        case 's': {
+            arg_type = log_arg_type_string;
+        }
+        break;
+
+        default: {
+            return false;
+        }
+        }
+
+        if (format->arg_count == LOG_MAX_ARGS)
+        {
+            return false;
+        }
+
+        format->arg_types[format->arg_count++] = (u8)arg_type;
+    }
+
+    return true;
+}
+
+// Writes a record into the ring (called by the thread that owns the ring).
+// args must match the format's conversions. Returns false if the ring is full.
+inline b32 log_write_record(log_ring_t *const restrict ring,
+                            const log_format_t *const restrict format,
+                            const u16 format_id, const u8 severity,
+                            const u8 category, const u64 timestamp,
+                            va_list args)
+{
+    ASSERT(ring);
+    ASSERT(format);
+
+    const u32 write_count = ring->write_count;
+
+    if (write_count - ring->read_count == LOG_RING_RECORD_COUNT)
+    {
+        ring->dropped_count++;
+        return false;
+    }
+
+    log_record_t *record =
+        &ring->records[write_count & (LOG_RING_RECORD_COUNT - 1)];
+
+    record->timestamp = timestamp;
+    record->format_id = format_id;
+    record->severity = severity;
+    record->category = category;
+
+    for (u32 i = 0; i < format->arg_count; i++)
+    {
+        switch (format->arg_types[i])
+        {
+        case log_arg_type_i32: {
+            record->args[i] = (u64)(i64)va_arg(args, i32);
+        }
+        break;
+
+        case log_arg_type_u32: {
+            record->args[i] = va_arg(args, u32);
+        }
+        break;
+
+        case log_arg_type_i64: {
+            record->args[i] = (u64)va_arg(args, i64);
+        }
+        break;
+
+        case log_arg_type_u64: {
+            record->args[i] = va_arg(args, u64);
+        }
+        break;
+
+        case log_arg_type_f64: {
+            const f64 value = va_arg(args, f64);
+            memcpy(&record->args[i], &value, sizeof(f64));
+        }
+        break;
+
+        case log_arg_type_string: {
+            record->args[i] = (u64)(uintptr_t)va_arg(args, const char *);
+        }
+        break;
+        }
+    }
+
+    // Publish the record (full barrier, so the record is written first).
+    atomic_exchange_u32(&ring->write_count, write_count + 1);
+
+    return true;
+}
+
+// Returns the oldest record in the ring (or NULL if it is empty), which stays
+// valid until log_release_record is called.
+inline const log_record_t *log_peek_record(const log_ring_t *const ring)
+{
+    ASSERT(ring);
+
+    const u32 read_count = ring->read_count;
+
+    if (read_count == ring->write_count)
+    {
+        return NULL;
+    }
+
+    return &ring->records[read_count & (LOG_RING_RECORD_COUNT - 1)];
+}
+
+inline void log_release_record(log_ring_t *const ring)
+{
+    ASSERT(ring);
+    ASSERT(ring->read_count != ring->write_count);
+
+    // Hand the record back to the producer (after it has been read).
+    atomic_exchange_u32(&ring->read_count, ring->read_count + 1);
+}
+
+// Formats the record's message into text (always null terminated). Returns the
+// length of the message.
+inline u32 log_format_record(char *const restrict text, const u32 text_size,
+                             const log_format_t *const restrict format,
+                             const log_record_t *const restrict record)
+{
+    ASSERT(text);
+    ASSERT(text_size > 0);
+    ASSERT(format);
+    ASSERT(record);
+
+    u32 length = 0;
+    u32 arg_index = 0;
+
+    // Copies literal text as is, and formats one conversion at a time (with
+    // its own specification, so flags / width / precision are kept).
+    const char *c = format->text;
+    while (*c && length + 1 < text_size)
+    {
+        if (c[0] != '%' || c[1] == '%')
+        {
+            text[length++] = *c;
+            c += c[0] == '%' ? 2 : 1;
+            continue;
+        }
+
+        char specification[32];
+        u32 specification_length = 0;
+
+        do
+        {
+            specification[specification_length++] = *c++;
+        } while (*c && !strchr("diuxXcfegs", *c) &&
+                 specification_length + 2 < sizeof(specification));
+
+        specification[specification_length++] = *c++;
+        specification[specification_length] = 0;
+
+        ASSERT(arg_index < format->arg_count);
+        const u64 arg = record->args[arg_index];
+
+        char *destination = text + length;
+        const size_t destination_size = text_size - length;
+        int written = 0;
+
+        switch (format->arg_types[arg_index++])
+        {
+        case log_arg_type_i32: {
+            written = snprintf(destination, destination_size, specification,
+                               (i32)arg);
+        }
+        break;
+
+        case log_arg_type_u32: {
+            written = snprintf(destination, destination_size, specification,
+                               (u32)arg);
+        }
+        break;
+
+        case log_arg_type_i64:
+        case log_arg_type_u64: {
+            written = snprintf(destination, destination_size, specification,
+                               arg);
+        }
+        break;
+
+        case log_arg_type_f64: {
+            f64 value = 0.0;
+            memcpy(&value, &arg, sizeof(f64));
+
+            written =
+                snprintf(destination, destination_size, specification, value);
+        }
+        break;
+
+        case log_arg_type_string: {
+            written = snprintf(destination, destination_size, specification,
+                               (const char *)(uintptr_t)arg);
+        }
+        break;
+        }
+
+        if (written > 0)
+        {
+            length += (u32)written < destination_size
+                          ? (u32)written
+                          : (u32)destination_size - 1;
+        }
+    }
+
+    text[length] = 0;
+
+    return length;
+}
+
+#endif
@@ -0,0 +1,475 @@
+// Audio output.
+// The game thread mixes audio once per frame, and pushes the samples into a
+// lock free ring buffer with a single producer (the game thread) and a single
+// consumer (the audio thread). The audio thread feeds the device (waveOut)
+// from the ring buffer, in small device buffers. Neither thread ever waits for
+// the other : when the ring buffer is full the game's samples are dropped, and
+// when it runs dry the device is fed silence.
+// Headless runs write the game's samples to a WAV file instead (see
+// win32_wav_sink_t).
+
+// NOTE: Must be a power of 2.
+#define WIN32_AUDIO_RING_SAMPLE_COUNT 16384u
+
+#define WIN32_AUDIO_DEVICE_BUFFER_COUNT 4
+#define WIN32_AUDIO_DEVICE_BUFFER_SAMPLE_COUNT                                 \
+    (GAME_SOUND_SAMPLES_PER_SECOND / 200)
+
+// Amount of audio (in samples) the game keeps queued in the ring buffer, on
+// top of what is queued in device buffers. Has to cover the longest expected
+// frame.
+#define WIN32_AUDIO_TARGET_LATENCY_SAMPLE_COUNT                                \
+    (GAME_SOUND_SAMPLES_PER_SECOND / 20)
+
+typedef struct
+{
+    // Total number of samples written / read (not wrapped). Written only by
+    // the game thread / audio thread respectively.
+    volatile LONG write_sample_count;
+    volatile LONG read_sample_count;
+
+    // Interleaved stereo samples.
+    i16 samples[2 * WIN32_AUDIO_RING_SAMPLE_COUNT];
+} win32_audio_ring_t;
+
+typedef struct
+{
+    win32_audio_ring_t ring;
+
+    b32 is_device_open;
+    HWAVEOUT wave_out;
+
+    // Signaled by the device whenever it is done with a device buffer.
+    HANDLE device_buffer_done_event;
+
+    HANDLE audio_thread;
+    // Set by the game thread to stop the audio thread.
+    volatile LONG should_stop;
+
+    WAVEHDR device_buffer_headers[WIN32_AUDIO_DEVICE_BUFFER_COUNT];
+    i16 device_buffer_samples[WIN32_AUDIO_DEVICE_BUFFER_COUNT]
+                             [2 * WIN32_AUDIO_DEVICE_BUFFER_SAMPLE_COUNT];
+
+    // The game mixes into game_samples.
+    i16 game_samples[2 * GAME_MAX_SOUND_SAMPLES_PER_FRAME];
+
+    // Fraction of a sample left over by
+    // win32_get_sound_sample_count_for_delta_time.
+    f64 pending_sample_count;
+
+    // Stats.
+    u32 dropped_sample_count;
+    // Written by the audio thread.
+    volatile LONG silent_sample_count;
+} win32_audio_t;
+
+internal u32 win32_get_audio_ring_fill(const win32_audio_ring_t *const ring)
+{
+    ASSERT(ring);
+
+    // NOTE: The counts wrap around, but their (unsigned) difference does not.
+    const u32 fill =
+        (u32)ring->write_sample_count - (u32)ring->read_sample_count;
+    ASSERT(fill <= WIN32_AUDIO_RING_SAMPLE_COUNT);
+
+    return fill;
+}
+
+// Copies samples from the ring buffer into the device buffer (padding it with
+// silence if the ring buffer runs dry), and hands it to the device.
+// NOTE: Only called on the audio thread (or before it is started).
+internal void
+win32_fill_device_buffer(win32_audio_t *const restrict audio,
+                         WAVEHDR *const restrict device_buffer_header)
+{
+    ASSERT(audio);
+    ASSERT(device_buffer_header);
+
+    win32_audio_ring_t *ring = &audio->ring;
+    i16 *device_samples = (i16 *)device_buffer_header->lpData;
+
+    // NOTE: The game thread writes the samples before it publishes the write
+    // count, and reads of volatiles are not reordered on x64, so all samples
+    // up to the write count read here are visible.
+    u32 sample_count = win32_get_audio_ring_fill(ring);
+    if (sample_count > WIN32_AUDIO_DEVICE_BUFFER_SAMPLE_COUNT)
+    {
+        sample_count = WIN32_AUDIO_DEVICE_BUFFER_SAMPLE_COUNT;
+    }
+
+    const u32 read_index =
+        (u32)ring->read_sample_count & (WIN32_AUDIO_RING_SAMPLE_COUNT - 1);
+
+    u32 first_sample_count = WIN32_AUDIO_RING_SAMPLE_COUNT - read_index;
+    if (first_sample_count > sample_count)
+    {
+        first_sample_count = sample_count;
+    }
+
+    memcpy(device_samples, &ring->samples[2 * read_index],
+           2 * sizeof(i16) * first_sample_count);
+    memcpy(device_samples + 2 * first_sample_count, ring->samples,
+           2 * sizeof(i16) * (sample_count - first_sample_count));
+
+    if (sample_count < WIN32_AUDIO_DEVICE_BUFFER_SAMPLE_COUNT)
+    {
+        memset(device_samples + 2 * sample_count, 0,
+               2 * sizeof(i16) *
+                   (WIN32_AUDIO_DEVICE_BUFFER_SAMPLE_COUNT - sample_count));
+
+        InterlockedExchangeAdd(&audio->silent_sample_count,
+                               (LONG)(WIN32_AUDIO_DEVICE_BUFFER_SAMPLE_COUNT -
+                                      sample_count));
+    }
+
+    // Hand the read samples back to the game thread.
+    InterlockedExchangeAdd(&ring->read_sample_count, (LONG)sample_count);
+
+    waveOutWrite(audio->wave_out, device_buffer_header, sizeof(WAVEHDR));
+}
+
+internal DWORD WINAPI win32_audio_thread_proc(LPVOID param)
+{
+    win32_audio_t *audio = (win32_audio_t *)param;
+    ASSERT(audio);
+
+    for (;;)
+    {
+        WaitForSingleObject(audio->device_buffer_done_event, INFINITE);
+
+        if (audio->should_stop)
+        {
+            break;
+        }
+
+        for (u32 i = 0; i < WIN32_AUDIO_DEVICE_BUFFER_COUNT; i++)
+        {
+            WAVEHDR *header = &audio->device_buffer_headers[i];
+
+            if (header->dwFlags & WHDR_DONE)
+            {
+                header->dwFlags &= ~WHDR_DONE;
+                win32_fill_device_buffer(audio, header);
+            }
+        }
+    }
+
+    return 0;
+}
+
+// If no audio device can be opened, the game still mixes audio (so that game
+// state does not depend on the presence of a device), which is then dropped.
+internal void win32_init_audio(win32_audio_t *const restrict audio)
+{
+    ASSERT(audio);
+
+    WAVEFORMATEX wave_format = {0};
+    wave_format.wFormatTag = WAVE_FORMAT_PCM;
+    wave_format.nChannels = 2;
+    wave_format.nSamplesPerSec = GAME_SOUND_SAMPLES_PER_SECOND;
+    wave_format.wBitsPerSample = 16;
+    wave_format.nBlockAlign =
+        wave_format.nChannels * wave_format.wBitsPerSample / 8;
+    wave_format.nAvgBytesPerSec =
+        wave_format.nSamplesPerSec * wave_format.nBlockAlign;
+
+    audio->device_buffer_done_event = CreateEventW(NULL, FALSE, FALSE, NULL);
+    ASSERT(audio->device_buffer_done_event);
+
+    if (waveOutOpen(&audio->wave_out, WAVE_MAPPER, &wave_format,
+                    (DWORD_PTR)audio->device_buffer_done_event, 0,
+                    CALLBACK_EVENT) != MMSYSERR_NOERROR)
+    {
+        WIN32_LOG(log_severity_warning, win32_log_category_audio,
+                  win32_log_format_audio_device_failed);
+        return;
+    }
+
+    audio->is_device_open = true;
+
+    // The device starts out with silence in all of its buffers.
+    for (u32 i = 0; i < WIN32_AUDIO_DEVICE_BUFFER_COUNT; i++)
+    {
+        WAVEHDR *header = &audio->device_buffer_headers[i];
+        header->lpData = (char *)audio->device_buffer_samples[i];
+        header->dwBufferLength = sizeof(audio->device_buffer_samples[i]);
+
+        waveOutPrepareHeader(audio->wave_out, header, sizeof(WAVEHDR));
+        win32_fill_device_buffer(audio, header);
+    }
+
+    audio->audio_thread =
+        CreateThread(NULL, 0, win32_audio_thread_proc, audio, 0, NULL);
+    ASSERT(audio->audio_thread);
+
+    // Refilling device buffers late is audible, so the audio thread runs
+    // ahead of everything else.
+    SetThreadPriority(audio->audio_thread, THREAD_PRIORITY_HIGHEST);
+}
+
+// Stops the audio thread, and closes the device (dropping whatever it still
+// has queued).
+internal void win32_shutdown_audio(win32_audio_t *const restrict audio)
+{
+    ASSERT(audio);
+
+    if (audio->audio_thread)
+    {
+        InterlockedExchange(&audio->should_stop, 1);
+        SetEvent(audio->device_buffer_done_event);
+        WaitForSingleObject(audio->audio_thread, INFINITE);
+
+        CloseHandle(audio->audio_thread);
+        audio->audio_thread = NULL;
+    }
+
+    if (audio->is_device_open)
+    {
+        // NOTE: Headers can only be unprepared once the device is done with
+        // them, which waveOutReset guarantees.
+        waveOutReset(audio->wave_out);
+
+        for (u32 i = 0; i < WIN32_AUDIO_DEVICE_BUFFER_COUNT; i++)
+        {
+            waveOutUnprepareHeader(audio->wave_out,
+                                   &audio->device_buffer_headers[i],
+                                   sizeof(WAVEHDR));
+        }
+
+        waveOutClose(audio->wave_out);
+        audio->is_device_open = false;
+    }
+
+    CloseHandle(audio->device_buffer_done_event);
+    audio->device_buffer_done_event = NULL;
+}
+
+// Number of samples (a multiple of 4) that cover delta_time (in ms). Used to
+// pace audio when there is no device to pace it.
+internal u32
+win32_get_sound_sample_count_for_delta_time(f64 *const restrict pending,
+                                            const f32 delta_time)
+{
+    ASSERT(pending);
+
+    *pending += (f64)delta_time * GAME_SOUND_SAMPLES_PER_SECOND / 1000.0;
+
+    u32 sample_count = (u32)*pending & ~3u;
+    if (sample_count > GAME_MAX_SOUND_SAMPLES_PER_FRAME)
+    {
+        sample_count = GAME_MAX_SOUND_SAMPLES_PER_FRAME;
+        *pending = 0.0;
+    }
+    else
+    {
+        *pending -= sample_count;
+    }
+
+    return sample_count;
+}
+
+// Returns the buffer the game mixes this frame's audio into. The game mixes
+// enough samples to bring the ring buffer back up to its target latency.
+// NOTE: delta_time (in ms) is only used when there is no audio device.
+internal game_sound_output_buffer_t
+win32_acquire_sound_buffer(win32_audio_t *const restrict audio,
+                           const f32 delta_time)
+{
+    ASSERT(audio);
+
+    u32 sample_count = 0;
+
+    if (audio->is_device_open)
+    {
+        const u32 fill = win32_get_audio_ring_fill(&audio->ring);
+
+        if (fill < WIN32_AUDIO_TARGET_LATENCY_SAMPLE_COUNT)
+        {
+            sample_count = (WIN32_AUDIO_TARGET_LATENCY_SAMPLE_COUNT - fill +
+                            3) &
+                           ~3u;
+        }
+
+        if (sample_count > GAME_MAX_SOUND_SAMPLES_PER_FRAME)
+        {
+            sample_count = GAME_MAX_SOUND_SAMPLES_PER_FRAME;
+        }
+    }
+    else
+    {
+        sample_count = win32_get_sound_sample_count_for_delta_time(
+            &audio->pending_sample_count, delta_time);
+    }
+
+    // NOTE: Cleared, so that a game that does not mix audio (e.g the stub
+    // while the game dll is reloaded) outputs silence.
+    memset(audio->game_samples, 0, 2 * sizeof(i16) * sample_count);
+
+    game_sound_output_buffer_t sound_buffer = {0};
+    sound_buffer.samples = audio->game_samples;
+    sound_buffer.sample_count = sample_count;
+    sound_buffer.samples_per_second = GAME_SOUND_SAMPLES_PER_SECOND;
+
+    return sound_buffer;
+}
+
+// Pushes the samples mixed by the game into the ring buffer.
+internal void
+win32_submit_sound_buffer(win32_audio_t *const restrict audio,
+                          const game_sound_output_buffer_t *const sound_buffer)
+{
+    ASSERT(audio);
+    ASSERT(sound_buffer);
+
+    if (!audio->is_device_open)
+    {
+        return;
+    }
+
+    win32_audio_ring_t *ring = &audio->ring;
+
+    const u32 free_sample_count =
+        WIN32_AUDIO_RING_SAMPLE_COUNT - win32_get_audio_ring_fill(ring);
+
+    u32 sample_count = sound_buffer->sample_count;
+    if (sample_count > free_sample_count)
+    {
+        audio->dropped_sample_count += sample_count - free_sample_count;
+        sample_count = free_sample_count;
+    }
+
+    const u32 write_index =
+        (u32)ring->write_sample_count & (WIN32_AUDIO_RING_SAMPLE_COUNT - 1);
+
+    u32 first_sample_count = WIN32_AUDIO_RING_SAMPLE_COUNT - write_index;
+    if (first_sample_count > sample_count)
+    {
+        first_sample_count = sample_count;
+    }
+
+    memcpy(&ring->samples[2 * write_index], sound_buffer->samples,
+           2 * sizeof(i16) * first_sample_count);
+    memcpy(ring->samples, sound_buffer->samples + 2 * first_sample_count,
+           2 * sizeof(i16) * (sample_count - first_sample_count));
+
+    // Publish the samples (full barrier, so the samples are written first).
+    InterlockedExchangeAdd(&ring->write_sample_count, (LONG)sample_count);
+}
+
+// WAV file sink, for headless runs.
+// The header is written with a size of 0 when the file is opened, and
+// rewritten with the final size when it is closed.
+#define WIN32_WAV_CHUNK_ID(a, b, c, d)                                         \
+    ((u32)(a) | ((u32)(b) << 8) | ((u32)(c) << 16) | ((u32)(d) << 24))
+
+#pragma pack(push, 1)
+typedef struct
+{
+    u32 riff_id;
+    u32 riff_size;
+    u32 wave_id;
+
+    u32 format_id;
+    u32 format_size;
+    u16 format_tag;
+    u16 channel_count;
+    u32 samples_per_second;
+    u32 bytes_per_second;
+    u16 block_align;
+    u16 bits_per_sample;
+
+    u32 data_id;
+    u32 data_size;
+} win32_wav_header_t;
+#pragma pack(pop)
+
+typedef struct
+{
+    HANDLE file_handle;
+    u32 sample_count;
+} win32_wav_sink_t;
+
+internal void win32_write_wav_header(win32_wav_sink_t *const restrict sink)
+{
+    ASSERT(sink);
+
+    const u32 data_size = 2 * sizeof(i16) * sink->sample_count;
+
+    win32_wav_header_t header = {0};
+    header.riff_id = WIN32_WAV_CHUNK_ID('R', 'I', 'F', 'F');
+    header.riff_size = sizeof(win32_wav_header_t) - 8 + data_size;
+    header.wave_id = WIN32_WAV_CHUNK_ID('W', 'A', 'V', 'E');
+    header.format_id = WIN32_WAV_CHUNK_ID('f', 'm', 't', ' ');
+    header.format_size = 16;
+    header.format_tag = WAVE_FORMAT_PCM;
+    header.channel_count = 2;
+    header.samples_per_second = GAME_SOUND_SAMPLES_PER_SECOND;
+    header.bytes_per_second = GAME_SOUND_SAMPLES_PER_SECOND * 2 * sizeof(i16);
+    header.block_align = 2 * sizeof(i16);
+    header.bits_per_sample = 16;
+    header.data_id = WIN32_WAV_CHUNK_ID('d', 'a', 't', 'a');
+    header.data_size = data_size;
+
+    LARGE_INTEGER file_start = {0};
+    SetFilePointerEx(sink->file_handle, file_start, NULL, FILE_BEGIN);
+
+    DWORD bytes_written = 0;
+    WriteFile(sink->file_handle, (void *)&header, sizeof(header),
+              &bytes_written, NULL);
+}
+
+internal b32 win32_open_wav_sink(win32_wav_sink_t *const restrict sink,
+                                 const char *const restrict file_path)
+{
+    ASSERT(sink);
+    ASSERT(file_path);
+
+    *sink = (win32_wav_sink_t){0};
+
+    sink->file_handle = CreateFileA(file_path, GENERIC_WRITE, 0, NULL,
+                                    CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (sink->file_handle == INVALID_HANDLE_VALUE)
+    {
+        sink->file_handle = NULL;
+        return false;
+    }
+
+    win32_write_wav_header(sink);
+
+    return true;
+}
+
+internal void
+win32_write_to_wav_sink(win32_wav_sink_t *const restrict sink,
+                        const game_sound_output_buffer_t *const sound_buffer)
+{
+    ASSERT(sink);
+    ASSERT(sound_buffer);
+
+    if (!sink->file_handle)
+    {
+        return;
+    }
+
+    DWORD bytes_written = 0;
+    WriteFile(sink->file_handle, (void *)sound_buffer->samples,
+              2 * sizeof(i16) * sound_buffer->sample_count, &bytes_written,
+              NULL);
+
+    sink->sample_count += sound_buffer->sample_count;
+}
+
+internal void win32_close_wav_sink(win32_wav_sink_t *const restrict sink)
+{
+    ASSERT(sink);
+
+    if (!sink->file_handle)
+    {
+        return;
+    }
+
+    win32_write_wav_header(sink);
+
+    CloseHandle(sink->file_handle);
+    sink->file_handle = NULL;
+}
@@ -0,0 +1,311 @@
+// Batch simulation.
+// Runs many independent instances of the game (each with its own game memory)
+// headless, on the worker threads of the work queue, for soak testing and for
+// generating training data. Instances are driven by scripted players (each
+// seeded differently), or all replay the input stream of the last live loop
+// recording. Rendering is optional, and done at a small resolution.
+//
+// Each job runs all frames of one instance, and the calling thread runs jobs
+// as well while it waits. Instances start from a new world : saves are neither
+// read nor written.
+
+#define WIN32_BATCH_FRAMEBUFFER_WIDTH 320u
+#define WIN32_BATCH_FRAMEBUFFER_HEIGHT 180u
+
+#define WIN32_BATCH_FRAME_MS (1000.0f / 60.0f)
+
+typedef struct
+{
+    u32 instance_count;
+    u32 frame_count;
+
+    b32 is_rendering;
+
+    // Replay the live loop recording's input stream (looped), instead of
+    // scripted players.
+    b32 uses_recorded_input;
+
+    u64 seed;
+} win32_batch_config_t;
+
+typedef struct win32_batch_t win32_batch_t;
+
+typedef struct
+{
+    win32_batch_t *batch;
+
+    game_memory_t game_memory;
+    win32_scripted_player_t player;
+
+    // NOTE: NULL when the batch is not rendering.
+    u32 *framebuffer_memory;
+
+    // Written by the thread running the instance.
+    u32 frame_count;
+    u64 update_counts;
+} win32_batch_instance_t;
+
+struct win32_batch_t
+{
+    win32_batch_config_t config;
+
+    game_update_and_render_t *update_and_render;
+    game_platform_services_t platform_services;
+
+    const game_input_t *recorded_inputs;
+    u32 recorded_input_count;
+
+    win32_batch_instance_t *instances;
+};
+
+internal DEF_PLATFORM_WORK_QUEUE_CALLBACK(win32_run_batch_instance_work)
+{
+    win32_batch_instance_t *instance = (win32_batch_instance_t *)data;
+    ASSERT(instance);
+
+    win32_batch_t *batch = instance->batch;
+    ASSERT(batch);
+
+    game_offscreen_buffer_t game_offscreen_buffer = {0};
+    game_offscreen_buffer.framebuffer_memory = instance->framebuffer_memory;
+    game_offscreen_buffer.width = WIN32_BATCH_FRAMEBUFFER_WIDTH;
+    game_offscreen_buffer.height = WIN32_BATCH_FRAMEBUFFER_HEIGHT;
+
+    // Same view of the world as the window has, at a lower resolution.
+    game_offscreen_buffer.render_scale =
+        (f32)WIN32_BATCH_FRAMEBUFFER_WIDTH / (f32)WINDOW_WIDTH;
+
+    i16 samples[2 * GAME_MAX_SOUND_SAMPLES_PER_FRAME];
+
+    const u64 start_counter_value = win32_get_perf_counter_value();
+
+    for (; instance->frame_count < batch->config.frame_count;
+         instance->frame_count++)
+    {
+        game_input_t game_input =
+            batch->recorded_inputs
+                ? batch->recorded_inputs[instance->frame_count %
+                                         batch->recorded_input_count]
+                : win32_get_scripted_input(&instance->player,
+                                           WIN32_BATCH_FRAME_MS);
+
+        // NOTE: The number of samples mixed only depends on the delta time,
+        // so that instances are deterministic.
+        u32 sample_count = (u32)(game_input.delta_time *
+                                 GAME_SOUND_SAMPLES_PER_SECOND / 1000.0f) &
+                           ~3u;
+        if (sample_count > GAME_MAX_SOUND_SAMPLES_PER_FRAME)
+        {
+            sample_count = GAME_MAX_SOUND_SAMPLES_PER_FRAME;
+        }
+
+        game_sound_output_buffer_t game_sound_buffer = {0};
+        game_sound_buffer.samples = samples;
+        game_sound_buffer.sample_count = sample_count;
+        game_sound_buffer.samples_per_second = GAME_SOUND_SAMPLES_PER_SECOND;
+
+        batch->update_and_render(&game_offscreen_buffer, &game_input,
+                                 &game_sound_buffer, &instance->game_memory,
+                                 &batch->platform_services);
+    }
+
+    instance->update_counts +=
+        win32_get_perf_counter_value() - start_counter_value;
+}
+
+internal win32_replay_result_t
+win32_run_batch(const win32_batch_config_t *const restrict config,
+                const u32 worker_thread_count)
+{
+    ASSERT(config);
+
+    char text[512];
+
+    if (config->instance_count == 0)
+    {
+        return win32_replay_result_success;
+    }
+
+    win32_batch_t batch = {0};
+    batch.config = *config;
+
+    game_t game = win32_load_game_dll("game.dll");
+    batch.update_and_render = game.update_and_render;
+
+    // NOTE: Instances run their jobs (e.g world generation) themselves, and
+    // neither write files nor print (they would all do it at once).
+    batch.platform_services = win32_get_platform_services(NULL, NULL);
+    batch.platform_services.read_file = NULL;
+    batch.platform_services.write_to_file = NULL;
+    batch.platform_services.write_file_at_offset = NULL;
+    batch.platform_services.debug_print = NULL;
+
+    u8 *recorded_input_file = NULL;
+    if (config->uses_recorded_input)
+    {
+        u64 recorded_input_file_size = 0;
+        recorded_input_file = win32_read_entire_file(
+            "prism_input_handle.txt", &recorded_input_file_size);
+
+        batch.recorded_inputs = (const game_input_t *)recorded_input_file;
+        batch.recorded_input_count = truncate_u64_to_u32(
+            recorded_input_file_size / sizeof(game_input_t));
+
+        if (!batch.recorded_input_count)
+        {
+            win32_print("Batch : Failed to read recorded input stream "
+                        "(prism_input_handle.txt).\n");
+            return win32_replay_result_missing_recording;
+        }
+    }
+
+    batch.instances = (win32_batch_instance_t *)VirtualAlloc(
+        0, sizeof(win32_batch_instance_t) * config->instance_count,
+        MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    ASSERT(batch.instances);
+
+    // NOTE: Pages are only backed by physical memory once touched, which
+    // spreads the cost over the worker threads.
+    const u64 game_memory_size = MEGABYTE(16);
+    u8 *game_memory_blocks = (u8 *)VirtualAlloc(
+        0, game_memory_size * config->instance_count, MEM_COMMIT | MEM_RESERVE,
+        PAGE_READWRITE);
+
+    const u64 framebuffer_size = sizeof(u32) * WIN32_BATCH_FRAMEBUFFER_WIDTH *
+                                 WIN32_BATCH_FRAMEBUFFER_HEIGHT;
+    u32 *framebuffers = NULL;
+    if (config->is_rendering)
+    {
+        framebuffers = (u32 *)VirtualAlloc(
+            0, framebuffer_size * config->instance_count,
+            MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    }
+
+    if (!game_memory_blocks || (config->is_rendering && !framebuffers))
+    {
+        sprintf(text,
+                "Batch : Failed to allocate game memory for %u instances "
+                "(%llu MB).\n",
+                config->instance_count,
+                (unsigned long long)(game_memory_size *
+                                     config->instance_count / MEGABYTE(1)));
+        win32_print(text);
+        return win32_replay_result_out_of_memory;
+    }
+
+    for (u32 i = 0; i < config->instance_count; i++)
+    {
+        win32_batch_instance_t *instance = &batch.instances[i];
+
+        instance->batch = &batch;
+        instance->game_memory.permanent_memory_block =
+            game_memory_blocks + game_memory_size * i;
+        instance->game_memory.permanent_memory_block_size = game_memory_size;
+        instance->player.random_state = hash_mix_u64(config->seed, i + 1);
+
+        if (framebuffers)
+        {
+            instance->framebuffer_memory =
+                framebuffers + framebuffer_size / sizeof(u32) * i;
+        }
+    }
+
+    platform_work_queue_t *work_queue = &g_work_queue;
+    win32_init_work_queue(work_queue, worker_thread_count);
+
+    const u64 perf_counter_frequency = win32_get_perf_counter_frequency();
+    const u64 batch_start_counter_value = win32_get_perf_counter_value();
+
+    // NOTE: The game dll's globals (tables, sprites) are otherwise built by
+    // the first call into the game, which would race between the workers. The
+    // only other globals of the dll back the save and memory stats writes,
+    // which instances never make (there is nowhere to write to).
+    game.init_globals();
+
+    // NOTE: The queue holds WIN32_MAX_WORK_QUEUE_ENTRIES - 1 entries, so
+    // instances are added in groups.
+    for (u32 first_instance_index = 0;
+         first_instance_index < config->instance_count;
+         first_instance_index += WIN32_MAX_WORK_QUEUE_ENTRIES - 1)
+    {
+        for (u32 i = first_instance_index;
+             i < config->instance_count &&
+             i < first_instance_index + WIN32_MAX_WORK_QUEUE_ENTRIES - 1;
+             i++)
+        {
+            platform_add_work_queue_entry(work_queue,
+                                          win32_run_batch_instance_work,
+                                          &batch.instances[i]);
+        }
+
+        platform_complete_all_work(work_queue);
+    }
+
+    const u64 batch_end_counter_value = win32_get_perf_counter_value();
+
+    // Report.
+    u64 total_frame_count = 0;
+    u64 total_update_counts = 0;
+    u64 batch_hash = HASH_SEED;
+
+    for (u32 i = 0; i < config->instance_count; i++)
+    {
+        const win32_batch_instance_t *instance = &batch.instances[i];
+
+        total_frame_count += instance->frame_count;
+        total_update_counts += instance->update_counts;
+
+        batch_hash = hash_mix_u64(
+            batch_hash,
+            hash_bytes(HASH_SEED, instance->game_memory.permanent_memory_block,
+                       instance->game_memory.permanent_memory_block_size));
+    }
+
+    const u32 thread_count = work_queue->worker_thread_count + 1;
+    const f32 total_ms = win32_get_time_delta_ms(batch_start_counter_value,
+                                                 batch_end_counter_value,
+                                                 perf_counter_frequency);
+    const f32 update_ms =
+        win32_get_time_delta_ms(0, total_update_counts, perf_counter_frequency);
+    const f64 frames_per_second =
+        total_ms > 0.0f ? 1000.0 * (f64)total_frame_count / total_ms : 0.0;
+
+    sprintf(text,
+            "Batch : %u instances (%s, %s), %u frames each, on %u threads. "
+            "Game memory : %llu MB.\n",
+            config->instance_count,
+            config->uses_recorded_input ? "recorded input" : "scripted input",
+            config->is_rendering ? "rendering" : "not rendering",
+            config->frame_count, thread_count,
+            (unsigned long long)(game_memory_size * config->instance_count /
+                                 MEGABYTE(1)));
+    win32_print(text);
+
+    sprintf(text,
+            "Batch : %llu frames in %.2f ms : %.1f frames per second, %.1f "
+            "frames per second per thread, %.4f ms per frame.\n",
+            (unsigned long long)total_frame_count, total_ms, frames_per_second,
+            frames_per_second / thread_count,
+            total_frame_count ? update_ms / (f64)total_frame_count : 0.0);
+    win32_print(text);
+
+    // NOTE: Instances are deterministic, so the hash only depends on the
+    // configuration (and not on the number of threads).
+    sprintf(text, "Batch : Game memory hash of all instances : %016llx.\n",
+            (unsigned long long)batch_hash);
+    win32_print(text);
+
+    if (recorded_input_file)
+    {
+        platform_close_file(recorded_input_file);
+    }
+    if (framebuffers)
+    {
+        VirtualFree(framebuffers, 0, MEM_RELEASE);
+    }
+    VirtualFree(game_memory_blocks, 0, MEM_RELEASE);
+    VirtualFree(batch.instances, 0, MEM_RELEASE);
+    win32_unload_game_dll(&game);
+
+    return win32_replay_result_success;
+}
@@ -0,0 +1,422 @@
+// Frame capture.
+// While capturing, every finished frame (as the game rendered it, with the
+// HUD if it is visible) is copied into one of a pool of preallocated slots and
+// handed to a background capture thread, which compresses it to a QOI image
+// and writes it to WIN32_CAPTURE_DIRECTORY. The game thread never waits for
+// the capture thread : when all slots are in use, the frame is dropped (and
+// counted) instead.
+// Files are named after the index of the frame in the live loop, so dropped
+// frames show up as gaps.
+// NOTE: Frames are captured at the render resolution (before the present
+// thread upscales them), so their size changes with dynamic resolution (see
+// --fixed-resolution).
+
+#define WIN32_CAPTURE_POOL_SIZE 8
+#define WIN32_CAPTURE_DIRECTORY "prism_capture"
+
+#define WIN32_CAPTURE_MAX_PIXEL_COUNT (WINDOW_WIDTH * WINDOW_HEIGHT)
+
+// Header, worst case of 4 bytes per pixel (QOI_OP_RGB) and the end marker.
+#define WIN32_QOI_HEADER_SIZE 14
+#define WIN32_QOI_END_MARKER_SIZE 8
+#define WIN32_CAPTURE_MAX_ENCODED_SIZE                                         \
+    (WIN32_QOI_HEADER_SIZE + 4 * WIN32_CAPTURE_MAX_PIXEL_COUNT +               \
+     WIN32_QOI_END_MARKER_SIZE)
+
+#define WIN32_QOI_OP_INDEX 0x00
+#define WIN32_QOI_OP_DIFF 0x40
+#define WIN32_QOI_OP_LUMA 0x80
+#define WIN32_QOI_OP_RUN 0xc0
+#define WIN32_QOI_OP_RGB 0xfe
+
+typedef struct
+{
+    u32 *pixels;
+    u32 width;
+    u32 height;
+    u32 frame_index;
+} win32_capture_slot_t;
+
+typedef struct
+{
+    b32 is_capturing;
+
+    win32_capture_slot_t slots[WIN32_CAPTURE_POOL_SIZE];
+
+    // Slots are filled and written in round robin order.
+    u32 submit_slot_index;
+    u32 write_slot_index;
+
+    // Counts the slots that can be filled.
+    HANDLE free_slot_semaphore;
+    // Counts the slots waiting to be written (plus one when stopping).
+    HANDLE submitted_slot_semaphore;
+
+    HANDLE capture_thread;
+    volatile LONG should_stop;
+
+    // Only used by the capture thread.
+    u8 *encoded_data;
+
+    // Stats since the capture thread was started. The submitted and dropped
+    // counts are written by the game thread, the rest by the capture thread.
+    u32 submitted_frame_count;
+    u32 dropped_frame_count;
+    u64 copy_counts;
+
+    volatile LONG written_frame_count;
+    volatile LONG failed_frame_count;
+    volatile u64 written_byte_count;
+    volatile u64 encode_counts;
+
+    // Time the last submitted frame took to copy.
+    u64 last_copy_counts;
+} win32_capture_t;
+
+internal u8 *win32_write_u32_big_endian(u8 *const restrict out,
+                                       const u32 value)
+{
+    out[0] = (u8)(value >> 24);
+    out[1] = (u8)(value >> 16);
+    out[2] = (u8)(value >> 8);
+    out[3] = (u8)value;
+
+    return out + 4;
+}
+
+// Encodes the (0x00RRGGBB) pixels as a 3 channel QOI image, and returns its
+// size. encoded_data must hold WIN32_CAPTURE_MAX_ENCODED_SIZE bytes.
+internal u32 win32_encode_qoi(const u32 *const restrict pixels, const u32 width,
+                              const u32 height, u8 *const restrict encoded_data)
+{
+    ASSERT(pixels);
+    ASSERT(encoded_data);
+    ASSERT(width * height <= WIN32_CAPTURE_MAX_PIXEL_COUNT);
+
+    u8 *out = encoded_data;
+
+    *out++ = 'q';
+    *out++ = 'o';
+    *out++ = 'i';
+    *out++ = 'f';
+
+    // Big endian dimensions, then 3 channels, sRGB.
+    out = win32_write_u32_big_endian(out, width);
+    out = win32_write_u32_big_endian(out, height);
+    *out++ = 3;
+    *out++ = 0;
+
+    // NOTE: Pixels are compared with an opaque alpha, so that the zeroed
+    // index never matches (as in the reference encoder).
+    u32 index[64] = {0};
+    u32 prev_pixel = 0xff000000;
+    u32 run = 0;
+
+    const u32 pixel_count = width * height;
+
+    for (u32 i = 0; i < pixel_count; i++)
+    {
+        const u32 pixel = pixels[i] | 0xff000000;
+
+        if (pixel == prev_pixel)
+        {
+            run++;
+            if (run == 62 || i == pixel_count - 1)
+            {
+                *out++ = (u8)(WIN32_QOI_OP_RUN | (run - 1));
+                run = 0;
+            }
+
+            continue;
+        }
+
+        if (run)
+        {
+            *out++ = (u8)(WIN32_QOI_OP_RUN | (run - 1));
+            run = 0;
+        }
+
+        const u8 r = (u8)(pixel >> 16);
+        const u8 g = (u8)(pixel >> 8);
+        const u8 b = (u8)pixel;
+
+        const u32 index_position = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+
+        if (index[index_position] == pixel)
+        {
+            *out++ = (u8)(WIN32_QOI_OP_INDEX | index_position);
+        }
+        else
+        {
+            index[index_position] = pixel;
+
+            const i8 dr = (i8)(r - (u8)(prev_pixel >> 16));
+            const i8 dg = (i8)(g - (u8)(prev_pixel >> 8));
+            const i8 db = (i8)(b - (u8)prev_pixel);
+
+            const i8 dr_dg = (i8)(dr - dg);
+            const i8 db_dg = (i8)(db - dg);
+
+            if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 &&
+                db <= 1)
+            {
+                *out++ = (u8)(WIN32_QOI_OP_DIFF | (dr + 2) << 4 |
+                              (dg + 2) << 2 | (db + 2));
+            }
+            else if (dr_dg >= -8 && dr_dg <= 7 && dg >= -32 && dg <= 31 &&
+                     db_dg >= -8 && db_dg <= 7)
+            {
+                *out++ = (u8)(WIN32_QOI_OP_LUMA | (dg + 32));
+                *out++ = (u8)((dr_dg + 8) << 4 | (db_dg + 8));
+            }
+            else
+            {
+                *out++ = WIN32_QOI_OP_RGB;
+                *out++ = r;
+                *out++ = g;
+                *out++ = b;
+            }
+        }
+
+        prev_pixel = pixel;
+    }
+
+    for (u32 i = 0; i < WIN32_QOI_END_MARKER_SIZE - 1; i++)
+    {
+        *out++ = 0;
+    }
+    *out++ = 1;
+
+    return (u32)(out - encoded_data);
+}
+
+internal DWORD WINAPI win32_capture_thread_proc(LPVOID param)
+{
+    win32_capture_t *capture = (win32_capture_t *)param;
+    ASSERT(capture);
+
+    char file_path[MAX_PATH];
+
+    for (;;)
+    {
+        WaitForSingleObject(capture->submitted_slot_semaphore, INFINITE);
+
+        // NOTE: Stopping releases the semaphore once more, so the capture
+        // thread only exits once every submitted slot was written.
+        const u32 written_slot_count =
+            (u32)(capture->written_frame_count + capture->failed_frame_count);
+        if (capture->should_stop &&
+            written_slot_count == capture->submitted_frame_count)
+        {
+            break;
+        }
+
+        win32_capture_slot_t *slot =
+            &capture->slots[capture->write_slot_index];
+        capture->write_slot_index =
+            (capture->write_slot_index + 1) % WIN32_CAPTURE_POOL_SIZE;
+
+        const u64 encode_start_counter_value = win32_get_perf_counter_value();
+
+        const u32 encoded_size = win32_encode_qoi(
+            slot->pixels, slot->width, slot->height, capture->encoded_data);
+
+        capture->encode_counts +=
+            win32_get_perf_counter_value() - encode_start_counter_value;
+
+        snprintf(file_path, sizeof(file_path),
+                 WIN32_CAPTURE_DIRECTORY "/frame_%06u.qoi", slot->frame_index);
+
+        // The slot can be reused as soon as it is encoded.
+        ReleaseSemaphore(capture->free_slot_semaphore, 1, NULL);
+
+        const HANDLE file_handle =
+            CreateFileA(file_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                        FILE_ATTRIBUTE_NORMAL, NULL);
+
+        DWORD bytes_written = 0;
+        if (file_handle != INVALID_HANDLE_VALUE &&
+            WriteFile(file_handle, capture->encoded_data, encoded_size,
+                      &bytes_written, NULL) &&
+            bytes_written == encoded_size)
+        {
+            capture->written_byte_count += encoded_size;
+            InterlockedIncrement(&capture->written_frame_count);
+        }
+        else
+        {
+            InterlockedIncrement(&capture->failed_frame_count);
+        }
+
+        if (file_handle != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(file_handle);
+        }
+    }
+
+    return 0;
+}
+
+// Allocates the pool and starts the capture thread (once), and starts
+// capturing frames.
+internal void win32_start_capture(win32_capture_t *const restrict capture)
+{
+    ASSERT(capture);
+
+    if (!capture->capture_thread)
+    {
+        for (u32 i = 0; i < WIN32_CAPTURE_POOL_SIZE; i++)
+        {
+            capture->slots[i].pixels = (u32 *)VirtualAlloc(
+                0, sizeof(u32) * WIN32_CAPTURE_MAX_PIXEL_COUNT,
+                MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+            ASSERT(capture->slots[i].pixels);
+        }
+
+        capture->encoded_data = (u8 *)VirtualAlloc(
+            0, WIN32_CAPTURE_MAX_ENCODED_SIZE, MEM_COMMIT | MEM_RESERVE,
+            PAGE_READWRITE);
+        ASSERT(capture->encoded_data);
+
+        CreateDirectoryA(WIN32_CAPTURE_DIRECTORY, NULL);
+
+        capture->free_slot_semaphore = CreateSemaphoreExW(
+            NULL, WIN32_CAPTURE_POOL_SIZE, WIN32_CAPTURE_POOL_SIZE, NULL, 0,
+            SEMAPHORE_ALL_ACCESS);
+        capture->submitted_slot_semaphore =
+            CreateSemaphoreExW(NULL, 0, WIN32_CAPTURE_POOL_SIZE + 1, NULL, 0,
+                               SEMAPHORE_ALL_ACCESS);
+
+        ASSERT(capture->free_slot_semaphore);
+        ASSERT(capture->submitted_slot_semaphore);
+
+        capture->capture_thread =
+            CreateThread(NULL, 0, win32_capture_thread_proc, capture, 0, NULL);
+        ASSERT(capture->capture_thread);
+
+        // Writing frames must not take time away from the game and present
+        // threads.
+        SetThreadPriority(capture->capture_thread,
+                          THREAD_PRIORITY_BELOW_NORMAL);
+    }
+
+    capture->is_capturing = true;
+
+    WIN32_LOG(log_severity_info, win32_log_category_platform,
+              win32_log_format_capture_started,
+              WIN32_CAPTURE_DIRECTORY);
+}
+
+internal void win32_log_capture_stats(const win32_capture_t *const capture)
+{
+    ASSERT(capture);
+
+    const u64 perf_counter_frequency = win32_get_perf_counter_frequency();
+    const u32 written_frame_count = (u32)capture->written_frame_count;
+
+    WIN32_LOG(
+        log_severity_info, win32_log_category_platform,
+        win32_log_format_capture_stats, capture->submitted_frame_count,
+        capture->dropped_frame_count, written_frame_count,
+        (u32)capture->failed_frame_count,
+        (f64)capture->written_byte_count / (f64)MEGABYTE(1),
+        capture->submitted_frame_count
+            ? (f64)win32_get_time_delta_ms(0, capture->copy_counts,
+                                           perf_counter_frequency) /
+                  capture->submitted_frame_count
+            : 0.0,
+        written_frame_count
+            ? (f64)win32_get_time_delta_ms(0, capture->encode_counts,
+                                           perf_counter_frequency) /
+                  written_frame_count
+            : 0.0);
+}
+
+// Frames that were already submitted are still written.
+internal void win32_stop_capture(win32_capture_t *const restrict capture)
+{
+    ASSERT(capture);
+
+    capture->is_capturing = false;
+
+    win32_log_capture_stats(capture);
+}
+
+// Copies the finished frame into a free slot for the capture thread, or drops
+// it if there is none. Does nothing when not capturing.
+internal void
+win32_submit_capture_frame(win32_capture_t *const restrict capture,
+                           const game_offscreen_buffer_t *const restrict buffer,
+                           const u32 frame_index)
+{
+    ASSERT(capture);
+    ASSERT(buffer);
+
+    if (!capture->is_capturing)
+    {
+        return;
+    }
+
+    ASSERT(buffer->width * buffer->height <= WIN32_CAPTURE_MAX_PIXEL_COUNT);
+
+    // NOTE: Never blocks, the game loop must not wait for the disk.
+    if (WaitForSingleObject(capture->free_slot_semaphore, 0) != WAIT_OBJECT_0)
+    {
+        capture->dropped_frame_count++;
+        return;
+    }
+
+    const u64 copy_start_counter_value = win32_get_perf_counter_value();
+
+    win32_capture_slot_t *slot = &capture->slots[capture->submit_slot_index];
+    capture->submit_slot_index =
+        (capture->submit_slot_index + 1) % WIN32_CAPTURE_POOL_SIZE;
+
+    // The framebuffer is tightly packed (its pitch is its width).
+    memcpy(slot->pixels, buffer->framebuffer_memory,
+           sizeof(u32) * buffer->width * buffer->height);
+    slot->width = buffer->width;
+    slot->height = buffer->height;
+    slot->frame_index = frame_index;
+
+    capture->last_copy_counts =
+        win32_get_perf_counter_value() - copy_start_counter_value;
+    capture->copy_counts += capture->last_copy_counts;
+    capture->submitted_frame_count++;
+
+    ReleaseSemaphore(capture->submitted_slot_semaphore, 1, NULL);
+}
+
+// Number of submitted frames that are not written yet.
+internal u32
+win32_get_queued_capture_frame_count(const win32_capture_t *const capture)
+{
+    ASSERT(capture);
+
+    return capture->submitted_frame_count -
+           (u32)(capture->written_frame_count + capture->failed_frame_count);
+}
+
+// Waits for the capture thread to write all submitted frames, and stops it.
+internal void win32_shutdown_capture(win32_capture_t *const restrict capture)
+{
+    ASSERT(capture);
+
+    if (!capture->capture_thread)
+    {
+        return;
+    }
+
+    capture->is_capturing = false;
+
+    InterlockedExchange(&capture->should_stop, 1);
+    ReleaseSemaphore(capture->submitted_slot_semaphore, 1, NULL);
+    WaitForSingleObject(capture->capture_thread, INFINITE);
+
+    win32_log_capture_stats(capture);
+
+    CloseHandle(capture->capture_thread);
+    CloseHandle(capture->free_slot_semaphore);
+    CloseHandle(capture->submitted_slot_semaphore);
+    capture->capture_thread = NULL;
+}
@@ -0,0 +1,343 @@
+// Incremental (dirty page) checkpoints of game memory.
+// Instead of copying the entire game memory for every snapshot, only pages that
+// were written to since the previous checkpoint are copied. Dirty pages are
+// found using write watching (MEM_WRITE_WATCH + GetWriteWatch). If the game
+// memory was not allocated with write watching, dirty pages are found by
+// comparing each page with the shadow copy (no copies, but reads all memory).
+//
+// The shadow copy always holds game memory as of the latest checkpoint. Each
+// checkpoint (except the oldest) stores the previous contents of the pages that
+// changed since the checkpoint before it (i.e an undo log), so rewinding to
+// an older checkpoint only touches pages that actually changed in between.
+
+#define WIN32_MAX_CHECKPOINTS 16
+
+typedef struct
+{
+    u64 id;
+
+    u32 page_count;
+    u32 page_capacity;
+
+    // Index (into game memory) of each saved page, and the contents of that
+    // page at the time of the previous checkpoint.
+    u32 *page_indices;
+    u8 *page_contents;
+} win32_checkpoint_t;
+
+typedef struct
+{
+    u8 *memory;
+    u64 memory_size;
+
+    u64 page_size;
+    u32 page_count;
+
+    b32 uses_write_watch;
+
+    // Contents of game memory at the latest checkpoint.
+    u8 *shadow_memory;
+
+    // Scratch space used to find dirty pages (page_count entries each).
+    void **dirty_page_addresses;
+    u32 *dirty_page_indices;
+
+    // Ring buffer of checkpoints, the oldest checkpoint is at
+    // first_checkpoint_index.
+    win32_checkpoint_t checkpoints[WIN32_MAX_CHECKPOINTS];
+    u32 first_checkpoint_index;
+    u32 checkpoint_count;
+
+    u64 next_checkpoint_id;
+
+    // Stats of the last checkpoint / rewind.
+    u32 last_dirty_page_count;
+    u64 last_copied_bytes;
+} win32_checkpoint_history_t;
+
+internal win32_checkpoint_t *win32_get_checkpoint(
+    win32_checkpoint_history_t *const restrict history, const u32 index)
+{
+    ASSERT(history);
+    ASSERT(index < history->checkpoint_count);
+
+    return &history->checkpoints[(history->first_checkpoint_index + index) %
+                                 WIN32_MAX_CHECKPOINTS];
+}
+
+internal void win32_reserve_checkpoint_pages(
+    win32_checkpoint_history_t *const restrict history,
+    win32_checkpoint_t *const restrict checkpoint, const u32 page_count)
+{
+    ASSERT(history);
+    ASSERT(checkpoint);
+
+    if (checkpoint->page_capacity >= page_count)
+    {
+        return;
+    }
+
+    if (checkpoint->page_indices)
+    {
+        VirtualFree(checkpoint->page_indices, 0, MEM_RELEASE);
+    }
+
+    // Page indices are stored first, followed by the (page aligned) page
+    // contents.
+    const u64 indices_size =
+        (sizeof(u32) * page_count + history->page_size - 1) &
+        ~(history->page_size - 1);
+
+    u8 *storage = (u8 *)VirtualAlloc(
+        0, indices_size + history->page_size * page_count,
+        MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    ASSERT(storage);
+
+    checkpoint->page_indices = (u32 *)storage;
+    checkpoint->page_contents = storage + indices_size;
+    checkpoint->page_capacity = page_count;
+}
+
+// Fills history->dirty_page_indices with the pages written to since the last
+// call (when reset is true) and returns the number of dirty pages.
+internal u32
+win32_find_dirty_pages(win32_checkpoint_history_t *const restrict history,
+                       const b32 reset)
+{
+    ASSERT(history);
+
+    u32 dirty_page_count = 0;
+
+    if (history->uses_write_watch)
+    {
+        ULONG_PTR address_count = history->page_count;
+        ULONG granularity = 0;
+
+        if (GetWriteWatch(reset ? WRITE_WATCH_FLAG_RESET : 0, history->memory,
+                          history->memory_size, history->dirty_page_addresses,
+                          &address_count, &granularity) == 0)
+        {
+            ASSERT(granularity == history->page_size);
+
+            for (ULONG_PTR i = 0; i < address_count; i++)
+            {
+                const u64 offset =
+                    (u8 *)history->dirty_page_addresses[i] - history->memory;
+                history->dirty_page_indices[dirty_page_count++] =
+                    (u32)(offset / history->page_size);
+            }
+
+            return dirty_page_count;
+        }
+
+        // Write watching failed, fall back to comparing with the shadow.
+        history->uses_write_watch = false;
+    }
+
+    for (u32 page_index = 0; page_index < history->page_count; page_index++)
+    {
+        const u64 offset = page_index * history->page_size;
+        if (memcmp(history->memory + offset, history->shadow_memory + offset,
+                   history->page_size) != 0)
+        {
+            history->dirty_page_indices[dirty_page_count++] = page_index;
+        }
+    }
+
+    return dirty_page_count;
+}
+
+internal void win32_init_checkpoint_history(
+    win32_checkpoint_history_t *const restrict history,
+    game_memory_t *const restrict game_memory)
+{
+    ASSERT(history);
+    ASSERT(game_memory);
+    ASSERT(game_memory->permanent_memory_block);
+
+    SYSTEM_INFO system_info = {0};
+    GetSystemInfo(&system_info);
+
+    *history = (win32_checkpoint_history_t){0};
+
+    history->memory = game_memory->permanent_memory_block;
+    history->memory_size = game_memory->permanent_memory_block_size;
+    history->page_size = system_info.dwPageSize;
+    history->page_count = truncate_u64_to_u32(
+        (history->memory_size + history->page_size - 1) / history->page_size);
+
+    // NOTE: The memory size must be a multiple of page size so that the last
+    // page can be copied in full.
+    ASSERT(history->memory_size % history->page_size == 0);
+
+    // GetWriteWatch fails if the memory was not allocated with
+    // MEM_WRITE_WATCH.
+    void *address = NULL;
+    ULONG_PTR address_count = 1;
+    ULONG granularity = 0;
+    history->uses_write_watch =
+        GetWriteWatch(0, history->memory, history->memory_size, &address,
+                      &address_count, &granularity) == 0;
+
+    history->shadow_memory = (u8 *)VirtualAlloc(
+        0, history->memory_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    ASSERT(history->shadow_memory);
+
+    history->dirty_page_addresses = (void **)VirtualAlloc(
+        0, (sizeof(void *) + sizeof(u32)) * history->page_count,
+        MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    ASSERT(history->dirty_page_addresses);
+
+    history->dirty_page_indices =
+        (u32 *)(history->dirty_page_addresses + history->page_count);
+
+    // The oldest checkpoint is the base, which is the only full copy.
+    memcpy(history->shadow_memory, history->memory, history->memory_size);
+
+    if (history->uses_write_watch)
+    {
+        ResetWriteWatch(history->memory, history->memory_size);
+    }
+
+    history->checkpoints[0].id = history->next_checkpoint_id++;
+    history->checkpoint_count = 1;
+}
+
+// Returns the id of the checkpoint, which can later be passed to
+// win32_rewind_to_checkpoint.
+internal u64
+win32_take_checkpoint(win32_checkpoint_history_t *const restrict history)
+{
+    ASSERT(history);
+    ASSERT(history->checkpoint_count > 0);
+
+    // If the ring is full, the oldest checkpoint is dropped, and the next one
+    // becomes the base (whose undo log is no longer required).
+    if (history->checkpoint_count == WIN32_MAX_CHECKPOINTS)
+    {
+        history->first_checkpoint_index =
+            (history->first_checkpoint_index + 1) % WIN32_MAX_CHECKPOINTS;
+        history->checkpoint_count--;
+
+        win32_get_checkpoint(history, 0)->page_count = 0;
+    }
+
+    const u32 dirty_page_count = win32_find_dirty_pages(history, true);
+
+    history->checkpoint_count++;
+    win32_checkpoint_t *checkpoint =
+        win32_get_checkpoint(history, history->checkpoint_count - 1);
+
+    win32_reserve_checkpoint_pages(history, checkpoint, dirty_page_count);
+
+    checkpoint->id = history->next_checkpoint_id++;
+    checkpoint->page_count = dirty_page_count;
+
+    const u64 page_size = history->page_size;
+
+    for (u32 i = 0; i < dirty_page_count; i++)
+    {
+        const u32 page_index = history->dirty_page_indices[i];
+        const u64 offset = page_index * page_size;
+
+        checkpoint->page_indices[i] = page_index;
+
+        memcpy(checkpoint->page_contents + i * page_size,
+               history->shadow_memory + offset, page_size);
+        memcpy(history->shadow_memory + offset, history->memory + offset,
+               page_size);
+    }
+
+    history->last_dirty_page_count = dirty_page_count;
+    history->last_copied_bytes = 2 * dirty_page_count * page_size;
+
+    return checkpoint->id;
+}
+
+// Restores game memory to the state it was in when the checkpoint with
+// checkpoint_id was taken. All newer checkpoints are discarded. Returns false
+// if the checkpoint no longer exists (game memory is left untouched).
+internal b32
+win32_rewind_to_checkpoint(win32_checkpoint_history_t *const restrict history,
+                           const u64 checkpoint_id)
+{
+    ASSERT(history);
+
+    i32 target_index = -1;
+    for (u32 i = 0; i < history->checkpoint_count; i++)
+    {
+        if (win32_get_checkpoint(history, i)->id == checkpoint_id)
+        {
+            target_index = (i32)i;
+            break;
+        }
+    }
+
+    if (target_index < 0)
+    {
+        return false;
+    }
+
+    const u64 page_size = history->page_size;
+    u64 copied_bytes = 0;
+
+    // Undo the writes done since the latest checkpoint.
+    const u32 dirty_page_count = win32_find_dirty_pages(history, true);
+    for (u32 i = 0; i < dirty_page_count; i++)
+    {
+        const u64 offset = history->dirty_page_indices[i] * page_size;
+        memcpy(history->memory + offset, history->shadow_memory + offset,
+               page_size);
+    }
+    copied_bytes += dirty_page_count * page_size;
+
+    // Walk back through the undo logs of all newer checkpoints.
+    while (history->checkpoint_count > (u32)target_index + 1)
+    {
+        win32_checkpoint_t *checkpoint =
+            win32_get_checkpoint(history, history->checkpoint_count - 1);
+
+        for (u32 i = 0; i < checkpoint->page_count; i++)
+        {
+            const u64 offset = checkpoint->page_indices[i] * page_size;
+            const u8 *page_contents = checkpoint->page_contents + i * page_size;
+
+            memcpy(history->memory + offset, page_contents, page_size);
+            memcpy(history->shadow_memory + offset, page_contents, page_size);
+        }
+        copied_bytes += 2 * checkpoint->page_count * page_size;
+
+        checkpoint->page_count = 0;
+        history->checkpoint_count--;
+    }
+
+    // The writes done above must not show up as dirty pages.
+    if (history->uses_write_watch)
+    {
+        ResetWriteWatch(history->memory, history->memory_size);
+    }
+
+    history->last_dirty_page_count = dirty_page_count;
+    history->last_copied_bytes = copied_bytes;
+
+    return true;
+}
+
+// Rewinds by checkpoints_back checkpoints (0 -> latest checkpoint). Rewinds to
+// the oldest checkpoint if there are not enough checkpoints.
+internal void
+win32_rewind_checkpoints(win32_checkpoint_history_t *const restrict history,
+                         const u32 checkpoints_back)
+{
+    ASSERT(history);
+    ASSERT(history->checkpoint_count > 0);
+
+    u32 target_index = 0;
+    if (checkpoints_back < history->checkpoint_count)
+    {
+        target_index = history->checkpoint_count - 1 - checkpoints_back;
+    }
+
+    win32_rewind_to_checkpoint(history,
+                               win32_get_checkpoint(history, target_index)->id);
+}
@@ -0,0 +1,477 @@
+// On screen performance HUD.
+// Draws frame time stats, platform profiler counters and a frame time graph
+// into the frame (after the game rendered it), in the top left corner.
+// Text uses a small built in 5x7 bitmap font, which is baked once into an
+// atlas of per pixel masks at HUD scale. Everything drawn (glyphs, graph
+// bars, the panel background) is pushed as a quad into a single batch, which
+// is then blitted with SSE2, 4 pixels at a time.
+// NOTE: The HUD is drawn at the render resolution, so it gets larger when
+// dynamic resolution lowers the render resolution.
+
+#include <emmintrin.h>
+
+#define WIN32_HUD_FONT_GLYPH_WIDTH 5
+#define WIN32_HUD_FONT_GLYPH_HEIGHT 7
+
+// Glyphs are baked at 2x, into 6x8 cells (with 1 pixel of spacing).
+#define WIN32_HUD_SCALE 2
+#define WIN32_HUD_GLYPH_WIDTH                                                  \
+    ((WIN32_HUD_FONT_GLYPH_WIDTH + 1) * WIN32_HUD_SCALE)
+#define WIN32_HUD_GLYPH_HEIGHT                                                 \
+    ((WIN32_HUD_FONT_GLYPH_HEIGHT + 1) * WIN32_HUD_SCALE)
+
+#define WIN32_HUD_MAX_QUADS 1024
+#define WIN32_HUD_FRAME_HISTORY_COUNT 128
+
+// Quads that are not glyphs use these instead of a glyph index.
+#define WIN32_HUD_SOLID_QUAD 0xfffe
+#define WIN32_HUD_DIM_QUAD 0xffff
+
+typedef struct
+{
+    char character;
+    // Rows from top to bottom, the highest of the 5 bits is the leftmost
+    // pixel.
+    u8 rows[WIN32_HUD_FONT_GLYPH_HEIGHT];
+} win32_hud_font_glyph_t;
+
+// NOTE: Lower case letters are drawn as upper case.
+global_variable const win32_hud_font_glyph_t g_hud_font[] = {
+    {' ', {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}},
+    {'0', {0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e}},
+    {'1', {0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e}},
+    {'2', {0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f}},
+    {'3', {0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e}},
+    {'4', {0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02}},
+    {'5', {0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e}},
+    {'6', {0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e}},
+    {'7', {0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}},
+    {'8', {0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e}},
+    {'9', {0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c}},
+    {'A', {0x0e, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11}},
+    {'B', {0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e}},
+    {'C', {0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e}},
+    {'D', {0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c}},
+    {'E', {0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f}},
+    {'F', {0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10}},
+    {'G', {0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f}},
+    {'H', {0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11}},
+    {'I', {0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e}},
+    {'J', {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c}},
+    {'K', {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11}},
+    {'L', {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f}},
+    {'M', {0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11}},
+    {'N', {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11}},
+    {'O', {0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e}},
+    {'P', {0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10}},
+    {'Q', {0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d}},
+    {'R', {0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11}},
+    {'S', {0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e}},
+    {'T', {0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}},
+    {'U', {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e}},
+    {'V', {0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04}},
+    {'W', {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a}},
+    {'X', {0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11}},
+    {'Y', {0x11, 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04}},
+    {'Z', {0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f}},
+    {'.', {0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c}},
+    {':', {0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00}},
+    {'/', {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00}},
+    {'%', {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03}},
+    {'-', {0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00}},
+    {'(', {0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02}},
+    {')', {0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08}},
+    {'=', {0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00}},
+    {'_', {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f}},
+};
+
+#define WIN32_HUD_GLYPH_COUNT ARRAY_COUNT(g_hud_font)
+
+typedef struct
+{
+    i32 x;
+    i32 y;
+    u16 width;
+    u16 height;
+
+    // Glyph index, WIN32_HUD_SOLID_QUAD or WIN32_HUD_DIM_QUAD.
+    u16 glyph_index;
+    u32 color;
+} win32_hud_quad_t;
+
+// Stats of the last completed frame (in ms unless noted otherwise).
+typedef struct
+{
+    f32 frame_ms;
+    u64 frame_cycles;
+    f32 update_ms;
+    f32 wait_for_buffer_ms;
+    f32 upscale_ms;
+    f32 present_ms;
+    f32 submit_to_present_ms;
+    f32 render_scale;
+
+    u32 queued_audio_sample_count;
+    u32 checkpoint_dirty_page_count;
+
+    b32 is_capturing;
+    u32 captured_frame_count;
+    u32 dropped_capture_frame_count;
+    u32 queued_capture_frame_count;
+    f32 capture_copy_ms;
+
+    win32_latency_percentiles_t input_to_present;
+    // Coarse (tick resolution), on top of input to present.
+    win32_latency_percentiles_t input_queue_wait;
+} win32_hud_frame_stats_t;
+
+typedef struct
+{
+    b32 is_visible;
+
+    // Glyph index of every (ascii) character, characters without a glyph map
+    // to the space glyph.
+    u8 glyph_indices[128];
+
+    // Baked glyphs : one mask (all bits set for set pixels) per pixel.
+    u32 glyph_masks[WIN32_HUD_GLYPH_COUNT][WIN32_HUD_GLYPH_HEIGHT]
+                   [WIN32_HUD_GLYPH_WIDTH];
+
+    win32_hud_quad_t quads[WIN32_HUD_MAX_QUADS];
+    u32 quad_count;
+
+    win32_hud_frame_stats_t stats;
+    f32 frame_ms_history[WIN32_HUD_FRAME_HISTORY_COUNT];
+    u32 next_history_index;
+
+    f32 target_ms_per_frame;
+
+    // Time the HUD itself took to draw last frame.
+    f32 draw_ms;
+} win32_hud_t;
+
+internal void win32_init_hud(win32_hud_t *const restrict hud,
+                             const f32 target_ms_per_frame,
+                             const b32 is_visible)
+{
+    ASSERT(hud);
+
+    hud->is_visible = is_visible;
+    hud->target_ms_per_frame = target_ms_per_frame;
+
+    memset(hud->glyph_indices, 0, sizeof(hud->glyph_indices));
+
+    for (u32 glyph_index = 0; glyph_index < WIN32_HUD_GLYPH_COUNT;
+         glyph_index++)
+    {
+        const win32_hud_font_glyph_t *glyph = &g_hud_font[glyph_index];
+
+        hud->glyph_indices[(u8)glyph->character] = (u8)glyph_index;
+        if (glyph->character >= 'A' && glyph->character <= 'Z')
+        {
+            hud->glyph_indices[glyph->character - 'A' + 'a'] = (u8)glyph_index;
+        }
+
+        for (u32 y = 0; y < WIN32_HUD_GLYPH_HEIGHT; y++)
+        {
+            for (u32 x = 0; x < WIN32_HUD_GLYPH_WIDTH; x++)
+            {
+                const u32 font_x = x / WIN32_HUD_SCALE;
+                const u32 font_y = y / WIN32_HUD_SCALE;
+
+                b32 is_set = false;
+                if (font_x < WIN32_HUD_FONT_GLYPH_WIDTH &&
+                    font_y < WIN32_HUD_FONT_GLYPH_HEIGHT)
+                {
+                    is_set = (glyph->rows[font_y] >>
+                              (WIN32_HUD_FONT_GLYPH_WIDTH - 1 - font_x)) &
+                             0x1;
+                }
+
+                hud->glyph_masks[glyph_index][y][x] = is_set ? 0xffffffff : 0;
+            }
+        }
+    }
+}
+
+// Called once per frame, with the stats of the frame that just completed.
+internal void
+win32_record_hud_frame_stats(win32_hud_t *const restrict hud,
+                             const win32_hud_frame_stats_t *const stats)
+{
+    ASSERT(hud);
+    ASSERT(stats);
+
+    hud->stats = *stats;
+
+    hud->frame_ms_history[hud->next_history_index] = stats->frame_ms;
+    hud->next_history_index =
+        (hud->next_history_index + 1) % WIN32_HUD_FRAME_HISTORY_COUNT;
+}
+
+internal void win32_push_hud_quad(win32_hud_t *const restrict hud, const i32 x,
+                                  const i32 y, const u32 width,
+                                  const u32 height, const u16 glyph_index,
+                                  const u32 color)
+{
+    ASSERT(hud);
+
+    if (hud->quad_count == WIN32_HUD_MAX_QUADS)
+    {
+        return;
+    }
+
+    win32_hud_quad_t *quad = &hud->quads[hud->quad_count++];
+    quad->x = x;
+    quad->y = y;
+    quad->width = (u16)width;
+    quad->height = (u16)height;
+    quad->glyph_index = glyph_index;
+    quad->color = color;
+}
+
+// Pushes a line of text, returns the y of the next line.
+internal i32 win32_push_hud_text(win32_hud_t *const restrict hud, const i32 x,
+                                 const i32 y, const char *const restrict text,
+                                 const u32 color)
+{
+    ASSERT(hud);
+    ASSERT(text);
+
+    i32 glyph_x = x;
+    for (const char *c = text; *c; c++)
+    {
+        const u8 glyph_index = hud->glyph_indices[(u8)*c & 0x7f];
+
+        // Spaces are not drawn.
+        if (glyph_index != 0)
+        {
+            win32_push_hud_quad(hud, glyph_x, y, WIN32_HUD_GLYPH_WIDTH,
+                                WIN32_HUD_GLYPH_HEIGHT, glyph_index, color);
+        }
+
+        glyph_x += WIN32_HUD_GLYPH_WIDTH;
+    }
+
+    return y + WIN32_HUD_GLYPH_HEIGHT + WIN32_HUD_SCALE;
+}
+
+// Blits all quads of the batch (in the order they were pushed).
+internal void
+win32_blit_hud_quads(win32_hud_t *const restrict hud,
+                     game_offscreen_buffer_t *const restrict buffer)
+{
+    ASSERT(hud);
+    ASSERT(buffer);
+
+    const __m128i dim_mask = _mm_set1_epi32(0x7f7f7f7f);
+
+    for (u32 quad_index = 0; quad_index < hud->quad_count; quad_index++)
+    {
+        const win32_hud_quad_t *quad = &hud->quads[quad_index];
+
+        // Clip against the buffer.
+        const i32 min_x = quad->x < 0 ? 0 : quad->x;
+        const i32 min_y = quad->y < 0 ? 0 : quad->y;
+        i32 max_x = quad->x + quad->width;
+        i32 max_y = quad->y + quad->height;
+
+        if (max_x > (i32)buffer->width)
+        {
+            max_x = (i32)buffer->width;
+        }
+
+        if (max_y > (i32)buffer->height)
+        {
+            max_y = (i32)buffer->height;
+        }
+
+        if (min_x >= max_x || min_y >= max_y)
+        {
+            continue;
+        }
+
+        const __m128i color = _mm_set1_epi32((i32)quad->color);
+
+        for (i32 y = min_y; y < max_y; y++)
+        {
+            u32 *row = buffer->framebuffer_memory + (u64)y * buffer->width;
+
+            const u32 *masks =
+                quad->glyph_index < WIN32_HUD_GLYPH_COUNT
+                    ? &hud->glyph_masks[quad->glyph_index][y - quad->y]
+                                       [min_x - quad->x]
+                    : NULL;
+
+            i32 x = min_x;
+
+            for (; x + 4 <= max_x; x += 4)
+            {
+                __m128i *pixels = (__m128i *)&row[x];
+                const __m128i destination = _mm_loadu_si128(pixels);
+
+                __m128i result;
+                if (quad->glyph_index == WIN32_HUD_DIM_QUAD)
+                {
+                    // Halve the brightness.
+                    result = _mm_and_si128(_mm_srli_epi32(destination, 1),
+                                           dim_mask);
+                }
+                else if (quad->glyph_index == WIN32_HUD_SOLID_QUAD)
+                {
+                    result = color;
+                }
+                else
+                {
+                    // color where the glyph is set, destination elsewhere.
+                    const __m128i mask =
+                        _mm_loadu_si128((const __m128i *)&masks[x - min_x]);
+                    result = _mm_or_si128(_mm_and_si128(mask, color),
+                                          _mm_andnot_si128(mask, destination));
+                }
+
+                _mm_storeu_si128(pixels, result);
+            }
+
+            // Remaining (< 4) pixels.
+            for (; x < max_x; x++)
+            {
+                if (quad->glyph_index == WIN32_HUD_DIM_QUAD)
+                {
+                    row[x] = (row[x] >> 1) & 0x7f7f7f7f;
+                }
+                else if (quad->glyph_index == WIN32_HUD_SOLID_QUAD ||
+                         masks[x - min_x])
+                {
+                    row[x] = quad->color;
+                }
+            }
+        }
+    }
+
+    hud->quad_count = 0;
+}
+
+internal void win32_draw_hud(win32_hud_t *const restrict hud,
+                             game_offscreen_buffer_t *const restrict buffer)
+{
+    ASSERT(hud);
+    ASSERT(buffer);
+
+    if (!hud->is_visible)
+    {
+        return;
+    }
+
+    const u64 start_counter_value = win32_get_perf_counter_value();
+
+    const win32_hud_frame_stats_t *stats = &hud->stats;
+
+    const i32 margin = 4 * WIN32_HUD_SCALE;
+    const i32 line_count = 6;
+    const i32 graph_height = 32 * WIN32_HUD_SCALE;
+    const i32 bar_width = WIN32_HUD_SCALE;
+
+    const i32 panel_width = 2 * margin + 56 * WIN32_HUD_GLYPH_WIDTH;
+    const i32 panel_height = 3 * margin + graph_height +
+                             line_count * (WIN32_HUD_GLYPH_HEIGHT +
+                                           WIN32_HUD_SCALE);
+
+    win32_push_hud_quad(hud, 0, 0, panel_width, panel_height,
+                        WIN32_HUD_DIM_QUAD, 0);
+
+    // Text.
+    const u32 text_color = 0xffffffff;
+    char text[128];
+
+    i32 y = margin;
+
+    snprintf(text, sizeof(text), "FRAME %6.2f MS  FPS %4d  CYCLES %llu",
+             stats->frame_ms,
+             stats->frame_ms > 0.0f ? (i32)(1000.0f / stats->frame_ms) : 0,
+             (unsigned long long)stats->frame_cycles);
+    y = win32_push_hud_text(hud, margin, y, text, text_color);
+
+    snprintf(text, sizeof(text),
+             "UPDATE %5.2f  WAIT %5.2f  UPSCALE %5.2f  PRESENT %5.2f",
+             stats->update_ms, stats->wait_for_buffer_ms, stats->upscale_ms,
+             stats->present_ms);
+    y = win32_push_hud_text(hud, margin, y, text, text_color);
+
+    snprintf(text, sizeof(text),
+             "LATENCY %5.2f MS  SCALE %4.2f  AUDIO %5u  DIRTY %5u",
+             stats->submit_to_present_ms, stats->render_scale,
+             stats->queued_audio_sample_count,
+             stats->checkpoint_dirty_page_count);
+    y = win32_push_hud_text(hud, margin, y, text, text_color);
+
+    snprintf(text, sizeof(text), "HUD %5.3f MS  (F1 TOGGLES)", hud->draw_ms);
+    y = win32_push_hud_text(hud, margin, y, text, text_color);
+
+    snprintf(text, sizeof(text),
+             "INPUT TO PRESENT %5.2f / %5.2f / %5.2f MS (P50/90/99)",
+             stats->input_to_present.p50_ms, stats->input_to_present.p90_ms,
+             stats->input_to_present.p99_ms);
+    y = win32_push_hud_text(hud, margin, y, text, text_color);
+
+    snprintf(text, sizeof(text),
+             "INPUT QUEUE WAIT %5.1f / %5.1f / %5.1f MS (TICKS)",
+             stats->input_queue_wait.p50_ms, stats->input_queue_wait.p90_ms,
+             stats->input_queue_wait.p99_ms);
+    y = win32_push_hud_text(hud, margin, y, text, text_color);
+
+    if (stats->is_capturing)
+    {
+        snprintf(text, sizeof(text),
+                 "CAPTURE %6u  DROPPED %5u  QUEUED %u  COPY %5.2f MS",
+                 stats->captured_frame_count,
+                 stats->dropped_capture_frame_count,
+                 stats->queued_capture_frame_count, stats->capture_copy_ms);
+    }
+    else
+    {
+        snprintf(text, sizeof(text), "CAPTURE OFF  (F2 TOGGLES)");
+    }
+    y = win32_push_hud_text(hud, margin, y, text, text_color);
+
+    // Frame time graph (oldest frame on the left), scaled so that twice the
+    // target frame time fills the graph.
+    const i32 graph_bottom = y + margin + graph_height;
+    const f32 pixels_per_ms =
+        (f32)graph_height / (2.0f * hud->target_ms_per_frame);
+
+    for (u32 i = 0; i < WIN32_HUD_FRAME_HISTORY_COUNT; i++)
+    {
+        const f32 frame_ms =
+            hud->frame_ms_history[(hud->next_history_index + i) %
+                                  WIN32_HUD_FRAME_HISTORY_COUNT];
+
+        i32 bar_height = (i32)(frame_ms * pixels_per_ms);
+        if (bar_height > graph_height)
+        {
+            bar_height = graph_height;
+        }
+
+        if (bar_height > 0)
+        {
+            const u32 bar_color = frame_ms > hud->target_ms_per_frame
+                                      ? 0xffff4040
+                                      : 0xff40ff40;
+
+            win32_push_hud_quad(hud, margin + (i32)i * bar_width,
+                                graph_bottom - bar_height, bar_width,
+                                bar_height, WIN32_HUD_SOLID_QUAD, bar_color);
+        }
+    }
+
+    // Target frame time.
+    win32_push_hud_quad(hud, margin, graph_bottom - graph_height / 2,
+                        WIN32_HUD_FRAME_HISTORY_COUNT * bar_width, 1,
+                        WIN32_HUD_SOLID_QUAD, 0xffffff40);
+
+    win32_blit_hud_quads(hud, buffer);
+
+    hud->draw_ms = win32_get_time_delta_ms(start_counter_value,
+                                           win32_get_perf_counter_value(),
+                                           win32_get_perf_counter_frequency());
+}
@@ -0,0 +1,154 @@
+// Input latency.
+// Every key transition is timestamped (with the perf counter) when its message
+// is taken off the message queue, and its latency is measured twice : until the
+// game gets the input (input to update), and until the frame that used it was
+// presented (input to present). Latencies go into fixed size histograms,
+// percentiles are read from the buckets.
+// The time a message waited in the queue before that (up to a frame, as
+// messages are pumped once per frame) is measured separately, from the message
+// time. Messages only carry a tick count (10 to 16 ms resolution), so the wait
+// is coarse, and is not added to the precise latencies : those are a lower
+// bound, the queue wait tells how much to add to them.
+// NOTE: Present is when the present thread is done blitting the frame to the
+// window, which is before the frame is actually scanned out.
+
+// The perf counter has sub microsecond resolution, so buckets are sized for
+// input to update latencies (tens of microseconds), and the range covers
+// several frames of input to present latency.
+#define WIN32_LATENCY_BUCKET_MS 0.025f
+#define WIN32_LATENCY_BUCKET_COUNT 4096u
+
+typedef struct
+{
+    // The last bucket also counts latencies past the range of the histogram.
+    u32 bucket_counts[WIN32_LATENCY_BUCKET_COUNT];
+    u32 sample_count;
+    f32 max_ms;
+} win32_latency_histogram_t;
+
+typedef struct
+{
+    f32 p50_ms;
+    f32 p90_ms;
+    f32 p99_ms;
+} win32_latency_percentiles_t;
+
+internal void
+win32_record_latency(win32_latency_histogram_t *const restrict histogram,
+                     const f32 latency_ms)
+{
+    ASSERT(histogram);
+
+    u32 bucket_index = latency_ms > 0.0f
+                           ? (u32)(latency_ms / WIN32_LATENCY_BUCKET_MS)
+                           : 0;
+    if (bucket_index >= WIN32_LATENCY_BUCKET_COUNT)
+    {
+        bucket_index = WIN32_LATENCY_BUCKET_COUNT - 1;
+    }
+
+    histogram->bucket_counts[bucket_index]++;
+    histogram->sample_count++;
+
+    if (latency_ms > histogram->max_ms)
+    {
+        histogram->max_ms = latency_ms;
+    }
+}
+
+// Percentiles are the upper bound of the bucket they fall in.
+// NOTE: May be called while another thread records, the result is then off
+// by the samples recorded meanwhile.
+internal win32_latency_percentiles_t
+win32_get_latency_percentiles(const win32_latency_histogram_t *const histogram)
+{
+    ASSERT(histogram);
+
+    win32_latency_percentiles_t percentiles = {0};
+
+    const u32 sample_count = histogram->sample_count;
+    if (!sample_count)
+    {
+        return percentiles;
+    }
+
+    // Rank (1 based) of the sample of every percentile.
+    const u32 p50_rank = (sample_count * 50 + 99) / 100;
+    const u32 p90_rank = (sample_count * 90 + 99) / 100;
+    const u32 p99_rank = (sample_count * 99 + 99) / 100;
+
+    u32 count = 0;
+    for (u32 i = 0; i < WIN32_LATENCY_BUCKET_COUNT; i++)
+    {
+        const u32 next_count = count + histogram->bucket_counts[i];
+        const f32 bucket_end_ms = (f32)(i + 1) * WIN32_LATENCY_BUCKET_MS;
+
+        if (count < p50_rank && next_count >= p50_rank)
+        {
+            percentiles.p50_ms = bucket_end_ms;
+        }
+        if (count < p90_rank && next_count >= p90_rank)
+        {
+            percentiles.p90_ms = bucket_end_ms;
+        }
+        if (count < p99_rank && next_count >= p99_rank)
+        {
+            percentiles.p99_ms = bucket_end_ms;
+            break;
+        }
+
+        count = next_count;
+    }
+
+    return percentiles;
+}
+
+// Records how long a key transition waited in the message queue, from the
+// message time to now (both in ticks). Key repeats are not transitions.
+internal void win32_record_message_queue_wait(
+    win32_latency_histogram_t *const restrict histogram,
+    const MSG *const restrict message)
+{
+    ASSERT(histogram);
+    ASSERT(message);
+
+    const b32 was_key_down = (message->lParam >> 30) & 0x1;
+    const b32 is_key_down = message->message == WM_KEYDOWN ||
+                            message->message == WM_SYSKEYDOWN;
+
+    if (was_key_down == is_key_down)
+    {
+        return;
+    }
+
+    // NOTE: Unsigned difference, so the tick count wrapping around is fine.
+    const DWORD wait_ms = GetTickCount() - message->time;
+
+    win32_record_latency(histogram, (f32)wait_ms);
+}
+
+// Appends a key transition to the input's events. Key repeats are not
+// transitions.
+internal void win32_push_input_event(game_input_t *const restrict input,
+                                     const game_key_t key,
+                                     const MSG *const restrict message,
+                                     const u64 timestamp)
+{
+    ASSERT(input);
+    ASSERT(message);
+
+    const b32 was_key_down = (message->lParam >> 30) & 0x1;
+    const b32 is_key_down = message->message == WM_KEYDOWN ||
+                            message->message == WM_SYSKEYDOWN;
+
+    if (was_key_down == is_key_down ||
+        input->event_count >= GAME_MAX_INPUT_EVENTS)
+    {
+        return;
+    }
+
+    game_input_event_t *event = &input->events[input->event_count++];
+    event->timestamp = timestamp;
+    event->key = key;
+    event->is_key_down = is_key_down;
+}
@@ -0,0 +1,347 @@
+// Platform logging (see log.h).
+// Every thread that logs gets its own ring the first time it logs. A
+// background log thread periodically drains all rings (merging them in
+// timestamp order), formats the records and writes them to the log file (and
+// the debugger output).
+// Messages below the minimum severity, or in a disabled category, are filtered
+// out by WIN32_LOG before its arguments are even evaluated.
+
+#define WIN32_LOG_MAX_THREADS 32
+#define WIN32_LOG_FILE_PATH "prism_log.txt"
+
+// The log thread wakes up at least this often (errors wake it right away).
+#define WIN32_LOG_FLUSH_INTERVAL_MS 100
+
+typedef enum
+{
+    win32_log_category_frame = 0,
+    win32_log_category_checkpoint = 1,
+    win32_log_category_audio = 2,
+    win32_log_category_platform = 3,
+    win32_log_category_input = 4,
+    win32_log_category_count = 5,
+} win32_log_category_t;
+
+global_variable const char *g_log_category_names[win32_log_category_count] = {
+    [win32_log_category_frame] = "frame",
+    [win32_log_category_checkpoint] = "checkpoint",
+    [win32_log_category_audio] = "audio",
+    [win32_log_category_platform] = "platform",
+    [win32_log_category_input] = "input",
+};
+
+global_variable const char *g_log_severity_names[log_severity_count] = {
+    [log_severity_debug] = "debug",
+    [log_severity_info] = "info",
+    [log_severity_warning] = "warning",
+    [log_severity_error] = "error",
+};
+
+typedef enum
+{
+    win32_log_format_frame_stats = 0,
+    win32_log_format_checkpoint = 1,
+    win32_log_format_audio_device_failed = 2,
+    win32_log_format_window_creation_failed = 3,
+    win32_log_format_game_dll_reloaded = 4,
+    win32_log_format_game_memory = 5,
+    win32_log_format_capture_started = 6,
+    win32_log_format_capture_stats = 7,
+    win32_log_format_input_latency = 8,
+    win32_log_format_input_queue_wait = 9,
+    win32_log_format_count = 10,
+} win32_log_format_id_t;
+
+// NOTE: Parsed by win32_init_log.
+global_variable log_format_t g_log_formats[win32_log_format_count] = {
+    [win32_log_format_frame_stats] =
+        {"MS for frame : %f ms, FPS : %d, Clocks per frame : %llu, Update : %f "
+         "ms, Wait for buffer : %f ms, Upscale : %f ms, Present : %f ms, "
+         "Submit to present : %f ms, Render scale : %f"},
+    [win32_log_format_checkpoint] = {"Checkpoint : %u dirty pages, %f ms"},
+    [win32_log_format_audio_device_failed] = {
+        "Audio : Failed to open audio device, audio is mixed but not played."},
+    [win32_log_format_window_creation_failed] = {
+        "Failed to create the window (error %u)."},
+    [win32_log_format_game_dll_reloaded] = {"Reloaded the game dll."},
+    [win32_log_format_game_memory] = {
+        "Game memory at 0x%llx (fixed base : %u), %u KB pages, allocated in "
+        "%f ms, %f ns per page access."},
+    [win32_log_format_capture_started] = {
+        "Capture : Writing frames to %s."},
+    [win32_log_format_capture_stats] = {
+        "Capture : %u frames captured, %u dropped (pool full), %u written, %u "
+        "failed to write, %f MB, %f ms copy and %f ms encode per frame."},
+    [win32_log_format_input_latency] = {
+        "Input latency : %u key transitions. Input to update : p50 %f, p90 "
+        "%f, p99 %f, max %f ms. Input to present : p50 %f, p90 %f, p99 %f, "
+        "max %f ms."},
+    [win32_log_format_input_queue_wait] = {
+        "Input queue wait (from message time, tick resolution) : p50 %f, p90 "
+        "%f, p99 %f, max %f ms, on top of the input latency."},
+};
+
+typedef struct
+{
+    // Rings are handed out to threads in order.
+    log_ring_t *rings;
+    volatile LONG ring_count;
+
+    // Filtering.
+    u32 min_severity;
+    u32 category_mask;
+
+    HANDLE file_handle;
+    HANDLE log_thread;
+    HANDLE wake_event;
+    volatile LONG should_stop;
+
+    u64 perf_counter_frequency;
+    u64 start_counter_value;
+
+    // Records already reported as dropped, per ring.
+    u32 reported_dropped_counts[WIN32_LOG_MAX_THREADS];
+
+    // Only used by the log thread.
+    char text[64 * 1024];
+} win32_log_t;
+
+global_variable win32_log_t g_log = {0};
+
+// The ring of the calling thread (NULL until the thread first logs).
+global_variable __declspec(thread) log_ring_t *g_thread_log_ring = NULL;
+
+#define WIN32_LOG(severity, category, ...)                                     \
+    do                                                                         \
+    {                                                                          \
+        if (win32_is_log_enabled(&g_log, severity, category))                  \
+        {                                                                      \
+            win32_log_write(&g_log, severity, category, __VA_ARGS__);          \
+        }                                                                      \
+    } while (0)
+
+internal b32 win32_is_log_enabled(const win32_log_t *const restrict log,
+                                  const log_severity_t severity,
+                                  const win32_log_category_t category)
+{
+    return severity >= log->min_severity &&
+           (log->category_mask & (1u << category));
+}
+
+// NOTE: Use WIN32_LOG instead, so that filtered messages cost nothing.
+internal void win32_log_write(win32_log_t *const restrict log,
+                              const log_severity_t severity,
+                              const win32_log_category_t category,
+                              const win32_log_format_id_t format_id, ...)
+{
+    ASSERT(log);
+    ASSERT(format_id < win32_log_format_count);
+
+    if (!g_thread_log_ring)
+    {
+        const LONG ring_index = InterlockedIncrement(&log->ring_count) - 1;
+
+        // NOTE: If this fires, WIN32_LOG_MAX_THREADS is too small.
+        ASSERT(ring_index < WIN32_LOG_MAX_THREADS);
+        if (ring_index >= WIN32_LOG_MAX_THREADS)
+        {
+            return;
+        }
+
+        g_thread_log_ring = &log->rings[ring_index];
+    }
+
+    LARGE_INTEGER counter_value = {0};
+    QueryPerformanceCounter(&counter_value);
+
+    va_list args;
+    va_start(args, format_id);
+    log_write_record(g_thread_log_ring, &g_log_formats[format_id],
+                     (u16)format_id, (u8)severity, (u8)category,
+                     (u64)counter_value.QuadPart, args);
+    va_end(args);
+
+    if (severity >= log_severity_error)
+    {
+        SetEvent(log->wake_event);
+    }
+}
+
+// Formats and writes all records that are in the rings. Rings are merged, so
+// that records are written in timestamp order.
+// NOTE: Only called on the log thread.
+internal void win32_flush_log(win32_log_t *const restrict log)
+{
+    ASSERT(log);
+
+    u32 ring_count = (u32)log->ring_count;
+    if (ring_count > WIN32_LOG_MAX_THREADS)
+    {
+        ring_count = WIN32_LOG_MAX_THREADS;
+    }
+
+    u32 text_length = 0;
+
+    for (;;)
+    {
+        // Oldest record across all rings.
+        const log_record_t *record = NULL;
+        u32 record_ring_index = 0;
+
+        for (u32 i = 0; i < ring_count; i++)
+        {
+            const log_record_t *ring_record = log_peek_record(&log->rings[i]);
+
+            if (ring_record &&
+                (!record || ring_record->timestamp < record->timestamp))
+            {
+                record = ring_record;
+                record_ring_index = i;
+            }
+        }
+
+        // Write out the text once it is (almost) full, or there is nothing
+        // left to format.
+        if (text_length && (!record || text_length + 1024 > sizeof(log->text)))
+        {
+            DWORD bytes_written = 0;
+            WriteFile(log->file_handle, log->text, text_length, &bytes_written,
+                      NULL);
+            OutputDebugStringA(log->text);
+
+            text_length = 0;
+        }
+
+        if (!record)
+        {
+            break;
+        }
+
+        const f64 time_ms =
+            1000.0 * (f64)(record->timestamp - log->start_counter_value) /
+            (f64)log->perf_counter_frequency;
+
+        text_length += (u32)snprintf(
+            log->text + text_length, sizeof(log->text) - text_length,
+            "[%10.3f ms] [thread %2u] [%s] [%s] ", time_ms, record_ring_index,
+            g_log_severity_names[record->severity],
+            g_log_category_names[record->category]);
+
+        text_length += log_format_record(
+            log->text + text_length, (u32)sizeof(log->text) - text_length - 1,
+            &g_log_formats[record->format_id], record);
+        log->text[text_length++] = '\n';
+        log->text[text_length] = 0;
+
+        log_release_record(&log->rings[record_ring_index]);
+    }
+
+    // Report records that were dropped since the last flush.
+    for (u32 i = 0; i < ring_count; i++)
+    {
+        const u32 dropped_count = log->rings[i].dropped_count;
+
+        if (dropped_count != log->reported_dropped_counts[i])
+        {
+            const int length = snprintf(
+                log->text, sizeof(log->text),
+                "[thread %2u] Log : %u records dropped (ring full).\n", i,
+                dropped_count - log->reported_dropped_counts[i]);
+
+            DWORD bytes_written = 0;
+            WriteFile(log->file_handle, log->text, (DWORD)length,
+                      &bytes_written, NULL);
+
+            log->reported_dropped_counts[i] = dropped_count;
+        }
+    }
+}
+
+internal DWORD WINAPI win32_log_thread_proc(LPVOID param)
+{
+    win32_log_t *log = (win32_log_t *)param;
+    ASSERT(log);
+
+    while (!log->should_stop)
+    {
+        WaitForSingleObject(log->wake_event, WIN32_LOG_FLUSH_INTERVAL_MS);
+        win32_flush_log(log);
+    }
+
+    return 0;
+}
+
+// category_mask has one bit per win32_log_category_t.
+internal void win32_init_log(win32_log_t *const restrict log,
+                             const log_severity_t min_severity,
+                             const u32 category_mask)
+{
+    ASSERT(log);
+
+    for (u32 i = 0; i < win32_log_format_count; i++)
+    {
+        // NOTE: If this fires, the format uses an unsupported conversion.
+        const b32 is_format_valid = log_parse_format(&g_log_formats[i]);
+        ASSERT(is_format_valid);
+    }
+
+    // NOTE: All rings are committed up front (so every ring counts against the
+    // commit limit), but committed pages only get physical memory once they
+    // are first written, which is when a thread first logs.
+    log->rings = (log_ring_t *)VirtualAlloc(
+        0, sizeof(log_ring_t) * WIN32_LOG_MAX_THREADS,
+        MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    ASSERT(log->rings);
+
+    log->file_handle =
+        CreateFileA(WIN32_LOG_FILE_PATH, GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                    CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (log->file_handle == INVALID_HANDLE_VALUE)
+    {
+        OutputDebugStringA("Log : Failed to create " WIN32_LOG_FILE_PATH
+                           ", logging is disabled.\n");
+        return;
+    }
+
+    log->perf_counter_frequency = win32_get_perf_counter_frequency();
+    log->start_counter_value = win32_get_perf_counter_value();
+
+    log->wake_event = CreateEventW(NULL, FALSE, FALSE, NULL);
+    ASSERT(log->wake_event);
+
+    log->log_thread =
+        CreateThread(NULL, 0, win32_log_thread_proc, log, 0, NULL);
+    ASSERT(log->log_thread);
+
+    SetThreadPriority(log->log_thread, THREAD_PRIORITY_BELOW_NORMAL);
+
+    // Filtering is only enabled once everything is set up, until then nothing
+    // is logged.
+    log->min_severity = min_severity;
+    log->category_mask = category_mask;
+}
+
+// Writes out everything that was logged so far, and stops the log thread.
+internal void win32_shutdown_log(win32_log_t *const restrict log)
+{
+    ASSERT(log);
+
+    if (!log->log_thread)
+    {
+        return;
+    }
+
+    // Nothing is logged from here on.
+    log->category_mask = 0;
+
+    InterlockedExchange(&log->should_stop, 1);
+    SetEvent(log->wake_event);
+    WaitForSingleObject(log->log_thread, INFINITE);
+
+    // Records written after the log thread's last flush.
+    win32_flush_log(log);
+
+    CloseHandle(log->log_thread);
+    CloseHandle(log->file_handle);
+    log->log_thread = NULL;
+}
@@ -4,12 +4,18 @@
 
 #include "common.h"
 #include "game.h"
+#include "hash.h"
+#include "log.h"
 
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
+#include <shellapi.h>
 #include <timeapi.h>
+#include <mmsystem.h>
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define WINDOW_WIDTH 1920
 #define WINDOW_HEIGHT 1080
@@ -27,8 +33,6 @@ typedef struct
     u32 height;
 } win32_offscreen_buffer_t;
 
-global_variable win32_offscreen_buffer_t g_backbuffer = {0};
-
 typedef struct
 {
     u32 width;
@@ -98,6 +102,46 @@ internal void win32_resize_framebuffer(
     buffer->height = height;
 }
 
+internal u64 win32_get_perf_counter_frequency()
+{
+    LARGE_INTEGER frequency = {0};
+    QueryPerformanceFrequency(&frequency);
+
+    return (u64)frequency.QuadPart;
+}
+
+internal u64 win32_get_perf_counter_value()
+{
+    LARGE_INTEGER counter_value = {0};
+    QueryPerformanceCounter(&counter_value);
+
+    return (u64)counter_value.QuadPart;
+}
+
+internal f32 win32_get_time_delta_ms(u64 start, u64 end, u64 counts_per_second)
+{
+    f32 result = 1000.0f * (f32)(end - start) / (f32)counts_per_second;
+    return result;
+}
+
+#include "win32_log.c"
+#include "win32_upscale.c"
+#include "win32_latency.c"
+#include "win32_swap_chain.c"
+#include "win32_work_queue.c"
+#include "win32_audio.c"
+#include "win32_hud.c"
+#include "win32_capture.c"
+
+global_variable win32_swap_chain_t g_swap_chain = {0};
+global_variable platform_work_queue_t g_work_queue = {0};
+// Jobs that only do file I/O (saves, memory stats dumps), so that waiting for
+// g_work_queue does not wait for the disk.
+global_variable platform_work_queue_t g_io_work_queue = {0};
+global_variable win32_audio_t g_audio = {0};
+global_variable win32_hud_t g_hud = {0};
+global_variable win32_capture_t g_capture = {0};
+
 internal void win32_handle_key_input(game_key_state_t *const restrict input,
                                      b32 is_key_down)
 {
@@ -135,10 +179,17 @@ internal LRESULT CALLBACK win32_window_proc(HWND window, UINT message,
             win32_get_window_client_dimensions(window);
 
         // NOTE: In WM_PAINT, the backbuffer is NOT being rendered to, but the
-        // window is being rendered to directly.
-        win32_render_buffer_to_window(&g_backbuffer, device_context,
-                                      window_dimensions.width,
-                                      window_dimensions.height);
+        // window is being rendered to directly. The most recently presented
+        // buffer is used (the swap chain keeps it out of the buffers the game
+        // renders into until the next present).
+        if (g_swap_chain.buffer_count)
+        {
+            win32_render_buffer_to_window(
+                &g_swap_chain
+                     .buffers[g_swap_chain.last_presented_buffer_index],
+                device_context, window_dimensions.width,
+                window_dimensions.height);
+        }
 
         EndPaint(window, &paint);
 
@@ -167,7 +218,10 @@ internal LRESULT CALLBACK win32_window_proc(HWND window, UINT message,
     return result;
 }
 
-internal DEF_PLATFORM_READ_FILE_FUNC(platform_read_file)
+// NOTE: One extra (zeroed) byte is allocated past the end of the file
+// contents, so text files can be parsed as null terminated strings.
+internal u8 *win32_read_entire_file(const char *file_name,
+                                    u64 *const restrict out_file_size)
 {
     ASSERT(file_name);
 
@@ -185,7 +239,7 @@ internal DEF_PLATFORM_READ_FILE_FUNC(platform_read_file)
             // Allocate memory for the buffer that will contain the file
             // contents.
             file_buffer =
-                (u8 *)VirtualAlloc(0, file_size.QuadPart,
+                (u8 *)VirtualAlloc(0, file_size.QuadPart + 1,
                                    MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
             ASSERT(file_buffer);
 
@@ -196,10 +250,16 @@ internal DEF_PLATFORM_READ_FILE_FUNC(platform_read_file)
                          &number_of_bytes_read, NULL))
             {
                 ASSERT(number_of_bytes_read == file_size.QuadPart);
+
+                if (out_file_size)
+                {
+                    *out_file_size = (u64)file_size.QuadPart;
+                }
             }
             else
             {
                 VirtualFree(file_buffer, 0, MEM_RELEASE);
+                file_buffer = NULL;
             }
         }
         CloseHandle(file_handle);
@@ -208,6 +268,11 @@ internal DEF_PLATFORM_READ_FILE_FUNC(platform_read_file)
     return file_buffer;
 }
 
+internal DEF_PLATFORM_READ_FILE_FUNC(platform_read_file)
+{
+    return win32_read_entire_file(file_name, out_file_size);
+}
+
 internal DEF_PLATFORM_CLOSE_FILE_FUNC(platform_close_file)
 {
     VirtualFree(file_buffer, 0, MEM_RELEASE);
@@ -245,31 +310,79 @@ internal DEF_PLATFORM_WRITE_TO_FILE_FUNC(platform_write_to_file)
     return result;
 }
 
-internal u64 win32_get_perf_counter_frequency()
+internal b32 win32_write_file_data(const HANDLE file_handle,
+                                   const void *const restrict data,
+                                   const u64 data_size)
 {
-    LARGE_INTEGER frequency = {0};
-    QueryPerformanceFrequency(&frequency);
+    DWORD number_of_bytes_written = 0;
 
-    return (u64)frequency.QuadPart;
+    return WriteFile(file_handle, data, truncate_u64_to_u32(data_size),
+                     &number_of_bytes_written, NULL) &&
+           number_of_bytes_written == data_size;
 }
 
-internal u64 win32_get_perf_counter_value()
+internal DEF_PLATFORM_WRITE_FILE_AT_OFFSET_FUNC(platform_write_file_at_offset)
 {
-    LARGE_INTEGER counter_value = {0};
-    QueryPerformanceCounter(&counter_value);
+    ASSERT(file_name);
+    ASSERT(data);
 
-    return (u64)counter_value.QuadPart;
+    b32 result = false;
+
+    if (offset == 0)
+    {
+        // The new file is written next to the old one, and then replaces it.
+        char temp_file_name[MAX_PATH];
+        snprintf(temp_file_name, sizeof(temp_file_name), "%s.tmp", file_name);
+
+        HANDLE file_handle =
+            CreateFileA(temp_file_name, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                        FILE_ATTRIBUTE_NORMAL, NULL);
+
+        if (file_handle != INVALID_HANDLE_VALUE)
+        {
+            result = win32_write_file_data(file_handle, data, data_size) &&
+                     FlushFileBuffers(file_handle);
+            CloseHandle(file_handle);
+
+            result = result &&
+                     MoveFileExA(temp_file_name, file_name,
+                                 MOVEFILE_REPLACE_EXISTING |
+                                     MOVEFILE_WRITE_THROUGH);
+        }
+    }
+    else
+    {
+        HANDLE file_handle =
+            CreateFileA(file_name, GENERIC_WRITE, 0, NULL, OPEN_EXISTING,
+                        FILE_ATTRIBUTE_NORMAL, NULL);
+
+        if (file_handle != INVALID_HANDLE_VALUE)
+        {
+            LARGE_INTEGER file_offset = {0};
+            file_offset.QuadPart = (LONGLONG)offset;
+
+            result =
+                SetFilePointerEx(file_handle, file_offset, NULL, FILE_BEGIN) &&
+                win32_write_file_data(file_handle, data, data_size) &&
+                SetEndOfFile(file_handle);
+            CloseHandle(file_handle);
+        }
+    }
+
+    return result;
 }
 
-internal f32 win32_get_time_delta_ms(u64 start, u64 end, u64 counts_per_second)
+internal DEF_PLATFORM_DEBUG_PRINT_FUNC(platform_debug_print)
 {
-    f32 result = 1000.0f * (f32)(end - start) / (f32)counts_per_second;
-    return result;
+    ASSERT(string);
+
+    OutputDebugStringA(string);
 }
 
 typedef struct
 {
     game_update_and_render_t *update_and_render;
+    game_init_globals_t *init_globals;
     FILETIME dll_last_write_time;
     HMODULE game_dll;
 } game_t;
@@ -279,6 +392,11 @@ internal DEF_GAME_UPDATE_AND_RENDER_FUNC(win32_game_update_and_render_stub)
     return;
 }
 
+internal DEF_GAME_INIT_GLOBALS_FUNC(win32_game_init_globals_stub)
+{
+    return;
+}
+
 void win32_unload_game_dll(game_t *game)
 {
     if (game->game_dll)
@@ -287,6 +405,7 @@ void win32_unload_game_dll(game_t *game)
 
         game->game_dll = NULL;
         game->update_and_render = win32_game_update_and_render_stub;
+        game->init_globals = win32_game_init_globals_stub;
     }
 }
 
@@ -295,6 +414,7 @@ game_t win32_load_game_dll(const char *game_dll_file_path)
 {
     game_t game = {0};
     game.update_and_render = win32_game_update_and_render_stub;
+    game.init_globals = win32_game_init_globals_stub;
 
     // NOTE: The platform does not load the game_dll_file_path directly. This is
     // because debuggers will "LOCK" the dll because of which hot reloading
@@ -307,6 +427,8 @@ game_t win32_load_game_dll(const char *game_dll_file_path)
         {
             game.update_and_render = (game_update_and_render_t *)GetProcAddress(
                 game.game_dll, "game_update_and_render");
+            game.init_globals = (game_init_globals_t *)GetProcAddress(
+                game.game_dll, "game_init_globals");
         }
     }
     else
@@ -323,8 +445,8 @@ internal FILETIME win32_get_last_write_time(const char *file_name)
 {
     FILETIME result = {0};
 
-    WIN32_FIND_DATAA file_data = {0};
-    if (FindFirstFileA(file_name, &file_data))
+    WIN32_FILE_ATTRIBUTE_DATA file_data = {0};
+    if (GetFileAttributesExA(file_name, GetFileExInfoStandard, &file_data))
     {
         result = file_data.ftLastWriteTime;
     }
@@ -332,6 +454,191 @@ internal FILETIME win32_get_last_write_time(const char *file_name)
     return result;
 }
 
+// Game dll hot reloading.
+// Instead of polling the dll's timestamp every frame, a background thread
+// waits for file change notifications in the directory of the game dll, and
+// flags that a reload might be required. The main thread then only checks
+// whether the build has completed (and reloads) when that flag is set.
+#define WIN32_GAME_DLL_LOCK_FILE_PATH "lock.tmp"
+
+typedef struct
+{
+    HANDLE directory_handle;
+    HANDLE thread;
+
+    // Set by the watcher thread, cleared by the main thread.
+    volatile LONG change_pending;
+} win32_game_dll_watcher_t;
+
+internal b32 win32_file_notification_has_name(
+    const FILE_NOTIFY_INFORMATION *const restrict notification,
+    const wchar_t *const restrict file_name)
+{
+    ASSERT(notification);
+    ASSERT(file_name);
+
+    const u64 file_name_length = wcslen(file_name);
+
+    return notification->FileNameLength == file_name_length * sizeof(wchar_t) &&
+           _wcsnicmp(notification->FileName, file_name, file_name_length) == 0;
+}
+
+internal DWORD WINAPI win32_game_dll_watcher_thread_proc(LPVOID param)
+{
+    win32_game_dll_watcher_t *watcher = (win32_game_dll_watcher_t *)param;
+    ASSERT(watcher);
+
+    // NOTE: FILE_NOTIFY_INFORMATION entries must be DWORD aligned.
+    DWORD notification_buffer[1024];
+
+    for (;;)
+    {
+        DWORD bytes_returned = 0;
+        if (!ReadDirectoryChangesW(
+                watcher->directory_handle, notification_buffer,
+                sizeof(notification_buffer), FALSE,
+                FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME |
+                    FILE_NOTIFY_CHANGE_SIZE,
+                &bytes_returned, NULL, NULL))
+        {
+            // Watching failed, fall back to checking every frame.
+            InterlockedExchange(&watcher->change_pending, 1);
+            break;
+        }
+
+        // If the notification buffer overflowed, the changed files are
+        // unknown, so a check is always requested.
+        b32 game_dll_changed = bytes_returned == 0;
+
+        u8 *cursor = (u8 *)notification_buffer;
+        while (bytes_returned && !game_dll_changed)
+        {
+            const FILE_NOTIFY_INFORMATION *notification =
+                (const FILE_NOTIFY_INFORMATION *)cursor;
+
+            // Writes to the lock file are included, so that the reload happens
+            // as soon as the build completes.
+            if (win32_file_notification_has_name(notification, L"game.dll") ||
+                win32_file_notification_has_name(notification, L"lock.tmp"))
+            {
+                game_dll_changed = true;
+            }
+
+            if (notification->NextEntryOffset == 0)
+            {
+                break;
+            }
+            cursor += notification->NextEntryOffset;
+        }
+
+        if (game_dll_changed)
+        {
+            InterlockedExchange(&watcher->change_pending, 1);
+        }
+    }
+
+    return 0;
+}
+
+internal void
+win32_start_game_dll_watcher(win32_game_dll_watcher_t *const restrict watcher)
+{
+    ASSERT(watcher);
+
+    // NOTE: The game dll is loaded from the working directory.
+    watcher->directory_handle =
+        CreateFileA(".", FILE_LIST_DIRECTORY,
+                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                    NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+
+    if (watcher->directory_handle != INVALID_HANDLE_VALUE)
+    {
+        watcher->thread = CreateThread(
+            NULL, 0, win32_game_dll_watcher_thread_proc, watcher, 0, NULL);
+    }
+
+    if (!watcher->thread)
+    {
+        // Without a watcher thread, the timestamp is checked every frame.
+        watcher->change_pending = 1;
+    }
+}
+
+// The compiler creates the lock file before the build starts and deletes it
+// once done. Even without a lock file, the linker might still be writing the
+// dll, in which case it can not be opened with exclusive access.
+internal b32 win32_is_game_dll_build_complete(const char *game_dll_file_path)
+{
+    ASSERT(game_dll_file_path);
+
+    WIN32_FILE_ATTRIBUTE_DATA lock_file_data = {0};
+    if (GetFileAttributesExA(WIN32_GAME_DLL_LOCK_FILE_PATH,
+                             GetFileExInfoStandard, &lock_file_data))
+    {
+        return false;
+    }
+
+    HANDLE game_dll_handle =
+        CreateFileA(game_dll_file_path, GENERIC_READ, 0, NULL, OPEN_EXISTING,
+                    FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (game_dll_handle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    CloseHandle(game_dll_handle);
+
+    return true;
+}
+
+// NOTE: Jobs added by the game run code from the game dll, so they have to be
+// completed (on both queues) before the dll is unloaded.
+internal void win32_reload_game_dll_if_changed(
+    game_t *const restrict game,
+    win32_game_dll_watcher_t *const restrict watcher,
+    platform_work_queue_t *const restrict work_queue,
+    platform_work_queue_t *const restrict io_work_queue,
+    const char *game_dll_file_path)
+{
+    ASSERT(game);
+    ASSERT(watcher);
+    ASSERT(game_dll_file_path);
+
+    if (!InterlockedExchange(&watcher->change_pending, 0))
+    {
+        return;
+    }
+
+    // If the build has not completed yet, check again next frame.
+    if (!win32_is_game_dll_build_complete(game_dll_file_path))
+    {
+        InterlockedExchange(&watcher->change_pending, 1);
+        return;
+    }
+
+    if (!watcher->thread)
+    {
+        InterlockedExchange(&watcher->change_pending, 1);
+    }
+
+    FILETIME dll_last_write_time =
+        win32_get_last_write_time(game_dll_file_path);
+
+    if (CompareFileTime(&game->dll_last_write_time, &dll_last_write_time) != 0)
+    {
+        platform_complete_all_work(work_queue);
+        platform_complete_all_work(io_work_queue);
+
+        win32_unload_game_dll(game);
+        *game = win32_load_game_dll(game_dll_file_path);
+        game->dll_last_write_time = dll_last_write_time;
+
+        WIN32_LOG(log_severity_info, win32_log_category_platform,
+                  win32_log_format_game_dll_reloaded);
+    }
+}
+
 // State machine for live loop editing.
 typedef enum
 {
@@ -393,8 +700,11 @@ void win32_stop_recording(win32_state_t *const restrict state)
     CloseHandle(state->game_memory_file_handle);
 }
 
+// NOTE: If restore_game_memory is false, the caller is responsible for
+// restoring game memory (for example from an in memory checkpoint).
 void win32_start_playback(win32_state_t *const restrict state,
-                          game_memory_t *restrict game_memory)
+                          game_memory_t *restrict game_memory,
+                          const b32 restore_game_memory)
 {
     ASSERT(state);
     ASSERT(game_memory);
@@ -414,6 +724,11 @@ void win32_start_playback(win32_state_t *const restrict state,
     state->input_file_handle = input_file_handle;
     state->game_memory_file_handle = game_memory_handle;
 
+    if (!restore_game_memory)
+    {
+        return;
+    }
+
     DWORD bytes_read = 0;
     // Read input and game state from memory.
     if (!ReadFile(state->game_memory_file_handle,
@@ -440,128 +755,1120 @@ void win32_stop_playback(win32_state_t *const restrict state)
     CloseHandle(state->game_memory_file_handle);
 }
 
-int WINAPI wWinMain(HINSTANCE instance, HINSTANCE prev_instance,
-                    PWSTR command_line, int command_show)
+#include "win32_checkpoint.c"
+
+// Starts playback of the live loop. Game memory is restored from the in memory
+// checkpoint taken when recording started, which only copies the pages that
+// changed since. The (full) snapshot file is only read if that checkpoint was
+// already dropped from the checkpoint history.
+internal void
+win32_restart_playback(win32_state_t *const restrict state,
+                       game_memory_t *const restrict game_memory,
+                       win32_checkpoint_history_t *const restrict history,
+                       const u64 loop_checkpoint_id)
 {
-    win32_state_type_t state_type = 0;
-    win32_state_t recording_state = {0};
+    ASSERT(state);
+    ASSERT(game_memory);
+    ASSERT(history);
 
-    // Load the game.
-    game_t game = win32_load_game_dll("game.dll");
-    game.dll_last_write_time = win32_get_last_write_time("game.dll");
+    const b32 restored_from_checkpoint =
+        win32_rewind_to_checkpoint(history, loop_checkpoint_id);
 
-    // Set thread scheduler granularity to 1ms.
-    timeBeginPeriod(1u);
+    win32_start_playback(state, game_memory, !restored_from_checkpoint);
+}
 
-    // Register a window class : set of behaviors that several windows might
-    // have in common (required even if only a single window is created by the
-    // application).
-    // CS_VREDRAW | CS_HREDRAW -> Redraw the entire window everytime horizontal
-    // / vertical movement or resizing is done.
-    // CS_OWNDC is used so that a device context for window can be taken once
-    // and reused without releasing it each time.
-    WNDCLASSEXW window_class = {0};
-    window_class.cbSize = sizeof(WNDCLASSEXW);
-    window_class.style = CS_VREDRAW | CS_HREDRAW | CS_OWNDC;
-    window_class.lpfnWndProc = win32_window_proc;
-    window_class.hInstance = instance;
-    window_class.lpszClassName = L"CustomWindowClass";
+// Dynamic resolution.
+// When the time taken by the game to update and render a frame approaches the
+// frame budget, the internal render resolution is lowered one step (the frame
+// is upscaled back to full resolution on the present thread). When the
+// predicted cost at the next higher resolution fits comfortably within budget
+// for a while, resolution is raised again.
+global_variable const f32 g_resolution_scales[] = {1.0f, 0.875f, 0.75f,
+                                                   0.625f, 0.5f};
 
-    RegisterClassExW(&window_class);
+typedef struct
+{
+    u32 scale_index;
 
-    // Create the actual window.
-    const HWND window = CreateWindowExW(
-        0, window_class.lpszClassName, L"prism-engine", WS_OVERLAPPEDWINDOW,
-        CW_USEDEFAULT, CW_USEDEFAULT, WINDOW_WIDTH, WINDOW_HEIGHT, NULL, NULL,
-        instance, NULL);
-    ShowWindow(window, SW_SHOWNORMAL);
+    // Exponential moving average of update and render time at the current
+    // scale.
+    f32 average_render_ms;
+    u32 frames_at_scale;
 
-    if (!window)
+    u32 frames_with_headroom;
+} win32_dynamic_resolution_t;
+
+internal void win32_update_dynamic_resolution(
+    win32_dynamic_resolution_t *const restrict dynamic_resolution,
+    const f32 render_ms, const f32 budget_ms, const b32 missed_frame)
+{
+    ASSERT(dynamic_resolution);
+
+    // Fraction of the frame budget rendering is allowed to take.
+    const f32 step_down_threshold = 0.8f;
+    const f32 step_up_threshold = 0.6f;
+
+    // Frames to wait before changing resolution again, so the average reflects
+    // the new resolution.
+    const u32 min_frames_at_scale = 8;
+    const u32 min_frames_with_headroom = 60;
+
+    win32_dynamic_resolution_t *dr = dynamic_resolution;
+
+    dr->average_render_ms =
+        dr->frames_at_scale == 0
+            ? render_ms
+            : 0.9f * dr->average_render_ms + 0.1f * render_ms;
+    dr->frames_at_scale++;
+
+    if (dr->frames_at_scale < min_frames_at_scale)
     {
-        // TODO: Logging.
-        return -1;
+        return;
     }
 
-    const HDC device_context = GetDC(window);
+    const u32 lowest_scale_index = ARRAY_COUNT(g_resolution_scales) - 1;
+
+    if ((missed_frame ||
+         dr->average_render_ms > step_down_threshold * budget_ms) &&
+        dr->scale_index < lowest_scale_index)
+    {
+        dr->scale_index++;
+        dr->frames_at_scale = 0;
+        dr->frames_with_headroom = 0;
 
-    win32_resize_framebuffer(&g_backbuffer, WINDOW_WIDTH, WINDOW_HEIGHT);
+        return;
+    }
 
-    // Get the number of counts that occur in a second.
-    u64 perf_counter_frequency = win32_get_perf_counter_frequency();
+    if (dr->scale_index == 0)
+    {
+        return;
+    }
 
-    game_input_t prev_game_input = {0};
-    game_input_t current_game_input = {0};
+    // Render cost is roughly proportional to the pixel count.
+    const f32 scale_ratio = g_resolution_scales[dr->scale_index - 1] /
+                            g_resolution_scales[dr->scale_index];
+    const f32 predicted_render_ms =
+        dr->average_render_ms * scale_ratio * scale_ratio;
 
-    game_input_t *prev_game_input_ptr = &prev_game_input;
-    game_input_t *current_game_input_ptr = &current_game_input;
+    if (predicted_render_ms < step_up_threshold * budget_ms)
+    {
+        dr->frames_with_headroom++;
+    }
+    else
+    {
+        dr->frames_with_headroom = 0;
+    }
 
-    game_memory_t game_memory = {0};
-    game_memory.permanent_memory_block_size = KILOBYTE(4);
-    game_memory.permanent_memory_block =
-        VirtualAlloc(0, game_memory.permanent_memory_block_size,
-                     MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (dr->frames_with_headroom >= min_frames_with_headroom)
+    {
+        dr->scale_index--;
+        dr->frames_at_scale = 0;
+        dr->frames_with_headroom = 0;
+    }
+}
 
-    ASSERT(game_memory.permanent_memory_block);
+// Game memory is reserved at a fixed base address (unless the address is
+// taken), so that pointers stored in game memory stay valid when a snapshot
+// written by another run is restored.
+#define WIN32_GAME_MEMORY_BASE_ADDRESS TERABYTE(2)
 
-    f32 delta_time = 0.0f;
+typedef struct
+{
+    b32 is_at_base_address;
+    u32 page_size;
 
-    // Code to limit framerate.
-    u32 monitor_refresh_rate = 60;
+    // Time to allocate game memory, and touch all of its pages.
+    f32 allocation_ms;
 
-    DEVMODEA dev_mode = {};
-    if (EnumDisplaySettingsA(NULL, ENUM_CURRENT_SETTINGS, &dev_mode))
+    // Average time of a random access to a page of game memory (see
+    // win32_measure_page_access_time).
+    f32 page_access_ns;
+} win32_game_memory_stats_t;
+
+// Large pages need the "Lock pages in memory" privilege, which an administrator
+// has to grant to the user first. It is also disabled by default, so it is
+// enabled here.
+internal b32 win32_enable_lock_memory_privilege()
+{
+    HANDLE token = NULL;
+    if (!OpenProcessToken(GetCurrentProcess(),
+                          TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
     {
-        monitor_refresh_rate = dev_mode.dmDisplayFrequency;
+        return false;
     }
 
-    const u32 game_update_hz = monitor_refresh_rate;
-    const u32 target_ms_per_frame = (u32)(1000.0f / (f32)game_update_hz);
+    TOKEN_PRIVILEGES privileges = {0};
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
 
-    // Get the current value of performance counter.
-    // This can be used to find number of 'counts' per frame. Then, by
-    // dividing with perf_counter_frequency, we can find how long it took
-    // (in seconds) to render this frame.
-    u64 last_counter_value = win32_get_perf_counter_value();
-    u64 last_timestamp_value = __rdtsc();
+    // NOTE: AdjustTokenPrivileges succeeds even if the privilege was not
+    // granted, in which case the last error is ERROR_NOT_ALL_ASSIGNED.
+    const b32 result =
+        LookupPrivilegeValueA(NULL, "SeLockMemoryPrivilege",
+                              &privileges.Privileges[0].Luid) &&
+        AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL) &&
+        GetLastError() == ERROR_SUCCESS;
 
-    u32 frame_index = 0;
+    CloseHandle(token);
 
-    b32 quit = false;
-    while (!quit)
-    {
-        // Check if the game dll's last write time has changed. If yes, re-load
-        // the dll.
-        FILETIME dll_last_write_time = win32_get_last_write_time("game.dll");
+    return result;
+}
 
-        if (CompareFileTime(&game.dll_last_write_time, &dll_last_write_time) !=
-            0)
-        {
-            win32_unload_game_dll(&game);
-            game = win32_load_game_dll("game.dll");
-            game.dll_last_write_time = dll_last_write_time;
-        }
+// Average time (in ns) of dependent loads from every page of memory, in an
+// order that hardware prefetchers do not follow. With 4 KB pages, most of the
+// loads miss the TLB once memory is larger than the TLB covers, with large
+// pages all of game memory is covered by a few TLB entries.
+internal f32 win32_measure_page_access_time(const u8 *const restrict memory,
+                                            const u64 memory_size)
+{
+    ASSERT(memory);
 
-        MSG message = {0};
+    const u64 page_count = memory_size / KILOBYTE(4);
+    ASSERT(page_count && (page_count & (page_count - 1)) == 0);
 
-        ZeroMemory((void *)current_game_input_ptr, sizeof(game_input_t));
+    // An odd stride visits every page before repeating.
+    const u64 page_stride = (page_count / 3) | 1;
+    const u64 access_count = 4 * page_count;
 
-        while (PeekMessageW(&message, 0, 0, 0, PM_REMOVE))
-        {
-            switch (message.message)
-            {
-            case WM_QUIT: {
-                quit = true;
-            }
+    u64 page_index = 0;
 
-            case WM_KEYUP:
-            case WM_SYSKEYDOWN:
-            case WM_SYSKEYUP:
-            case WM_KEYDOWN: {
-                b32 is_key_down = ~((message.lParam >> 30) & 0x1);
+    const u64 start_counter_value = win32_get_perf_counter_value();
 
-                switch (message.wParam)
-                {
-                case VK_ESCAPE: {
+    for (u64 i = 0; i < access_count; i++)
+    {
+        const u64 value = *(volatile u64 *)(memory + page_index * KILOBYTE(4));
+
+        // The loaded value (whatever it is) decides the next page, so loads
+        // can not overlap.
+        page_index = ((page_index + page_stride) ^ (value >> 63)) &
+                     (page_count - 1);
+    }
+
+    const u64 end_counter_value = win32_get_perf_counter_value();
+
+    return (f32)((f64)(end_counter_value - start_counter_value) * 1e9 /
+                 (f64)win32_get_perf_counter_frequency() / (f64)access_count);
+}
+
+// base_address of 0 lets the system choose where game memory goes. Large pages
+// are used if use_large_pages is set, and they are available.
+internal game_memory_t
+win32_allocate_game_memory(const u64 base_address, const b32 use_large_pages,
+                           win32_game_memory_stats_t *const restrict stats)
+{
+    ASSERT(stats);
+
+    memset(stats, 0, sizeof(win32_game_memory_stats_t));
+
+    const u64 start_counter_value = win32_get_perf_counter_value();
+
+    game_memory_t game_memory = {0};
+    game_memory.permanent_memory_block_size = MEGABYTE(16);
+
+    void *base = (void *)base_address;
+
+    const u64 large_page_size = use_large_pages &&
+                                        win32_enable_lock_memory_privilege()
+                                    ? GetLargePageMinimum()
+                                    : 0;
+
+    // NOTE: Large pages are not pageable, and do not support write watching,
+    // so checkpoints fall back to comparing pages.
+    if (large_page_size)
+    {
+        const u64 size =
+            (game_memory.permanent_memory_block_size + large_page_size - 1) &
+            ~(large_page_size - 1);
+
+        game_memory.permanent_memory_block =
+            VirtualAlloc(base, size, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES,
+                         PAGE_READWRITE);
+
+        stats->page_size = (u32)large_page_size;
+    }
+
+    // Write watching is used to find dirty pages for checkpoints. If it is not
+    // supported, checkpoints fall back to comparing pages.
+    for (u32 attempt = 0; attempt < 2 && !game_memory.permanent_memory_block;
+         attempt++)
+    {
+        // The base address may be taken (or invalid), in which case any
+        // address is used.
+        if (attempt == 1)
+        {
+            base = NULL;
+        }
+
+        game_memory.permanent_memory_block =
+            VirtualAlloc(base, game_memory.permanent_memory_block_size,
+                         MEM_COMMIT | MEM_RESERVE | MEM_WRITE_WATCH,
+                         PAGE_READWRITE);
+
+        if (!game_memory.permanent_memory_block)
+        {
+            game_memory.permanent_memory_block =
+                VirtualAlloc(base, game_memory.permanent_memory_block_size,
+                             MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        }
+
+        stats->page_size = KILOBYTE(4);
+    }
+
+    ASSERT(game_memory.permanent_memory_block);
+
+    // Pages are committed on first touch, so they are touched here, instead of
+    // during the first frames.
+    for (u64 offset = 0; offset < game_memory.permanent_memory_block_size;
+         offset += KILOBYTE(4))
+    {
+        ((volatile u8 *)game_memory.permanent_memory_block)[offset] = 0;
+    }
+
+    stats->is_at_base_address =
+        base_address &&
+        game_memory.permanent_memory_block == (u8 *)base_address;
+    stats->allocation_ms =
+        (f32)((f64)(win32_get_perf_counter_value() - start_counter_value) *
+              1000.0 / (f64)win32_get_perf_counter_frequency());
+    stats->page_access_ns =
+        win32_measure_page_access_time(game_memory.permanent_memory_block,
+                                       game_memory.permanent_memory_block_size);
+
+    return game_memory;
+}
+
+// Both queues can be NULL, in which case the game runs all jobs itself.
+internal game_platform_services_t
+win32_get_platform_services(platform_work_queue_t *const work_queue,
+                            platform_work_queue_t *const io_work_queue)
+{
+    game_platform_services_t platform_services = {0};
+    platform_services.read_file = platform_read_file;
+    platform_services.write_to_file = platform_write_to_file;
+    platform_services.close_file = platform_close_file;
+    platform_services.write_file_at_offset = platform_write_file_at_offset;
+    platform_services.debug_print = platform_debug_print;
+
+    platform_services.work_queue = work_queue;
+    platform_services.io_work_queue = io_work_queue;
+    platform_services.add_work_queue_entry = platform_add_work_queue_entry;
+    platform_services.complete_all_work = platform_complete_all_work;
+    platform_services.do_next_work_queue_entry =
+        platform_do_next_work_queue_entry;
+
+    return platform_services;
+}
+
+// NOTE: The platform is a windows subsystem application, so it has no console
+// by default. When launched from a shell (for example on a build server), the
+// parent's console is used so that reports are visible there as well.
+internal void win32_print(const char *const restrict string)
+{
+    ASSERT(string);
+
+    OutputDebugStringA(string);
+
+    HANDLE std_output = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (std_output && std_output != INVALID_HANDLE_VALUE)
+    {
+        DWORD bytes_written = 0;
+        WriteFile(std_output, (void *)string,
+                  truncate_u64_to_u32(strlen(string)), &bytes_written, NULL);
+    }
+}
+
+// Headless deterministic replay.
+// Loads the game memory snapshot + input stream written by the live loop
+// recording, and runs game_update_and_render for every recorded frame as fast
+// as possible (no window, no frame limiting). After each frame the
+// framebuffer and game memory are hashed. The hashes are written to
+// replay_hashes_file_path, and if golden_hashes_file_path is provided, they are
+// compared against it so that performance changes can be validated for both
+// speed and bit exactness. The game's audio is written to
+// replay_audio_file_path (a WAV file).
+typedef struct
+{
+    u64 framebuffer_hash;
+    u64 game_memory_hash;
+} win32_replay_frame_hash_t;
+
+typedef enum
+{
+    win32_replay_result_success = 0,
+    win32_replay_result_divergence = 1,
+    win32_replay_result_missing_recording = 2,
+    win32_replay_result_out_of_memory = 3,
+} win32_replay_result_t;
+
+// Format of the hash file : One line per frame with the frame index,
+// framebuffer hash and game memory hash (in hex). Empty lines are skipped.
+// Returns the number of hashes parsed. is_valid is cleared (and parsing stops)
+// on a line that does not parse, a frame index out of order, or more than
+// max_hash_count hashes.
+internal u32 win32_parse_replay_hashes(
+    const char *restrict text, win32_replay_frame_hash_t *const restrict hashes,
+    const u32 max_hash_count, b32 *const restrict is_valid)
+{
+    ASSERT(text);
+    ASSERT(hashes);
+    ASSERT(is_valid);
+
+    *is_valid = true;
+
+    u32 hash_count = 0;
+
+    while (*text)
+    {
+        u32 frame_index = 0;
+        unsigned long long framebuffer_hash = 0;
+        unsigned long long game_memory_hash = 0;
+
+        if (*text == '\n' || *text == '\r')
+        {
+            text++;
+            continue;
+        }
+
+        if (sscanf(text, "%u %llx %llx", &frame_index, &framebuffer_hash,
+                   &game_memory_hash) != 3 ||
+            frame_index != hash_count || hash_count == max_hash_count)
+        {
+            *is_valid = false;
+            break;
+        }
+
+        hashes[hash_count].framebuffer_hash = framebuffer_hash;
+        hashes[hash_count].game_memory_hash = game_memory_hash;
+        hash_count++;
+
+        // Move to next line.
+        while (*text && *text != '\n')
+        {
+            text++;
+        }
+
+        if (*text)
+        {
+            text++;
+        }
+    }
+
+    return hash_count;
+}
+
+internal win32_replay_result_t win32_run_headless_replay(
+    const char *const restrict replay_hashes_file_path,
+    const char *const restrict golden_hashes_file_path,
+    const char *const restrict replay_audio_file_path,
+    const u64 game_memory_base_address, const b32 use_large_pages)
+{
+    ASSERT(replay_hashes_file_path);
+    ASSERT(replay_audio_file_path);
+
+    char text[512];
+
+    game_t game = win32_load_game_dll("game.dll");
+
+    win32_game_memory_stats_t game_memory_stats = {0};
+    game_memory_t game_memory = win32_allocate_game_memory(
+        game_memory_base_address, use_large_pages, &game_memory_stats);
+
+    sprintf(text,
+            "Replay : Game memory at 0x%llx (fixed base : %u), %u KB pages, "
+            "allocated in %.3f ms, %.2f ns per page access.\n",
+            (unsigned long long)game_memory.permanent_memory_block,
+            game_memory_stats.is_at_base_address,
+            game_memory_stats.page_size / 1024, game_memory_stats.allocation_ms,
+            game_memory_stats.page_access_ns);
+    win32_print(text);
+
+    // NOTE: Without a work queue, the game runs its jobs (e.g world generation)
+    // on the game thread, so that the results do not depend on thread timing.
+    game_platform_services_t platform_services =
+        win32_get_platform_services(NULL, NULL);
+
+    // NOTE: Replays must not overwrite the player's save game.
+    platform_services.write_file_at_offset = NULL;
+
+    win32_offscreen_buffer_t backbuffer = {0};
+    win32_resize_framebuffer(&backbuffer, WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    const u64 framebuffer_size =
+        sizeof(u32) * (u64)backbuffer.width * backbuffer.height;
+
+    HANDLE input_file_handle =
+        CreateFileA("prism_input_handle.txt", GENERIC_READ, 0, NULL,
+                    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    LARGE_INTEGER input_file_size = {0};
+    if (input_file_handle == INVALID_HANDLE_VALUE ||
+        !GetFileSizeEx(input_file_handle, &input_file_size))
+    {
+        win32_print("Replay : Failed to open recorded input stream "
+                    "(prism_input_handle.txt).\n");
+        return win32_replay_result_missing_recording;
+    }
+    CloseHandle(input_file_handle);
+
+    const u32 frame_count = truncate_u64_to_u32(
+        (u64)input_file_size.QuadPart / sizeof(game_input_t));
+
+    // Frame hashes of this run, followed by the golden hashes.
+    win32_replay_frame_hash_t *frame_hashes =
+        (win32_replay_frame_hash_t *)VirtualAlloc(
+            0, 2 * sizeof(win32_replay_frame_hash_t) * (frame_count + 1),
+            MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    ASSERT(frame_hashes);
+
+    win32_replay_frame_hash_t *golden_hashes = frame_hashes + frame_count + 1;
+
+    // Restores the game memory snapshot and opens the input stream.
+    win32_state_t replay_state = {0};
+    win32_start_playback(&replay_state, &game_memory, true);
+
+    // NOTE: The number of samples mixed per frame only depends on the recorded
+    // delta time, so that audio (and game memory) is deterministic.
+    win32_audio_t *audio = (win32_audio_t *)VirtualAlloc(
+        0, sizeof(win32_audio_t), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    ASSERT(audio);
+
+    win32_wav_sink_t wav_sink = {0};
+    if (!win32_open_wav_sink(&wav_sink, replay_audio_file_path))
+    {
+        sprintf(text, "Replay : Failed to create audio file %s.\n",
+                replay_audio_file_path);
+        win32_print(text);
+    }
+
+    const u64 perf_counter_frequency = win32_get_perf_counter_frequency();
+
+    u64 update_counts = 0;
+    u64 hash_counts = 0;
+    const u64 replay_start_counter_value = win32_get_perf_counter_value();
+
+    u32 frame_index = 0;
+    for (; frame_index < frame_count; frame_index++)
+    {
+        game_input_t game_input = {0};
+
+        DWORD bytes_read = 0;
+        if (!ReadFile(replay_state.input_file_handle, (void *)&game_input,
+                      sizeof(game_input_t), &bytes_read, NULL) ||
+            bytes_read != sizeof(game_input_t))
+        {
+            break;
+        }
+
+        game_offscreen_buffer_t game_offscreen_buffer = {0};
+        game_offscreen_buffer.framebuffer_memory =
+            backbuffer.framebuffer_memory;
+        game_offscreen_buffer.width = backbuffer.width;
+        game_offscreen_buffer.height = backbuffer.height;
+        game_offscreen_buffer.render_scale = 1.0f;
+
+        game_sound_output_buffer_t game_sound_buffer =
+            win32_acquire_sound_buffer(audio, game_input.delta_time);
+
+        const u64 update_start_counter_value = win32_get_perf_counter_value();
+
+        game.update_and_render(&game_offscreen_buffer, &game_input,
+                               &game_sound_buffer, &game_memory,
+                               &platform_services);
+
+        const u64 hash_start_counter_value = win32_get_perf_counter_value();
+
+        win32_write_to_wav_sink(&wav_sink, &game_sound_buffer);
+
+        frame_hashes[frame_index].framebuffer_hash = hash_bytes(
+            HASH_SEED, backbuffer.framebuffer_memory, framebuffer_size);
+        frame_hashes[frame_index].game_memory_hash =
+            hash_bytes(HASH_SEED, game_memory.permanent_memory_block,
+                       game_memory.permanent_memory_block_size);
+
+        const u64 hash_end_counter_value = win32_get_perf_counter_value();
+
+        update_counts += hash_start_counter_value - update_start_counter_value;
+        hash_counts += hash_end_counter_value - hash_start_counter_value;
+    }
+
+    const u64 replay_end_counter_value = win32_get_perf_counter_value();
+
+    win32_stop_playback(&replay_state);
+
+    win32_close_wav_sink(&wav_sink);
+    VirtualFree(audio, 0, MEM_RELEASE);
+
+    const u32 replayed_frame_count = frame_index;
+
+    // Write the hashes of this run (can be used as the next golden file).
+    const u64 hash_file_text_size = 64 * ((u64)replayed_frame_count + 1);
+    char *hash_file_text = (char *)VirtualAlloc(
+        0, hash_file_text_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    ASSERT(hash_file_text);
+
+    char *hash_file_cursor = hash_file_text;
+    for (u32 i = 0; i < replayed_frame_count; i++)
+    {
+        hash_file_cursor +=
+            sprintf(hash_file_cursor, "%u %016llx %016llx\n", i,
+                    (unsigned long long)frame_hashes[i].framebuffer_hash,
+                    (unsigned long long)frame_hashes[i].game_memory_hash);
+    }
+
+    platform_write_to_file(hash_file_text, replay_hashes_file_path);
+    VirtualFree(hash_file_text, 0, MEM_RELEASE);
+
+    // Compare against golden hashes.
+    win32_replay_result_t result = win32_replay_result_success;
+
+    if (golden_hashes_file_path)
+    {
+        u8 *golden_file = win32_read_entire_file(golden_hashes_file_path, NULL);
+        if (!golden_file)
+        {
+            sprintf(text, "Replay : Failed to read golden hash file %s.\n",
+                    golden_hashes_file_path);
+            win32_print(text);
+
+            result = win32_replay_result_missing_recording;
+        }
+        else
+        {
+            b32 is_golden_file_valid = false;
+            const u32 golden_hash_count = win32_parse_replay_hashes(
+                (const char *)golden_file, golden_hashes, frame_count + 1,
+                &is_golden_file_valid);
+            platform_close_file(golden_file);
+
+            // NOTE: A malformed (e.g truncated) golden file can not vouch for
+            // the frames it does not cover, so it counts as divergence.
+            if (!is_golden_file_valid)
+            {
+                sprintf(text,
+                        "Replay : Golden hash file %s is malformed after frame "
+                        "%u (or has more frames than the recording).\n",
+                        golden_hashes_file_path, golden_hash_count);
+                win32_print(text);
+
+                result = win32_replay_result_divergence;
+            }
+
+            u32 mismatch_count = 0;
+            i32 first_mismatch_frame_index = -1;
+
+            for (u32 i = 0; i < replayed_frame_count && i < golden_hash_count;
+                 i++)
+            {
+                if (frame_hashes[i].framebuffer_hash !=
+                        golden_hashes[i].framebuffer_hash ||
+                    frame_hashes[i].game_memory_hash !=
+                        golden_hashes[i].game_memory_hash)
+                {
+                    if (first_mismatch_frame_index < 0)
+                    {
+                        first_mismatch_frame_index = (i32)i;
+                    }
+                    mismatch_count++;
+                }
+            }
+
+            if (is_golden_file_valid &&
+                golden_hash_count != replayed_frame_count)
+            {
+                sprintf(text,
+                        "Replay : Frame count mismatch (expected : %u golden "
+                        "frames, actual : %u replayed frames).\n",
+                        golden_hash_count, replayed_frame_count);
+                win32_print(text);
+
+                result = win32_replay_result_divergence;
+            }
+
+            if (mismatch_count)
+            {
+                const win32_replay_frame_hash_t *replayed =
+                    &frame_hashes[first_mismatch_frame_index];
+                const win32_replay_frame_hash_t *golden =
+                    &golden_hashes[first_mismatch_frame_index];
+
+                sprintf(text,
+                        "Replay : DIVERGED on %u frames, first at frame %d "
+                        "(framebuffer %s, game memory %s).\n",
+                        mismatch_count, first_mismatch_frame_index,
+                        replayed->framebuffer_hash == golden->framebuffer_hash
+                            ? "matches"
+                            : "differs",
+                        replayed->game_memory_hash == golden->game_memory_hash
+                            ? "matches"
+                            : "differs");
+                win32_print(text);
+
+                result = win32_replay_result_divergence;
+            }
+            else if (result == win32_replay_result_success)
+            {
+                win32_print("Replay : All frames match the golden hashes.\n");
+            }
+        }
+    }
+
+    const f32 total_ms = win32_get_time_delta_ms(replay_start_counter_value,
+                                                 replay_end_counter_value,
+                                                 perf_counter_frequency);
+    const f32 update_ms =
+        win32_get_time_delta_ms(0, update_counts, perf_counter_frequency);
+    const f32 hash_ms =
+        win32_get_time_delta_ms(0, hash_counts, perf_counter_frequency);
+
+    const f32 frames = replayed_frame_count ? (f32)replayed_frame_count : 1.0f;
+
+    sprintf(text,
+            "Replay : %u frames in %.2f ms (%.1f frames per second). Update "
+            "and render : %.4f ms per frame, hashing : %.4f ms per frame.\n",
+            replayed_frame_count, total_ms,
+            total_ms > 0.0f ? 1000.0f * replayed_frame_count / total_ms : 0.0f,
+            update_ms / frames, hash_ms / frames);
+    win32_print(text);
+
+    VirtualFree(frame_hashes, 0, MEM_RELEASE);
+    win32_unload_game_dll(&game);
+
+    return result;
+}
+
+#include "win32_scripted_input.c"
+#include "win32_rollback.c"
+#include "win32_batch.c"
+
+int WINAPI wWinMain(HINSTANCE instance, HINSTANCE prev_instance,
+                    PWSTR command_line, int command_show)
+{
+    // Command line options :
+    // --replay : Run the headless replay of the last live loop recording.
+    // --golden <path> : Golden hash file the replay is validated against.
+    // --hashes <path> : Where the replay writes its per frame hashes.
+    // --audio <path> : Where the replay writes its audio (WAV).
+    // --frames-in-flight <n> : Max frames waiting for presentation (1 or 2).
+    // --fixed-resolution : Disable dynamic resolution.
+    // --nearest-upscale : Use nearest (instead of bilinear) upscaling with
+    // dynamic resolution.
+    // --worker-threads <n> : Number of worker threads (default : one per
+    // logical processor except one).
+    // --log-level <debug | info | warning | error> : Minimum severity of
+    // logged messages (default : info, per frame stats are logged as debug).
+    // --log-category <name> : Only log messages of this category (can be
+    // repeated, default : all categories).
+    // --no-hud : Start with the performance HUD hidden (F1 toggles it).
+    // --capture : Start capturing frames to disk right away (F2 toggles it).
+    // --memory-base <hex address> : Where game memory is reserved (default :
+    // 0x20000000000, 0 lets the system choose).
+    // --large-pages : Back game memory with large pages, if the user has the
+    // "Lock pages in memory" privilege.
+    // --rollback : Run a headless rollback session between two peers over a
+    // simulated link.
+    // --rollback-frames <n> : Frames the session runs (default : 1200).
+    // --rollback-window <n> : Max frames a peer runs ahead of the remote
+    // inputs it has (default : 8, at most 15).
+    // --rollback-latency <ticks> / --rollback-jitter <ticks> : Latency of the
+    // simulated link, and extra random latency per packet (default : 4 / 2).
+    // --rollback-loss <percent> : Packet loss of the simulated link (default :
+    // 5).
+    // --rollback-seed <n> : Seed of the scripted players and of the link.
+    // --batch <n> : Run n game instances headless on the worker threads (see
+    // --worker-threads), and report the simulation throughput.
+    // --batch-frames <n> : Frames each instance runs (default : 600).
+    // --batch-render : Render the instances (at 320x180).
+    // --batch-recorded-input : Instances replay the input stream of the last
+    // live loop recording, instead of scripted players.
+    // --batch-seed <n> : Seed of the scripted players.
+    b32 run_replay = false;
+    u32 max_frames_in_flight = 1;
+    b32 use_dynamic_resolution = true;
+    win32_upscale_filter_t upscale_filter = win32_upscale_filter_bilinear;
+    char golden_hashes_file_path[MAX_PATH] = {0};
+    char replay_hashes_file_path[MAX_PATH] = "prism_replay_hashes.txt";
+    char replay_audio_file_path[MAX_PATH] = "prism_replay_audio.wav";
+    u32 worker_thread_count = 0;
+    log_severity_t log_min_severity = log_severity_info;
+    u32 log_category_mask = (1u << win32_log_category_count) - 1;
+    b32 has_log_category_option = false;
+    b32 is_hud_visible = true;
+    b32 is_capturing = false;
+    u64 game_memory_base_address = WIN32_GAME_MEMORY_BASE_ADDRESS;
+    b32 use_large_pages = false;
+    b32 run_rollback_session = false;
+
+    win32_rollback_config_t rollback_config = {0};
+    rollback_config.frame_count = 1200;
+    rollback_config.max_rollback_frames = 8;
+    rollback_config.latency_ticks = 4;
+    rollback_config.jitter_ticks = 2;
+    rollback_config.loss_percent = 5;
+    rollback_config.seed = 1;
+
+    win32_batch_config_t batch_config = {0};
+    batch_config.frame_count = 600;
+    batch_config.seed = 1;
+
+    i32 argument_count = 0;
+    wchar_t **arguments =
+        CommandLineToArgvW(GetCommandLineW(), &argument_count);
+    if (arguments)
+    {
+        for (i32 i = 1; i < argument_count; i++)
+        {
+            if (wcscmp(arguments[i], L"--replay") == 0)
+            {
+                run_replay = true;
+            }
+            else if (wcscmp(arguments[i], L"--golden") == 0 &&
+                     i + 1 < argument_count)
+            {
+                WideCharToMultiByte(CP_UTF8, 0, arguments[++i], -1,
+                                    golden_hashes_file_path, MAX_PATH, NULL,
+                                    NULL);
+            }
+            else if (wcscmp(arguments[i], L"--hashes") == 0 &&
+                     i + 1 < argument_count)
+            {
+                WideCharToMultiByte(CP_UTF8, 0, arguments[++i], -1,
+                                    replay_hashes_file_path, MAX_PATH, NULL,
+                                    NULL);
+            }
+            else if (wcscmp(arguments[i], L"--audio") == 0 &&
+                     i + 1 < argument_count)
+            {
+                WideCharToMultiByte(CP_UTF8, 0, arguments[++i], -1,
+                                    replay_audio_file_path, MAX_PATH, NULL,
+                                    NULL);
+            }
+            else if (wcscmp(arguments[i], L"--frames-in-flight") == 0 &&
+                     i + 1 < argument_count)
+            {
+                max_frames_in_flight = (u32)_wtoi(arguments[++i]);
+            }
+            else if (wcscmp(arguments[i], L"--fixed-resolution") == 0)
+            {
+                use_dynamic_resolution = false;
+            }
+            else if (wcscmp(arguments[i], L"--nearest-upscale") == 0)
+            {
+                upscale_filter = win32_upscale_filter_nearest;
+            }
+            else if (wcscmp(arguments[i], L"--no-hud") == 0)
+            {
+                is_hud_visible = false;
+            }
+            else if (wcscmp(arguments[i], L"--capture") == 0)
+            {
+                is_capturing = true;
+            }
+            else if (wcscmp(arguments[i], L"--memory-base") == 0 &&
+                     i + 1 < argument_count)
+            {
+                // Hex, 0 lets the system choose.
+                game_memory_base_address =
+                    (u64)wcstoull(arguments[++i], NULL, 16);
+            }
+            else if (wcscmp(arguments[i], L"--large-pages") == 0)
+            {
+                use_large_pages = true;
+            }
+            else if (wcscmp(arguments[i], L"--rollback") == 0)
+            {
+                run_rollback_session = true;
+            }
+            else if (wcscmp(arguments[i], L"--rollback-frames") == 0 &&
+                     i + 1 < argument_count)
+            {
+                rollback_config.frame_count = (u32)_wtoi(arguments[++i]);
+            }
+            else if (wcscmp(arguments[i], L"--rollback-window") == 0 &&
+                     i + 1 < argument_count)
+            {
+                rollback_config.max_rollback_frames =
+                    (u32)_wtoi(arguments[++i]);
+            }
+            else if (wcscmp(arguments[i], L"--rollback-latency") == 0 &&
+                     i + 1 < argument_count)
+            {
+                rollback_config.latency_ticks = (u32)_wtoi(arguments[++i]);
+            }
+            else if (wcscmp(arguments[i], L"--rollback-jitter") == 0 &&
+                     i + 1 < argument_count)
+            {
+                rollback_config.jitter_ticks = (u32)_wtoi(arguments[++i]);
+            }
+            else if (wcscmp(arguments[i], L"--rollback-loss") == 0 &&
+                     i + 1 < argument_count)
+            {
+                rollback_config.loss_percent = (u32)_wtoi(arguments[++i]);
+            }
+            else if (wcscmp(arguments[i], L"--rollback-seed") == 0 &&
+                     i + 1 < argument_count)
+            {
+                rollback_config.seed = (u64)_wtoi(arguments[++i]);
+            }
+            else if (wcscmp(arguments[i], L"--batch") == 0 &&
+                     i + 1 < argument_count)
+            {
+                batch_config.instance_count = (u32)_wtoi(arguments[++i]);
+            }
+            else if (wcscmp(arguments[i], L"--batch-frames") == 0 &&
+                     i + 1 < argument_count)
+            {
+                batch_config.frame_count = (u32)_wtoi(arguments[++i]);
+            }
+            else if (wcscmp(arguments[i], L"--batch-render") == 0)
+            {
+                batch_config.is_rendering = true;
+            }
+            else if (wcscmp(arguments[i], L"--batch-recorded-input") == 0)
+            {
+                batch_config.uses_recorded_input = true;
+            }
+            else if (wcscmp(arguments[i], L"--batch-seed") == 0 &&
+                     i + 1 < argument_count)
+            {
+                batch_config.seed = (u64)_wtoi(arguments[++i]);
+            }
+            else if (wcscmp(arguments[i], L"--worker-threads") == 0 &&
+                     i + 1 < argument_count)
+            {
+                worker_thread_count = (u32)_wtoi(arguments[++i]);
+            }
+            else if ((wcscmp(arguments[i], L"--log-level") == 0 ||
+                      wcscmp(arguments[i], L"--log-category") == 0) &&
+                     i + 1 < argument_count)
+            {
+                const b32 is_level = wcscmp(arguments[i], L"--log-level") == 0;
+
+                char name[32] = {0};
+                WideCharToMultiByte(CP_UTF8, 0, arguments[++i], -1, name,
+                                    sizeof(name), NULL, NULL);
+
+                if (is_level)
+                {
+                    for (u32 severity = 0; severity < log_severity_count;
+                         severity++)
+                    {
+                        if (strcmp(name, g_log_severity_names[severity]) == 0)
+                        {
+                            log_min_severity = (log_severity_t)severity;
+                        }
+                    }
+                }
+                else
+                {
+                    // The first category option replaces the default.
+                    if (!has_log_category_option)
+                    {
+                        log_category_mask = 0;
+                        has_log_category_option = true;
+                    }
+
+                    for (u32 category = 0; category < win32_log_category_count;
+                         category++)
+                    {
+                        if (strcmp(name, g_log_category_names[category]) == 0)
+                        {
+                            log_category_mask |= 1u << category;
+                        }
+                    }
+                }
+            }
+        }
+
+        LocalFree(arguments);
+    }
+
+    if (run_replay)
+    {
+        AttachConsole(ATTACH_PARENT_PROCESS);
+
+        return (int)win32_run_headless_replay(
+            replay_hashes_file_path,
+            golden_hashes_file_path[0] ? golden_hashes_file_path : NULL,
+            replay_audio_file_path, game_memory_base_address, use_large_pages);
+    }
+
+    if (run_rollback_session)
+    {
+        AttachConsole(ATTACH_PARENT_PROCESS);
+
+        return (int)win32_run_rollback_session(
+            &rollback_config, game_memory_base_address, use_large_pages);
+    }
+
+    if (batch_config.instance_count)
+    {
+        AttachConsole(ATTACH_PARENT_PROCESS);
+
+        return (int)win32_run_batch(&batch_config, worker_thread_count);
+    }
+
+    win32_init_log(&g_log, log_min_severity, log_category_mask);
+
+    win32_state_type_t state_type = 0;
+    win32_state_t recording_state = {0};
+
+    // Load the game.
+    game_t game = win32_load_game_dll("game.dll");
+    game.dll_last_write_time = win32_get_last_write_time("game.dll");
+
+    win32_game_dll_watcher_t game_dll_watcher = {0};
+    win32_start_game_dll_watcher(&game_dll_watcher);
+
+    // Set thread scheduler granularity to 1ms.
+    timeBeginPeriod(1u);
+
+    // Register a window class : set of behaviors that several windows might
+    // have in common (required even if only a single window is created by the
+    // application).
+    // CS_VREDRAW | CS_HREDRAW -> Redraw the entire window everytime horizontal
+    // / vertical movement or resizing is done.
+    // CS_OWNDC is used so that a device context for window can be taken once
+    // and reused without releasing it each time.
+    WNDCLASSEXW window_class = {0};
+    window_class.cbSize = sizeof(WNDCLASSEXW);
+    window_class.style = CS_VREDRAW | CS_HREDRAW | CS_OWNDC;
+    window_class.lpfnWndProc = win32_window_proc;
+    window_class.hInstance = instance;
+    window_class.lpszClassName = L"CustomWindowClass";
+
+    RegisterClassExW(&window_class);
+
+    // Create the actual window.
+    const HWND window = CreateWindowExW(
+        0, window_class.lpszClassName, L"prism-engine", WS_OVERLAPPEDWINDOW,
+        CW_USEDEFAULT, CW_USEDEFAULT, WINDOW_WIDTH, WINDOW_HEIGHT, NULL, NULL,
+        instance, NULL);
+    ShowWindow(window, SW_SHOWNORMAL);
+
+    if (!window)
+    {
+        WIN32_LOG(log_severity_error, win32_log_category_platform,
+                  win32_log_format_window_creation_failed,
+                  (u32)GetLastError());
+        win32_shutdown_log(&g_log);
+
+        return -1;
+    }
+
+    win32_init_swap_chain(&g_swap_chain, window, WINDOW_WIDTH, WINDOW_HEIGHT,
+                          max_frames_in_flight, upscale_filter);
+
+    win32_dynamic_resolution_t dynamic_resolution = {0};
+
+    win32_init_work_queue(&g_work_queue, worker_thread_count);
+    // NOTE: Writes are sequential, so more threads would only contend for the
+    // disk.
+    win32_init_work_queue(&g_io_work_queue, 1);
+
+    win32_init_audio(&g_audio);
+
+    // Get the number of counts that occur in a second.
+    u64 perf_counter_frequency = win32_get_perf_counter_frequency();
+
+    game_input_t prev_game_input = {0};
+    game_input_t current_game_input = {0};
+
+    game_input_t *prev_game_input_ptr = &prev_game_input;
+    game_input_t *current_game_input_ptr = &current_game_input;
+
+    win32_game_memory_stats_t game_memory_stats = {0};
+    game_memory_t game_memory = win32_allocate_game_memory(
+        game_memory_base_address, use_large_pages, &game_memory_stats);
+
+    WIN32_LOG(log_severity_info, win32_log_category_platform,
+              win32_log_format_game_memory,
+              (unsigned long long)game_memory.permanent_memory_block,
+              game_memory_stats.is_at_base_address,
+              game_memory_stats.page_size / 1024,
+              (f64)game_memory_stats.allocation_ms,
+              (f64)game_memory_stats.page_access_ns);
+
+    // A checkpoint of game memory is taken every second, so the game can be
+    // rewound by up to WIN32_MAX_CHECKPOINTS seconds.
+    win32_checkpoint_history_t checkpoint_history = {0};
+    win32_init_checkpoint_history(&checkpoint_history, &game_memory);
+
+    u64 loop_checkpoint_id = 0;
+
+    // Latency of key transitions until the game gets them (the present thread
+    // measures the latency until they are presented).
+    win32_latency_histogram_t input_to_update_histogram = {0};
+    // Time key transitions waited in the message queue, before being
+    // timestamped.
+    win32_latency_histogram_t input_queue_wait_histogram = {0};
+
+    f32 delta_time = 0.0f;
+
+    // Code to limit framerate.
+    u32 monitor_refresh_rate = 60;
+
+    DEVMODEA dev_mode = {};
+    if (EnumDisplaySettingsA(NULL, ENUM_CURRENT_SETTINGS, &dev_mode))
+    {
+        monitor_refresh_rate = dev_mode.dmDisplayFrequency;
+    }
+
+    const u32 game_update_hz = monitor_refresh_rate;
+    const u32 target_ms_per_frame = (u32)(1000.0f / (f32)game_update_hz);
+
+    win32_init_hud(&g_hud, (f32)target_ms_per_frame, is_hud_visible);
+
+    if (is_capturing)
+    {
+        win32_start_capture(&g_capture);
+    }
+
+    // Get the current value of performance counter.
+    // This can be used to find number of 'counts' per frame. Then, by
+    // dividing with perf_counter_frequency, we can find how long it took
+    // (in seconds) to render this frame.
+    u64 last_counter_value = win32_get_perf_counter_value();
+    u64 last_timestamp_value = __rdtsc();
+
+    u32 frame_index = 0;
+
+    b32 quit = false;
+    while (!quit)
+    {
+        // Re-load the game dll if it was rebuilt.
+        win32_reload_game_dll_if_changed(&game, &game_dll_watcher,
+                                         &g_work_queue, &g_io_work_queue,
+                                         "game.dll");
+
+        MSG message = {0};
+
+        ZeroMemory((void *)current_game_input_ptr, sizeof(game_input_t));
+
+        while (PeekMessageW(&message, 0, 0, 0, PM_REMOVE))
+        {
+            switch (message.message)
+            {
+            case WM_QUIT: {
+                quit = true;
+            }
+
+            case WM_KEYUP:
+            case WM_SYSKEYDOWN:
+            case WM_SYSKEYUP:
+            case WM_KEYDOWN: {
+                b32 is_key_down = ~((message.lParam >> 30) & 0x1);
+
+                // NOTE: Timestamped when dequeued, the coarse message time
+                // tells how long the message was queued (see
+                // win32_latency.c).
+                const u64 message_counter_value =
+                    win32_get_perf_counter_value();
+                win32_record_message_queue_wait(&input_queue_wait_histogram,
+                                                &message);
+
+                switch (message.wParam)
+                {
+                case VK_ESCAPE: {
                     quit = true;
                 }
                 break;
@@ -570,6 +1877,8 @@ int WINAPI wWinMain(HINSTANCE instance, HINSTANCE prev_instance,
                     win32_handle_key_input(
                         &current_game_input_ptr->keyboard_state.key_w,
                         is_key_down);
+                    win32_push_input_event(current_game_input_ptr, game_key_w,
+                                           &message, message_counter_value);
                 }
                 break;
 
@@ -577,6 +1886,8 @@ int WINAPI wWinMain(HINSTANCE instance, HINSTANCE prev_instance,
                     win32_handle_key_input(
                         &current_game_input_ptr->keyboard_state.key_s,
                         is_key_down);
+                    win32_push_input_event(current_game_input_ptr, game_key_s,
+                                           &message, message_counter_value);
                 }
                 break;
 
@@ -584,6 +1895,8 @@ int WINAPI wWinMain(HINSTANCE instance, HINSTANCE prev_instance,
                     win32_handle_key_input(
                         &current_game_input_ptr->keyboard_state.key_a,
                         is_key_down);
+                    win32_push_input_event(current_game_input_ptr, game_key_a,
+                                           &message, message_counter_value);
                 }
                 break;
 
@@ -591,14 +1904,42 @@ int WINAPI wWinMain(HINSTANCE instance, HINSTANCE prev_instance,
                     win32_handle_key_input(
                         &current_game_input_ptr->keyboard_state.key_d,
                         is_key_down);
+                    win32_push_input_event(current_game_input_ptr, game_key_d,
+                                           &message, message_counter_value);
+                }
+                break;
+
+                case VK_SPACE: {
+                    // NOTE: Only the initial key press (not auto repeat) is
+                    // passed on, since space toggles a tile.
+                    const b32 was_key_down = (message.lParam >> 30) & 0x1;
+
+                    win32_push_input_event(current_game_input_ptr,
+                                           game_key_space, &message,
+                                           message_counter_value);
+
+                    if (message.message == WM_KEYDOWN && !was_key_down)
+                    {
+                        win32_handle_key_input(
+                            &current_game_input_ptr->keyboard_state.key_space,
+                            true);
+                    }
                 }
                 break;
 
                 case 'R': {
                     if (state_type == win32_state_type_none)
                     {
+                        // NOTE: Worker threads write to game memory, so they
+                        // have to be idle whenever game memory is saved or
+                        // restored.
+                        platform_complete_all_work(&g_work_queue);
+
                         state_type = win32_state_type_recording;
                         recording_state = win32_start_recording(&game_memory);
+
+                        loop_checkpoint_id =
+                            win32_take_checkpoint(&checkpoint_history);
                     }
                     else if (state_type == win32_state_type_playback)
                     {
@@ -618,7 +1959,49 @@ int WINAPI wWinMain(HINSTANCE instance, HINSTANCE prev_instance,
 
                         state_type = win32_state_type_playback;
 
-                        win32_start_playback(&recording_state, &game_memory);
+                        platform_complete_all_work(&g_work_queue);
+                        win32_restart_playback(&recording_state, &game_memory,
+                                               &checkpoint_history,
+                                               loop_checkpoint_id);
+                    }
+                }
+                break;
+
+                case VK_F1: {
+                    // Toggle only on the first key down (not on repeats).
+                    if (message.message == WM_KEYDOWN &&
+                        !((message.lParam >> 30) & 0x1))
+                    {
+                        g_hud.is_visible = !g_hud.is_visible;
+                    }
+                }
+                break;
+
+                case VK_F2: {
+                    if (message.message == WM_KEYDOWN &&
+                        !((message.lParam >> 30) & 0x1))
+                    {
+                        if (g_capture.is_capturing)
+                        {
+                            win32_stop_capture(&g_capture);
+                        }
+                        else
+                        {
+                            win32_start_capture(&g_capture);
+                        }
+                    }
+                }
+                break;
+
+                case 'B': {
+                    // Rewind by one checkpoint (i.e a second), once per key
+                    // press (not on key up or repeats).
+                    if (message.message == WM_KEYDOWN &&
+                        !((message.lParam >> 30) & 0x1) &&
+                        state_type == win32_state_type_none)
+                    {
+                        platform_complete_all_work(&g_work_queue);
+                        win32_rewind_checkpoints(&checkpoint_history, 1);
                     }
                 }
                 break;
@@ -634,34 +2017,38 @@ int WINAPI wWinMain(HINSTANCE instance, HINSTANCE prev_instance,
             }
         }
 
-        const win32_window_dimensions_t window_dimensions =
-            win32_get_window_client_dimensions(window);
-
         // Render and update the game.
-        game_offscreen_buffer_t game_offscreen_buffer = {0};
-        game_offscreen_buffer.framebuffer_memory =
-            g_backbuffer.framebuffer_memory;
-        game_offscreen_buffer.width = g_backbuffer.width;
-        game_offscreen_buffer.height = g_backbuffer.height;
+        game_offscreen_buffer_t game_offscreen_buffer =
+            win32_acquire_swap_chain_buffer(
+                &g_swap_chain,
+                g_resolution_scales[dynamic_resolution.scale_index]);
 
         game_input_t game_input = {0};
         game_input.keyboard_state = current_game_input_ptr->keyboard_state;
         game_input.delta_time = delta_time;
+        game_input.event_count = current_game_input_ptr->event_count;
+        memcpy(game_input.events, current_game_input_ptr->events,
+               sizeof(game_input_event_t) * game_input.event_count);
+        game_input.sample_timestamp = win32_get_perf_counter_value();
+        game_input.timestamp_frequency = perf_counter_frequency;
 
         game_input_t *temp = current_game_input_ptr;
         current_game_input_ptr = prev_game_input_ptr;
         prev_game_input_ptr = temp;
 
-        game_platform_services_t platform_services = {0};
-        platform_services.read_file = platform_read_file;
-        platform_services.write_to_file = platform_write_to_file;
-        platform_services.close_file = platform_close_file;
+        game_platform_services_t platform_services =
+            win32_get_platform_services(&g_work_queue, &g_io_work_queue);
 
         if (state_type == win32_state_type_recording)
         {
-            ASSERT(WriteFile(recording_state.input_file_handle,
-                             (void *)&game_input, sizeof(game_input_t), NULL,
-                             NULL));
+            // NOTE: WriteFile must not be called inside of ASSERT, as it
+            // compiles to nothing in non debug builds.
+            DWORD bytes_written = 0;
+            const BOOL input_written =
+                WriteFile(recording_state.input_file_handle,
+                          (void *)&game_input, sizeof(game_input_t),
+                          &bytes_written, NULL);
+            ASSERT(input_written);
         }
 
         if (state_type == win32_state_type_playback)
@@ -674,27 +2061,102 @@ int WINAPI wWinMain(HINSTANCE instance, HINSTANCE prev_instance,
                 if (bytes_read == 0)
                 {
                     win32_stop_playback(&recording_state);
-                    win32_start_playback(&recording_state, &game_memory);
+
+                    platform_complete_all_work(&g_work_queue);
+                    win32_restart_playback(&recording_state, &game_memory,
+                                           &checkpoint_history,
+                                           loop_checkpoint_id);
                 }
             }
         }
 
+        // NOTE: Played back inputs have the timestamps of the recording, so
+        // their latency is not measured.
+        const game_input_t *measured_input =
+            state_type == win32_state_type_playback ? NULL : &game_input;
+
+        if (measured_input)
+        {
+            for (u32 i = 0; i < measured_input->event_count; i++)
+            {
+                win32_record_latency(
+                    &input_to_update_histogram,
+                    win32_get_time_delta_ms(measured_input->events[i].timestamp,
+                                            measured_input->sample_timestamp,
+                                            perf_counter_frequency));
+            }
+        }
+
+        game_sound_output_buffer_t game_sound_buffer =
+            win32_acquire_sound_buffer(&g_audio, game_input.delta_time);
+
+        const u64 update_start_counter_value = win32_get_perf_counter_value();
+
         game.update_and_render(&game_offscreen_buffer, &game_input,
-                               &game_memory, &platform_services);
+                               &game_sound_buffer, &game_memory,
+                               &platform_services);
+
+        const u64 update_end_counter_value = win32_get_perf_counter_value();
+
+        // The audio thread plays the samples from the ring buffer.
+        win32_submit_sound_buffer(&g_audio, &game_sound_buffer);
+
+        // NOTE: The HUD is drawn by the platform (not the game), as what it
+        // shows depends on timing, and would break replays.
+        win32_draw_hud(&g_hud, &game_offscreen_buffer);
+
+        // NOTE: Copied before the frame is submitted, as the present thread
+        // upscales into the swap chain buffer.
+        win32_submit_capture_frame(&g_capture, &game_offscreen_buffer,
+                                   frame_index);
+
+        // The present thread presents this frame while the game thread
+        // continues with the next one.
+        win32_submit_swap_chain_buffer(&g_swap_chain, measured_input);
+
+        if (state_type != win32_state_type_playback &&
+            frame_index % game_update_hz == game_update_hz - 1)
+        {
+            const u64 checkpoint_start_counter_value =
+                win32_get_perf_counter_value();
+
+            platform_complete_all_work(&g_work_queue);
+            win32_take_checkpoint(&checkpoint_history);
+
+            WIN32_LOG(log_severity_info, win32_log_category_checkpoint,
+                      win32_log_format_checkpoint,
+                      checkpoint_history.last_dirty_page_count,
+                      (f64)win32_get_time_delta_ms(
+                          checkpoint_start_counter_value,
+                          win32_get_perf_counter_value(),
+                          perf_counter_frequency));
+        }
 
         u64 end_counter_value = win32_get_perf_counter_value();
 
         f32 ms_for_frame = win32_get_time_delta_ms(
             last_counter_value, end_counter_value, perf_counter_frequency);
 
-        if (ms_for_frame <= target_ms_per_frame)
+        const b32 missed_frame = ms_for_frame > target_ms_per_frame;
+
+        if (!missed_frame)
         {
             Sleep((DWORD)(target_ms_per_frame - ms_for_frame));
         }
         else
         {
             // Missed the time within which frame has to be prepared (audio +
-            // video).
+            // video). Dynamic resolution lowers the render resolution.
+        }
+
+        if (use_dynamic_resolution)
+        {
+            win32_update_dynamic_resolution(
+                &dynamic_resolution,
+                win32_get_time_delta_ms(update_start_counter_value,
+                                        update_end_counter_value,
+                                        perf_counter_frequency),
+                (f32)target_ms_per_frame, missed_frame);
         }
         end_counter_value = win32_get_perf_counter_value();
 
@@ -703,16 +2165,12 @@ int WINAPI wWinMain(HINSTANCE instance, HINSTANCE prev_instance,
 
         delta_time = ms_for_frame;
 
-        win32_render_buffer_to_window(&g_backbuffer, device_context,
-                                      window_dimensions.width,
-                                      window_dimensions.height);
-
         frame_index++;
 
         // NOTE: The value of perf counter is fetched right after Sleep is done.
-        // It does NOT account for rendering the buffer to window. Should check
-        // if RTDSC has to also be fetched after sleep (it isn't being used for
-        // now to control framerate).
+        // Rendering the buffer to window happens on the present thread, and is
+        // reported separately. Should check if RTDSC has to also be fetched
+        // after sleep (it isn't being used for now to control framerate).
         u64 end_timestamp_value = __rdtsc();
         u64 clock_cycles_per_frame = end_timestamp_value - last_timestamp_value;
 
@@ -721,15 +2179,98 @@ int WINAPI wWinMain(HINSTANCE instance, HINSTANCE prev_instance,
         // single frame.
         i32 fps = truncate_f32_to_i32(1000 / delta_time);
 
-        char text[256];
-        sprintf(text,
-                "MS for frame : %f ms, FPS : %d, Clocks per frame :  %llu \n",
-                ms_for_frame, fps, clock_cycles_per_frame);
-        OutputDebugStringA(text);
+        // NOTE: Only a small binary record is written here, the log thread
+        // formats it.
+        WIN32_LOG(
+            log_severity_debug, win32_log_category_frame,
+            win32_log_format_frame_stats, (f64)ms_for_frame, fps,
+            (unsigned long long)clock_cycles_per_frame,
+            (f64)win32_get_time_delta_ms(update_start_counter_value,
+                                         update_end_counter_value,
+                                         perf_counter_frequency),
+            (f64)win32_get_time_delta_ms(0, g_swap_chain.wait_for_buffer_counts,
+                                         perf_counter_frequency),
+            (f64)win32_get_time_delta_ms(0, g_swap_chain.upscale_counts,
+                                         perf_counter_frequency),
+            (f64)win32_get_time_delta_ms(0, g_swap_chain.present_counts,
+                                         perf_counter_frequency),
+            (f64)win32_get_time_delta_ms(
+                0, g_swap_chain.submit_to_present_counts,
+                perf_counter_frequency),
+            (f64)g_resolution_scales[dynamic_resolution.scale_index]);
+
+        win32_hud_frame_stats_t hud_frame_stats = {0};
+        hud_frame_stats.frame_ms = ms_for_frame;
+        hud_frame_stats.frame_cycles = clock_cycles_per_frame;
+        hud_frame_stats.update_ms = win32_get_time_delta_ms(
+            update_start_counter_value, update_end_counter_value,
+            perf_counter_frequency);
+        hud_frame_stats.wait_for_buffer_ms = win32_get_time_delta_ms(
+            0, g_swap_chain.wait_for_buffer_counts, perf_counter_frequency);
+        hud_frame_stats.upscale_ms = win32_get_time_delta_ms(
+            0, g_swap_chain.upscale_counts, perf_counter_frequency);
+        hud_frame_stats.present_ms = win32_get_time_delta_ms(
+            0, g_swap_chain.present_counts, perf_counter_frequency);
+        hud_frame_stats.submit_to_present_ms = win32_get_time_delta_ms(
+            0, g_swap_chain.submit_to_present_counts, perf_counter_frequency);
+        hud_frame_stats.render_scale =
+            g_resolution_scales[dynamic_resolution.scale_index];
+        hud_frame_stats.queued_audio_sample_count =
+            win32_get_audio_ring_fill(&g_audio.ring);
+        hud_frame_stats.checkpoint_dirty_page_count =
+            checkpoint_history.last_dirty_page_count;
+        hud_frame_stats.is_capturing = g_capture.is_capturing;
+        hud_frame_stats.captured_frame_count = g_capture.submitted_frame_count;
+        hud_frame_stats.dropped_capture_frame_count =
+            g_capture.dropped_frame_count;
+        hud_frame_stats.queued_capture_frame_count =
+            win32_get_queued_capture_frame_count(&g_capture);
+        hud_frame_stats.capture_copy_ms = win32_get_time_delta_ms(
+            0, g_capture.last_copy_counts, perf_counter_frequency);
+        hud_frame_stats.input_to_present = win32_get_latency_percentiles(
+            &g_swap_chain.input_to_present_histogram);
+        hud_frame_stats.input_queue_wait =
+            win32_get_latency_percentiles(&input_queue_wait_histogram);
+        win32_record_hud_frame_stats(&g_hud, &hud_frame_stats);
 
         last_counter_value = end_counter_value;
         last_timestamp_value = end_timestamp_value;
     }
 
+    // NOTE: Jobs run code from the game dll, and the last save may still be in
+    // flight.
+    platform_complete_all_work(&g_work_queue);
+    platform_complete_all_work(&g_io_work_queue);
+
+    win32_shutdown_swap_chain(&g_swap_chain);
+    win32_shutdown_audio(&g_audio);
+    win32_shutdown_capture(&g_capture);
+
+    const win32_latency_percentiles_t input_to_update =
+        win32_get_latency_percentiles(&input_to_update_histogram);
+    const win32_latency_percentiles_t input_to_present =
+        win32_get_latency_percentiles(&g_swap_chain.input_to_present_histogram);
+
+    WIN32_LOG(log_severity_info, win32_log_category_input,
+              win32_log_format_input_latency,
+              input_to_update_histogram.sample_count,
+              (f64)input_to_update.p50_ms, (f64)input_to_update.p90_ms,
+              (f64)input_to_update.p99_ms,
+              (f64)input_to_update_histogram.max_ms,
+              (f64)input_to_present.p50_ms, (f64)input_to_present.p90_ms,
+              (f64)input_to_present.p99_ms,
+              (f64)g_swap_chain.input_to_present_histogram.max_ms);
+
+    const win32_latency_percentiles_t input_queue_wait =
+        win32_get_latency_percentiles(&input_queue_wait_histogram);
+
+    WIN32_LOG(log_severity_info, win32_log_category_input,
+              win32_log_format_input_queue_wait,
+              (f64)input_queue_wait.p50_ms, (f64)input_queue_wait.p90_ms,
+              (f64)input_queue_wait.p99_ms,
+              (f64)input_queue_wait_histogram.max_ms);
+
+    win32_shutdown_log(&g_log);
+
     return 0;
 }
@@ -0,0 +1,855 @@
+// Rollback networking.
+// Two peers each run their own copy of the game, and only exchange inputs. A
+// peer does not wait for the remote input of a frame : it predicts it (the
+// remote player keeps holding the keys of its last known input) and runs the
+// frame right away. When the actual input arrives and differs from the
+// prediction, game memory is rewound to the checkpoint taken before the
+// mispredicted frame (see win32_checkpoint.c), and every frame since is
+// simulated again with the inputs known now.
+//
+// Every WIN32_ROLLBACK_HASH_INTERVAL frames, peers exchange the hash of game
+// memory once the frame is confirmed (both of its inputs are known), which
+// detects desyncs (the game not being deterministic) as they happen.
+//
+// The game has a single player, which the inputs of both peers drive : keys
+// are down when either player holds them.
+//
+// Peers are connected by a simulated (in process) link with configurable
+// latency, jitter and packet loss, so sessions run headless and every run is
+// the same. The players are scripted.
+
+// NOTE: A checkpoint is taken before every frame, and the checkpoint history
+// holds WIN32_MAX_CHECKPOINTS of them, which limits how far back a peer can
+// rewind.
+#define WIN32_ROLLBACK_MAX_FRAMES (WIN32_MAX_CHECKPOINTS - 1)
+
+#define WIN32_ROLLBACK_PEER_COUNT 2u
+
+// Per frame state is kept in rings of this size (a power of 2), indexed by
+// frame % WIN32_ROLLBACK_FRAME_RING_SIZE.
+#define WIN32_ROLLBACK_FRAME_RING_SIZE 64u
+
+#define WIN32_ROLLBACK_MAX_PACKET_INPUTS 32u
+#define WIN32_ROLLBACK_MAX_PACKETS_IN_FLIGHT 256u
+
+#define WIN32_ROLLBACK_HASH_INTERVAL 8u
+
+// Sessions run at a fixed tick, and the number of samples mixed per frame only
+// depends on it (the mixer's state is part of game memory).
+#define WIN32_ROLLBACK_FRAME_MS (1000.0f / 60.0f)
+#define WIN32_ROLLBACK_SAMPLES_PER_FRAME (GAME_SOUND_SAMPLES_PER_SECOND / 60u)
+
+typedef struct
+{
+    // Inputs of the sender for frames first_input_frame up to (excluding)
+    // first_input_frame + input_count.
+    u32 first_input_frame;
+    u32 input_count;
+    game_input_t inputs[WIN32_ROLLBACK_MAX_PACKET_INPUTS];
+
+    // The sender has the receiver's inputs of all frames before
+    // acked_frame_count.
+    u32 acked_frame_count;
+
+    // Hash of the sender's game memory after (confirmed) frame hash_frame.
+    b32 has_hash;
+    u32 hash_frame;
+    u64 hash;
+} win32_rollback_packet_t;
+
+typedef struct
+{
+    u32 receiver_index;
+    u32 delivery_tick;
+    win32_rollback_packet_t packet;
+} win32_rollback_packet_in_flight_t;
+
+typedef struct
+{
+    u32 latency_ticks;
+
+    // Each packet is delayed by up to jitter_ticks more (so packets arrive out
+    // of order).
+    u32 jitter_ticks;
+
+    u32 loss_percent;
+
+    u64 random_state;
+
+    // Packets of both directions, in no particular order.
+    win32_rollback_packet_in_flight_t
+        packets[WIN32_ROLLBACK_MAX_PACKETS_IN_FLIGHT];
+    u32 packet_count;
+
+    // Stats.
+    u32 sent_packet_count;
+    u32 lost_packet_count;
+} win32_rollback_link_t;
+
+typedef struct
+{
+    // Ticks where the peer could not run a frame, because it was
+    // max_rollback_frames ahead of the remote inputs it had.
+    u32 stalled_tick_count;
+
+    u32 rollback_count;
+    u32 resimulated_frame_count;
+    u32 max_rollback_frame_count;
+
+    u32 checked_hash_count;
+    u32 desync_count;
+    u32 first_desync_frame;
+
+    // In performance counter counts.
+    u64 simulation_counts;
+    u64 resimulation_counts;
+    u64 max_tick_resimulation_counts;
+    u64 checkpoint_counts;
+
+    u64 checkpoint_copied_bytes;
+} win32_rollback_peer_stats_t;
+
+typedef struct
+{
+    u32 player_index;
+
+    game_memory_t game_memory;
+    win32_checkpoint_history_t checkpoint_history;
+
+    // The next frame to simulate.
+    u32 frame_count;
+
+    // The remote peer's inputs are known for all frames before
+    // remote_input_frame_count.
+    u32 remote_input_frame_count;
+
+    // The remote peer has the local inputs of all frames before
+    // acked_frame_count.
+    u32 acked_frame_count;
+
+    b32 has_misprediction;
+    u32 first_mispredicted_frame;
+
+    game_input_t local_inputs[WIN32_ROLLBACK_FRAME_RING_SIZE];
+    game_input_t remote_inputs[WIN32_ROLLBACK_FRAME_RING_SIZE];
+
+    // The remote input each frame was last simulated with.
+    game_input_t simulated_remote_inputs[WIN32_ROLLBACK_FRAME_RING_SIZE];
+
+    // Checkpoint of game memory before each frame.
+    u64 checkpoint_ids[WIN32_ROLLBACK_FRAME_RING_SIZE];
+
+    // Hash of game memory after each frame (every WIN32_ROLLBACK_HASH_INTERVAL
+    // frames only).
+    u64 state_hashes[WIN32_ROLLBACK_FRAME_RING_SIZE];
+
+    // The remote peer's latest hash which was not checked yet. Hashes of
+    // frames before next_hash_frame were checked already.
+    b32 has_remote_hash;
+    u32 remote_hash_frame;
+    u64 remote_hash;
+    u32 next_hash_frame;
+
+    win32_scripted_player_t player;
+
+    win32_rollback_peer_stats_t stats;
+} win32_rollback_peer_t;
+
+typedef struct
+{
+    u32 frame_count;
+
+    // Clamped to WIN32_ROLLBACK_MAX_FRAMES.
+    u32 max_rollback_frames;
+
+    u32 latency_ticks;
+    u32 jitter_ticks;
+    u32 loss_percent;
+
+    u64 seed;
+} win32_rollback_config_t;
+
+typedef struct
+{
+    win32_rollback_config_t config;
+
+    game_update_and_render_t *update_and_render;
+    game_platform_services_t platform_services;
+
+    win32_rollback_link_t link;
+    win32_rollback_peer_t peers[WIN32_ROLLBACK_PEER_COUNT];
+
+    u32 tick;
+
+    // Shared by the peers, which run one after the other.
+    game_offscreen_buffer_t offscreen_buffer;
+    game_offscreen_buffer_t resimulation_offscreen_buffer;
+    i16 samples[2 * WIN32_ROLLBACK_SAMPLES_PER_FRAME];
+} win32_rollback_session_t;
+
+internal void win32_send_rollback_packet(
+    win32_rollback_link_t *const restrict link, const u32 receiver_index,
+    const u32 tick, const win32_rollback_packet_t *const restrict packet)
+{
+    ASSERT(link);
+    ASSERT(packet);
+
+    link->sent_packet_count++;
+
+    // NOTE: Packets that do not fit in flight are lost as well (like packets
+    // dropped by a full router queue).
+    if (win32_random_u32(&link->random_state) % 100 <
+            link->loss_percent ||
+        link->packet_count == WIN32_ROLLBACK_MAX_PACKETS_IN_FLIGHT)
+    {
+        link->lost_packet_count++;
+        return;
+    }
+
+    win32_rollback_packet_in_flight_t *in_flight =
+        &link->packets[link->packet_count++];
+
+    in_flight->receiver_index = receiver_index;
+    in_flight->delivery_tick = tick + link->latency_ticks;
+    if (link->jitter_ticks)
+    {
+        in_flight->delivery_tick +=
+            win32_random_u32(&link->random_state) %
+            (link->jitter_ticks + 1);
+    }
+    in_flight->packet = *packet;
+}
+
+// Keys are down when either player holds them.
+internal void win32_merge_rollback_key(game_key_state_t *const restrict merged,
+                                       const game_key_state_t *const restrict a,
+                                       const game_key_state_t *const restrict b)
+{
+    merged->is_key_down = a->is_key_down || b->is_key_down;
+    merged->state_transition_count =
+        a->state_transition_count + b->state_transition_count;
+}
+
+internal game_input_t
+win32_merge_rollback_inputs(const game_input_t *const restrict a,
+                            const game_input_t *const restrict b)
+{
+    ASSERT(a);
+    ASSERT(b);
+    ASSERT(a->delta_time == b->delta_time);
+
+    game_input_t merged = {0};
+    win32_merge_rollback_key(&merged.keyboard_state.key_w,
+                             &a->keyboard_state.key_w,
+                             &b->keyboard_state.key_w);
+    win32_merge_rollback_key(&merged.keyboard_state.key_a,
+                             &a->keyboard_state.key_a,
+                             &b->keyboard_state.key_a);
+    win32_merge_rollback_key(&merged.keyboard_state.key_s,
+                             &a->keyboard_state.key_s,
+                             &b->keyboard_state.key_s);
+    win32_merge_rollback_key(&merged.keyboard_state.key_d,
+                             &a->keyboard_state.key_d,
+                             &b->keyboard_state.key_d);
+    win32_merge_rollback_key(&merged.keyboard_state.key_space,
+                             &a->keyboard_state.key_space,
+                             &b->keyboard_state.key_space);
+    merged.delta_time = a->delta_time;
+
+    return merged;
+}
+
+// The actual remote input if it is known, otherwise the remote player is
+// assumed to keep holding the keys of its last known input.
+internal game_input_t win32_get_remote_rollback_input(
+    const win32_rollback_peer_t *const restrict peer, const u32 frame)
+{
+    ASSERT(peer);
+
+    if (frame < peer->remote_input_frame_count)
+    {
+        return peer->remote_inputs[frame % WIN32_ROLLBACK_FRAME_RING_SIZE];
+    }
+
+    game_input_t predicted_input = {0};
+
+    if (peer->remote_input_frame_count)
+    {
+        predicted_input =
+            peer->remote_inputs[(peer->remote_input_frame_count - 1) %
+                                WIN32_ROLLBACK_FRAME_RING_SIZE];
+
+        predicted_input.keyboard_state.key_w.state_transition_count = 0;
+        predicted_input.keyboard_state.key_a.state_transition_count = 0;
+        predicted_input.keyboard_state.key_s.state_transition_count = 0;
+        predicted_input.keyboard_state.key_d.state_transition_count = 0;
+        predicted_input.keyboard_state.key_space.state_transition_count = 0;
+        predicted_input.event_count = 0;
+    }
+
+    predicted_input.delta_time = WIN32_ROLLBACK_FRAME_MS;
+
+    return predicted_input;
+}
+
+internal void
+win32_simulate_rollback_frame(win32_rollback_session_t *const restrict session,
+                              win32_rollback_peer_t *const restrict peer,
+                              const u32 frame, const b32 is_resimulation)
+{
+    ASSERT(session);
+    ASSERT(peer);
+
+    const u32 ring_index = frame % WIN32_ROLLBACK_FRAME_RING_SIZE;
+
+    peer->simulated_remote_inputs[ring_index] =
+        win32_get_remote_rollback_input(peer, frame);
+
+    // NOTE: The inputs are merged in player order, so that both peers
+    // simulate the exact same input.
+    const game_input_t *player_inputs[WIN32_ROLLBACK_PEER_COUNT] = {0};
+    player_inputs[peer->player_index] = &peer->local_inputs[ring_index];
+    player_inputs[1 - peer->player_index] =
+        &peer->simulated_remote_inputs[ring_index];
+
+    game_input_t game_input =
+        win32_merge_rollback_inputs(player_inputs[0], player_inputs[1]);
+
+    game_sound_output_buffer_t game_sound_buffer = {0};
+    game_sound_buffer.samples = session->samples;
+    game_sound_buffer.sample_count = WIN32_ROLLBACK_SAMPLES_PER_FRAME;
+    game_sound_buffer.samples_per_second = GAME_SOUND_SAMPLES_PER_SECOND;
+
+    // NOTE: Re-simulated frames are never displayed, so they are not rendered
+    // (game state does not depend on rendering).
+    session->update_and_render(is_resimulation
+                                   ? &session->resimulation_offscreen_buffer
+                                   : &session->offscreen_buffer,
+                               &game_input, &game_sound_buffer,
+                               &peer->game_memory,
+                               &session->platform_services);
+
+    if (frame % WIN32_ROLLBACK_HASH_INTERVAL == 0)
+    {
+        peer->state_hashes[ring_index] =
+            hash_bytes(HASH_SEED, peer->game_memory.permanent_memory_block,
+                       peer->game_memory.permanent_memory_block_size);
+    }
+}
+
+internal void win32_receive_rollback_packet(
+    win32_rollback_peer_t *const restrict peer,
+    const win32_rollback_packet_t *const restrict packet)
+{
+    ASSERT(peer);
+    ASSERT(packet);
+
+    // NOTE: Packets start at the frame the sender knows was acked, which is
+    // never after remote_input_frame_count, so inputs arrive without gaps.
+    ASSERT(packet->first_input_frame <= peer->remote_input_frame_count);
+
+    const u32 end_frame = packet->first_input_frame + packet->input_count;
+
+    for (u32 frame = peer->remote_input_frame_count; frame < end_frame;
+         frame++)
+    {
+        // The remote peer is at most WIN32_ROLLBACK_MAX_FRAMES frames ahead of
+        // the local inputs it has.
+        ASSERT(frame < peer->frame_count + WIN32_ROLLBACK_FRAME_RING_SIZE / 2);
+
+        const u32 ring_index = frame % WIN32_ROLLBACK_FRAME_RING_SIZE;
+
+        peer->remote_inputs[ring_index] =
+            packet->inputs[frame - packet->first_input_frame];
+
+        if (frame < peer->frame_count &&
+            memcmp(&peer->remote_inputs[ring_index],
+                   &peer->simulated_remote_inputs[ring_index],
+                   sizeof(game_input_t)) != 0 &&
+            !peer->has_misprediction)
+        {
+            peer->has_misprediction = true;
+            peer->first_mispredicted_frame = frame;
+        }
+    }
+
+    if (end_frame > peer->remote_input_frame_count)
+    {
+        peer->remote_input_frame_count = end_frame;
+    }
+
+    if (packet->acked_frame_count > peer->acked_frame_count)
+    {
+        peer->acked_frame_count = packet->acked_frame_count;
+    }
+
+    if (packet->has_hash && packet->hash_frame >= peer->next_hash_frame &&
+        (!peer->has_remote_hash ||
+         packet->hash_frame > peer->remote_hash_frame))
+    {
+        peer->has_remote_hash = true;
+        peer->remote_hash_frame = packet->hash_frame;
+        peer->remote_hash = packet->hash;
+    }
+}
+
+// Rewinds to the first mispredicted frame, and simulates all frames since
+// again.
+internal void
+win32_rollback_peer(win32_rollback_session_t *const restrict session,
+                    win32_rollback_peer_t *const restrict peer)
+{
+    ASSERT(session);
+    ASSERT(peer);
+    ASSERT(peer->has_misprediction);
+
+    const u32 first_frame = peer->first_mispredicted_frame;
+    ASSERT(first_frame < peer->frame_count);
+
+    const u64 start_counter_value = win32_get_perf_counter_value();
+
+    const b32 did_rewind = win32_rewind_to_checkpoint(
+        &peer->checkpoint_history,
+        peer->checkpoint_ids[first_frame % WIN32_ROLLBACK_FRAME_RING_SIZE]);
+    ASSERT(did_rewind);
+
+    peer->stats.checkpoint_copied_bytes +=
+        peer->checkpoint_history.last_copied_bytes;
+
+    for (u32 frame = first_frame; frame < peer->frame_count; frame++)
+    {
+        // The checkpoint of the first frame was just rewound to.
+        if (frame != first_frame)
+        {
+            peer->checkpoint_ids[frame % WIN32_ROLLBACK_FRAME_RING_SIZE] =
+                win32_take_checkpoint(&peer->checkpoint_history);
+            peer->stats.checkpoint_copied_bytes +=
+                peer->checkpoint_history.last_copied_bytes;
+        }
+
+        win32_simulate_rollback_frame(session, peer, frame, true);
+    }
+
+    const u64 resimulation_counts =
+        win32_get_perf_counter_value() - start_counter_value;
+
+    const u32 rollback_frame_count = peer->frame_count - first_frame;
+
+    peer->stats.rollback_count++;
+    peer->stats.resimulated_frame_count += rollback_frame_count;
+    if (rollback_frame_count > peer->stats.max_rollback_frame_count)
+    {
+        peer->stats.max_rollback_frame_count = rollback_frame_count;
+    }
+
+    peer->stats.resimulation_counts += resimulation_counts;
+    if (resimulation_counts > peer->stats.max_tick_resimulation_counts)
+    {
+        peer->stats.max_tick_resimulation_counts = resimulation_counts;
+    }
+
+    peer->has_misprediction = false;
+}
+
+// Frames before the returned frame are confirmed : they were simulated with
+// the actual inputs of both players.
+internal u32 win32_get_confirmed_rollback_frame_count(
+    const win32_rollback_peer_t *const restrict peer)
+{
+    ASSERT(peer);
+    ASSERT(!peer->has_misprediction);
+
+    return peer->remote_input_frame_count < peer->frame_count
+               ? peer->remote_input_frame_count
+               : peer->frame_count;
+}
+
+internal void win32_check_remote_rollback_hash(
+    win32_rollback_peer_t *const restrict peer)
+{
+    ASSERT(peer);
+
+    if (!peer->has_remote_hash ||
+        peer->remote_hash_frame >=
+            win32_get_confirmed_rollback_frame_count(peer))
+    {
+        return;
+    }
+
+    // NOTE: Hashes of frames that left the ring can not be checked anymore.
+    if (peer->frame_count - peer->remote_hash_frame <=
+        WIN32_ROLLBACK_FRAME_RING_SIZE)
+    {
+        const u64 hash =
+            peer->state_hashes[peer->remote_hash_frame %
+                               WIN32_ROLLBACK_FRAME_RING_SIZE];
+
+        if (hash != peer->remote_hash)
+        {
+            if (!peer->stats.desync_count)
+            {
+                peer->stats.first_desync_frame = peer->remote_hash_frame;
+            }
+            peer->stats.desync_count++;
+        }
+
+        peer->stats.checked_hash_count++;
+    }
+
+    peer->has_remote_hash = false;
+    peer->next_hash_frame = peer->remote_hash_frame + 1;
+}
+
+// Runs one tick of the peer : handles the packets that arrived, rolls back if
+// a remote input was mispredicted, simulates the next frame and sends the
+// local inputs the remote peer does not have yet.
+internal void
+win32_update_rollback_peer(win32_rollback_session_t *const restrict session,
+                           const u32 peer_index)
+{
+    ASSERT(session);
+    ASSERT(peer_index < WIN32_ROLLBACK_PEER_COUNT);
+
+    win32_rollback_peer_t *peer = &session->peers[peer_index];
+    win32_rollback_link_t *link = &session->link;
+
+    for (u32 i = 0; i < link->packet_count;)
+    {
+        win32_rollback_packet_in_flight_t *in_flight = &link->packets[i];
+
+        if (in_flight->receiver_index == peer_index &&
+            in_flight->delivery_tick <= session->tick)
+        {
+            win32_receive_rollback_packet(peer, &in_flight->packet);
+            *in_flight = link->packets[--link->packet_count];
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    if (peer->has_misprediction)
+    {
+        win32_rollback_peer(session, peer);
+    }
+
+    win32_check_remote_rollback_hash(peer);
+
+    if (peer->frame_count < session->config.frame_count)
+    {
+        // NOTE: Local inputs are kept until the remote peer has them.
+        if (peer->frame_count >= peer->remote_input_frame_count +
+                                     session->config.max_rollback_frames ||
+            peer->frame_count - peer->acked_frame_count >=
+                WIN32_ROLLBACK_FRAME_RING_SIZE)
+        {
+            peer->stats.stalled_tick_count++;
+        }
+        else
+        {
+            const u32 frame = peer->frame_count;
+            const u32 ring_index = frame % WIN32_ROLLBACK_FRAME_RING_SIZE;
+
+            peer->local_inputs[ring_index] =
+                win32_get_scripted_input(&peer->player,
+                                         WIN32_ROLLBACK_FRAME_MS);
+
+            const u64 checkpoint_start_counter_value =
+                win32_get_perf_counter_value();
+
+            peer->checkpoint_ids[ring_index] =
+                win32_take_checkpoint(&peer->checkpoint_history);
+            peer->stats.checkpoint_copied_bytes +=
+                peer->checkpoint_history.last_copied_bytes;
+
+            const u64 simulation_start_counter_value =
+                win32_get_perf_counter_value();
+
+            win32_simulate_rollback_frame(session, peer, frame, false);
+
+            const u64 simulation_end_counter_value =
+                win32_get_perf_counter_value();
+
+            peer->stats.checkpoint_counts +=
+                simulation_start_counter_value - checkpoint_start_counter_value;
+            peer->stats.simulation_counts +=
+                simulation_end_counter_value - simulation_start_counter_value;
+
+            peer->frame_count++;
+        }
+    }
+
+    // The packet is sent every tick (even if nothing changed), so that lost
+    // inputs and acks are sent again.
+    win32_rollback_packet_t packet = {0};
+    packet.first_input_frame = peer->acked_frame_count;
+    packet.input_count = peer->frame_count - peer->acked_frame_count;
+    if (packet.input_count > WIN32_ROLLBACK_MAX_PACKET_INPUTS)
+    {
+        packet.input_count = WIN32_ROLLBACK_MAX_PACKET_INPUTS;
+    }
+
+    for (u32 i = 0; i < packet.input_count; i++)
+    {
+        packet.inputs[i] =
+            peer->local_inputs[(packet.first_input_frame + i) %
+                               WIN32_ROLLBACK_FRAME_RING_SIZE];
+    }
+
+    packet.acked_frame_count = peer->remote_input_frame_count;
+
+    const u32 confirmed_frame_count =
+        win32_get_confirmed_rollback_frame_count(peer);
+    if (confirmed_frame_count)
+    {
+        packet.has_hash = true;
+        packet.hash_frame = (confirmed_frame_count - 1) /
+                            WIN32_ROLLBACK_HASH_INTERVAL *
+                            WIN32_ROLLBACK_HASH_INTERVAL;
+        packet.hash = peer->state_hashes[packet.hash_frame %
+                                         WIN32_ROLLBACK_FRAME_RING_SIZE];
+    }
+
+    win32_send_rollback_packet(link, 1 - peer_index, session->tick, &packet);
+}
+
+// Game memory of the peers must be allocated (and zeroed), the framebuffer
+// must be full resolution.
+internal void win32_init_rollback_session(
+    win32_rollback_session_t *const restrict session,
+    const win32_rollback_config_t *const restrict config,
+    game_update_and_render_t *const update_and_render,
+    u32 *const restrict framebuffer_memory, const u32 framebuffer_width,
+    const u32 framebuffer_height)
+{
+    ASSERT(session);
+    ASSERT(config);
+    ASSERT(update_and_render);
+    ASSERT(framebuffer_memory);
+
+    session->config = *config;
+    if (session->config.max_rollback_frames > WIN32_ROLLBACK_MAX_FRAMES)
+    {
+        session->config.max_rollback_frames = WIN32_ROLLBACK_MAX_FRAMES;
+    }
+    if (session->config.max_rollback_frames == 0)
+    {
+        session->config.max_rollback_frames = 1;
+    }
+
+    session->update_and_render = update_and_render;
+
+    // NOTE: Without a work queue, the game runs its jobs (e.g world
+    // generation) on the game thread, so that frames do not depend on thread
+    // timing. The session must not overwrite the player's save game either.
+    session->platform_services = win32_get_platform_services(NULL, NULL);
+    session->platform_services.write_file_at_offset = NULL;
+
+    session->link.latency_ticks = config->latency_ticks;
+    session->link.jitter_ticks = config->jitter_ticks;
+    session->link.loss_percent = config->loss_percent;
+    session->link.random_state = config->seed;
+
+    for (u32 i = 0; i < WIN32_ROLLBACK_PEER_COUNT; i++)
+    {
+        win32_rollback_peer_t *peer = &session->peers[i];
+
+        ASSERT(peer->game_memory.permanent_memory_block);
+
+        peer->player_index = i;
+        peer->player.random_state = hash_mix_u64(config->seed, i + 1);
+
+        win32_init_checkpoint_history(&peer->checkpoint_history,
+                                      &peer->game_memory);
+    }
+
+    session->offscreen_buffer.framebuffer_memory = framebuffer_memory;
+    session->offscreen_buffer.width = framebuffer_width;
+    session->offscreen_buffer.height = framebuffer_height;
+    session->offscreen_buffer.render_scale = 1.0f;
+
+    // Without a framebuffer, the game does not render.
+    session->resimulation_offscreen_buffer = session->offscreen_buffer;
+    session->resimulation_offscreen_buffer.framebuffer_memory = NULL;
+}
+
+// Returns true once both peers ran all frames with the actual inputs.
+internal b32 win32_update_rollback_session(
+    win32_rollback_session_t *const restrict session)
+{
+    ASSERT(session);
+
+    for (u32 i = 0; i < WIN32_ROLLBACK_PEER_COUNT; i++)
+    {
+        win32_update_rollback_peer(session, i);
+    }
+
+    session->tick++;
+
+    b32 is_done = true;
+    for (u32 i = 0; i < WIN32_ROLLBACK_PEER_COUNT; i++)
+    {
+        const win32_rollback_peer_t *peer = &session->peers[i];
+
+        is_done = is_done &&
+                  peer->frame_count == session->config.frame_count &&
+                  peer->remote_input_frame_count >= peer->frame_count;
+    }
+
+    return is_done;
+}
+
+internal void win32_print_rollback_stats(
+    const win32_rollback_session_t *const restrict session)
+{
+    ASSERT(session);
+
+    char text[512];
+    const f64 counts_per_ms =
+        (f64)win32_get_perf_counter_frequency() / 1000.0;
+
+    for (u32 i = 0; i < WIN32_ROLLBACK_PEER_COUNT; i++)
+    {
+        const win32_rollback_peer_t *peer = &session->peers[i];
+        const win32_rollback_peer_stats_t *stats = &peer->stats;
+
+        const f64 frames = peer->frame_count ? (f64)peer->frame_count : 1.0;
+        const f64 resimulated_frames =
+            stats->resimulated_frame_count
+                ? (f64)stats->resimulated_frame_count
+                : 1.0;
+        const f64 ticks = session->tick ? (f64)session->tick : 1.0;
+
+        sprintf(text,
+                "Rollback : Peer %u ran %u frames (%u ticks stalled). %u "
+                "rollbacks re-simulated %u frames (%.2f per rollback, at most "
+                "%u).\n",
+                i, peer->frame_count, stats->stalled_tick_count,
+                stats->rollback_count, stats->resimulated_frame_count,
+                stats->rollback_count ? (f64)stats->resimulated_frame_count /
+                                            stats->rollback_count
+                                      : 0.0,
+                stats->max_rollback_frame_count);
+        win32_print(text);
+
+        sprintf(text,
+                "Rollback : Peer %u simulation : %.4f ms per frame, "
+                "re-simulation : %.4f ms per re-simulated frame, %.4f ms per "
+                "tick on average, %.4f ms at most. Checkpoints : %.4f ms and "
+                "%.1f KB copied per frame.\n",
+                i, stats->simulation_counts / counts_per_ms / frames,
+                stats->resimulation_counts / counts_per_ms /
+                    resimulated_frames,
+                stats->resimulation_counts / counts_per_ms / ticks,
+                stats->max_tick_resimulation_counts / counts_per_ms,
+                stats->checkpoint_counts / counts_per_ms / frames,
+                stats->checkpoint_copied_bytes / 1024.0 / frames);
+        win32_print(text);
+
+        if (stats->desync_count)
+        {
+            sprintf(text,
+                    "Rollback : Peer %u checked %u remote hashes, %u DESYNCS "
+                    "(first at frame %u).\n",
+                    i, stats->checked_hash_count, stats->desync_count,
+                    stats->first_desync_frame);
+        }
+        else
+        {
+            sprintf(text,
+                    "Rollback : Peer %u checked %u remote hashes, no "
+                    "desyncs.\n",
+                    i, stats->checked_hash_count);
+        }
+        win32_print(text);
+    }
+
+    sprintf(text,
+            "Rollback : %u ticks, link sent %u packets, lost %u (latency %u "
+            "ticks, jitter %u ticks, loss %u%%).\n",
+            session->tick, session->link.sent_packet_count,
+            session->link.lost_packet_count, session->link.latency_ticks,
+            session->link.jitter_ticks, session->link.loss_percent);
+    win32_print(text);
+}
+
+// Runs a headless rollback session between two peers in this process, and
+// checks that they end up with the same game memory.
+internal win32_replay_result_t
+win32_run_rollback_session(const win32_rollback_config_t *const restrict config,
+                           const u64 game_memory_base_address,
+                           const b32 use_large_pages)
+{
+    ASSERT(config);
+
+    game_t game = win32_load_game_dll("game.dll");
+
+    win32_rollback_session_t *session =
+        (win32_rollback_session_t *)VirtualAlloc(
+            0, sizeof(win32_rollback_session_t), MEM_COMMIT | MEM_RESERVE,
+            PAGE_READWRITE);
+    ASSERT(session);
+
+    // NOTE: Game memory holds no pointers, so the second peer's memory can go
+    // anywhere.
+    for (u32 i = 0; i < WIN32_ROLLBACK_PEER_COUNT; i++)
+    {
+        win32_game_memory_stats_t game_memory_stats = {0};
+        session->peers[i].game_memory = win32_allocate_game_memory(
+            i == 0 ? game_memory_base_address : 0, use_large_pages,
+            &game_memory_stats);
+    }
+
+    win32_offscreen_buffer_t backbuffer = {0};
+    win32_resize_framebuffer(&backbuffer, WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    win32_init_rollback_session(session, config, game.update_and_render,
+                                backbuffer.framebuffer_memory,
+                                backbuffer.width, backbuffer.height);
+
+    // NOTE: With 100% loss (for example), the session never completes.
+    const u32 max_tick_count = 4 * config->frame_count + 1000;
+
+    b32 is_done = false;
+    while (!is_done && session->tick < max_tick_count)
+    {
+        is_done = win32_update_rollback_session(session);
+    }
+
+    win32_print_rollback_stats(session);
+
+    win32_replay_result_t result = win32_replay_result_success;
+
+    u64 game_memory_hashes[WIN32_ROLLBACK_PEER_COUNT] = {0};
+    for (u32 i = 0; i < WIN32_ROLLBACK_PEER_COUNT; i++)
+    {
+        const game_memory_t *game_memory = &session->peers[i].game_memory;
+
+        game_memory_hashes[i] =
+            hash_bytes(HASH_SEED, game_memory->permanent_memory_block,
+                       game_memory->permanent_memory_block_size);
+    }
+
+    if (!is_done)
+    {
+        win32_print("Rollback : Session did not complete.\n");
+        result = win32_replay_result_divergence;
+    }
+    else if (game_memory_hashes[0] != game_memory_hashes[1] ||
+             session->peers[0].stats.desync_count ||
+             session->peers[1].stats.desync_count)
+    {
+        win32_print("Rollback : DESYNC, the peers' game memory differs.\n");
+        result = win32_replay_result_divergence;
+    }
+    else
+    {
+        win32_print("Rollback : The peers' game memory matches.\n");
+    }
+
+    VirtualFree(session, 0, MEM_RELEASE);
+    win32_unload_game_dll(&game);
+
+    return result;
+}
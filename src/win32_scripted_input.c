@@ -0,0 +1,66 @@
+// Scripted players, which drive headless runs (rollback sessions, batch
+// simulation) instead of the keyboard. Everything is derived from the random
+// state, so a player seeded the same way always plays the same.
+
+typedef struct
+{
+    u64 random_state;
+    u32 held_key_bits;
+} win32_scripted_player_t;
+
+internal u32 win32_random_u32(u64 *const restrict random_state)
+{
+    ASSERT(random_state);
+
+    *random_state = hash_mix_u64(*random_state, 0x9e3779b97f4a7c15ULL);
+
+    return (u32)(*random_state >> 32);
+}
+
+internal void win32_set_scripted_key(game_key_state_t *const restrict key,
+                                     const u32 held_key_bits,
+                                     const u32 previous_held_key_bits,
+                                     const u32 key_bit)
+{
+    key->is_key_down = (held_key_bits & key_bit) != 0;
+    key->state_transition_count =
+        (held_key_bits & key_bit) != (previous_held_key_bits & key_bit);
+}
+
+// The player holds a random set of direction keys for a while, and now and
+// then presses space (toggling the wall it faces).
+internal game_input_t
+win32_get_scripted_input(win32_scripted_player_t *const restrict player,
+                         const f32 delta_time)
+{
+    ASSERT(player);
+
+    const u32 previous_held_key_bits = player->held_key_bits;
+
+    u32 direction_key_bits = player->held_key_bits & 0xfu;
+    if (win32_random_u32(&player->random_state) % 32 == 0)
+    {
+        direction_key_bits = win32_random_u32(&player->random_state) & 0xfu;
+    }
+
+    const u32 space_key_bit =
+        win32_random_u32(&player->random_state) % 48 == 0 ? 0x10u : 0u;
+
+    player->held_key_bits = direction_key_bits | space_key_bit;
+
+    game_input_t input = {0};
+    win32_set_scripted_key(&input.keyboard_state.key_w, player->held_key_bits,
+                           previous_held_key_bits, 0x1u);
+    win32_set_scripted_key(&input.keyboard_state.key_a, player->held_key_bits,
+                           previous_held_key_bits, 0x2u);
+    win32_set_scripted_key(&input.keyboard_state.key_s, player->held_key_bits,
+                           previous_held_key_bits, 0x4u);
+    win32_set_scripted_key(&input.keyboard_state.key_d, player->held_key_bits,
+                           previous_held_key_bits, 0x8u);
+    win32_set_scripted_key(&input.keyboard_state.key_space,
+                           player->held_key_bits, previous_held_key_bits,
+                           0x10u);
+    input.delta_time = delta_time;
+
+    return input;
+}
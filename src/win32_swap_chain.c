@@ -0,0 +1,315 @@
+// Pipelined presentation.
+// The game thread renders into one of the swap chain's offscreen buffers, and
+// hands it to a dedicated present thread which blits / scales it to the
+// window, while the game thread already starts working on the next frame.
+// The number of frames that are submitted but not yet presented (i.e frames in
+// flight) is bounded, so input to display latency stays bounded too : when the
+// limit is reached, the game thread waits for the present thread.
+// The most recently presented buffer is kept out of the free buffers until the
+// next one is presented, so it can be blitted again (WM_PAINT) without the
+// game rendering into it.
+// Frames rendered at a reduced internal resolution (dynamic resolution) are
+// upscaled to full resolution on the present thread.
+// The present thread also measures the input to present latency of the key
+// transitions each frame used (see win32_latency.c).
+
+#define WIN32_MAX_FRAMES_IN_FLIGHT 2
+#define WIN32_MAX_SWAP_CHAIN_BUFFERS (WIN32_MAX_FRAMES_IN_FLIGHT + 1)
+
+typedef struct
+{
+    win32_offscreen_buffer_t buffers[WIN32_MAX_SWAP_CHAIN_BUFFERS];
+
+    // When rendering at a reduced resolution, the game renders into
+    // render_memory (tightly packed, render_width x render_height) instead of
+    // the buffer itself.
+    u32 *render_memory[WIN32_MAX_SWAP_CHAIN_BUFFERS];
+    u32 render_widths[WIN32_MAX_SWAP_CHAIN_BUFFERS];
+    u32 render_heights[WIN32_MAX_SWAP_CHAIN_BUFFERS];
+
+    // Only used by the present thread.
+    win32_upscaler_t upscaler;
+    win32_upscale_filter_t upscale_filter;
+
+    // Perf counter value when each buffer was submitted for presentation.
+    u64 submit_counter_values[WIN32_MAX_SWAP_CHAIN_BUFFERS];
+
+    // Timestamps of the key transitions of each buffer's input.
+    u64 input_timestamps[WIN32_MAX_SWAP_CHAIN_BUFFERS][GAME_MAX_INPUT_EVENTS];
+    u32 input_timestamp_counts[WIN32_MAX_SWAP_CHAIN_BUFFERS];
+
+    u32 buffer_count;
+
+    // Buffers are rendered to and presented in round robin order.
+    u32 render_buffer_index;
+    u32 present_buffer_index;
+
+    // Index of the most recently presented buffer (used by WM_PAINT). Only
+    // freed once the next buffer is presented.
+    volatile LONG last_presented_buffer_index;
+
+    // Counts the buffers that can be rendered to (at most
+    // max_frames_in_flight, as the last presented buffer is not free).
+    HANDLE free_buffer_semaphore;
+    // Counts the buffers waiting to be presented.
+    HANDLE submitted_buffer_semaphore;
+
+    HWND window;
+    HANDLE present_thread;
+    // Set by the game thread once all submitted buffers are presented.
+    volatile LONG should_stop;
+
+    // Timing stats (in perf counter counts) of the last frame. The present
+    // stats are written by the present thread.
+    u64 wait_for_buffer_counts;
+    volatile u64 present_counts;
+    volatile u64 upscale_counts;
+    volatile u64 submit_to_present_counts;
+    volatile LONG presented_frame_count;
+
+    // Written by the present thread.
+    win32_latency_histogram_t input_to_present_histogram;
+} win32_swap_chain_t;
+
+internal DWORD WINAPI win32_present_thread_proc(LPVOID param)
+{
+    win32_swap_chain_t *swap_chain = (win32_swap_chain_t *)param;
+    ASSERT(swap_chain);
+
+    // NOTE: The device context is only used by the present thread.
+    const HDC device_context = GetDC(swap_chain->window);
+
+    const u64 perf_counter_frequency = win32_get_perf_counter_frequency();
+
+    for (;;)
+    {
+        WaitForSingleObject(swap_chain->submitted_buffer_semaphore, INFINITE);
+
+        if (swap_chain->should_stop)
+        {
+            break;
+        }
+
+        const u32 buffer_index = swap_chain->present_buffer_index;
+        swap_chain->present_buffer_index =
+            (swap_chain->present_buffer_index + 1) % swap_chain->buffer_count;
+
+        const u64 present_start_counter_value = win32_get_perf_counter_value();
+
+        win32_offscreen_buffer_t *buffer = &swap_chain->buffers[buffer_index];
+
+        const u32 render_width = swap_chain->render_widths[buffer_index];
+        const u32 render_height = swap_chain->render_heights[buffer_index];
+
+        if (render_width != buffer->width || render_height != buffer->height)
+        {
+            win32_upscale(&swap_chain->upscaler, swap_chain->upscale_filter,
+                          swap_chain->render_memory[buffer_index],
+                          render_width, render_height,
+                          buffer->framebuffer_memory, buffer->width,
+                          buffer->height);
+        }
+
+        const u64 upscale_end_counter_value = win32_get_perf_counter_value();
+
+        const win32_window_dimensions_t window_dimensions =
+            win32_get_window_client_dimensions(swap_chain->window);
+
+        win32_render_buffer_to_window(buffer, device_context,
+                                      window_dimensions.width,
+                                      window_dimensions.height);
+
+        const u64 present_end_counter_value = win32_get_perf_counter_value();
+
+        swap_chain->upscale_counts =
+            upscale_end_counter_value - present_start_counter_value;
+        swap_chain->present_counts =
+            present_end_counter_value - upscale_end_counter_value;
+        swap_chain->submit_to_present_counts =
+            present_end_counter_value -
+            swap_chain->submit_counter_values[buffer_index];
+
+        for (u32 i = 0; i < swap_chain->input_timestamp_counts[buffer_index];
+             i++)
+        {
+            win32_record_latency(
+                &swap_chain->input_to_present_histogram,
+                win32_get_time_delta_ms(
+                    swap_chain->input_timestamps[buffer_index][i],
+                    present_end_counter_value, perf_counter_frequency));
+        }
+
+        // NOTE: Buffers are presented in round robin order, so the previously
+        // presented buffer is the next one the game renders into.
+        InterlockedExchange(&swap_chain->last_presented_buffer_index,
+                            (LONG)buffer_index);
+        InterlockedIncrement(&swap_chain->presented_frame_count);
+
+        ReleaseSemaphore(swap_chain->free_buffer_semaphore, 1, NULL);
+    }
+
+    ReleaseDC(swap_chain->window, device_context);
+
+    return 0;
+}
+
+// max_frames_in_flight : 1 -> double buffering, 2 -> triple buffering.
+internal void win32_init_swap_chain(
+    win32_swap_chain_t *const restrict swap_chain, const HWND window,
+    const u32 width, const u32 height, u32 max_frames_in_flight,
+    const win32_upscale_filter_t upscale_filter)
+{
+    ASSERT(swap_chain);
+    ASSERT(window);
+
+    if (max_frames_in_flight < 1)
+    {
+        max_frames_in_flight = 1;
+    }
+
+    if (max_frames_in_flight > WIN32_MAX_FRAMES_IN_FLIGHT)
+    {
+        max_frames_in_flight = WIN32_MAX_FRAMES_IN_FLIGHT;
+    }
+
+    swap_chain->buffer_count = max_frames_in_flight + 1;
+    swap_chain->window = window;
+    swap_chain->upscale_filter = upscale_filter;
+
+    for (u32 i = 0; i < swap_chain->buffer_count; i++)
+    {
+        win32_resize_framebuffer(&swap_chain->buffers[i], width, height);
+
+        swap_chain->render_memory[i] =
+            (u32 *)VirtualAlloc(0, sizeof(u32) * width * height,
+                                MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        ASSERT(swap_chain->render_memory[i]);
+    }
+
+    // NOTE: Until the first present, the last buffer (which is rendered to
+    // last) stands in for the last presented buffer.
+    swap_chain->last_presented_buffer_index =
+        (LONG)(swap_chain->buffer_count - 1);
+
+    swap_chain->free_buffer_semaphore =
+        CreateSemaphoreExW(NULL, max_frames_in_flight, swap_chain->buffer_count,
+                           NULL, 0, SEMAPHORE_ALL_ACCESS);
+    swap_chain->submitted_buffer_semaphore = CreateSemaphoreExW(
+        NULL, 0, swap_chain->buffer_count, NULL, 0, SEMAPHORE_ALL_ACCESS);
+
+    ASSERT(swap_chain->free_buffer_semaphore);
+    ASSERT(swap_chain->submitted_buffer_semaphore);
+
+    swap_chain->present_thread =
+        CreateThread(NULL, 0, win32_present_thread_proc, swap_chain, 0, NULL);
+    ASSERT(swap_chain->present_thread);
+
+    // Presentation is on the critical path of the frame, so it should not get
+    // preempted by background work.
+    SetThreadPriority(swap_chain->present_thread, THREAD_PRIORITY_ABOVE_NORMAL);
+}
+
+// Returns the buffer the game should render the next frame into, at
+// render_scale times the full resolution. Blocks if max_frames_in_flight frames
+// are already waiting for presentation.
+internal game_offscreen_buffer_t
+win32_acquire_swap_chain_buffer(win32_swap_chain_t *const restrict swap_chain,
+                                const f32 render_scale)
+{
+    ASSERT(swap_chain);
+    ASSERT(render_scale > 0.0f && render_scale <= 1.0f);
+
+    const u64 wait_start_counter_value = win32_get_perf_counter_value();
+
+    WaitForSingleObject(swap_chain->free_buffer_semaphore, INFINITE);
+
+    swap_chain->wait_for_buffer_counts =
+        win32_get_perf_counter_value() - wait_start_counter_value;
+
+    const u32 buffer_index = swap_chain->render_buffer_index;
+    const win32_offscreen_buffer_t *buffer = &swap_chain->buffers[buffer_index];
+
+    game_offscreen_buffer_t game_offscreen_buffer = {0};
+    game_offscreen_buffer.width =
+        round_f32_to_u32(buffer->width * render_scale);
+    game_offscreen_buffer.height =
+        round_f32_to_u32(buffer->height * render_scale);
+    game_offscreen_buffer.render_scale = render_scale;
+
+    if (game_offscreen_buffer.width == buffer->width &&
+        game_offscreen_buffer.height == buffer->height)
+    {
+        game_offscreen_buffer.framebuffer_memory = buffer->framebuffer_memory;
+    }
+    else
+    {
+        game_offscreen_buffer.framebuffer_memory =
+            swap_chain->render_memory[buffer_index];
+    }
+
+    swap_chain->render_widths[buffer_index] = game_offscreen_buffer.width;
+    swap_chain->render_heights[buffer_index] = game_offscreen_buffer.height;
+
+    return game_offscreen_buffer;
+}
+
+// Hands the buffer returned by the last acquire to the present thread.
+// game_input is the input the frame was rendered with, or NULL if its latency
+// should not be measured (e.g it was played back).
+internal void
+win32_submit_swap_chain_buffer(win32_swap_chain_t *const restrict swap_chain,
+                               const game_input_t *const restrict game_input)
+{
+    ASSERT(swap_chain);
+
+    const u32 buffer_index = swap_chain->render_buffer_index;
+
+    swap_chain->input_timestamp_counts[buffer_index] = 0;
+    if (game_input)
+    {
+        for (u32 i = 0; i < game_input->event_count; i++)
+        {
+            swap_chain->input_timestamps[buffer_index][i] =
+                game_input->events[i].timestamp;
+        }
+        swap_chain->input_timestamp_counts[buffer_index] =
+            game_input->event_count;
+    }
+
+    swap_chain->submit_counter_values[buffer_index] =
+        win32_get_perf_counter_value();
+
+    swap_chain->render_buffer_index =
+        (swap_chain->render_buffer_index + 1) % swap_chain->buffer_count;
+
+    ReleaseSemaphore(swap_chain->submitted_buffer_semaphore, 1, NULL);
+}
+
+// Waits until all submitted buffers are presented, and stops the present
+// thread.
+internal void
+win32_shutdown_swap_chain(win32_swap_chain_t *const restrict swap_chain)
+{
+    ASSERT(swap_chain);
+
+    if (!swap_chain->present_thread)
+    {
+        return;
+    }
+
+    // Once every buffer but the last presented one is free, none is waiting to
+    // be presented.
+    for (u32 i = 0; i < swap_chain->buffer_count - 1; i++)
+    {
+        WaitForSingleObject(swap_chain->free_buffer_semaphore, INFINITE);
+    }
+
+    InterlockedExchange(&swap_chain->should_stop, 1);
+    ReleaseSemaphore(swap_chain->submitted_buffer_semaphore, 1, NULL);
+    WaitForSingleObject(swap_chain->present_thread, INFINITE);
+
+    CloseHandle(swap_chain->present_thread);
+    CloseHandle(swap_chain->free_buffer_semaphore);
+    CloseHandle(swap_chain->submitted_buffer_semaphore);
+    swap_chain->present_thread = NULL;
+}
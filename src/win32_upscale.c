@@ -0,0 +1,284 @@
+// SSE2 upscalers, used to scale frames rendered at a reduced internal
+// resolution (dynamic resolution) back up to the full resolution before they
+// are presented.
+// Source and destination pixels are 32 bit (XX RR GG BB), and are tightly
+// packed (pitch == width).
+
+#include <emmintrin.h>
+
+typedef enum
+{
+    win32_upscale_filter_nearest = 0,
+    win32_upscale_filter_bilinear = 1,
+} win32_upscale_filter_t;
+
+// Per destination column source indices and (bilinear) weights. Recomputed
+// only when the source or destination width changes.
+#define WIN32_MAX_UPSCALE_WIDTH 4096
+
+typedef struct
+{
+    u32 source_width;
+    u32 destination_width;
+
+    u32 source_x[WIN32_MAX_UPSCALE_WIDTH];
+    // Weight (0..256) of source_x + 1.
+    u16 weight_x[WIN32_MAX_UPSCALE_WIDTH];
+
+    // Vertically interpolated source row (+1 pixel of padding for the last
+    // column).
+    u32 blended_row[WIN32_MAX_UPSCALE_WIDTH + 4];
+} win32_upscaler_t;
+
+internal void
+win32_prepare_upscaler(win32_upscaler_t *const restrict upscaler,
+                       const u32 source_width, const u32 destination_width)
+{
+    ASSERT(upscaler);
+    ASSERT(destination_width <= WIN32_MAX_UPSCALE_WIDTH);
+    ASSERT(source_width <= WIN32_MAX_UPSCALE_WIDTH);
+
+    if (upscaler->source_width == source_width &&
+        upscaler->destination_width == destination_width)
+    {
+        return;
+    }
+
+    // Sample at pixel centers, in 16.16 fixed point.
+    const u32 step = (source_width << 16) / destination_width;
+    i32 x = (i32)(step / 2) - (1 << 15);
+
+    for (u32 i = 0; i < destination_width; i++, x += step)
+    {
+        const i32 clamped_x = x < 0 ? 0 : x;
+
+        upscaler->source_x[i] = (u32)clamped_x >> 16;
+        upscaler->weight_x[i] = (u16)(((u32)clamped_x & 0xffff) >> 8);
+
+        if (upscaler->source_x[i] >= source_width - 1)
+        {
+            upscaler->source_x[i] = source_width - 1;
+            upscaler->weight_x[i] = 0;
+        }
+    }
+
+    upscaler->source_width = source_width;
+    upscaler->destination_width = destination_width;
+}
+
+internal void win32_upscale_nearest(
+    win32_upscaler_t *const restrict upscaler,
+    const u32 *const restrict source, const u32 source_width,
+    const u32 source_height, u32 *const restrict destination,
+    const u32 destination_width, const u32 destination_height)
+{
+    ASSERT(upscaler);
+    ASSERT(source);
+    ASSERT(destination);
+
+    win32_prepare_upscaler(upscaler, source_width, destination_width);
+
+    // Nearest sampling uses the source pixel the destination pixel center
+    // falls in.
+    const u32 step_y = (source_height << 16) / destination_height;
+    u32 y = step_y / 2;
+
+    u32 previous_source_y = 0xffffffff;
+    const u32 *source_x = upscaler->source_x;
+
+    for (u32 dy = 0; dy < destination_height; dy++, y += step_y)
+    {
+        const u32 source_y = y >> 16;
+        u32 *destination_row = destination + dy * destination_width;
+
+        // Consecutive rows sampling the same source row are copies.
+        if (source_y == previous_source_y)
+        {
+            memcpy(destination_row, destination_row - destination_width,
+                   sizeof(u32) * destination_width);
+            continue;
+        }
+        previous_source_y = source_y;
+
+        const u32 *source_row = source + source_y * source_width;
+
+        u32 dx = 0;
+        for (; dx + 4 <= destination_width; dx += 4)
+        {
+            // NOTE: Rounding the source x of nearest sampling is done with the
+            // bilinear weight (i.e the pixel center closer to the sample).
+            const __m128i pixels = _mm_setr_epi32(
+                (int)source_row[source_x[dx] + (upscaler->weight_x[dx] >> 7)],
+                (int)source_row[source_x[dx + 1] +
+                                (upscaler->weight_x[dx + 1] >> 7)],
+                (int)source_row[source_x[dx + 2] +
+                                (upscaler->weight_x[dx + 2] >> 7)],
+                (int)source_row[source_x[dx + 3] +
+                                (upscaler->weight_x[dx + 3] >> 7)]);
+
+            _mm_storeu_si128((__m128i *)(destination_row + dx), pixels);
+        }
+
+        for (; dx < destination_width; dx++)
+        {
+            destination_row[dx] =
+                source_row[source_x[dx] + (upscaler->weight_x[dx] >> 7)];
+        }
+    }
+}
+
+internal void win32_upscale_bilinear(
+    win32_upscaler_t *const restrict upscaler,
+    const u32 *const restrict source, const u32 source_width,
+    const u32 source_height, u32 *const restrict destination,
+    const u32 destination_width, const u32 destination_height)
+{
+    ASSERT(upscaler);
+    ASSERT(source);
+    ASSERT(destination);
+
+    win32_prepare_upscaler(upscaler, source_width, destination_width);
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weight_one = _mm_set1_epi16(256);
+
+    const u32 step_y = (source_height << 16) / destination_height;
+    i32 y = (i32)(step_y / 2) - (1 << 15);
+
+    u32 *blended_row = upscaler->blended_row;
+
+    for (u32 dy = 0; dy < destination_height; dy++, y += step_y)
+    {
+        const u32 clamped_y = y < 0 ? 0 : (u32)y;
+
+        u32 source_y = clamped_y >> 16;
+        u32 weight_y = (clamped_y & 0xffff) >> 8;
+
+        if (source_y >= source_height - 1)
+        {
+            source_y = source_height - 1;
+            weight_y = 0;
+        }
+
+        const u32 *row_0 = source + source_y * source_width;
+        const u32 *row_1 = weight_y ? row_0 + source_width : row_0;
+
+        // Vertical pass : blend the two source rows, 4 pixels at a time.
+        // Each 8 bit channel is widened to 16 bits, so that
+        // a * (256 - w) + b * w (<= 255 * 256) does not overflow.
+        const __m128i w_1 = _mm_set1_epi16((i16)weight_y);
+        const __m128i w_0 = _mm_sub_epi16(weight_one, w_1);
+
+        u32 sx = 0;
+        for (; sx + 4 <= source_width; sx += 4)
+        {
+            const __m128i a = _mm_loadu_si128((const __m128i *)(row_0 + sx));
+            const __m128i b = _mm_loadu_si128((const __m128i *)(row_1 + sx));
+
+            const __m128i lo = _mm_srli_epi16(
+                _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), w_0),
+                              _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), w_1)),
+                8);
+            const __m128i hi = _mm_srli_epi16(
+                _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), w_0),
+                              _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), w_1)),
+                8);
+
+            _mm_storeu_si128((__m128i *)(blended_row + sx),
+                             _mm_packus_epi16(lo, hi));
+        }
+
+        for (; sx < source_width; sx++)
+        {
+            const u32 a = row_0[sx];
+            const u32 b = row_1[sx];
+
+            u32 blended = 0;
+            for (u32 shift = 0; shift < 32; shift += 8)
+            {
+                const u32 channel = (((a >> shift) & 0xff) * (256 - weight_y) +
+                                     ((b >> shift) & 0xff) * weight_y) >>
+                                    8;
+                blended |= channel << shift;
+            }
+            blended_row[sx] = blended;
+        }
+
+        // Padding, so that source_x + 1 is always readable.
+        blended_row[source_width] = blended_row[source_width - 1];
+
+        // Horizontal pass : 2 destination pixels per iteration. Each pixel
+        // loads its 2 neighbouring source pixels (8 bytes), widened to 16 bit
+        // lanes as [left channels, right channels].
+        u32 *destination_row = destination + dy * destination_width;
+
+        u32 dx = 0;
+        for (; dx + 2 <= destination_width; dx += 2)
+        {
+            const u32 *pixels_0 = blended_row + upscaler->source_x[dx];
+            const u32 *pixels_1 = blended_row + upscaler->source_x[dx + 1];
+
+            const __m128i p_0 = _mm_unpacklo_epi8(
+                _mm_loadl_epi64((const __m128i *)pixels_0), zero);
+            const __m128i p_1 = _mm_unpacklo_epi8(
+                _mm_loadl_epi64((const __m128i *)pixels_1), zero);
+
+            const i16 wx_0 = (i16)upscaler->weight_x[dx];
+            const i16 wx_1 = (i16)upscaler->weight_x[dx + 1];
+
+            const __m128i m_0 = _mm_mullo_epi16(
+                p_0, _mm_setr_epi16(256 - wx_0, 256 - wx_0, 256 - wx_0,
+                                    256 - wx_0, wx_0, wx_0, wx_0, wx_0));
+            const __m128i m_1 = _mm_mullo_epi16(
+                p_1, _mm_setr_epi16(256 - wx_1, 256 - wx_1, 256 - wx_1,
+                                    256 - wx_1, wx_1, wx_1, wx_1, wx_1));
+
+            // [left_0, left_1] + [right_0, right_1].
+            const __m128i sum =
+                _mm_add_epi16(_mm_unpacklo_epi64(m_0, m_1),
+                              _mm_unpackhi_epi64(m_0, m_1));
+
+            _mm_storel_epi64((__m128i *)(destination_row + dx),
+                             _mm_packus_epi16(_mm_srli_epi16(sum, 8), zero));
+        }
+
+        for (; dx < destination_width; dx++)
+        {
+            const u32 a = blended_row[upscaler->source_x[dx]];
+            const u32 b = blended_row[upscaler->source_x[dx] + 1];
+            const u32 weight_x = upscaler->weight_x[dx];
+
+            u32 blended = 0;
+            for (u32 shift = 0; shift < 32; shift += 8)
+            {
+                const u32 channel = (((a >> shift) & 0xff) * (256 - weight_x) +
+                                     ((b >> shift) & 0xff) * weight_x) >>
+                                    8;
+                blended |= channel << shift;
+            }
+            destination_row[dx] = blended;
+        }
+    }
+}
+
+internal void win32_upscale(win32_upscaler_t *const restrict upscaler,
+                            const win32_upscale_filter_t filter,
+                            const u32 *const restrict source,
+                            const u32 source_width, const u32 source_height,
+                            u32 *const restrict destination,
+                            const u32 destination_width,
+                            const u32 destination_height)
+{
+    if (filter == win32_upscale_filter_bilinear)
+    {
+        win32_upscale_bilinear(upscaler, source, source_width, source_height,
+                               destination, destination_width,
+                               destination_height);
+    }
+    else
+    {
+        win32_upscale_nearest(upscaler, source, source_width, source_height,
+                              destination, destination_width,
+                              destination_height);
+    }
+}
@@ -0,0 +1,159 @@
+// Work queue, that runs jobs added by the game thread on a pool of worker
+// threads.
+// The queue is a ring buffer with a single producer (the game thread) and
+// multiple consumers. Consumers claim entries with a compare exchange on the
+// read index, so no locks are taken. Idle workers sleep on a semaphore that
+// is released once per added entry.
+
+#define WIN32_MAX_WORK_QUEUE_ENTRIES 256
+#define WIN32_MAX_WORKER_THREADS 16
+
+typedef struct
+{
+    platform_work_queue_callback_t *callback;
+    void *data;
+} win32_work_queue_entry_t;
+
+struct platform_work_queue_t
+{
+    // Number of entries added / completed since the queue was last drained.
+    volatile LONG completion_goal;
+    volatile LONG completion_count;
+
+    volatile LONG next_entry_to_write;
+    volatile LONG next_entry_to_read;
+
+    HANDLE semaphore;
+
+    u32 worker_thread_count;
+
+    win32_work_queue_entry_t entries[WIN32_MAX_WORK_QUEUE_ENTRIES];
+};
+
+// Runs the next entry (if any). Returns false if the queue was empty.
+internal b32 win32_do_next_work_queue_entry(platform_work_queue_t *work_queue)
+{
+    ASSERT(work_queue);
+
+    const LONG entry_to_read = work_queue->next_entry_to_read;
+
+    if (entry_to_read == work_queue->next_entry_to_write)
+    {
+        return false;
+    }
+
+    const LONG next_entry_to_read =
+        (entry_to_read + 1) % WIN32_MAX_WORK_QUEUE_ENTRIES;
+
+    // Another thread might have claimed the entry in the meantime, in which
+    // case the caller simply tries again.
+    if (InterlockedCompareExchange(&work_queue->next_entry_to_read,
+                                   next_entry_to_read,
+                                   entry_to_read) == entry_to_read)
+    {
+        const win32_work_queue_entry_t entry =
+            work_queue->entries[entry_to_read];
+
+        entry.callback(work_queue, entry.data);
+
+        InterlockedIncrement(&work_queue->completion_count);
+    }
+
+    return true;
+}
+
+internal DWORD WINAPI win32_worker_thread_proc(LPVOID param)
+{
+    platform_work_queue_t *work_queue = (platform_work_queue_t *)param;
+    ASSERT(work_queue);
+
+    for (;;)
+    {
+        if (!win32_do_next_work_queue_entry(work_queue))
+        {
+            WaitForSingleObject(work_queue->semaphore, INFINITE);
+        }
+    }
+}
+
+internal DEF_PLATFORM_ADD_WORK_QUEUE_ENTRY_FUNC(platform_add_work_queue_entry)
+{
+    ASSERT(work_queue);
+    ASSERT(callback);
+
+    const LONG entry_to_write = work_queue->next_entry_to_write;
+    const LONG next_entry_to_write =
+        (entry_to_write + 1) % WIN32_MAX_WORK_QUEUE_ENTRIES;
+
+    // NOTE: If this fires, the queue is full.
+    ASSERT(next_entry_to_write != work_queue->next_entry_to_read);
+
+    work_queue->entries[entry_to_write].callback = callback;
+    work_queue->entries[entry_to_write].data = data;
+
+    work_queue->completion_goal++;
+
+    // The entry must be written before it is made visible to the workers.
+    InterlockedExchange(&work_queue->next_entry_to_write, next_entry_to_write);
+
+    ReleaseSemaphore(work_queue->semaphore, 1, NULL);
+}
+
+internal DEF_PLATFORM_DO_NEXT_WORK_QUEUE_ENTRY_FUNC(
+    platform_do_next_work_queue_entry)
+{
+    return win32_do_next_work_queue_entry(work_queue);
+}
+
+internal DEF_PLATFORM_COMPLETE_ALL_WORK_FUNC(platform_complete_all_work)
+{
+    ASSERT(work_queue);
+
+    while (work_queue->completion_count != work_queue->completion_goal)
+    {
+        win32_do_next_work_queue_entry(work_queue);
+    }
+
+    work_queue->completion_goal = 0;
+    InterlockedExchange(&work_queue->completion_count, 0);
+}
+
+// thread_count 0 -> one worker thread per logical processor, except for the
+// one the game thread runs on.
+internal void win32_init_work_queue(platform_work_queue_t *const work_queue,
+                                    u32 thread_count)
+{
+    ASSERT(work_queue);
+
+    if (thread_count == 0)
+    {
+        SYSTEM_INFO system_info = {0};
+        GetSystemInfo(&system_info);
+
+        thread_count = system_info.dwNumberOfProcessors > 1
+                           ? system_info.dwNumberOfProcessors - 1
+                           : 1;
+    }
+
+    if (thread_count > WIN32_MAX_WORKER_THREADS)
+    {
+        thread_count = WIN32_MAX_WORKER_THREADS;
+    }
+
+    work_queue->semaphore = CreateSemaphoreExW(NULL, 0, thread_count, NULL, 0,
+                                               SEMAPHORE_ALL_ACCESS);
+    ASSERT(work_queue->semaphore);
+
+    for (u32 i = 0; i < thread_count; i++)
+    {
+        HANDLE thread = CreateThread(NULL, 0, win32_worker_thread_proc,
+                                     work_queue, 0, NULL);
+        ASSERT(thread);
+
+        // Background work should not preempt the game or present threads.
+        SetThreadPriority(thread, THREAD_PRIORITY_BELOW_NORMAL);
+        CloseHandle(thread);
+    }
+
+    work_queue->worker_thread_count = thread_count;
+}